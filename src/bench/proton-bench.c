@@ -0,0 +1,885 @@
+/** Micro-benchmarks for the proton library hot paths, run on synthetic
+ *  volumes so that no patient data is needed
+ *
+ *  Usage: proton-bench [-d NXxNYxNZ]... [-p spacing] [-r reps] [-o results.json]
+ *                      [-m scratch.mcc] [-i isa|all]
+ *
+ *  Every -d adds a volume size (x, depth, z). -i runs the kernels of one
+ *  instruction set, or of every one the CPU supports. Results are printed as
+ *  a table and, with -o, written as JSON for regression tracking
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "synth.h"
+#include "proton-aux.h"
+#include "proton/mcc-data.h"
+#include "proton/mcc-volume.h"
+#include "proton/proton-contour.h"
+#include "proton/proton-kernels.h"
+#include "proton/proton-profile.h"
+#include "proton/proton-compare.h"
+#include "proton/proton-gamma.h"
+#include "proton/proton-histogram.h"
+#include "proton/proton-slice.h"
+#include "proton/proton-sum.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+#define MAX_VOLUMES 16
+#define DEFAULT_REPS 5
+#define LINE_COUNT 1000
+#define POINT_COUNT 100000
+#define BEAM_COUNT 4
+#define MCC_PLANES 10
+
+#define MIB (1024.0 * 1024.0)
+
+
+struct bench_result {
+    char name[32];
+    char params[64];
+    char volume[48];
+    const char *isa;
+    int reps;
+    double best, median;    /* Seconds per repetition */
+    double items;           /* Work items per repetition */
+    const char *unit;
+    double bytes;           /* Bytes touched per repetition */
+};
+
+struct bench_ctx {
+    int reps;
+    const char *volume;
+    struct bench_result *res;
+    size_t nres, cap;
+};
+
+typedef void (*bench_fn)(void *arg);
+
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+    return STATIC_CAST(double, ts.tv_sec) + 1e-9 * STATIC_CAST(double, ts.tv_nsec);
+}
+
+
+static int bench_dblcmp(const void *a, const void *b)
+{
+    const double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/** A simple LCG, so every run queries the same points */
+static double bench_random(unsigned long *state)
+{
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return STATIC_CAST(double, (*state >> 11) & 0xFFFFFFFFUL) / 4294967296.0;
+}
+
+
+static void bench_run(struct bench_ctx *ctx, const char *name, const char *params,
+                      bench_fn fn, void *arg, double items, const char *unit,
+                      double bytes)
+{
+    struct bench_result *res;
+    double *times, t0;
+    int r;
+
+    if (ctx->nres == ctx->cap) {
+        void *newptr;
+        ctx->cap = (ctx->cap) ? 2 * ctx->cap : 32;
+        newptr = realloc(ctx->res, sizeof *ctx->res * ctx->cap);
+        if (!newptr) {
+            fputs("Out of memory\n", stderr);
+            exit(EXIT_FAILURE);
+        }
+        ctx->res = newptr;
+    }
+    times = malloc(sizeof *times * ctx->reps);
+    if (!times) {
+        fputs("Out of memory\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    /* Warm the caches and the allocator */
+    fn(arg);
+    for (r = 0; r < ctx->reps; r++) {
+        t0 = bench_now();
+        fn(arg);
+        times[r] = bench_now() - t0;
+    }
+    qsort(times, ctx->reps, sizeof *times, bench_dblcmp);
+    res = ctx->res + ctx->nres++;
+    snprintf(res->name, sizeof res->name, "%s", name);
+    snprintf(res->params, sizeof res->params, "%s", params);
+    snprintf(res->volume, sizeof res->volume, "%s", ctx->volume);
+    res->isa = proton_isa_name(proton_cpu_isa());
+    res->reps = ctx->reps;
+    res->best = times[0];
+    res->median = times[ctx->reps / 2];
+    res->items = items;
+    res->unit = unit;
+    res->bytes = bytes;
+    free(times);
+    printf("%-20s %-16s %-16s %-7s %10.3f ms %12.4g %-9s %10.1f MB/s\n",
+           res->name, res->params, res->volume, res->isa, res->median * 1e3,
+           res->items / res->median, res->unit,
+           res->bytes / res->median / MIB);
+}
+
+
+static bool bench_write_json(const struct bench_ctx *ctx, const char *filename)
+{
+    FILE *f;
+    size_t i;
+
+    f = fopen(filename, "w");
+    if (!f) {
+        return true;
+    }
+    fprintf(f, "{\n  \"benchmarks\": [\n");
+    for (i = 0; i < ctx->nres; i++) {
+        const struct bench_result *r = ctx->res + i;
+        fprintf(f, "    {\"name\": \"%s\", \"params\": \"%s\", \"volume\": \"%s\", "
+                   "\"isa\": \"%s\", \"reps\": %d, \"best_s\": %.9g, \"median_s\": %.9g, "
+                   "\"throughput\": %.9g, \"unit\": \"%s\", \"mb_per_s\": %.9g}%s\n",
+                r->name, r->params, r->volume, r->isa, r->reps, r->best, r->median,
+                r->items / r->median, r->unit, r->bytes / r->median / MIB,
+                (i + 1 < ctx->nres) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    return fclose(f) != 0;
+}
+
+
+/* ---------------------------------------------------------------------- */
+/*                                 Cases                                  */
+/* ---------------------------------------------------------------------- */
+
+struct plane_arg {
+    ProtonDose *dose;
+    ProtonPlaneParams params;
+    ProtonImage *img;
+    float depth;
+    long level;             /* Pyramid level, or -1 to let the library pick */
+    const double *view;     /* Zoomed view in mm, or NULL for the whole plane */
+    const ProtonView *region;   /* Tile view, overrides the above */
+    long steps;                 /* Renders 0.1 mm apart per call, for region */
+};
+
+struct line_arg {
+    ProtonDose *dose;
+    double pts[LINE_COUNT][2];
+};
+
+struct contour_arg {
+    const ProtonDose *dose;
+    float depth;
+    float levels[6];
+};
+
+struct slice_arg {
+    const ProtonDose *dose;
+    const ProtonPlaneParams *params;
+    ProtonImage *img;
+    ProtonSlice slice;
+};
+
+struct profile_arg {
+    const ProtonDose *dose;
+    float depth;
+    ProtonProfile prof;
+    double shift[2];
+    long nlines;            /* Batch of parallel lines, or 0 for one */
+    float *out;
+};
+
+struct sum_arg {
+    ProtonSumSource src[BEAM_COUNT];
+};
+
+struct compare_arg {
+    const ProtonDose *ref;
+    ProtonSumSource other;
+    int mode;
+};
+
+struct gamma_arg {
+    const ProtonDose *ref, *eval;
+    ProtonGammaParams params;
+    ProtonGammaStats stats;
+};
+
+struct histogram_arg {
+    ProtonHistogram *hist;
+    float depth, step;
+    long steps;
+};
+
+struct mcc_arg {
+    const char *filename;
+    MCCData *mcc;
+    MCCVolume *vol;
+    double pts[POINT_COUNT][2];
+};
+
+
+static void bench_planes(void *arg)
+{
+    proton_planes_create(arg);
+}
+
+static void bench_gradient(void *arg)
+{
+    proton_gradient_create(arg);
+}
+
+static void bench_pyramid(void *arg)
+{
+    proton_pyramid_create(arg);
+}
+
+static void bench_plane(void *arg)
+{
+    struct plane_arg *p = arg;
+
+    long i;
+
+    if (p->region) {
+        for (i = 0; i < p->steps; i++) {
+            proton_dose_get_plane_region(p->dose, &p->params, p->img,
+                                         p->depth + 0.1f * STATIC_CAST(float, i),
+                                         p->region);
+        }
+    } else if (p->view) {
+        proton_dose_get_plane_view(p->dose, &p->params, p->img, p->depth, p->view);
+    } else if (p->level < 0) {
+        proton_dose_get_plane(p->dose, &p->params, p->img, p->depth);
+    } else {
+        proton_dose_get_plane_level(p->dose, &p->params, p->img, p->depth, p->level);
+    }
+}
+
+static void bench_line(void *arg)
+{
+    struct line_arg *l = arg;
+    long i;
+
+    for (i = 0; i < LINE_COUNT; i++) {
+        proton_dose_get_line(l->dose, l->pts[i][0], l->pts[i][1]);
+    }
+}
+
+static void bench_contours(void *arg)
+{
+    const struct contour_arg *c = arg;
+
+    proton_contours_destroy(proton_contours_create(c->dose, c->depth, c->levels, 6,
+                                                   0.2 * c->dose->px_spacing[0]));
+}
+
+static void bench_slice(void *arg)
+{
+    const struct slice_arg *s = arg;
+
+    proton_dose_get_slice(s->dose, s->params, s->img, &s->slice);
+}
+
+static void bench_profile(void *arg)
+{
+    const struct profile_arg *p = arg;
+
+    if (p->nlines) {
+        proton_dose_get_profiles(p->dose, p->depth, &p->prof, p->shift, p->nlines, p->out);
+    } else {
+        proton_dose_get_profile(p->dose, p->depth, &p->prof, p->out);
+    }
+}
+
+/** A beam's frames come straight out of a volume, as if already decoded */
+static bool bench_sum_frame(void *arg, long k, float *frame)
+{
+    const ProtonDose *dose = arg;
+    const long framesz = dose->px_dimensions[0] * dose->px_dimensions[1];
+
+    memcpy(frame, dose->data + k * framesz, sizeof *frame * framesz);
+    return false;
+}
+
+static void bench_sum(void *arg)
+{
+    const struct sum_arg *s = arg;
+
+    proton_dose_destroy(proton_dose_sum(s->src, BEAM_COUNT));
+}
+
+static void bench_compare(void *arg)
+{
+    const struct compare_arg *c = arg;
+
+    proton_dose_destroy(proton_dose_compare(c->ref, &c->other, c->mode));
+}
+
+static void bench_gamma(void *arg)
+{
+    struct gamma_arg *g = arg;
+
+    proton_dose_destroy(proton_dose_gamma(g->ref, g->eval, &g->params, &g->stats));
+}
+
+static void bench_histogram(void *arg)
+{
+    const struct histogram_arg *h = arg;
+    long i;
+
+    for (i = 0; i < h->steps; i++) {
+        proton_histogram_plane(h->hist, h->depth + h->step * STATIC_CAST(float, i));
+    }
+}
+
+static void bench_mcc_create(void *arg)
+{
+    struct mcc_arg *m = arg;
+    int stat;
+
+    mcc_data_destroy(m->mcc);
+    m->mcc = mcc_data_create(m->filename, &stat);
+}
+
+static void bench_mcc_point(void *arg)
+{
+    struct mcc_arg *m = arg;
+    volatile double sink = 0.0;
+    long i;
+
+    for (i = 0; i < POINT_COUNT; i++) {
+        sink += mcc_data_get_point_dose(m->mcc, m->pts[i][0], m->pts[i][1]);
+    }
+    (void)sink;
+}
+
+/** A depth curve as the plots drew it, searching each plane's file */
+static void bench_mcc_curve(void *arg)
+{
+    struct mcc_arg *m = arg;
+    volatile double sink = 0.0;
+    long i, k;
+
+    for (i = 0; i < POINT_COUNT; i++) {
+        for (k = 0; k < MCC_PLANES; k++) {
+            sink += mcc_data_get_point_dose(m->mcc, m->pts[i][0], m->pts[i][1]);
+        }
+    }
+    (void)sink;
+}
+
+static void bench_mcc_volume(void *arg)
+{
+    struct mcc_arg *m = arg;
+    volatile double sink = 0.0;
+    double dose[MCC_PLANES];
+    long i;
+
+    for (i = 0; i < POINT_COUNT; i++) {
+        mcc_volume_depth_dose(m->vol, m->pts[i][0], m->pts[i][1], dose);
+        sink += dose[MCC_PLANES - 1];
+    }
+    (void)sink;
+}
+
+
+static void bench_volume(struct bench_ctx *ctx, const long dim[],
+                         const double spacing[])
+{
+    static const struct {
+        const char *name;
+        void (*cmap)(float, unsigned char *);
+        int type;
+    } cmaps[] = {
+        { "jet",      proton_colormap,      PROTON_IMG_DOSE },
+        { "turbo",    proton_cmap_turbo,    PROTON_IMG_DOSE },
+        { "viridis",  proton_cmap_viridis,  PROTON_IMG_DOSE },
+        { "gradient", proton_cmap_gradient, PROTON_IMG_GRAD }
+    };
+    static const long sizes[] = { 64, 256, 1024, 2048 };
+    const double voxels = STATIC_CAST(double, dim[0] * dim[1] * dim[2]);
+    const double plane = STATIC_CAST(double, dim[0] * dim[2]);
+    struct synth_field f;
+    struct plane_arg parg;
+    struct line_arg *larg;
+    ProtonDose *dose;
+    unsigned long seed = 1;
+    char params[64];
+    float range[2];
+    size_t c, s;
+    long i;
+
+    synth_field_default(&f);
+    f.r50 = 0.6 * STATIC_CAST(double, dim[1]) * spacing[1];
+    f.modulation = 0.35 * STATIC_CAST(double, dim[1]) * spacing[1];
+    f.size[0] = 0.5 * STATIC_CAST(double, dim[0]) * spacing[0];
+    f.size[1] = 0.5 * STATIC_CAST(double, dim[2]) * spacing[2];
+    dose = synth_dose_create(&f, dim, spacing);
+    if (!dose || proton_dose_derive(dose)) {
+        fprintf(stderr, "Failed to allocate a %s volume\n", ctx->volume);
+        proton_dose_destroy(dose);
+        return;
+    }
+
+    bench_run(ctx, "planes_integrate", "", bench_planes, dose,
+              voxels, "voxels/s", 2.0 * sizeof(float) * voxels);
+    bench_run(ctx, "gradient_compute", "", bench_gradient, dose,
+              voxels, "voxels/s", 3.0 * sizeof(float) * voxels);
+    bench_run(ctx, "pyramid_create", "", bench_pyramid, dose,
+              voxels, "voxels/s", 2.0 * sizeof(float) * voxels);
+
+    larg = malloc(sizeof *larg);
+    if (larg) {
+        larg->dose = dose;
+        for (i = 0; i < LINE_COUNT; i++) {
+            larg->pts[i][0] = (bench_random(&seed) - 0.5) * f.size[0];
+            larg->pts[i][1] = (bench_random(&seed) - 0.5) * f.size[1];
+        }
+        bench_run(ctx, "get_line", "1000 lines", bench_line, larg,
+                  4.0 * LINE_COUNT * STATIC_CAST(double, dose->nplanes), "voxels/s",
+                  4.0 * sizeof(float) * LINE_COUNT * STATIC_CAST(double, dose->nplanes));
+        free(larg);
+    }
+
+    proton_dose_depth_range(dose, range);
+    parg.dose = dose;
+    parg.img = NULL;
+    parg.depth = 0.5f * (range[0] + range[1]);
+    parg.params.pct_diff = 0.03f;
+    parg.params.depth_err = 0.5f;
+    parg.level = -1;
+    parg.view = NULL;
+    parg.region = NULL;
+    parg.steps = 1;
+    for (s = 0; s < sizeof sizes / sizeof *sizes; s++) {
+        const double px = STATIC_CAST(double, sizes[s] * sizes[s]);
+        if (proton_image_realloc(&parg.img, sizes[s], sizes[s], PROTON_PX_BGRA32)) {
+            fputs("Out of memory\n", stderr);
+            break;
+        }
+        for (c = 0; c < sizeof cmaps / sizeof *cmaps; c++) {
+            parg.params.colormap = cmaps[c].cmap;
+            parg.params.type = cmaps[c].type;
+            snprintf(params, sizeof params, "%ldpx %s", sizes[s], cmaps[c].name);
+            bench_run(ctx, "get_plane", params, bench_plane, &parg,
+                      px, "pixels/s", 4.0 * px + 2.0 * sizeof(float) * plane);
+        }
+        /* The same render without the pyramid, for comparison */
+        if (proton_dose_pick_level(dose, sizes[s], sizes[s]) > 0) {
+            parg.params.colormap = cmaps[0].cmap;
+            parg.params.type = cmaps[0].type;
+            parg.level = 0;
+            snprintf(params, sizeof params, "%ldpx %s", sizes[s], cmaps[0].name);
+            bench_run(ctx, "get_plane_full", params, bench_plane, &parg,
+                      px, "pixels/s", 4.0 * px + 2.0 * sizeof(float) * plane);
+            parg.level = -1;
+        }
+        /* An 8x zoom on the field centre should cost the same per pixel */
+        {
+            const double view[4] = {
+                -f.size[0] / 16.0, -f.size[1] / 16.0, f.size[0] / 16.0, f.size[1] / 16.0 };
+            parg.params.colormap = cmaps[0].cmap;
+            parg.params.type = cmaps[0].type;
+            parg.view = view;
+            snprintf(params, sizeof params, "%ldpx %s 8x", sizes[s], cmaps[0].name);
+            bench_run(ctx, "get_plane_view", params, bench_plane, &parg,
+                      px, "pixels/s", 4.0 * px + 2.0 * sizeof(float) * plane / 64.0);
+            parg.view = NULL;
+        }
+    }
+    /* One tile from the middle of a 2048 px plane, as the dose window
+    renders them */
+    if (!proton_image_realloc(&parg.img, 128, 128, PROTON_PX_BGRA32)) {
+        const double rect[4] = {
+            dose->top_left[0], dose->top_left[2],
+            dose->top_left[0] + STATIC_CAST(double, dim[0] - 1) * spacing[0],
+            dose->top_left[2] + STATIC_CAST(double, dim[2] - 1) * spacing[2] };
+        ProtonView region;
+        proton_view_fit(&region, rect, 2048, 2048);
+        region.origin[0] += 960.0 * region.step[0];
+        region.origin[1] += 960.0 * region.step[1];
+        parg.params.colormap = cmaps[0].cmap;
+        parg.params.type = cmaps[0].type;
+        parg.region = &region;
+        bench_run(ctx, "get_plane_tile", "128px of 2048px", bench_plane, &parg,
+                  128.0 * 128.0, "pixels/s", 4.0 * 128.0 * 128.0);
+        parg.region = NULL;
+    }
+    /* Scrubbing 0.1 mm at a time through a 256 px plane, as the fine depth
+    mode does */
+    if (!proton_image_realloc(&parg.img, 256, 256, PROTON_PX_BGRA32)) {
+        const double rect[4] = {
+            dose->top_left[0], dose->top_left[2],
+            dose->top_left[0] + STATIC_CAST(double, dim[0] - 1) * spacing[0],
+            dose->top_left[2] + STATIC_CAST(double, dim[2] - 1) * spacing[2] };
+        ProtonView region;
+        proton_view_fit(&region, rect, 256, 256);
+        parg.region = &region;
+        parg.steps = 10;
+        bench_run(ctx, "get_plane_scrub", "256px 10 steps", bench_plane, &parg,
+                  10.0 * 256.0 * 256.0, "pixels/s", 4.0 * 10.0 * 256.0 * 256.0);
+        parg.region = NULL;
+        parg.steps = 1;
+    }
+    /* Planes through the depth axis, which should cost about what the
+    coronal plane of the same size does */
+    if (!proton_image_realloc(&parg.img, 512, 512, PROTON_PX_BGRA32)) {
+        static const char *const orients[] = { "sagittal", "axial", "oblique" };
+        struct slice_arg sarg;
+        sarg.dose = dose;
+        sarg.params = &parg.params;
+        sarg.img = parg.img;
+        sarg.slice.pos = 0.0;
+        sarg.slice.centre[0] = sarg.slice.centre[1] = 0.0;
+        sarg.slice.angle = 30.0;
+        parg.params.colormap = cmaps[0].cmap;
+        parg.params.type = cmaps[0].type;
+        for (s = 0; s < sizeof orients / sizeof *orients; s++) {
+            sarg.slice.orient = STATIC_CAST(int, s);
+            snprintf(params, sizeof params, "512px %s", orients[s]);
+            bench_run(ctx, "get_slice", params, bench_slice, &sarg,
+                      512.0 * 512.0, "pixels/s", 4.0 * 512.0 * 512.0);
+        }
+    }
+    proton_image_destroy(parg.img);
+    /* The isodose overlay's default levels */
+    {
+        static const float pct[6] = { 10.0f, 50.0f, 80.0f, 90.0f, 95.0f, 105.0f };
+        struct contour_arg carg;
+        carg.dose = dose;
+        carg.depth = parg.depth;
+        for (i = 0; i < 6; i++) {
+            carg.levels[i] = pct[i] / 100.0f * dose->dmax;
+        }
+        bench_run(ctx, "isodose_contours", "6 levels", bench_contours, &carg,
+                  6.0 * plane, "cells/s", sizeof(float) * plane);
+    }
+    /* A crossline through the middle of the plane at 0.1 mm, and then one
+    every 0.5 mm across the plane at 0.5 mm, about what the rows of an MCC
+    scan need */
+    {
+        struct profile_arg prarg;
+        long n;
+        prarg.dose = dose;
+        prarg.depth = parg.depth;
+        prarg.prof.start[0] = dose->top_left[0];
+        prarg.prof.end[0] = dose->top_left[0] + STATIC_CAST(double, dim[0] - 1) * spacing[0];
+        prarg.prof.start[1] = prarg.prof.end[1] = dose->top_left[2]
+            + 0.5 * STATIC_CAST(double, dim[2] - 1) * spacing[2];
+        prarg.prof.step = 0.1;
+        prarg.shift[0] = 0.0;
+        prarg.shift[1] = 0.5;
+        prarg.nlines = 0;
+        n = proton_profile_samples(&prarg.prof);
+        prarg.out = malloc(sizeof *prarg.out * n);
+        if (prarg.out) {
+            bench_run(ctx, "get_profile", "crossline 0.1 mm", bench_profile, &prarg,
+                      STATIC_CAST(double, n), "samples/s", 8.0 * sizeof(float) * n);
+            free(prarg.out);
+        }
+        prarg.prof.start[1] = prarg.prof.end[1] = dose->top_left[2];
+        prarg.prof.step = 0.5;
+        prarg.nlines = STATIC_CAST(long, STATIC_CAST(double, dim[2] - 1) * spacing[2] / prarg.shift[1]) + 1;
+        n = proton_profile_samples(&prarg.prof);
+        prarg.out = malloc(sizeof *prarg.out * n * prarg.nlines);
+        if (prarg.out) {
+            snprintf(params, sizeof params, "%ld lines", prarg.nlines);
+            bench_run(ctx, "get_profiles", params, bench_profile, &prarg,
+                      STATIC_CAST(double, n * prarg.nlines), "samples/s",
+                      8.0 * sizeof(float) * n * prarg.nlines);
+            free(prarg.out);
+        }
+    }
+    /* The slider moved 0.1 mm at a time, once between two rows and once
+    through ten of them, and then a depth on a row that was already binned */
+    {
+        struct histogram_arg harg;
+        harg.hist = proton_histogram_create(dose, 256);
+        if (harg.hist) {
+            harg.depth = STATIC_CAST(float, (STATIC_CAST(double, dim[1] / 2) + 0.55) * spacing[1]);
+            harg.step = 0.1f * STATIC_CAST(float, spacing[1]);
+            harg.steps = 4;
+            bench_run(ctx, "plane_histogram", "between 2 rows", bench_histogram, &harg,
+                      4.0 * plane, "voxels/s", 4.0 * 2.0 * sizeof(float) * plane);
+            harg.steps = 100;
+            bench_run(ctx, "plane_histogram", "10 rows by 0.1", bench_histogram, &harg,
+                      100.0 * plane, "voxels/s", 100.0 * 2.0 * sizeof(float) * plane);
+            harg.depth = STATIC_CAST(float, (STATIC_CAST(double, dim[1] / 2) + 0.5) * spacing[1]);
+            harg.steps = 1;
+            bench_run(ctx, "plane_histogram", "on a row", bench_histogram, &harg,
+                      plane, "voxels/s", 0.0);
+            proton_histogram_destroy(harg.hist);
+        }
+    }
+    /* A plan of four beams on the dose's grid, and then with every other
+    beam moved half a voxel, so that those are resampled. Both include
+    deriving the sum */
+    {
+        struct sum_arg sarg;
+        long b;
+        int d;
+        for (b = 0; b < BEAM_COUNT; b++) {
+            for (d = 0; d < 3; d++) {
+                sarg.src[b].grid.dim[d] = dim[d];
+                sarg.src[b].grid.top_left[d] = dose->top_left[d];
+                sarg.src[b].grid.spacing[d] = spacing[d];
+            }
+            sarg.src[b].frame = bench_sum_frame;
+            sarg.src[b].release = NULL;
+            sarg.src[b].arg = dose;
+        }
+        snprintf(params, sizeof params, "%d beams", BEAM_COUNT);
+        bench_run(ctx, "dose_sum", params, bench_sum, &sarg, BEAM_COUNT * voxels,
+                  "voxels/s", 3.0 * sizeof(float) * BEAM_COUNT * voxels);
+        for (b = 1; b < BEAM_COUNT; b += 2) {
+            for (d = 0; d < 3; d++) {
+                sarg.src[b].grid.top_left[d] += 0.5 * spacing[d];
+            }
+        }
+        snprintf(params, sizeof params, "%d resampled", BEAM_COUNT);
+        bench_run(ctx, "dose_sum", params, bench_sum, &sarg, BEAM_COUNT * voxels,
+                  "voxels/s", 3.0 * sizeof(float) * BEAM_COUNT * voxels);
+    }
+    /* The dose against itself, read a frame at a time as above, and then
+    moved half a voxel so that it is resampled */
+    {
+        struct compare_arg carg;
+        int d;
+        carg.ref = dose;
+        for (d = 0; d < 3; d++) {
+            carg.other.grid.dim[d] = dim[d];
+            carg.other.grid.top_left[d] = dose->top_left[d];
+            carg.other.grid.spacing[d] = spacing[d];
+        }
+        carg.other.frame = bench_sum_frame;
+        carg.other.release = NULL;
+        carg.other.arg = dose;
+        carg.mode = PROTON_COMPARE_DIFF;
+        bench_run(ctx, "dose_compare", "difference", bench_compare, &carg, voxels,
+                  "voxels/s", 4.0 * sizeof(float) * voxels);
+        carg.mode = PROTON_COMPARE_RATIO;
+        bench_run(ctx, "dose_compare", "ratio", bench_compare, &carg, voxels,
+                  "voxels/s", 4.0 * sizeof(float) * voxels);
+        for (d = 0; d < 3; d++) {
+            carg.other.grid.top_left[d] += 0.5 * spacing[d];
+        }
+        carg.mode = PROTON_COMPARE_DIFF;
+        bench_run(ctx, "dose_compare", "diff resampled", bench_compare, &carg, voxels,
+                  "voxels/s", 4.0 * sizeof(float) * voxels);
+    }
+    /* A second calculation with a slightly longer range and higher dose, so
+    that the search runs on in the distal falloff and the penumbra */
+    {
+        static const struct {
+            const char *name;
+            ProtonGammaParams params;
+        } crit[] = {
+            { "3%/3 mm",       { 3.0f, 3.0f, 10.0f, false, 3 } },
+            { "2%/2 mm",       { 2.0f, 2.0f, 10.0f, false, 3 } },
+            { "2%/2 mm local", { 2.0f, 2.0f, 10.0f, true,  3 } }
+        };
+        struct gamma_arg garg;
+        ProtonDose *eval;
+
+        f.r50 += 1.0;
+        f.dose *= 1.01;
+        eval = synth_dose_create(&f, dim, spacing);
+        if (eval) {
+            garg.ref = dose;
+            garg.eval = eval;
+            for (c = 0; c < sizeof crit / sizeof *crit; c++) {
+                garg.params = crit[c].params;
+                bench_run(ctx, "dose_gamma", crit[c].name, bench_gamma, &garg, voxels,
+                          "voxels/s", 2.0 * sizeof(float) * voxels);
+            }
+        }
+        proton_dose_destroy(eval);
+    }
+    proton_dose_destroy(dose);
+}
+
+
+/** The one plane stacked MCC_PLANES deep, which costs the volume as much as
+ *  distinct planes on the same lattice would */
+static void bench_mcc_stack(struct bench_ctx *ctx, struct mcc_arg *marg)
+{
+    const MCCData *planes[MCC_PLANES];
+    double depths[MCC_PLANES];
+    long k;
+
+    for (k = 0; k < MCC_PLANES; k++) {
+        planes[k] = marg->mcc;
+        depths[k] = 10.0 * STATIC_CAST(double, k + 1);
+    }
+    marg->vol = mcc_volume_create(planes, depths, MCC_PLANES);
+    if (!marg->vol) {
+        return;
+    }
+    bench_run(ctx, "mcc_depth_curve", "10 planes, files", bench_mcc_curve,
+              marg, POINT_COUNT, "curves/s", 0.0);
+    bench_run(ctx, "mcc_depth_curve", "10 planes, stack", bench_mcc_volume,
+              marg, POINT_COUNT, "curves/s", 0.0);
+    mcc_volume_destroy(marg->vol);
+    marg->vol = NULL;
+}
+
+
+static void bench_mcc(struct bench_ctx *ctx, const char *filename)
+{
+    static const double pitch = 2.5, extent = 270.0;
+    const double n = (extent / pitch + 1.0) * (extent / pitch + 1.0);
+    struct synth_field f;
+    struct mcc_arg *marg;
+    unsigned long seed = 2;
+    long fsize, i;
+    FILE *file;
+
+    synth_field_default(&f);
+    if (synth_mcc_write(filename, &f, 100.0, pitch, extent)) {
+        fprintf(stderr, "Failed to write %s\n", filename);
+        return;
+    }
+    file = fopen(filename, "rb");
+    if (!file) {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    fsize = ftell(file);
+    fclose(file);
+
+    marg = calloc(1, sizeof *marg);
+    if (marg) {
+        marg->filename = filename;
+        ctx->volume = "mcc";
+        bench_run(ctx, "mcc_data_create", "2.5mm pitch", bench_mcc_create, marg,
+                  n, "points/s", STATIC_CAST(double, fsize));
+        if (marg->mcc) {
+            for (i = 0; i < POINT_COUNT; i++) {
+                marg->pts[i][0] = (bench_random(&seed) - 0.5) * extent;
+                marg->pts[i][1] = (bench_random(&seed) - 0.5) * extent;
+            }
+            bench_run(ctx, "mcc_get_point_dose", "100000 points", bench_mcc_point,
+                      marg, POINT_COUNT, "points/s", 0.0);
+            bench_mcc_stack(ctx, marg);
+        }
+        mcc_data_destroy(marg->mcc);
+        free(marg);
+    }
+    remove(filename);
+}
+
+
+/** "all" runs every supported instruction set in turn */
+static bool bench_parse_isa(const char *s, int *first, int *last)
+{
+    int isa;
+
+    if (!strcmp(s, "all")) {
+        *first = 0;
+        *last = PROTON_ISA_COUNT - 1;
+        return false;
+    }
+    for (isa = 0; isa < PROTON_ISA_COUNT; isa++) {
+        if (!strcmp(s, proton_isa_name(isa))) {
+            *first = *last = isa;
+            return !proton_cpu_supports(isa);
+        }
+    }
+    return true;
+}
+
+
+static bool bench_parse_dim(const char *s, long dim[])
+{
+    return sscanf(s, "%ldx%ldx%ld", dim, dim + 1, dim + 2) != 3
+        || dim[0] < 2 || dim[1] < 2 || dim[2] < 2;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static const long defaults[][3] = {
+        {  64, 100,  64 },
+        { 128, 200, 128 },
+        { 256, 300, 256 }
+    };
+    long dims[MAX_VOLUMES][3];
+    struct bench_ctx ctx = { DEFAULT_REPS, NULL, NULL, 0, 0 };
+    const char *output = NULL, *mccfile = "proton-bench.mcc";
+    double spacing = 2.0;
+    char volume[48];
+    int i, isa, ndims = 0, isafirst, isalast;
+
+    isafirst = isalast = proton_cpu_isa();
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            if (ndims == MAX_VOLUMES) {
+                fprintf(stderr, "At most %d volumes may be given\n", MAX_VOLUMES);
+                return EXIT_FAILURE;
+            } else if (bench_parse_dim(argv[++i], dims[ndims++])) {
+                fprintf(stderr, "Bad volume size %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            spacing = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            ctx.reps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            mccfile = argv[++i];
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            if (bench_parse_isa(argv[++i], &isafirst, &isalast)) {
+                fprintf(stderr, "Unsupported instruction set %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [-d NXxNYxNZ]... [-p spacing] [-r reps] "
+                            "[-o results.json] [-m scratch.mcc] [-i isa|all]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (ctx.reps < 1 || spacing <= 0.0) {
+        fputs("Repetitions and spacing must be positive\n", stderr);
+        return EXIT_FAILURE;
+    }
+    if (!ndims) {
+        memcpy(dims, defaults, sizeof defaults);
+        ndims = sizeof defaults / sizeof *defaults;
+    }
+
+    printf("%-20s %-16s %-16s %-7s %13s %12s %-9s %15s\n", "benchmark", "params",
+           "volume", "isa", "median", "throughput", "", "bandwidth");
+    for (isa = isafirst; isa <= isalast; isa++) {
+        if (proton_cpu_select(isa)) {
+            continue;
+        }
+        for (i = 0; i < ndims; i++) {
+            const double sp[3] = { spacing, spacing, spacing };
+            snprintf(volume, sizeof volume, "%ldx%ldx%ld", dims[i][0], dims[i][1], dims[i][2]);
+            ctx.volume = volume;
+            bench_volume(&ctx, dims[i], sp);
+        }
+    }
+    bench_mcc(&ctx, mccfile);
+
+    if (output && bench_write_json(&ctx, output)) {
+        fprintf(stderr, "Failed to write %s\n", output);
+        free(ctx.res);
+        return EXIT_FAILURE;
+    }
+    free(ctx.res);
+    return EXIT_SUCCESS;
+}
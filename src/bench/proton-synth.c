@@ -0,0 +1,168 @@
+/** Writes synthetic spread-out Bragg peak RTDose and MCC files, so that
+ *  benchmarks and stress tests can run without patient data
+ *
+ *  Usage: proton-synth dose OUTPUT [-d NXxNYxNZ | -S MiB] [-p spacing] [-b 16|32]
+ *                      [field options]
+ *         proton-synth mcc OUTPUT [-z depth] [-a pitch] [-e extent]
+ *                      [field options]
+ *
+ *  Field options: -R r50 -M modulation -F WxH -P penumbra -D dose, all in mm
+ *  except the dose in Gy. The dose grid defaults to the field plus a 30 mm
+ *  margin at 2 mm spacing. -S sizes the grid's lateral extent to produce a
+ *  file of roughly that many MiB instead
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "synth.h"
+#include "proton/dcmload.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+#define MARGIN 30.0
+
+#define ERRBUFSZ 256
+
+
+struct frame_arg {
+    const struct synth_field *f;
+    const long *dim;
+    const double *spacing;
+};
+
+
+static void synth_frame(void *arg, long k, float *plane)
+{
+    const struct frame_arg *fa = arg;
+
+    synth_dose_frame(fa->f, fa->dim, fa->spacing, k, plane);
+}
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "Usage: %s dose OUTPUT [-d NXxNYxNZ | -S MiB] [-p spacing] [-b 16|32] [field]\n"
+            "       %s mcc OUTPUT [-z depth] [-a pitch] [-e extent] [field]\n"
+            "Field: -R r50 -M modulation -F WxH -P penumbra -D dose\n",
+            argv0, argv0);
+}
+
+
+/** Lateral voxel count covering @p width mm plus the margin on both sides */
+static long grid_cover(double width, double spacing)
+{
+    return STATIC_CAST(long, ceil((width + 2.0 * MARGIN) / spacing)) + 1;
+}
+
+
+static int write_dose(const char *output, const struct synth_field *f,
+                      long dim[], double spacing, double mib, int bits)
+{
+    const double sp[3] = { spacing, spacing, spacing };
+    struct frame_arg fa = { f, dim, sp };
+    char err[ERRBUFSZ];
+    RTDoseDesc desc;
+
+    if (dim[0] == 0) {
+        dim[1] = STATIC_CAST(long, ceil((f->r50 + MARGIN) / spacing));
+        if (mib > 0.0) {
+            /* Square frames about the beam axis, nx = nz */
+            const double voxels = mib * 1048576.0 / (bits / 8);
+            dim[0] = STATIC_CAST(long, sqrt(voxels / STATIC_CAST(double, dim[1])));
+            dim[0] = (dim[0] < 2) ? 2 : dim[0];
+            dim[2] = dim[0];
+        } else {
+            dim[0] = grid_cover(f->size[0], spacing);
+            dim[2] = grid_cover(f->size[1], spacing);
+        }
+    }
+    synth_dose_origin(dim, sp, desc.imgpos);
+    memcpy(desc.spacing, sp, sizeof sp);
+    memcpy(desc.dim, dim, sizeof desc.dim);
+    desc.dmax = STATIC_CAST(float, f->dose);
+    desc.bits = bits;
+    printf("Writing %ldx%ldx%ld voxels at %g mm, %.1f MiB of pixel data\n",
+           dim[0], dim[1], dim[2], spacing,
+           STATIC_CAST(double, dim[0] * dim[1]) * STATIC_CAST(double, dim[2])
+           * (bits / 8) / 1048576.0);
+    if (rtdose_write(output, &desc, synth_frame, &fa, sizeof err, err)) {
+        fprintf(stderr, "Failed to write %s: %s\n", output, err);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct synth_field f;
+    long dim[3] = { 0, 0, 0 };
+    double spacing = 2.0, mib = 0.0;
+    double depth = 100.0, pitch = 5.0, extent = 270.0;
+    const char *mode, *output;
+    int i, bits = 32;
+
+    if (argc < 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    mode = argv[1];
+    output = argv[2];
+    synth_field_default(&f);
+    for (i = 3; i < argc; i++) {
+        const char *opt = argv[i], *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!val || opt[0] != '-' || !opt[1] || opt[2]) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        i++;
+        switch (opt[1]) {
+        case 'd':
+            if (sscanf(val, "%ldx%ldx%ld", dim, dim + 1, dim + 2) != 3
+             || dim[0] < 2 || dim[1] < 2 || dim[2] < 2) {
+                fprintf(stderr, "Bad grid size %s\n", val);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'S': mib = strtod(val, NULL); break;
+        case 'p': spacing = strtod(val, NULL); break;
+        case 'b': bits = atoi(val); break;
+        case 'z': depth = strtod(val, NULL); break;
+        case 'a': pitch = strtod(val, NULL); break;
+        case 'e': extent = strtod(val, NULL); break;
+        case 'R': f.r50 = strtod(val, NULL); break;
+        case 'M': f.modulation = strtod(val, NULL); break;
+        case 'P': f.penumbra = strtod(val, NULL); break;
+        case 'D': f.dose = strtod(val, NULL); break;
+        case 'F':
+            if (sscanf(val, "%lfx%lf", f.size, f.size + 1) != 2) {
+                fprintf(stderr, "Bad field size %s\n", val);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (spacing <= 0.0 || pitch <= 0.0 || extent < 0.0 || f.dose <= 0.0
+     || f.modulation > f.r50 || f.penumbra <= 0.0) {
+        fputs("Spacing, pitch, dose and penumbra must be positive, and the "
+              "modulation cannot exceed r50\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    if (!strcmp(mode, "dose")) {
+        return write_dose(output, &f, dim, spacing, mib, bits);
+    } else if (!strcmp(mode, "mcc")) {
+        if (synth_mcc_write(output, &f, depth, pitch, extent)) {
+            fprintf(stderr, "Failed to write %s\n", output);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    usage(argv[0]);
+    return EXIT_FAILURE;
+}
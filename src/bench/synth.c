@@ -0,0 +1,151 @@
+#include <math.h>
+#include <stdio.h>
+#include "synth.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+#define SQRT2 1.41421356237309504880
+
+/* Relative entrance dose of the plateau, and range straggling as a fraction of
+the range */
+#define ENTRANCE_RATIO  0.65
+#define STRAGGLE_FRAC   0.012
+
+
+void synth_field_default(struct synth_field *f)
+{
+    f->r50 = 150.0;
+    f->modulation = 100.0;
+    f->size[0] = 100.0;
+    f->size[1] = 100.0;
+    f->penumbra = 3.0;
+    f->dose = 2.0;
+}
+
+
+static double synth_lateral(double x, double width, double sigma)
+{
+    const double s = SQRT2 * sigma;
+    return 0.5 * (erf((x + 0.5 * width) / s) - erf((x - 0.5 * width) / s));
+}
+
+
+/** Rises quadratically from the entrance to the proximal edge, flat over the
+ *  modulation, and falls off as an error function about r50 */
+static double synth_depth(const struct synth_field *f, double depth)
+{
+    const double proximal = f->r50 - f->modulation;
+    const double sigma = STRAGGLE_FRAC * f->r50 + 1.0;
+    double plateau;
+
+    if (depth < 0.0) {
+        return 0.0;
+    } else if (depth < proximal) {
+        plateau = depth / proximal;
+        plateau = ENTRANCE_RATIO + (1.0 - ENTRANCE_RATIO) * plateau * plateau;
+    } else {
+        plateau = 1.0;
+    }
+    return plateau * 0.5 * erfc((depth - f->r50) / (SQRT2 * sigma));
+}
+
+
+double synth_dose(const struct synth_field *f, double x, double depth, double z)
+{
+    return f->dose * synth_depth(f, depth)
+        * synth_lateral(x, f->size[0], f->penumbra)
+        * synth_lateral(z, f->size[1], f->penumbra);
+}
+
+
+void synth_dose_origin(const long dim[], const double spacing[], double origin[])
+{
+    origin[0] = -0.5 * STATIC_CAST(double, dim[0] - 1) * spacing[0];
+    origin[1] = 0.0;
+    origin[2] = -0.5 * STATIC_CAST(double, dim[2] - 1) * spacing[2];
+}
+
+
+float synth_dose_frame(const struct synth_field *f, const long dim[],
+                       const double spacing[], long k, float *plane)
+{
+    double origin[3];
+    float dmax = 0.0f;
+    double z;
+    long i, j;
+
+    synth_dose_origin(dim, spacing, origin);
+    z = origin[2] + STATIC_CAST(double, k) * spacing[2];
+    for (j = 0; j < dim[1]; j++) {
+        /* Plane j sits half a voxel deep, as in proton_dose_depth_range */
+        const double depth = (STATIC_CAST(double, j) + 0.5) * spacing[1];
+        for (i = 0; i < dim[0]; i++) {
+            const double x = origin[0] + STATIC_CAST(double, i) * spacing[0];
+            *plane = STATIC_CAST(float, synth_dose(f, x, depth, z));
+            dmax = (*plane > dmax) ? *plane : dmax;
+            plane++;
+        }
+    }
+    return dmax;
+}
+
+
+ProtonDose *synth_dose_create(const struct synth_field *f, const long dim[],
+                              const double spacing[])
+{
+    const long framesz = dim[0] * dim[1];
+    ProtonDose *dose;
+    double origin[3];
+    float *dptr, fmax, dmax = 0.0f;
+    long k;
+
+    synth_dose_origin(dim, spacing, origin);
+    dose = proton_dose_alloc(dim, origin, spacing);
+    if (!dose) {
+        return NULL;
+    }
+    dptr = proton_dose_data(dose);
+    for (k = 0; k < dim[2]; k++, dptr += framesz) {
+        fmax = synth_dose_frame(f, dim, spacing, k, dptr);
+        dmax = (fmax > dmax) ? fmax : dmax;
+    }
+    dose->dmax = dmax;
+    return dose;
+}
+
+
+/** See the grammar at the top of mcc-data.c. Each inplane offset is a scan,
+ *  and each scan is a crossline row of detectors */
+bool synth_mcc_write(const char *filename, const struct synth_field *f,
+                     double depth, double pitch, double extent)
+{
+    const long n = STATIC_CAST(long, floor(extent / pitch)) + 1;
+    const double x0 = -0.5 * STATIC_CAST(double, n - 1) * pitch;
+    FILE *mcc;
+    long i, j;
+
+    mcc = fopen(filename, "w");
+    if (!mcc) {
+        return true;
+    }
+    fprintf(mcc, "BEGIN_SCAN_DATA\n");
+    fprintf(mcc, "\tFORMAT=CC-Export-V1.9\n");
+    fprintf(mcc, "\tFILE_CREATION_DATE=synthetic\n");
+    for (j = 0; j < n; j++) {
+        const double y = x0 + STATIC_CAST(double, j) * pitch;
+        fprintf(mcc, "\tBEGIN_SCAN %ld\n", j + 1);
+        fprintf(mcc, "\t\tSCAN_DEPTH=%.2f\n", depth);
+        fprintf(mcc, "\t\tSCAN_OFFAXIS_INPLANE=%.2f\n", y);
+        fprintf(mcc, "\t\tCROSS_CALIBRATION=1.000\n");
+        fprintf(mcc, "\t\tBEGIN_DATA\n");
+        for (i = 0; i < n; i++) {
+            const double x = x0 + STATIC_CAST(double, i) * pitch;
+            fprintf(mcc, "\t\t\t%.2f\t%.4E\t#%ld\n",
+                    x, synth_dose(f, x, depth, y), i + 1);
+        }
+        fprintf(mcc, "\t\tEND_DATA\n");
+        fprintf(mcc, "\tEND_SCAN %ld\n", j + 1);
+    }
+    fprintf(mcc, "END_SCAN_DATA\n");
+    return fclose(mcc) != 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+/** Analytic spread-out Bragg peak fields, for benchmarks and generated test
+ *  data. Nothing here is meant to be dosimetrically accurate, only shaped
+ *  like the real thing */
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <stdbool.h>
+#include "proton/proton-dose.h"
+
+
+struct synth_field {
+    double r50;             /* Distal 50% depth (mm) */
+    double modulation;      /* Plateau width (mm) */
+    double size[2];         /* Field size in x and z (mm) */
+    double penumbra;        /* Lateral Gaussian sigma (mm) */
+    double dose;            /* Plateau dose (Gy) */
+};
+
+/** A 10x10 cm field, 15 cm range with 10 cm modulation, 2 Gy plateau */
+void synth_field_default(struct synth_field *f);
+
+/** Dose at lateral position (x, z) and depth @p depth, all in mm */
+double synth_dose(const struct synth_field *f, double x, double depth, double z);
+
+/** Writes the position of voxel (0, 0, 0) of a @p dim grid centred laterally
+ *  on the field, with depth measured from the first plane's proximal edge */
+void synth_dose_origin(const long dim[], const double spacing[], double origin[]);
+
+/** Fills the dim[0] x dim[1] frame @p k of that grid, returning its maximum.
+ *  The field's plateau dose bounds the maximum of every frame */
+float synth_dose_frame(const struct synth_field *f, const long dim[],
+                       const double spacing[], long k, float *plane);
+
+/** Allocates a dose of @p dim voxels at @p spacing, centred laterally on the
+ *  field, filled from @p f with its maximum written. The derived quantities
+ *  are NOT computed, call proton_dose_derive() for those */
+ProtonDose *synth_dose_create(const struct synth_field *f, const long dim[],
+                              const double spacing[]);
+
+/** Writes an Octavius-style MCC file of the field at @p depth, sampled on a
+ *  square detector lattice of @p pitch mm covering @p extent mm. Returns true
+ *  on failure */
+bool synth_mcc_write(const char *filename, const struct synth_field *f,
+                     double depth, double pitch, double extent);
+
+
+#endif /* SYNTH_H */
@@ -0,0 +1,219 @@
+#include <chrono>
+#include <cmath>
+#include "cine-renderer.h"
+#include <wx/filename.h>
+#include "proton/proton-trace.h"
+
+wxDEFINE_EVENT(EVT_CINE_PROGRESS, wxThreadEvent);
+wxDEFINE_EVENT(EVT_CINE_FINISHED, wxThreadEvent);
+
+
+/** Renders @p job into @p img, reattached to @p buf, which is resized to fit.
+ *  Returns true on failure */
+static bool cine_render(const CineJob &job, std::vector<unsigned char> &buf,
+                        ProtonImage **img)
+{
+    const long bpp = (job.format == PROTON_PX_RGB24) ? 3 : 4;
+    ProtonView view;
+
+    try {
+        buf.resize(static_cast<size_t>(job.dim[0] * job.dim[1] * bpp));
+    } catch (std::bad_alloc &) {
+        return true;
+    }
+    if (proton_image_attach(img, buf.data(), job.dim[0], job.dim[1],
+                            job.dim[0] * bpp, job.format)) {
+        return true;
+    }
+    proton_view_fit(&view, job.rect, job.dim[0], job.dim[1]);
+    proton_dose_get_plane_region(job.dose, &job.params, *img, job.depth, &view);
+    return false;
+}
+
+
+void CineRenderer::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    for (;;) {
+        cond.wait(guard, [this]() { return queued || quit; });
+        if (quit) {
+            break;
+        }
+        queued = false;
+        busy = true;
+        guard.unlock();
+        render(next);
+        guard.lock();
+        busy = false;
+        done = true;
+        cond.notify_all();
+    }
+}
+
+
+void CineRenderer::render(const CineJob &job)
+/** A frame that could not be allocated comes back empty */
+{
+    PROTON_TRACE_SCOPE("cine frame");
+    const auto t0 = std::chrono::steady_clock::now();
+
+    back.depth = job.depth;
+    if (cine_render(job, back.px, &img)) {
+        back.dim[0] = back.dim[1] = 0;
+    } else {
+        back.dim[0] = job.dim[0];
+        back.dim[1] = job.dim[1];
+    }
+    back.ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - t0).count();
+}
+
+
+CineRenderer::CineRenderer():
+    queued(false),
+    busy(false),
+    done(false),
+    quit(false),
+    img(nullptr)
+{
+    worker = std::thread(&CineRenderer::run, this);
+}
+
+
+CineRenderer::~CineRenderer()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    cond.notify_all();
+    worker.join();
+    proton_image_destroy(img);
+}
+
+
+bool CineRenderer::submit(const CineJob &job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (queued || busy || done) {
+            return false;
+        }
+        next = job;
+        queued = true;
+    }
+    cond.notify_all();
+    return true;
+}
+
+
+bool CineRenderer::collect(CineFrame &out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (!done) {
+        return false;
+    }
+    std::swap(out, back);
+    done = false;
+    return true;
+}
+
+
+void CineRenderer::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    cond.wait(guard, [this]() { return !queued && !busy; });
+    done = false;
+}
+
+
+void CineExporter::run(wxEvtHandler *sink, CineJob job, float last, float step, wxString dir)
+/** The frame count is fixed up front so the depths are exact multiples of
+ *  the step, rather than an accumulated sum */
+{
+    PROTON_TRACE_SCOPE("cine export");
+    const float first = job.depth;
+    const long n = static_cast<long>(std::floor((last - first) / step + 1e-4f)) + 1;
+    std::vector<unsigned char> buf;
+    ProtonImage *img = nullptr;
+    wxString err;
+    long i;
+
+    for (i = 0; i < n && !cancel.load(); i++) {
+        job.depth = first + step * static_cast<float>(i);
+        if (cine_render(job, buf, &img)) {
+            err = wxT("Out of memory");
+            break;
+        }
+        wxImage frame(job.dim[0], job.dim[1], buf.data(), true);
+        const wxFileName path(dir, wxString::Format(wxT("frame_%04ld_%.1fmm.png"), i, job.depth));
+        if (!frame.SaveFile(path.GetFullPath(), wxBITMAP_TYPE_PNG)) {
+            err = wxT("Failed to write ") + path.GetFullPath();
+            break;
+        }
+        wxThreadEvent *e = new wxThreadEvent(EVT_CINE_PROGRESS);
+        e->SetInt(static_cast<int>(i + 1));
+        e->SetExtraLong(n);
+        wxQueueEvent(sink, e);
+    }
+    proton_image_destroy(img);
+    {
+        wxThreadEvent *e = new wxThreadEvent(EVT_CINE_FINISHED);
+        e->SetInt(static_cast<int>(i));
+        e->SetExtraLong(n);
+        e->SetString(err);
+        wxQueueEvent(sink, e);
+    }
+}
+
+
+CineExporter::CineExporter():
+    cancel(false)
+{
+}
+
+
+CineExporter::~CineExporter()
+{
+    stop();
+}
+
+
+bool CineExporter::start(wxEvtHandler *sink, const CineJob &job, float last,
+                         float step, const wxString &dir)
+{
+    CineJob rgb = job;
+
+    if (running()) {
+        return true;
+    }
+    if (!wxImage::FindHandler(wxBITMAP_TYPE_PNG)) {
+        wxImage::AddHandler(new wxPNGHandler);
+    }
+    rgb.format = PROTON_PX_RGB24;
+    cancel = false;
+    /* wxString is not safe to share between threads, so the copy is deep */
+    worker = std::thread(&CineExporter::run, this, sink, rgb, last, step,
+                         wxString(dir.wc_str()));
+    return false;
+}
+
+
+void CineExporter::stop()
+{
+    if (running()) {
+        cancel = true;
+        worker.join();
+    }
+}
+
+
+void CineExporter::finished()
+{
+    if (running()) {
+        worker.join();
+    }
+}
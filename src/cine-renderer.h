@@ -0,0 +1,104 @@
+#pragma once
+
+#ifndef CINE_RENDERER_H
+#define CINE_RENDERER_H
+
+#include <wx/wx.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "proton/proton-dose.h"
+
+/** Posted by CineExporter. The integer is the number of frames written and
+ *  the extra long the number in the sweep. The finishing event carries an
+ *  error message in its string, empty on success or when cancelled */
+wxDECLARE_EVENT(EVT_CINE_PROGRESS, wxThreadEvent);
+wxDECLARE_EVENT(EVT_CINE_FINISHED, wxThreadEvent);
+
+
+/** Everything a worker needs to draw one plane without touching the UI */
+struct CineJob {
+    const ProtonDose *dose;
+    ProtonPlaneParams params;
+    float depth;
+    double rect[4];             /* Same as proton_dose_get_plane_view() */
+    long dim[2];
+    int format;
+};
+
+
+struct CineFrame {
+    float depth;
+    long dim[2];
+    double ms;                  /* Time spent rendering */
+    std::vector<unsigned char> px;  /* Packed rows, no padding */
+};
+
+
+/** Renders planes on a worker thread, one at a time, so the UI can show one
+ *  frame while the next is drawn. The dose must outlive any job queued
+ *  against it, see wait() */
+class CineRenderer {
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable cond;
+    bool queued, busy, done, quit;
+
+    /* Only the worker touches these while busy */
+    CineJob next;
+    CineFrame back;
+    ProtonImage *img;
+
+    void run();
+    void render(const CineJob &job);
+
+public:
+    CineRenderer();
+    ~CineRenderer();
+
+    /** Queues @p job unless a render is in flight or its frame has not been
+     *  collected. Returns true if it was queued */
+    bool submit(const CineJob &job);
+
+    /** Swaps the finished frame into @p out, whose buffer is reused for the
+     *  next one. Returns false while nothing is finished */
+    bool collect(CineFrame &out);
+
+    /** Blocks until the worker is idle, then drops any finished frame. Call
+     *  this before the dose goes away */
+    void wait();
+};
+
+
+/** Writes a depth sweep as numbered PNG files on its own thread. Frames are
+ *  rendered at full resolution, whatever the playback is doing */
+class CineExporter {
+    std::thread worker;
+    std::atomic<bool> cancel;
+
+    void run(wxEvtHandler *sink, CineJob job, float last, float step, wxString dir);
+
+public:
+    CineExporter();
+    ~CineExporter();
+
+    /** Starts writing frames from job.depth to @p last in steps of @p step
+     *  mm into @p dir, posting progress to @p sink. Returns true if an
+     *  export is already running */
+    bool start(wxEvtHandler *sink, const CineJob &job, float last, float step,
+               const wxString &dir);
+
+    /** Cancels the export and waits for the worker. Events already posted
+     *  still arrive */
+    void stop();
+
+    /** Joins the worker once it has posted EVT_CINE_FINISHED */
+    void finished();
+
+    bool running() const noexcept { return worker.joinable(); }
+};
+
+
+#endif /* CINE_RENDERER_H */
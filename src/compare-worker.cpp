@@ -0,0 +1,123 @@
+#include "compare-worker.h"
+#include "proton/proton-trace.h"
+
+wxDEFINE_EVENT(EVT_COMPARE_DONE, wxThreadEvent);
+
+
+void CompareWorker::run(CompareJob job)
+{
+    std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+    CompareResult out;
+    char err[1024];
+
+    for (;;) {
+        PROTON_TRACE_SCOPE("dose compare");
+        err[0] = '\0';
+        out.mode = job.mode;
+        out.stats = ProtonGammaStats();
+        if (job.mode == PROTON_COMPARE_GAMMA) {
+            out.dose = proton_dose_create_gamma(job.ref, job.path.c_str(), &job.gamma,
+                                                &out.stats, sizeof err, err);
+        } else {
+            out.dose = proton_dose_create_compare(job.ref, job.path.c_str(), job.mode,
+                                                  sizeof err, err);
+        }
+        out.err = err;
+        guard.lock();
+        if (stale) {
+            proton_dose_destroy(out.dose);
+        } else {
+            proton_dose_destroy(res.dose);
+            res = std::move(out);
+            ready = true;
+            wxQueueEvent(sink, new wxThreadEvent(EVT_COMPARE_DONE));
+        }
+        if (!queued) {
+            busy = false;
+            break;
+        }
+        job = std::move(waiting);
+        queued = stale = false;
+        guard.unlock();
+    }
+}
+
+
+CompareWorker::CompareWorker(wxEvtHandler *sink):
+    res{ nullptr, 0, ProtonGammaStats(), std::string() },
+    queued(false),
+    busy(false),
+    ready(false),
+    stale(false),
+    sink(sink)
+{
+}
+
+
+CompareWorker::~CompareWorker()
+{
+    wait();
+}
+
+
+void CompareWorker::submit(const CompareJob &job)
+/** A worker that has finished is joined here, which does not block. A
+ *  result not yet collected belongs to an earlier request, and goes */
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (ready) {
+        proton_dose_destroy(res.dose);
+        res.dose = nullptr;
+        ready = false;
+    }
+    if (busy) {
+        waiting = job;
+        queued = stale = true;
+        return;
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+    busy = true;
+    stale = false;
+    worker = std::thread(&CompareWorker::run, this, job);
+}
+
+
+void CompareWorker::cancel()
+    noexcept
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    queued = false;
+    stale = true;
+    if (ready) {
+        proton_dose_destroy(res.dose);
+        res.dose = nullptr;
+        ready = false;
+    }
+}
+
+
+void CompareWorker::wait()
+{
+    cancel();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+
+bool CompareWorker::collect(CompareResult &out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (!ready) {
+        return false;
+    }
+    out = std::move(res);
+    res.dose = nullptr;
+    ready = false;
+    return true;
+}
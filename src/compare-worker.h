@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef COMPARE_WORKER_H
+#define COMPARE_WORKER_H
+
+#include <wx/wx.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "proton/proton-compare.h"
+#include "proton/proton-gamma.h"
+
+/** Posted by CompareWorker when a comparison is ready, see collect() */
+wxDECLARE_EVENT(EVT_COMPARE_DONE, wxThreadEvent);
+
+
+struct CompareJob {
+    const ProtonDose *ref;
+    std::string path;
+    int mode;                   /* PROTON_COMPARE_* */
+    ProtonGammaParams gamma;
+};
+
+
+struct CompareResult {
+    ProtonDose *dose;           /* NULL on failure, owned by the collector */
+    int mode;
+    ProtonGammaStats stats;     /* Gamma only */
+    std::string err;
+};
+
+
+/** Compares the loaded dose with a second RTDose on a worker thread, since a
+ *  gamma analysis on a clinical grid takes seconds. One comparison runs at a
+ *  time. A request made while one runs waits for it, replacing any other
+ *  request still waiting, and the result of a superseded or cancelled
+ *  request is dropped rather than posted. The reference dose must outlive
+ *  the worker's use of it, see wait() */
+class CompareWorker {
+    std::thread worker;
+    std::mutex lock;
+    CompareJob waiting;
+    CompareResult res;
+    bool queued, busy, ready, stale;
+
+    wxEvtHandler *sink;
+
+    void run(CompareJob job);
+
+public:
+    CompareWorker(wxEvtHandler *sink);
+    ~CompareWorker();
+
+    void submit(const CompareJob &job);
+
+    /** Drops the waiting request and the results of the running and any
+     *  uncollected one, without waiting */
+    void cancel() noexcept;
+
+    /** Cancels, then blocks until the worker is idle. Call this before the
+     *  reference dose goes away */
+    void wait();
+
+    /** Moves the finished comparison into @p out, returning false if there
+     *  is none */
+    bool collect(CompareResult &out);
+};
+
+
+#endif /* COMPARE_WORKER_H */
@@ -0,0 +1,111 @@
+#include "compute-graph.h"
+#include "proton/proton-trace.h"
+
+
+wxString ComputeGraph::describe(unsigned long mask)
+{
+    static const wxString names[IN_COUNT] = {
+        wxT("dose"),
+        wxT("depth"),
+        wxT("visuals"),
+        wxT("line point"),
+        wxT("measurements"),
+        wxT("shift"),
+        wxT("detector"),
+        wxT("isodose"),
+        wxT("profile")
+    };
+    wxString res;
+    int i;
+
+    for (i = 0; i < IN_COUNT; i++) {
+        if (mask & (1UL << i)) {
+            if (!res.empty()) {
+                res += wxT(", ");
+            }
+            res += names[i];
+        }
+    }
+    return res;
+}
+
+
+ComputeGraph::ComputeGraph():
+    flushing(false)
+{
+
+}
+
+
+void ComputeGraph::add_output(const wxString &name, std::initializer_list<input> deps,
+                              std::function<void()> fn)
+{
+    unsigned long mask = 0;
+
+    for (const input in : deps) {
+        mask |= 1UL << in;
+    }
+    outputs.push_back({ name, "graph: " + name.ToStdString(), mask, 0, 0, std::move(fn) });
+}
+
+
+void ComputeGraph::invalidate(input in)
+    noexcept
+{
+    const unsigned long bit = 1UL << in;
+
+    for (output &out : outputs) {
+        if (out.deps & bit) {
+            out.cause |= bit;
+        }
+    }
+}
+
+
+void ComputeGraph::flush()
+{
+    bool dirty;
+
+    if (flushing) {
+        return;
+    }
+    PROTON_TRACE_SCOPE("graph flush");
+    flushing = true;
+    do {
+        dirty = false;
+        for (output &out : outputs) {
+            if (out.cause) {
+                wxLogTrace(RECOMPUTE_TRACE, wxT("%s <- %s"),
+                           out.name, describe(out.cause));
+                out.cause = 0;
+                out.count++;
+                const uint64_t t0 = proton_trace_begin();
+                out.fn();
+                proton_trace_end(out.trace.c_str(), t0);
+                dirty = true;
+            }
+        }
+    } while (dirty);
+    flushing = false;
+}
+
+
+void ComputeGraph::discard()
+    noexcept
+{
+    for (output &out : outputs) {
+        out.cause = 0;
+    }
+}
+
+
+wxString ComputeGraph::stats() const
+{
+    wxString res, line;
+
+    for (const output &out : outputs) {
+        line.Printf(wxT("%-24s %8lu  (%s)\n"), out.name, out.count, describe(out.deps));
+        res += line;
+    }
+    return res;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef COMPUTE_GRAPH_H
+#define COMPUTE_GRAPH_H
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include <wx/wx.h>
+
+/** Trace mask for the recompute log. Run with WXTRACE=recompute (debug
+ *  builds) or enable it with wxLog::AddTraceMask */
+#define RECOMPUTE_TRACE wxT("recompute")
+
+
+/** Records which outputs depend on which inputs, so that a change to an
+ *  input recomputes exactly the outputs that read it. Outputs run in the
+ *  order they were added, which must therefore be a topological order: an
+ *  output may invalidate inputs of outputs added after it */
+class ComputeGraph {
+public:
+    enum input {
+        IN_DOSE = 0,        /* A new dose was loaded */
+        IN_DEPTH,           /* Slice depth */
+        IN_VISUALS,         /* Plane parameters (colormap, gradient norm) */
+        IN_LINE_POINT,      /* Line dose crosshair */
+        IN_MEASUREMENTS,    /* MCC files or their depths */
+        IN_SHIFT,           /* Detector translation and rotation */
+        IN_DETECTOR,        /* Detector window visibility */
+        IN_ISODOSE,         /* Isodose line visibility and style */
+        IN_PROFILE,         /* Lateral profile segment and step */
+        IN_COUNT
+    };
+
+private:
+    struct output {
+        wxString name;
+        std::string trace;      /* Span name, "graph: " and the name */
+        unsigned long deps;     /* Mask of inputs read */
+        unsigned long cause;    /* Mask of inputs changed since the last run */
+        unsigned long count;    /* Number of recomputes */
+        std::function<void()> fn;
+    };
+
+    std::vector<output> outputs;
+    bool flushing;
+
+    static wxString describe(unsigned long mask);
+
+public:
+    ComputeGraph();
+
+    void add_output(const wxString &name, std::initializer_list<input> deps,
+                    std::function<void()> fn);
+
+    /** Marks every output reading @p in as stale */
+    void invalidate(input in) noexcept;
+
+    /** Recomputes every stale output. Invalidations made by an output while
+     *  this runs are picked up by the same flush */
+    void flush();
+
+    /** Forgets all pending invalidations */
+    void discard() noexcept;
+
+    /** One line per output: its recompute count and its inputs */
+    wxString stats() const;
+};
+
+
+#endif /* COMPUTE_GRAPH_H */
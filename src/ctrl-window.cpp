@@ -4,16 +4,24 @@
 CtrlWindow::CtrlWindow(wxWindow *parent):
     wxPanel(parent),
     dcon(new DepthControl(this)),
+    ccon(new CineControl(this)),
     vcon(new VisualControl(this)),
+    icon(new IsodoseControl(this)),
     pcon(new PlotControl(this)),
+    prcon(new ProfileControl(this)),
+    cmcon(new CompareControl(this)),
     scon(new ShiftControl(this))
 {
     wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
     vbox->Add(dcon, 0, wxEXPAND);
+    vbox->Add(ccon, 0, wxEXPAND);
     vbox->AddStretchSpacer();
     vbox->Add(vcon, 0, wxEXPAND);
+    vbox->Add(icon, 0, wxEXPAND);
     vbox->AddStretchSpacer();
     vbox->Add(pcon, 0, wxEXPAND);
+    vbox->Add(prcon, 0, wxEXPAND);
+    vbox->Add(cmcon, 0, wxEXPAND);
     vbox->AddStretchSpacer();
     vbox->Add(scon, 0, wxEXPAND);
     this->SetSizer(vbox);
@@ -21,7 +29,5 @@ CtrlWindow::CtrlWindow(wxWindow *parent):
 
 void CtrlWindow::set_depth_range(float min, float max)
 {
-    int l = static_cast<int>(std::ceil(min));
-    int h = static_cast<int>(std::floor(max));
-    dcon->set_depth_range(l, h);
+    dcon->set_depth_range(static_cast<double>(min), static_cast<double>(max));
 }
@@ -4,16 +4,24 @@
 #define CTRL_WINDOW_H
 
 #include <wx/wx.h>
+#include "ctrls/cine-control.h"
+#include "ctrls/compare-control.h"
 #include "ctrls/depth-control.h"
+#include "ctrls/isodose-control.h"
 #include "ctrls/plot-control.h"
+#include "ctrls/profile-control.h"
 #include "ctrls/shift-control.h"
 #include "ctrls/visual-control.h"
 
 
 class CtrlWindow : public wxPanel {
     DepthControl  *dcon;
+    CineControl   *ccon;
     VisualControl *vcon;
+    IsodoseControl *icon;
     PlotControl   *pcon;
+    ProfileControl *prcon;
+    CompareControl *cmcon;
     ShiftControl  *scon;
 
 public:
@@ -21,22 +29,49 @@ public:
 
     inline float get_depth() const { return static_cast<float>(dcon->get_value()); }
 
-    void on_depth_changed(wxCommandEvent &e) { vcon->on_depth_changed(e); }
+    /** Returns true if the visual parameters changed with the depth */
+    bool on_depth_changed() { return vcon->on_depth_changed(); }
 
-    /** Sets the valid integer slider depths to [ceil(min), floor(max)] */
+    /** Sets the valid slider depths to the steps within [min, max] */
     void set_depth_range(float min, float max);
+
+    /** Steps the depth by @p delta mm and posts the change. In coarse mode a
+     *  step smaller than 1 mm still moves by one */
+    inline void nudge_depth(double delta) { dcon->nudge(delta); }
+    /** Moves the slider without posting a change, for cine playback */
+    inline void show_depth(double depth) { dcon->set_value(depth); }
     inline double get_max_slider_depth() const { return static_cast<double>(dcon->get_max()); }
 
+    inline bool cine_playing() const { return ccon->playing(); }
+    inline void set_cine_playing(bool x) { ccon->set_playing(x); }
+    inline double get_cine_fps() const { return ccon->get_fps(); }
+    inline double get_cine_step() const noexcept { return ccon->get_step(); }
+    inline bool cine_exporting() const noexcept { return ccon->is_exporting(); }
+    inline void set_cine_exporting(bool x) { ccon->set_exporting(x); }
+    inline void set_cine_progress(long done, long total) { ccon->set_export_progress(done, total); }
+
     inline void get_detector_affine(double affine[]) const noexcept { scon->get_affine(affine); }
 
     inline void set_translation(double x, double y) { scon->set_translation(x, y); }
 
     inline void get_line_dose(double *x, double *y) const noexcept { pcon->get_point(x, y); }
     inline void set_line_dose(double x, double y) { pcon->set_point(x, y); }
+    inline void add_measurements(const wxArrayString &paths) { pcon->add_files(paths); }
+
+    inline const ProtonProfile &profile() const noexcept { return prcon->profile(); }
+    inline void set_profile(const double start[], const double end[]) { prcon->set_segment(start, end); }
+    inline void span_profile(int dim) { prcon->span(dim); }
+
+    inline int compare_mode() const noexcept { return cmcon->mode(); }
+    inline const wxString &compare_file() const noexcept { return cmcon->file(); }
+    inline void show_dose() { cmcon->show_dose(); }
+    inline const ProtonGammaParams &gamma() const noexcept { return cmcon->gamma(); }
+    inline void set_gamma_result(const ProtonGammaStats *stats) { cmcon->set_gamma_result(stats); }
 
     inline void get_ld_measurements(std::vector<std::tuple<double, double>> &meas) const { pcon->get_ld_measurements(meas); }
     inline void get_pd_measurements(std::vector<std::tuple<double, double>> &meas) const { pcon->get_pd_measurements(meas); }
     inline void get_sp_measurements(std::vector<std::tuple<double, double>> &meas) const { pcon->get_sp_measurements(meas); }
+    inline void get_profile_measurements(std::vector<std::tuple<double, double>> &meas) const { pcon->get_profile_measurements(prcon->profile(), get_depth(), meas); }
 
     /** Converts the RS does coordinates to MCC dose coordinates */
     inline void convert_coordinates(double *x, double *y) const noexcept { scon->convert_coordinates(x, y); }
@@ -44,6 +79,8 @@ public:
     inline bool detector_enabled() const { return scon->detector_enabled(); }
 
     const ProtonPlaneParams &visuals() const noexcept { return vcon->visuals(); }
+    inline void set_signed_dose(bool x) { vcon->set_signed(x); }
+    const IsodoseParams &isodose() const noexcept { return icon->isodose(); }
 };
 
 
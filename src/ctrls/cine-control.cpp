@@ -0,0 +1,142 @@
+#include <array>
+#include "ctrl-symbols.h"
+#include "cine-control.h"
+#include <wx/valnum.h>
+
+#define CINE_FPS_INIT 2         /* Index into rates() */
+#define CINE_STEP_MIN 0.1
+
+wxDEFINE_EVENT(EVT_CINE_CONTROL, wxCommandEvent);
+
+
+const wxArrayString &CineControl::rates() noexcept
+{
+    static const std::array<wxString, 5> rates = {
+        wxString(wxT("5")),
+        wxString(wxT("10")),
+        wxString(wxT("15")),
+        wxString(wxT("24")),
+        wxString(wxT("30"))
+    };
+    static const wxArrayString res(rates.size(), rates.data());
+
+    return res;
+}
+
+
+void CineControl::post_change_event(int what)
+{
+    wxCommandEvent e(EVT_CINE_CONTROL);
+
+    e.SetInt(what);
+    wxPostEvent(this, e);
+}
+
+
+void CineControl::on_evt_play(wxCommandEvent &WXUNUSED(e))
+{
+    play->SetLabel((play->GetValue()) ? CINE_PAUSELBL : CINE_PLAYLBL);
+    post_change_event(CINE_CHANGE_PLAY);
+}
+
+
+void CineControl::on_evt_fps(wxCommandEvent &WXUNUSED(e))
+{
+    post_change_event(CINE_CHANGE_RATE);
+}
+
+
+void CineControl::on_evt_step(wxCommandEvent &e)
+{
+    wxString str;
+    double x;
+
+    str = e.GetString();
+    if (str.IsEmpty()) {
+        e.Skip();
+    } else if (str.ToDouble(&x) && x >= CINE_STEP_MIN) {
+        stepmm = x;
+        post_change_event(CINE_CHANGE_RATE);
+    }
+}
+
+
+void CineControl::on_evt_export(wxCommandEvent &WXUNUSED(e))
+{
+    post_change_event(CINE_CHANGE_EXPORT);
+}
+
+
+CineControl::CineControl(wxWindow *parent):
+    wxPanel(parent),
+    play(new wxToggleButton(this, wxID_ANY, CINE_PLAYLBL)),
+    fps(new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, rates())),
+    step(new wxTextCtrl(this, wxID_ANY, CINE_STEPINIT, wxDefaultPosition, ENTRYSZ)),
+    exprt(new wxButton(this, wxID_ANY, CINE_EXPORTLBL)),
+    status(new wxStaticText(this, wxID_ANY, wxEmptyString)),
+    stepmm(1.0),
+    exporting(false)
+{
+    wxFloatingPointValidator<double> v;
+    wxStaticBoxSizer *vbox = new wxStaticBoxSizer(wxVERTICAL, this, CINE_LABEL);
+    wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
+
+    hbox->Add(play, 1);
+    hbox->Add(fps, 0);
+    hbox->Add(new wxStaticText(this, wxID_ANY, CINE_FPSLBL), 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 4);
+    vbox->Add(hbox, 0, wxEXPAND);
+    hbox = new wxBoxSizer(wxHORIZONTAL);
+    hbox->Add(new wxStaticText(this, wxID_ANY, CINE_STEPLBL), 1, wxALIGN_CENTER_VERTICAL);
+    hbox->Add(step, 0);
+    vbox->Add(hbox, 0, wxEXPAND);
+    hbox = new wxBoxSizer(wxHORIZONTAL);
+    hbox->Add(exprt, 0);
+    hbox->Add(status, 1, wxALIGN_CENTER_VERTICAL | wxLEFT, 4);
+    vbox->Add(hbox, 0, wxEXPAND);
+    this->SetSizerAndFit(vbox);
+
+    fps->SetSelection(CINE_FPS_INIT);
+    v.SetPrecision(1);
+    step->SetValidator(v);
+
+    play->Bind(wxEVT_TOGGLEBUTTON, &CineControl::on_evt_play, this);
+    fps->Bind(wxEVT_CHOICE, &CineControl::on_evt_fps, this);
+    step->Bind(wxEVT_TEXT, &CineControl::on_evt_step, this);
+    exprt->Bind(wxEVT_BUTTON, &CineControl::on_evt_export, this);
+}
+
+
+void CineControl::set_playing(bool x)
+{
+    play->SetValue(x);
+    play->SetLabel((x) ? CINE_PAUSELBL : CINE_PLAYLBL);
+}
+
+
+double CineControl::get_fps() const
+{
+    double x;
+
+    if (!fps->GetStringSelection().ToDouble(&x)) {
+        x = 15.0;
+    }
+    return x;
+}
+
+
+void CineControl::set_exporting(bool x)
+{
+    exporting = x;
+    exprt->SetLabel((x) ? CINE_CANCELLBL : CINE_EXPORTLBL);
+    status->SetLabel(wxEmptyString);
+    this->Layout();
+}
+
+
+void CineControl::set_export_progress(long done, long total)
+{
+    wxString str;
+
+    str.Printf(wxT("%ld/%ld"), done, total);
+    status->SetLabel(str);
+}
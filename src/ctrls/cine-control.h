@@ -0,0 +1,53 @@
+#pragma once
+
+#ifndef CINE_CONTROL_H
+#define CINE_CONTROL_H
+
+#include <wx/wx.h>
+#include <wx/tglbtn.h>
+
+wxDECLARE_EVENT(EVT_CINE_CONTROL, wxCommandEvent);
+
+/** EVT_CINE_CONTROL carries one of these in its integer */
+enum {
+    CINE_CHANGE_PLAY = 0,       /* Play toggled */
+    CINE_CHANGE_RATE,           /* Frame rate or depth step changed */
+    CINE_CHANGE_EXPORT          /* Export or cancel pressed */
+};
+
+
+class CineControl : public wxPanel {
+    wxToggleButton *play;
+    wxChoice *fps;
+    wxTextCtrl *step;
+    wxButton *exprt;
+    wxStaticText *status;
+    double stepmm;
+    bool exporting;
+
+    static const wxArrayString &rates() noexcept;
+
+    void post_change_event(int what);
+
+    void on_evt_play(wxCommandEvent &e);
+    void on_evt_fps(wxCommandEvent &e);
+    void on_evt_step(wxCommandEvent &e);
+    void on_evt_export(wxCommandEvent &e);
+
+public:
+    CineControl(wxWindow *parent);
+
+    inline bool playing() const { return play->GetValue(); }
+    /** Does not post an event */
+    void set_playing(bool x);
+
+    double get_fps() const;
+    constexpr double get_step() const noexcept { return stepmm; }
+
+    constexpr bool is_exporting() const noexcept { return exporting; }
+    void set_exporting(bool x);
+    void set_export_progress(long done, long total);
+};
+
+
+#endif /* CINE_CONTROL_H */
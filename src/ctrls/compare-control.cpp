@@ -0,0 +1,190 @@
+#include <array>
+#include <wx/filename.h>
+#include <wx/valnum.h>
+#include "ctrl-symbols.h"
+#include "../main-window.h"
+
+wxDEFINE_EVENT(EVT_COMPARE_CONTROL, wxCommandEvent);
+
+
+/** In the order of mode(), from COMPARE_SHOW_DOSE */
+const wxArrayString &CompareControl::modes() noexcept
+{
+    static const std::array<wxString, 4> modes = {
+        wxString(wxT("Dose")),
+        wxString(wxT("Difference (Gy)")),
+        wxString(wxT("Ratio - 1")),
+        wxString(wxT("Gamma"))
+    };
+    static const wxArrayString res(modes.size(), modes.data());
+
+    return res;
+}
+
+
+const wxArrayString &CompareControl::steps() noexcept
+{
+    static const std::array<wxString, 4> steps = {
+        wxString(wxT("1")),
+        wxString(wxT("2")),
+        wxString(wxT("3")),
+        wxString(wxT("5"))
+    };
+    static const wxArrayString res(steps.size(), steps.data());
+
+    return res;
+}
+
+
+void CompareControl::post_change_event()
+{
+    wxPostEvent(this, wxCommandEvent(EVT_COMPARE_CONTROL));
+}
+
+
+void CompareControl::on_evt_mode(wxCommandEvent &WXUNUSED(e))
+{
+    post_change_event();
+}
+
+
+void CompareControl::on_evt_button(wxCommandEvent &WXUNUSED(e))
+/** A new file is shown as a difference straight away */
+{
+    wxFileDialog dlg(this, COMPARE_DLGTITLE, wxGetApp().get_RS_directory(),
+                     wxEmptyString, wxT("DICOM files (*.dcm)|*.dcm"),
+                     wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+
+    if (dlg.ShowModal() == wxID_CANCEL) {
+        return;
+    }
+    path = dlg.GetPath();
+    flbl->SetLabelText(wxFileName(path).GetName());
+    mchoice->Enable(true);
+    gbtn->Enable(true);
+    if (mode() == COMPARE_SHOW_DOSE) {
+        mchoice->SetSelection(PROTON_COMPARE_DIFF + 1);
+    }
+    post_change_event();
+}
+
+
+void CompareControl::on_evt_criterion(wxCommandEvent &e)
+/** The cutoff may be zero, the criteria may not */
+{
+    wxString str;
+    double x;
+
+    str = e.GetString();
+    if (str.IsEmpty() || !str.ToDouble(&x)) {
+        e.Skip();
+    } else if (e.GetEventObject() == gcut) {
+        if (x >= 0.0 && x < 100.0) {
+            gparams.threshold = static_cast<float>(x);
+        }
+    } else if (x > 0.0) {
+        float &crit = (e.GetEventObject() == gdose) ? gparams.dose : gparams.dta;
+        crit = static_cast<float>(x);
+    }
+}
+
+
+void CompareControl::on_evt_local(wxCommandEvent &WXUNUSED(e))
+{
+    gparams.local = glocal->GetValue();
+}
+
+
+void CompareControl::on_evt_interp(wxCommandEvent &WXUNUSED(e))
+{
+    long x;
+
+    if (ginterp->GetStringSelection().ToLong(&x)) {
+        gparams.interp = static_cast<int>(x);
+    }
+}
+
+
+void CompareControl::on_evt_run(wxCommandEvent &WXUNUSED(e))
+{
+    mchoice->SetSelection(PROTON_COMPARE_GAMMA + 1);
+    post_change_event();
+}
+
+
+CompareControl::CompareControl(wxWindow *parent):
+    wxPanel(parent),
+    mchoice(new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, modes())),
+    fbtn(new wxButton(this, wxID_ANY, COMPARE_LOADLBL)),
+    flbl(new wxStaticText(this, wxID_ANY, wxEmptyString)),
+    gdose(new wxTextCtrl(this, wxID_ANY, GAMMA_DOSEINIT, wxDefaultPosition, ENTRYSZ)),
+    gdta(new wxTextCtrl(this, wxID_ANY, GAMMA_DTAINIT, wxDefaultPosition, ENTRYSZ)),
+    gcut(new wxTextCtrl(this, wxID_ANY, GAMMA_CUTINIT, wxDefaultPosition, ENTRYSZ)),
+    glocal(new wxCheckBox(this, wxID_ANY, GAMMA_LOCALLBL)),
+    ginterp(new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, steps())),
+    gbtn(new wxButton(this, wxID_ANY, GAMMA_RUNLBL)),
+    gres(new wxStaticText(this, wxID_ANY, wxEmptyString)),
+    gparams{ 3.0f, 3.0f, 10.0f, false, 3 }
+{
+    wxFloatingPointValidator<double> v;
+    wxStaticBoxSizer *vbox = new wxStaticBoxSizer(wxVERTICAL, this, COMPARE_LABEL);
+    wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
+    auto add_row = [this, vbox](const wxString &label, wxWindow *ctrl) {
+        wxBoxSizer *row = new wxBoxSizer(wxHORIZONTAL);
+        row->Add(new wxStaticText(this, wxID_ANY, label), 1, wxALIGN_CENTER_VERTICAL);
+        row->Add(ctrl, 0);
+        vbox->Add(row, 0, wxEXPAND);
+    };
+
+    mchoice->SetSelection(COMPARE_SHOW_DOSE + 1);
+    mchoice->Enable(false);
+    ginterp->SetSelection(2);      /* 3, as in gparams */
+    gbtn->Enable(false);
+    v.SetPrecision(1);
+    gdose->SetValidator(v);
+    gdta->SetValidator(v);
+    gcut->SetValidator(v);
+
+    hbox->Add(fbtn, 0);
+    hbox->Add(flbl, 1, wxALIGN_CENTER_VERTICAL | wxLEFT, 4);
+    vbox->Add(hbox, 0, wxEXPAND);
+    vbox->Add(mchoice, 0, wxEXPAND);
+    add_row(GAMMA_DOSELBL, gdose);
+    add_row(GAMMA_DTALBL, gdta);
+    add_row(GAMMA_CUTLBL, gcut);
+    add_row(GAMMA_INTERPLBL, ginterp);
+    vbox->Add(glocal, 0);
+    hbox = new wxBoxSizer(wxHORIZONTAL);
+    hbox->Add(gbtn, 0);
+    hbox->Add(gres, 1, wxALIGN_CENTER_VERTICAL | wxLEFT, 4);
+    vbox->Add(hbox, 0, wxEXPAND);
+    this->SetSizerAndFit(vbox);
+
+    mchoice->Bind(wxEVT_CHOICE, &CompareControl::on_evt_mode, this);
+    fbtn->Bind(wxEVT_BUTTON, &CompareControl::on_evt_button, this);
+    gdose->Bind(wxEVT_TEXT, &CompareControl::on_evt_criterion, this);
+    gdta->Bind(wxEVT_TEXT, &CompareControl::on_evt_criterion, this);
+    gcut->Bind(wxEVT_TEXT, &CompareControl::on_evt_criterion, this);
+    glocal->Bind(wxEVT_CHECKBOX, &CompareControl::on_evt_local, this);
+    ginterp->Bind(wxEVT_CHOICE, &CompareControl::on_evt_interp, this);
+    gbtn->Bind(wxEVT_BUTTON, &CompareControl::on_evt_run, this);
+}
+
+
+void CompareControl::show_dose()
+{
+    mchoice->SetSelection(COMPARE_SHOW_DOSE + 1);
+}
+
+
+void CompareControl::set_gamma_result(const ProtonGammaStats *stats)
+{
+    wxString str;
+
+    if (stats && stats->evaluated) {
+        str.Printf(wxT("%.1f%% pass, max %.2f"),
+                   100.0 * static_cast<double>(stats->passed) / static_cast<double>(stats->evaluated),
+                   static_cast<double>(stats->max));
+    }
+    gres->SetLabelText(str);
+}
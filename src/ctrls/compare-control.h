@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef COMPARE_CONTROL_H
+#define COMPARE_CONTROL_H
+
+#include <wx/wx.h>
+#include "../proton/proton-gamma.h"
+
+wxDECLARE_EVENT(EVT_COMPARE_CONTROL, wxCommandEvent);
+
+/** mode() while the dose itself is shown */
+#define COMPARE_SHOW_DOSE -1
+
+
+/** Picks a second RTDose and whether the dose, or its difference, ratio or
+ *  gamma with that one, is shown. Editing the gamma criteria does nothing
+ *  until gamma is run, since a run takes seconds */
+class CompareControl : public wxPanel {
+    wxChoice *mchoice;
+    wxButton *fbtn;
+    wxStaticText *flbl;
+
+    wxTextCtrl *gdose, *gdta, *gcut;
+    wxCheckBox *glocal;
+    wxChoice *ginterp;
+    wxButton *gbtn;
+    wxStaticText *gres;
+
+    wxString path;
+    ProtonGammaParams gparams;
+
+    static const wxArrayString &modes() noexcept;
+    static const wxArrayString &steps() noexcept;
+
+    void post_change_event();
+
+    void on_evt_mode(wxCommandEvent &e);
+    void on_evt_button(wxCommandEvent &e);
+    void on_evt_criterion(wxCommandEvent &e);
+    void on_evt_local(wxCommandEvent &e);
+    void on_evt_interp(wxCommandEvent &e);
+    void on_evt_run(wxCommandEvent &e);
+
+public:
+    CompareControl(wxWindow *parent);
+
+    /** COMPARE_SHOW_DOSE, or one of PROTON_COMPARE_* */
+    int mode() const noexcept { return mchoice->GetSelection() - 1; }
+    const wxString &file() const noexcept { return path; }
+    const ProtonGammaParams &gamma() const noexcept { return gparams; }
+
+    /** Goes back to showing the dose, without posting */
+    void show_dose();
+
+    /** Shows the pass rate of @p stats, or clears it if NULL */
+    void set_gamma_result(const ProtonGammaStats *stats);
+};
+
+
+#endif /* COMPARE_CONTROL_H */
@@ -10,9 +10,15 @@
 
 #define DEPTH_LABEL     wxT("Slice depth (mm)")
 #define DEPTH_INIT_MAX  300
+#define DEPTH_FINE      wxT("0.1 mm steps")
+#define DEPTH_FINE_SCALE 10
 
 #define VISUAL_LABEL    wxT("Parameters")
 
+#define ISODOSE_LABEL   wxT("Isodose lines (% of max)")
+#define ISODOSE_SHOW    wxT("Show isodose lines")
+#define ISODOSE_WIDTH   wxT("Line width (px)")
+
 #define GRADIENT_LABEL  wxT("Gradient")
 #define GRADIENT_SHOW   wxT("Show gradient")
 #define GRADIENT_AUTO   wxT("Automatic depth error")
@@ -27,6 +33,27 @@
 #define PLOT_YLABEL     wxT("y (mm)")
 #define PLOT_ZERO       wxT("0.00")
 #define PLOT_OPENLBL    wxT("Open plot window")
+#define SLICE_OPENLBL   wxT("Open slice window")
+#define PLOT_ADDLBL     wxT("Add MCC files...")
+
+#define PROFILE_LABEL   wxT("Lateral profile")
+#define PROFILE_STEPLBL wxT("Step (mm)")
+#define PROFILE_CROSSLBL wxT("Crossline")
+#define PROFILE_INLINELBL wxT("Inline")
+#define PROFILE_HINT    wxT("Shift and right drag on the plane to draw the profile")
+
+#define COMPARE_LABEL   wxT("Comparison")
+#define COMPARE_LOADLBL wxT("Second RTDose...")
+#define COMPARE_DLGTITLE wxT("Load an RTDose to compare with")
+#define GAMMA_DOSELBL   wxT("Dose criterion (%)")
+#define GAMMA_DOSEINIT  wxT("3.0")
+#define GAMMA_DTALBL    wxT("DTA (mm)")
+#define GAMMA_DTAINIT   wxT("3.0")
+#define GAMMA_CUTLBL    wxT("Low-dose cutoff (%)")
+#define GAMMA_CUTINIT   wxT("10.0")
+#define GAMMA_LOCALLBL  wxT("Local dose criterion")
+#define GAMMA_INTERPLBL wxT("Search steps per voxel")
+#define GAMMA_RUNLBL    wxT("Run gamma")
 
 #define DETECTOR_SHOW   wxT("Show detector window")
 #define DETECTOR_RESET  wxT("Reset")
@@ -36,6 +63,15 @@
 #define SHIFT_YLABEL    wxT("y (cm)")
 #define SHIFT_ZERO      wxT("0.00")
 
+#define CINE_LABEL      wxT("Depth sweep")
+#define CINE_PLAYLBL    wxT("Play")
+#define CINE_PAUSELBL   wxT("Pause")
+#define CINE_FPSLBL     wxT("fps")
+#define CINE_STEPLBL    wxT("Step (mm)")
+#define CINE_STEPINIT   wxT("1.0")
+#define CINE_EXPORTLBL  wxT("Export frames...")
+#define CINE_CANCELLBL  wxT("Cancel export")
+
 #define ANGLE_LABEL wxT("Window angle (degrees)")
 #define ANGLE_MIN  -450
 #define ANGLE_MAX   450
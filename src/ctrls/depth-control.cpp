@@ -1,3 +1,4 @@
+#include <cmath>
 #include "ctrl-symbols.h"
 #include "depth-control.h"
 #include <wx/valnum.h>
@@ -12,11 +13,20 @@ void DepthControl::post_change_event()
     wxPostEvent(this, e);
 }
 
-void DepthControl::on_evt_slider(wxScrollEvent &e)
+void DepthControl::write_entry()
 {
     wxString str;
-    str.Printf(wxT("%d"), e.GetInt());
+    if (scale > 1) {
+        str.Printf(wxT("%.1f"), get_value());
+    } else {
+        str.Printf(wxT("%d"), slider->GetValue());
+    }
     entry->ChangeValue(str);
+}
+
+void DepthControl::on_evt_slider(wxScrollEvent &WXUNUSED(e))
+{
+    write_entry();
     post_change_event();
 }
 
@@ -28,30 +38,47 @@ void DepthControl::on_evt_text(wxCommandEvent &e)
     if (str.IsEmpty()) {
         e.Skip();
     } else {
-        const unsigned int max = static_cast<int>(slider->GetMax());
-        unsigned long x;
-        str.ToULong(&x);
-        if (x > 0 && x <= max) {
-            slider->SetValue(static_cast<int>(x));
+        const double min = static_cast<double>(slider->GetMin()) / scale;
+        double x;
+        if (str.ToDouble(&x) && x >= min && x <= get_max()) {
+            slider->SetValue(static_cast<int>(std::lround(x * scale)));
             post_change_event();
         } else {
-            str.Printf(wxT("%d"), slider->GetValue());
-            entry->ChangeValue(str);
+            write_entry();
         }
     }
 }
 
+void DepthControl::on_evt_fine(wxCommandEvent &WXUNUSED(e))
+/** The depth is kept, rounded to the new step */
+{
+    const double x = get_value();
+
+    scale = (fine->GetValue()) ? DEPTH_FINE_SCALE : 1;
+    set_depth_range(range[0], range[1]);
+    set_value(x);
+    post_change_event();
+}
+
 DepthControl::DepthControl(wxWindow *parent):
     wxPanel(parent),
     slider(new wxSlider(this, wxID_ANY, 0, 0, DEPTH_INIT_MAX)),
-    entry(new wxTextCtrl(this, wxID_ANY, wxT("0"), wxDefaultPosition, ENTRYSZ))
+    entry(new wxTextCtrl(this, wxID_ANY, wxT("0"), wxDefaultPosition, ENTRYSZ)),
+    fine(new wxCheckBox(this, wxID_ANY, DEPTH_FINE)),
+    scale(1),
+    range{ 0.0, DEPTH_INIT_MAX }
 {
-    wxBoxSizer *hbox = new wxStaticBoxSizer(wxHORIZONTAL, this, DEPTH_LABEL);
+    wxFloatingPointValidator<double> valid8tor;
+    wxStaticBoxSizer *vbox = new wxStaticBoxSizer(wxVERTICAL, this, DEPTH_LABEL);
+    wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
     hbox->Add(slider, SLIDERSCALE);
     hbox->Add(entry, ENTRYSCALE);
-    this->SetSizerAndFit(hbox);
+    vbox->Add(hbox, wxSizerFlags().Expand());
+    vbox->Add(fine);
+    this->SetSizerAndFit(vbox);
 
-    entry->SetValidator(wxIntegerValidator<unsigned int>());
+    valid8tor.SetPrecision(1);
+    entry->SetValidator(valid8tor);
     /* entry->SetMaxLength(3); Not needed */
 
     slider->Bind(wxEVT_SCROLL_TOP, &DepthControl::on_evt_slider, this);
@@ -62,22 +89,37 @@ DepthControl::DepthControl(wxWindow *parent):
     slider->Bind(wxEVT_SCROLL_PAGEDOWN, &DepthControl::on_evt_slider, this);
     slider->Bind(wxEVT_SCROLL_THUMBTRACK, &DepthControl::on_evt_slider, this);
     entry->Bind(wxEVT_TEXT, &DepthControl::on_evt_text, this);
+    fine->Bind(wxEVT_CHECKBOX, &DepthControl::on_evt_fine, this);
 }
 
-void DepthControl::set_value(int x)
+void DepthControl::set_value(double x)
 {
-    wxString str;
-    slider->SetValue(x);
-    str.Printf(wxT("%d"), x);
-    entry->ChangeValue(str);
+    slider->SetValue(static_cast<int>(std::lround(x * scale)));
+    write_entry();
+}
+
+void DepthControl::nudge(double delta)
+{
+    const int step = static_cast<int>(std::lround(delta * scale));
+    int cur = slider->GetValue() + ((step) ? step : (delta > 0.0) - (delta < 0.0));
+    cur = std::max(slider->GetMin(), cur);
+    cur = std::min(slider->GetMax(), cur);
+    slider->SetValue(cur);
+    write_entry();
+    post_change_event();
 }
 
-void DepthControl::set_depth_range(int min, int max)
+void DepthControl::set_depth_range(double min, double max)
 {
+    const int l = static_cast<int>(std::ceil(min * scale - 1e-9));
+    const int h = static_cast<int>(std::floor(max * scale + 1e-9));
     int cur = slider->GetValue();
-    cur = std::max(min, cur);
-    cur = std::min(max, cur);
-    slider->SetMin(min);
-    slider->SetMax(max);
-    this->set_value(cur);
+    range[0] = min;
+    range[1] = max;
+    cur = std::max(l, cur);
+    cur = std::min(h, cur);
+    slider->SetMin(l);
+    slider->SetMax(h);
+    slider->SetValue(cur);
+    write_entry();
 }
@@ -8,23 +8,37 @@
 wxDECLARE_EVENT(EVT_DEPTH_CONTROL, wxCommandEvent);
 
 
+/** The slider counts whole steps of 1 mm, or 0.1 mm in fine mode, so that
+ *  depths stay exact decimals */
 class DepthControl : public wxPanel {
     wxSlider *slider;
     wxTextCtrl *entry;
+    wxCheckBox *fine;
+
+    /** Slider steps per mm, and the valid depths in mm */
+    int scale;
+    double range[2];
 
     void post_change_event();
+    void write_entry();
 
     void on_evt_slider(wxScrollEvent &e);
     void on_evt_text(wxCommandEvent &e);
+    void on_evt_fine(wxCommandEvent &e);
 
 public:
     DepthControl(wxWindow *parent);
 
-    inline int get_value() const { return slider->GetValue(); }
-    void set_value(int x);
+    inline double get_value() const { return static_cast<double>(slider->GetValue()) / scale; }
+    void set_value(double x);
+
+    /** Moves the depth by @p delta mm, clamped to the range, and posts the
+     *  change */
+    void nudge(double delta);
 
-    void set_depth_range(int low, int high);
-    inline int get_max() const { return slider->GetMax(); }
+    /** Sets the valid depths to the whole steps within [min, max] */
+    void set_depth_range(double min, double max);
+    inline double get_max() const { return static_cast<double>(slider->GetMax()) / scale; }
 };
 
 
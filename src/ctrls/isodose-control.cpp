@@ -0,0 +1,110 @@
+#include <array>
+#include "ctrl-symbols.h"
+#include "isodose-control.h"
+
+#define ISODOSE_WIDTH_INIT 1    /* Index into widths() */
+#define ISODOSE_COLUMNS 3
+
+wxDEFINE_EVENT(EVT_ISODOSE_CONTROL, wxCommandEvent);
+
+
+/** The usual planning system colours, hottest last. The levels are percent
+ *  of the dose maximum, so the hottest is just under it rather than the
+ *  planning systems' 105% of prescription, which could never be reached */
+static const struct {
+    float pct;
+    unsigned char rgb[3];
+    bool on;
+} isodose_levels[] = {
+    {  10.0f, {   0,   0, 255 }, false },
+    {  50.0f, {   0, 255, 255 }, true  },
+    {  80.0f, {   0, 255,   0 }, true  },
+    {  90.0f, { 255, 255,   0 }, true  },
+    {  95.0f, { 255, 128,   0 }, true  },
+    {  98.0f, { 255,   0, 255 }, true  }
+};
+
+
+const wxArrayString &IsodoseControl::widths() noexcept
+{
+    static const std::array<wxString, 4> widths = {
+        wxString(wxT("1")),
+        wxString(wxT("1.5")),
+        wxString(wxT("2")),
+        wxString(wxT("3"))
+    };
+    static const wxArrayString res(widths.size(), widths.data());
+
+    return res;
+}
+
+
+void IsodoseControl::post_change_event()
+{
+    wxPostEvent(this, wxCommandEvent(EVT_ISODOSE_CONTROL));
+}
+
+
+void IsodoseControl::on_evt_show(wxCommandEvent &WXUNUSED(e))
+{
+    params.show = show->GetValue();
+    post_change_event();
+}
+
+
+void IsodoseControl::on_evt_level(wxCommandEvent &WXUNUSED(e))
+{
+    size_t i;
+
+    for (i = 0; i < boxes.size(); i++) {
+        params.enabled[i] = boxes[i]->GetValue();
+    }
+    post_change_event();
+}
+
+
+void IsodoseControl::on_evt_width(wxCommandEvent &WXUNUSED(e))
+{
+    width->GetStringSelection().ToDouble(&params.width);
+    post_change_event();
+}
+
+
+IsodoseControl::IsodoseControl(wxWindow *parent):
+    wxPanel(parent),
+    show(new wxCheckBox(this, wxID_ANY, ISODOSE_SHOW)),
+    width(new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, widths()))
+{
+    wxStaticBoxSizer *vbox = new wxStaticBoxSizer(wxVERTICAL, this, ISODOSE_LABEL);
+    wxGridSizer *grid = new wxGridSizer(ISODOSE_COLUMNS);
+    wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
+    wxString str;
+
+    params.show = false;
+    for (const auto &lvl : isodose_levels) {
+        wxCheckBox *box;
+
+        str.Printf(wxT("%g"), lvl.pct);
+        box = new wxCheckBox(this, wxID_ANY, str);
+        box->SetValue(lvl.on);
+        box->SetForegroundColour(wxColour(lvl.rgb[0], lvl.rgb[1], lvl.rgb[2]));
+        box->Bind(wxEVT_CHECKBOX, &IsodoseControl::on_evt_level, this);
+        grid->Add(box);
+        boxes.push_back(box);
+        params.levels.push_back(lvl.pct);
+        params.enabled.push_back(lvl.on);
+        params.colours.emplace_back(lvl.rgb[0], lvl.rgb[1], lvl.rgb[2]);
+    }
+    width->SetSelection(ISODOSE_WIDTH_INIT);
+    width->GetStringSelection().ToDouble(&params.width);
+
+    vbox->Add(show);
+    vbox->Add(grid, 0, wxEXPAND);
+    hbox->Add(new wxStaticText(this, wxID_ANY, ISODOSE_WIDTH), 1, wxALIGN_CENTER_VERTICAL);
+    hbox->Add(width, 0);
+    vbox->Add(hbox, 0, wxEXPAND);
+    this->SetSizerAndFit(vbox);
+
+    show->Bind(wxEVT_CHECKBOX, &IsodoseControl::on_evt_show, this);
+    width->Bind(wxEVT_CHOICE, &IsodoseControl::on_evt_width, this);
+}
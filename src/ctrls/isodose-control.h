@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef ISODOSE_CONTROL_H
+#define ISODOSE_CONTROL_H
+
+#include <vector>
+#include <wx/wx.h>
+
+wxDECLARE_EVENT(EVT_ISODOSE_CONTROL, wxCommandEvent);
+
+
+/** Every level is traced whether it is drawn or not, so toggling a level
+ *  or restyling the lines only repaints */
+struct IsodoseParams {
+    bool show;
+    double width;                   /* Pixels */
+    std::vector<float> levels;      /* Percent of the dose maximum */
+    std::vector<bool> enabled;
+    std::vector<wxColour> colours;
+};
+
+
+class IsodoseControl : public wxPanel {
+    wxCheckBox *show;
+    std::vector<wxCheckBox *> boxes;
+    wxChoice *width;
+
+    IsodoseParams params;
+
+    static const wxArrayString &widths() noexcept;
+
+    void post_change_event();
+
+    void on_evt_show(wxCommandEvent &e);
+    void on_evt_level(wxCommandEvent &e);
+    void on_evt_width(wxCommandEvent &e);
+
+public:
+    IsodoseControl(wxWindow *parent);
+
+    const IsodoseParams &isodose() const noexcept { return params; }
+};
+
+
+#endif /* ISODOSE_CONTROL_H */
@@ -3,12 +3,24 @@
 #include "../main-window.h"
 #include <wx/filename.h>
 #include <wx/valnum.h>
+#include <algorithm>
+#include <cmath>
 #include <map>
 
+/* Profiles are compared with files measured within this many mm of the slice,
+and sampled at the finest detector pitch of the arrays */
+#define PROFILE_DEPTH_TOL   0.5
+#define PROFILE_MEAS_PITCH  2.5
+
+/* Rows shown before the measurement list scrolls */
+#define PLOT_MEAS_ROWS      6
+
 wxDEFINE_EVENT(EVT_PLOT_CONTROL, wxCommandEvent);
 wxDEFINE_EVENT(EVT_PLOT_OPEN, wxCommandEvent);
+wxDEFINE_EVENT(EVT_SLICE_OPEN, wxCommandEvent);
 
 wxDEFINE_EVENT(EVT_PLOTMEAS_DCHANGE, wxCommandEvent);
+wxDEFINE_EVENT(EVT_PLOTMEAS_REMOVE, wxCommandEvent);
 
 
 void PlotMeasurement::post_change_event()
@@ -29,39 +41,10 @@ static void entry_write_double(wxTextCtrl *ctrl, double x)
 
 
 void PlotMeasurement::on_evt_button(wxCommandEvent &WXUNUSED(e))
+/** Only the first click is posted */
 {
-    if (data) {
-        mcc_data_destroy(data);
-        data = nullptr;
-        btn->SetLabelText(wxT("Load"));
-        dctrl->Enable(false);
-        dctrl->ChangeValue(wxEmptyString);
-        flbl->SetLabelText(wxEmptyString);
-    } else {
-        wxFileDialog dlg(this, wxT("Load an MCC file"), wxGetApp().get_RS_directory(),
-            wxEmptyString, wxT("MCC files (*.mcc)|*.mcc"));
-        if (dlg.ShowModal() == wxID_CANCEL) {
-            return;
-        } else {
-            wxString result = dlg.GetPath();
-            wxFileName fname(result);
-            int envno;
-            data = mcc_data_create(result.c_str(), &envno);
-            if (data) {
-                btn->SetLabelText(wxT("Remove"));
-                dctrl->Enable(true);
-                flbl->SetLabelText(fname.GetName());
-                depth = wxGetApp().get_depth();
-                entry_write_double(dctrl, depth / 10.0);
-            } else {
-                wxString msg;
-                msg.Printf(wxT("Failed to load MCC file: %s"), wxString::FromUTF8(mcc_get_error(envno)));
-                wxMessageBox(msg, wxT("Load failed"), wxICON_ERROR);
-                return;
-            }
-        }
-    }
-    post_change_event();
+    btn->Disable();
+    wxPostEvent(this, wxCommandEvent(EVT_PLOTMEAS_REMOVE));
 }
 
 
@@ -85,11 +68,14 @@ void PlotMeasurement::on_evt_text(wxCommandEvent &e)
 }
 
 
-PlotMeasurement::PlotMeasurement(wxWindow *parent):
+PlotMeasurement::PlotMeasurement(wxWindow *parent, long id, const wxString &path):
     wxPanel(parent),
-    btn(new wxButton(this, wxID_ANY, wxT("Load"))),
+    btn(new wxButton(this, wxID_ANY, wxT("Remove"))),
     dctrl(new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, ENTRYSZ)),
     flbl(new wxStaticText(this, wxID_ANY, wxEmptyString)),
+    name(wxFileName(path).GetName()),
+    id(id),
+    depth(wxGetApp().get_depth()),
     data(nullptr)
 {
     wxFloatingPointValidator<double> v;
@@ -104,6 +90,7 @@ PlotMeasurement::PlotMeasurement(wxWindow *parent):
     v.SetPrecision(1);
     dctrl->SetValidator(v);
     dctrl->Enable(false);
+    flbl->SetLabelText(name + wxT(" (loading)"));
 
     btn->Bind(wxEVT_BUTTON, &PlotMeasurement::on_evt_button, this);
     dctrl->Bind(wxEVT_TEXT, &PlotMeasurement::on_evt_text, this);
@@ -116,10 +103,53 @@ PlotMeasurement::~PlotMeasurement()
 }
 
 
-void PlotControl::post_change_event()
+void PlotMeasurement::set_data(MCCData *mcc)
+/** Files without a depth are taken at the slice shown when they were added */
+{
+    mcc_data_destroy(data);
+    data = mcc;
+    if (mcc_data_get_depth(data) >= 0.0) {
+        depth = mcc_data_get_depth(data);
+    }
+    entry_write_double(dctrl, depth / 10.0);
+    dctrl->Enable(true);
+    flbl->SetLabelText(name);
+}
+
+
+bool PlotControl::MeasurementDrop::OnDropFiles(wxCoord              WXUNUSED(x),
+                                               wxCoord              WXUNUSED(y),
+                                               const wxArrayString &filenames)
+{
+    ctrl->add_files(filenames);
+    return !filenames.empty();
+}
+
+
+void PlotControl::rebuild_volume()
+{
+    std::vector<const MCCData *> planes;
+    std::vector<double> depths;
+
+    for (const PlotMeasurement *p: measurements) {
+        if (p->is_loaded()) {
+            planes.push_back(p->get_data());
+            depths.push_back(p->get_depth());
+        }
+    }
+    mcc_volume_destroy(volume);
+    volume = mcc_volume_create(planes.data(), depths.data(), static_cast<long>(planes.size()));
+}
+
+
+void PlotControl::post_change_event(int what)
 {
     wxCommandEvent e(EVT_PLOT_CONTROL);
 
+    if (what == PLOT_CHANGE_MEASUREMENT) {
+        rebuild_volume();
+    }
+    e.SetInt(what);
     wxPostEvent(this, e);
 }
 
@@ -134,7 +164,7 @@ void PlotControl::on_evt_text(wxCommandEvent &e)
     } else {
         xtxt->GetValue().ToDouble(&x);
         ytxt->GetValue().ToDouble(&y);
-        post_change_event();
+        post_change_event(PLOT_CHANGE_POINT);
     }
 }
 
@@ -144,10 +174,13 @@ PlotControl::PlotControl(wxWindow *parent):
     xtxt(new wxTextCtrl(this, wxID_ANY, PLOT_ZERO, wxDefaultPosition, ENTRYSZ)),
     ytxt(new wxTextCtrl(this, wxID_ANY, PLOT_ZERO, wxDefaultPosition, ENTRYSZ)),
     obtn(new wxButton(this, wxID_ANY, PLOT_OPENLBL)),
+    sbtn(new wxButton(this, wxID_ANY, SLICE_OPENLBL)),
+    abtn(new wxButton(this, wxID_ANY, PLOT_ADDLBL)),
+    mlist(new wxScrolledWindow(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxVSCROLL)),
     x(0.0), y(0.0),
-    measurements({new PlotMeasurement(this),
-        new PlotMeasurement(this),
-        new PlotMeasurement(this)})
+    volume(nullptr),
+    loader(this),
+    nextid(0)
 {
     wxFloatingPointValidator<double> v;
     wxBoxSizer *hbox = new wxStaticBoxSizer(wxHORIZONTAL, this, PLOT_LABEL);
@@ -156,15 +189,17 @@ PlotControl::PlotControl(wxWindow *parent):
     hbox->Add(new wxStaticText(this, wxID_ANY, PLOT_YLABEL, wxDefaultPosition, wxDefaultSize, wxALIGN_CENTRE_HORIZONTAL), 1);
     hbox->Add(ytxt, 1);
     wxBoxSizer *measbox = new wxStaticBoxSizer(wxVERTICAL, this, wxT("Measurements"));
-    for (PlotMeasurement *p: measurements) {
-        measbox->Add(p, 1, wxEXPAND);
-        p->Bind(EVT_PLOTMEAS_DCHANGE, [this](wxCommandEvent &){
-                this->post_change_event();
-            });
-    }
+    measbox->Add(abtn, 0, wxEXPAND);
+    measbox->Add(mlist, 0, wxEXPAND);
+    mlist->SetSizer(new wxBoxSizer(wxVERTICAL));
+    mlist->SetScrollRate(0, 5);
+    mlist->SetMinSize(wxSize(-1, 0));
+    wxBoxSizer *obox = new wxBoxSizer(wxHORIZONTAL);
+    obox->Add(obtn, 1, wxEXPAND);
+    obox->Add(sbtn, 1, wxEXPAND);
     wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
     vbox->Add(hbox, 0, wxEXPAND);
-    vbox->Add(obtn, 1, wxEXPAND);
+    vbox->Add(obox, 1, wxEXPAND);
     vbox->Add(measbox, 0, wxEXPAND);
     this->SetSizer(vbox);
 
@@ -179,6 +214,132 @@ PlotControl::PlotControl(wxWindow *parent):
             e.SetEventType(EVT_PLOT_OPEN);
             wxPostEvent(this, e);
         });
+    sbtn->Bind(wxEVT_BUTTON, [this](wxCommandEvent &e){
+            e.SetEventType(EVT_SLICE_OPEN);
+            wxPostEvent(this, e);
+        });
+    abtn->Bind(wxEVT_BUTTON, &PlotControl::on_evt_add, this);
+    this->Bind(EVT_MCC_LOADED, &PlotControl::on_evt_loaded, this);
+    this->SetDropTarget(new MeasurementDrop(this));
+}
+
+
+PlotControl::~PlotControl()
+{
+    mcc_volume_destroy(volume);
+}
+
+
+void PlotControl::relayout()
+{
+    const int rows = std::min(static_cast<int>(measurements.size()), PLOT_MEAS_ROWS);
+    int height = 0;
+
+    if (rows) {
+        height = rows * measurements.front()->GetBestSize().GetHeight();
+    }
+    mlist->SetMinSize(wxSize(-1, height));
+    mlist->FitInside();
+    this->Layout();
+    this->GetParent()->Layout();
+}
+
+
+void PlotControl::remove(PlotMeasurement *p)
+{
+    const bool loaded = p->is_loaded();
+
+    measurements.erase(std::find(measurements.begin(), measurements.end(), p));
+    p->Destroy();
+    relayout();
+    if (loaded) {
+        post_change_event(PLOT_CHANGE_MEASUREMENT);
+    }
+}
+
+
+void PlotControl::remove_id(long id)
+/** The entry may already be gone by the time this runs */
+{
+    auto it = std::find_if(measurements.begin(), measurements.end(),
+        [id](const PlotMeasurement *p) { return p->get_id() == id; });
+
+    if (it != measurements.end()) {
+        remove(*it);
+    }
+}
+
+
+void PlotControl::on_evt_add(wxCommandEvent &WXUNUSED(e))
+{
+    wxFileDialog dlg(this, wxT("Load MCC files"), wxGetApp().get_RS_directory(),
+                     wxEmptyString, wxT("MCC files (*.mcc)|*.mcc"),
+                     wxFD_OPEN | wxFD_FILE_MUST_EXIST | wxFD_MULTIPLE);
+    wxArrayString paths;
+
+    if (dlg.ShowModal() == wxID_CANCEL) {
+        return;
+    }
+    dlg.GetPaths(paths);
+    add_files(paths);
+}
+
+
+void PlotControl::on_evt_loaded(wxThreadEvent &WXUNUSED(e))
+/** Files removed while they were parsing are dropped here. Failures are
+ *  reported together, one message for the batch */
+{
+    std::vector<MCCLoaded> done;
+    wxString errs;
+    bool changed = false;
+
+    if (!loader.collect(done)) {
+        return;
+    }
+    for (const MCCLoaded &res: done) {
+        auto it = std::find_if(measurements.begin(), measurements.end(),
+            [&res](const PlotMeasurement *p) { return p->get_id() == res.id; });
+        if (it == measurements.end()) {
+            mcc_data_destroy(res.data);
+        } else if (res.data) {
+            (*it)->set_data(res.data);
+            changed = true;
+        } else {
+            errs += wxString::Format(wxT("%s: %s\n"), (*it)->get_name(),
+                                     wxString::FromUTF8(mcc_get_error(res.stat)));
+            remove(*it);
+        }
+    }
+    if (changed) {
+        post_change_event(PLOT_CHANGE_MEASUREMENT);
+    }
+    if (!errs.IsEmpty()) {
+        wxMessageBox(wxT("Failed to load MCC files:\n") + errs, wxT("Load failed"), wxICON_ERROR);
+    }
+}
+
+
+void PlotControl::add_files(const wxArrayString &paths)
+{
+    PlotMeasurement *p;
+
+    for (const wxString &path: paths) {
+        if (!wxFileName(path).GetExt().IsSameAs(wxT("mcc"), false)) {
+            continue;
+        }
+        p = new PlotMeasurement(mlist, nextid, path);
+        p->Bind(EVT_PLOTMEAS_DCHANGE, [this](wxCommandEvent &){
+                this->post_change_event(PLOT_CHANGE_MEASUREMENT);
+            });
+        /* Not while p is still dispatching */
+        p->Bind(EVT_PLOTMEAS_REMOVE, [this, id = nextid](wxCommandEvent &){
+                this->CallAfter(&PlotControl::remove_id, id);
+            });
+        mlist->GetSizer()->Add(p, 0, wxEXPAND);
+        measurements.push_back(p);
+        loader.submit(nextid++, path);
+    }
+    relayout();
 }
 
 
@@ -192,20 +353,25 @@ void PlotControl::set_point(double x, double y)
     xtxt->ChangeValue(str);
     str.Printf(wxT("%.2f"), y);
     ytxt->ChangeValue(str);
-    post_change_event();
+    post_change_event(PLOT_CHANGE_POINT);
 }
 
 
 void PlotControl::get_ld_measurements(std::vector<std::tuple<double, double>> &meas) const
 {
     double mccx = this->x, mccy = this->y;
+    std::vector<double> dose;
+    long k;
 
-    wxGetApp().convert_coordinates(&mccx, &mccy);
     meas.clear();
-    for (const PlotMeasurement *p: measurements) {
-        if (p->is_loaded()) {
-            meas.push_back({p->get_depth(), p->get_dose(mccx, mccy)});
-        }
+    if (!volume) {
+        return;
+    }
+    wxGetApp().convert_coordinates(&mccx, &mccy);
+    dose.resize(mcc_volume_planes(volume));
+    mcc_volume_depth_dose(volume, mccx, mccy, dose.data());
+    for (k = 0; k < mcc_volume_planes(volume); k++) {
+        meas.push_back({mcc_volume_depth(volume, k), dose[k]});
     }
 }
 
@@ -241,3 +407,43 @@ void PlotControl::get_sp_measurements(std::vector<std::tuple<double, double>> &m
         }
     }
 }
+
+
+void PlotControl::get_profile_measurements(const ProtonProfile &prof, float depth,
+                                           std::vector<std::tuple<double, double>> &meas) const
+/** The array reads zero off its detectors, and those samples are left out */
+{
+    const double len = proton_profile_length(&prof);
+    const long n = static_cast<long>(std::floor(len / PROFILE_MEAS_PITCH)) + 1;
+    double x, y, t, dose;
+    long i, k, lo, hi;
+
+    meas.clear();
+    if (!volume) {
+        return;
+    }
+    /* The planes are in depth order, so those near the slice are a run */
+    lo = 0;
+    while (lo < mcc_volume_planes(volume) && mcc_volume_depth(volume, lo) < depth - PROFILE_DEPTH_TOL) {
+        lo++;
+    }
+    hi = lo;
+    while (hi < mcc_volume_planes(volume) && mcc_volume_depth(volume, hi) <= depth + PROFILE_DEPTH_TOL) {
+        hi++;
+    }
+    if (lo == hi) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        t = static_cast<double>(i) * PROFILE_MEAS_PITCH;
+        x = (len > 0.0) ? prof.start[0] + (prof.end[0] - prof.start[0]) * t / len : prof.start[0];
+        y = (len > 0.0) ? prof.start[1] + (prof.end[1] - prof.start[1]) * t / len : prof.start[1];
+        wxGetApp().convert_coordinates(&x, &y);
+        for (k = lo; k < hi; k++) {
+            dose = mcc_volume_plane_dose(volume, k, x, y);
+            if (dose != 0.0) {
+                meas.push_back({t, dose});
+            }
+        }
+    }
+}
@@ -3,22 +3,34 @@
 #ifndef PLOT_CONTROL_H
 #define PLOT_CONTROL_H
 
-#include <array>
 #include <tuple>
 #include <vector>
 #include <wx/wx.h>
+#include <wx/dnd.h>
 /* #include <wx/spinctrl.h> */
-#include "../proton/mcc-data.h"
+#include "../mcc-loader.h"
+#include "../proton/mcc-volume.h"
+#include "../proton/proton-profile.h"
 
 wxDECLARE_EVENT(EVT_PLOT_CONTROL, wxCommandEvent);
 wxDECLARE_EVENT(EVT_PLOT_OPEN, wxCommandEvent);
+wxDECLARE_EVENT(EVT_SLICE_OPEN, wxCommandEvent);
+
+/** EVT_PLOT_CONTROL carries one of these in its integer */
+enum {
+    PLOT_CHANGE_POINT = 0,      /* Line dose crosshair moved */
+    PLOT_CHANGE_MEASUREMENT     /* MCC file or measurement depth changed */
+};
 
 
+/** One MCC file, shown as loading until its data arrives from the loader */
 class PlotMeasurement : public wxPanel {
     wxButton *btn;
     wxTextCtrl *dctrl;
     wxStaticText *flbl;
     
+    wxString name;
+    long id;
     double depth;
     MCCData *data;
 
@@ -28,11 +40,16 @@ class PlotMeasurement : public wxPanel {
     void on_evt_text(wxCommandEvent &e);
 
 public:
-    PlotMeasurement(wxWindow *parent);
+    PlotMeasurement(wxWindow *parent, long id, const wxString &path);
     ~PlotMeasurement();
 
+    /** Takes ownership of @p mcc, and its depth if the file has one */
+    void set_data(MCCData *mcc);
+
+    constexpr long get_id() const noexcept { return id; }
+    const wxString &get_name() const noexcept { return name; }
     constexpr bool is_loaded() const noexcept { return data != nullptr; }
-    inline double get_dose(double x, double y) const noexcept { return mcc_data_get_point_dose(data, x, y); }
+    constexpr const MCCData *get_data() const noexcept { return data; }
     constexpr double get_depth() const noexcept { return depth; }
     inline double get_sum() const noexcept { return mcc_data_get_sum(data); }
     inline long get_supp() const noexcept { return mcc_data_get_supp(data); }
@@ -41,25 +58,61 @@ public:
 
 class PlotControl : public wxPanel {
     wxTextCtrl *xtxt, *ytxt;
-    wxButton *obtn;
+    wxButton *obtn, *sbtn, *abtn;
+    wxScrolledWindow *mlist;
     double x, y;
 
-    std::array<PlotMeasurement *, 3> measurements;
+    std::vector<PlotMeasurement *> measurements;
+    MCCVolume *volume;
+    MCCLoader loader;
+    long nextid;
 
-    void post_change_event();
+    class MeasurementDrop : public wxFileDropTarget {
+        PlotControl *ctrl;
+
+    public:
+        MeasurementDrop(PlotControl *ctrl): ctrl(ctrl) { }
+
+        virtual bool OnDropFiles(wxCoord              WXUNUSED(x),
+                                 wxCoord              WXUNUSED(y),
+                                 const wxArrayString &filenames)
+            override;
+    };
+
+    /** Restacks the loaded files before posting PLOT_CHANGE_MEASUREMENT */
+    void post_change_event(int what);
+    void rebuild_volume();
+
+    /** Fits the list to its rows, up to a few of them */
+    void relayout();
+    void remove(PlotMeasurement *p);
+    void remove_id(long id);
 
     void on_evt_text(wxCommandEvent &e);
+    void on_evt_add(wxCommandEvent &e);
+    void on_evt_loaded(wxThreadEvent &e);
 
 public:
     PlotControl(wxWindow *parent);
+    ~PlotControl();
+
+    /** Adds a measurement for each MCC file in @p paths, parsed in the
+     *  background. Anything else is ignored */
+    void add_files(const wxArrayString &paths);
 
     void get_point(double *x, double *y) const noexcept { *x = this->x; *y = this->y; }
     void set_point(double x, double y);
 
+    /** (depth, dose) of every loaded file at the crosshair, by depth */
     void get_ld_measurements(std::vector<std::tuple<double, double>> &meas) const;
     /** YOU **MUST** REWRITE vv THIS vv **/
     void get_pd_measurements(std::vector<std::tuple<double, double>> &meas) const;
     void get_sp_measurements(std::vector<std::tuple<double, double>> &meas) const;
+
+    /** (position along @p prof in mm, dose) of the files measured at the
+     *  slice @p depth, every detector pitch */
+    void get_profile_measurements(const ProtonProfile &prof, float depth,
+                                  std::vector<std::tuple<double, double>> &meas) const;
 };
 
 
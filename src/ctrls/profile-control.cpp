@@ -0,0 +1,102 @@
+#include <array>
+#include "ctrl-symbols.h"
+#include "../main-window.h"
+
+#define PROFILE_STEP_INIT 2     /* Index into steps() */
+
+wxDEFINE_EVENT(EVT_PROFILE_CONTROL, wxCommandEvent);
+
+
+const wxArrayString &ProfileControl::steps() noexcept
+{
+    static const std::array<wxString, 5> steps = {
+        wxString(wxT("0.1")),
+        wxString(wxT("0.25")),
+        wxString(wxT("0.5")),
+        wxString(wxT("1")),
+        wxString(wxT("2"))
+    };
+    static const wxArrayString res(steps.size(), steps.data());
+
+    return res;
+}
+
+
+void ProfileControl::post_change_event()
+{
+    wxPostEvent(this, wxCommandEvent(EVT_PROFILE_CONTROL));
+}
+
+
+void ProfileControl::on_evt_step(wxCommandEvent &WXUNUSED(e))
+{
+    step->GetStringSelection().ToDouble(&prof.step);
+    post_change_event();
+}
+
+
+ProfileControl::ProfileControl(wxWindow *parent):
+    wxPanel(parent),
+    step(new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, steps())),
+    xbtn(new wxButton(this, wxID_ANY, PROFILE_CROSSLBL)),
+    zbtn(new wxButton(this, wxID_ANY, PROFILE_INLINELBL))
+{
+    wxStaticBoxSizer *vbox = new wxStaticBoxSizer(wxVERTICAL, this, PROFILE_LABEL);
+    wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
+    wxBoxSizer *bbox = new wxBoxSizer(wxHORIZONTAL);
+
+    prof.start[0] = prof.start[1] = 0.0;
+    prof.end[0] = prof.end[1] = 0.0;
+    step->SetSelection(PROFILE_STEP_INIT);
+    step->GetStringSelection().ToDouble(&prof.step);
+    this->SetToolTip(PROFILE_HINT);
+
+    hbox->Add(new wxStaticText(this, wxID_ANY, PROFILE_STEPLBL), 1, wxALIGN_CENTER_VERTICAL);
+    hbox->Add(step, 0);
+    bbox->Add(xbtn, 1, wxEXPAND);
+    bbox->Add(zbtn, 1, wxEXPAND);
+    vbox->Add(hbox, 0, wxEXPAND);
+    vbox->Add(bbox, 0, wxEXPAND);
+    this->SetSizerAndFit(vbox);
+
+    step->Bind(wxEVT_CHOICE, &ProfileControl::on_evt_step, this);
+    xbtn->Bind(wxEVT_BUTTON, [this](wxCommandEvent &){ this->span(DOSE_LR); });
+    zbtn->Bind(wxEVT_BUTTON, [this](wxCommandEvent &){ this->span(DOSE_SI); });
+}
+
+
+void ProfileControl::set_segment(const double start[], const double end[])
+{
+    prof.start[0] = start[0];
+    prof.start[1] = start[1];
+    prof.end[0] = end[0];
+    prof.end[1] = end[1];
+    post_change_event();
+}
+
+
+void ProfileControl::span(int dim)
+/** The crosshair's other coordinate fixes the line, which runs between the
+ *  outermost nodes of the grid */
+{
+    const ProtonDose *dose;
+    double x, y, lo, hi;
+
+    if (!wxGetApp().dose_loaded()) {
+        return;
+    }
+    dose = wxGetApp().get_dose();
+    wxGetApp().get_line_dose(&x, &y);
+    lo = proton_dose_origin(dose, dim);
+    hi = lo + static_cast<double>(proton_dose_dimension(dose, dim) - 1) * proton_dose_spacing(dose, dim);
+    if (dim == DOSE_LR) {
+        prof.start[0] = lo;
+        prof.end[0] = hi;
+        prof.start[1] = prof.end[1] = y;
+    } else {
+        prof.start[0] = prof.end[0] = x;
+        prof.start[1] = lo;
+        prof.end[1] = hi;
+    }
+    post_change_event();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef PROFILE_CONTROL_H
+#define PROFILE_CONTROL_H
+
+#include <wx/wx.h>
+#include "../proton/proton-profile.h"
+
+wxDECLARE_EVENT(EVT_PROFILE_CONTROL, wxCommandEvent);
+
+
+/** The segment of the lateral profile plot. It is drawn on the plane with
+ *  Shift and the right button, or spanned across the grid through the line
+ *  dose crosshair by the buttons */
+class ProfileControl : public wxPanel {
+    wxChoice *step;
+    wxButton *xbtn, *zbtn;
+
+    ProtonProfile prof;
+
+    static const wxArrayString &steps() noexcept;
+
+    void post_change_event();
+
+    void on_evt_step(wxCommandEvent &e);
+
+public:
+    ProfileControl(wxWindow *parent);
+
+    const ProtonProfile &profile() const noexcept { return prof; }
+    void set_segment(const double start[], const double end[]);
+
+    /** Spans the grid along @p dim, DOSE_LR or DOSE_SI, through the line dose
+     *  crosshair */
+    void span(int dim);
+};
+
+
+#endif /* PROFILE_CONTROL_H */
@@ -5,10 +5,11 @@
 wxDEFINE_EVENT(EVT_SHIFT_CONTROL, wxCommandEvent);
 
 
-void ShiftControl::post_change_event()
+void ShiftControl::post_change_event(int what)
 {
     wxCommandEvent e(EVT_SHIFT_CONTROL);
 
+    e.SetInt(what);
     wxPostEvent(this, e);
 }
 
@@ -23,7 +24,7 @@ void ShiftControl::write_trig_functions(double degrees) noexcept
 
 void ShiftControl::on_evt_checkbox(wxCommandEvent &WXUNUSED(e))
 {
-    post_change_event();
+    post_change_event(SHIFT_CHANGE_DETECTOR);
 }
 
 
@@ -7,6 +7,12 @@
 
 wxDECLARE_EVENT(EVT_SHIFT_CONTROL, wxCommandEvent);
 
+/** EVT_SHIFT_CONTROL carries one of these in its integer */
+enum {
+    SHIFT_CHANGE_AFFINE = 0,    /* Translation or rotation changed */
+    SHIFT_CHANGE_DETECTOR       /* Detector window shown or hidden */
+};
+
 
 class ShiftControl : public wxPanel {
     wxCheckBox *enabld;
@@ -17,7 +23,7 @@ class ShiftControl : public wxPanel {
     double x, y;
     double cos, sin;
 
-    void post_change_event();
+    void post_change_event(int what = SHIFT_CHANGE_AFFINE);
 
     void write_trig_functions(double degrees) noexcept;
 
@@ -25,15 +25,17 @@ const wxArrayString &VisualControl::choices() noexcept
 }
 
 
-void VisualControl::set_auto_error()
+bool VisualControl::set_auto_error()
 {
-    double depth;
-    wxString str;
+    float err;
 
-    depth = wxGetApp().get_depth();
-    params.depth_err = proton_buildup_err(depth);
+    err = static_cast<float>(proton_buildup_err(wxGetApp().get_depth()));
+    if (err == params.depth_err) {
+        return false;
+    }
+    params.depth_err = err;
     write_err();
-    post_changed_event();
+    return true;
 }
 
 
@@ -61,15 +63,21 @@ void VisualControl::write_err()
 }
 
 
-void VisualControl::on_evt_checkbox(wxCommandEvent &)
+void VisualControl::write_colormap()
 {
     if (cbox->GetValue()) {
         params.colormap = proton_cmap_gradient;
         params.type = ProtonPlaneParams::PROTON_IMG_GRAD;
     } else {
-        params.colormap = proton_colormap;
+        params.colormap = (sgn) ? proton_cmap_diverging : proton_colormap;
         params.type = ProtonPlaneParams::PROTON_IMG_DOSE;
     }
+}
+
+
+void VisualControl::on_evt_checkbox(wxCommandEvent &)
+{
+    write_colormap();
     post_changed_event();
 }
 
@@ -109,8 +117,11 @@ void VisualControl::on_evt_difftext(wxCommandEvent &e)
     } else {
         str.ToDouble(&x);
         if (x <= range[1] && x >= range[0]) {
-            params.pct_diff = x / 100.0;
-            post_changed_event();
+            const float pct = static_cast<float>(x / 100.0);
+            if (pct != params.pct_diff) {
+                params.pct_diff = pct;
+                post_changed_event();
+            }
         } else {
             write_diff();
         }
@@ -130,8 +141,10 @@ void VisualControl::on_evt_errtext(wxCommandEvent &e)
     } else {
         str.ToDouble(&x);
         if (x <= range[1] && x >= range[0]) {
-            params.depth_err = x;
-            post_changed_event();
+            if (static_cast<float>(x) != params.depth_err) {
+                params.depth_err = static_cast<float>(x);
+                post_changed_event();
+            }
         } else {
             write_err();
         }
@@ -148,6 +161,7 @@ VisualControl::VisualControl(wxWindow *parent):
     derr(new wxTextCtrl(this, wxID_ANY, GRAD_ERRINIT,
                         wxDefaultPosition, ENTRYSZ)),
     autocalc(new wxCheckBox(this, wxID_ANY, GRADIENT_AUTO)),
+    sgn(false),
     params({
         ProtonPlaneParams::PROTON_IMG_DOSE,
         proton_colormap,
@@ -198,9 +212,17 @@ VisualControl::VisualControl(wxWindow *parent):
 }
 
 
-void VisualControl::on_depth_changed(wxCommandEvent &)
+bool VisualControl::on_depth_changed()
+/** The depth error only scales the gradient, so the plane is unaffected by it
+ *  while the dose is shown */
 {
-    if (automatic()) {
-        set_auto_error();
-    }
+    return automatic() && set_auto_error()
+        && params.type == ProtonPlaneParams::PROTON_IMG_GRAD;
+}
+
+
+void VisualControl::set_signed(bool x)
+{
+    sgn = x;
+    write_colormap();
 }
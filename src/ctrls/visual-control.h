@@ -19,6 +19,7 @@ class VisualControl: public wxPanel {
     wxTextCtrl *diff, *derr;
     wxCheckBox *autocalc;
 
+    bool sgn;
     ProtonPlaneParams params;
 
     static const wxArrayString &choices() noexcept;
@@ -26,8 +27,8 @@ class VisualControl: public wxPanel {
     bool automatic() noexcept { return autocalc->GetValue(); }
 
     /** Fetches the current depth, computes the error, and writes it out to the
-     *  text box */
-    void set_auto_error();
+     *  text box. Returns true if the error changed */
+    bool set_auto_error();
 
     void post_changed_event();
 
@@ -39,6 +40,9 @@ class VisualControl: public wxPanel {
      *  it automatically updates or needs to be reset */
     void write_err();
 
+    /** Picks the colormap for the checkbox and the sign of the dose */
+    void write_colormap();
+
     void on_evt_checkbox(wxCommandEvent &e);
     void on_evt_reset(wxCommandEvent &e);
     void on_evt_automatic(wxCommandEvent &e);
@@ -48,9 +52,14 @@ class VisualControl: public wxPanel {
 public:
     VisualControl(wxWindow *parent);
 
-    void on_depth_changed(wxCommandEvent &e);
+    /** Returns true if the rendered plane changed, instead of posting */
+    bool on_depth_changed();
 
     const ProtonPlaneParams &visuals() const noexcept { return params; }
+
+    /** A signed dose, such as a comparison, is drawn with a diverging
+     *  colormap. The caller redraws */
+    void set_signed(bool x);
 };
 
 
@@ -1,18 +1,79 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
 #include "main-window.h"
+#include <wx/filename.h>
 #include <wx/graphics.h>
+#include <wx/rawbmp.h>
+#include <wx/stopwatch.h>
 #include "proton-aux.h"
+#include "proton/proton-contour.h"
+#include "proton/proton-trace.h"
+
+#define STATS_MAX 32
+#define STATS_PERIOD 500
+
+/* Zoom limit relative to the fitted plane, and the factor per wheel notch */
+#define ZOOM_MAX 32.0
+#define ZOOM_STEP 1.25
+
+/* Tile edge and preview reduction in pixels, and the rendering time spent
+per idle event in ms */
+#define TILE_SIZE 128
+#define PREVIEW_SCALE 4
+#define TILE_BUDGET 8
+
+/* A cine frame taking more than the first fraction of the period halves the
+resolution, one taking less than the second doubles it again. A quarter of
+the pixels renders in about a quarter of the time, so the two are far enough
+apart not to oscillate */
+#define CINE_SLOW 0.75
+#define CINE_FAST 0.15
+
+/* Isodose depths kept, and how far a simplified line may stray from the
+traced one, in voxels */
+#define ISODOSE_CACHE 8
+#define ISODOSE_TOLERANCE 0.2
+
+enum {
+    ID_STATS_TIMER = wxID_HIGHEST + 1,
+    ID_CINE_TIMER
+};
+
+
+/** The renderer writes straight into the bitmap's native 32-bit layout */
+static constexpr int native_format()
+{
+    return (wxAlphaPixelFormat::RED == 2 && wxAlphaPixelFormat::BLUE == 0)
+        ? PROTON_PX_BGRA32
+        : PROTON_PX_RGBA32;
+}
 
 
 bool DoseWindow::DoseDragNDrop::OnDropFiles(wxCoord              WXUNUSED(x),
                                             wxCoord              WXUNUSED(y),
                                             const wxArrayString &filenames)
+/** MCC files go to the measurements, and the rest are loaded as doses */
 {
-    if (filenames.size() != 1) {
-        return false;
-    } else {
-        wxGetApp().dropped_file(filenames[0]);
-        return true;
+    wxArrayString doses, mccs;
+
+    for (const wxString &path: filenames) {
+        if (wxFileName(path).GetExt().IsSameAs(wxT("mcc"), false)) {
+            mccs.Add(path);
+        } else {
+            doses.Add(path);
+        }
+    }
+    if (!mccs.empty()) {
+        wxGetApp().dropped_measurements(mccs);
     }
+    if (doses.size() == 1) {
+        wxGetApp().dropped_file(doses[0]);
+    } else if (doses.size() > 1) {
+        wxGetApp().dropped_files(doses);
+    }
+    return !filenames.empty();
 }
 
 
@@ -27,8 +88,10 @@ void DoseWindow::paint_detector(wxPaintDC &dc)
     wxGraphicsContext *gc;
     
     gc = wxGraphicsContext::Create(dc);
+    gc->Clip(0.0, 0.0, static_cast<double>(proton_image_dimension(img, 0)),
+             static_cast<double>(proton_image_dimension(img, 1)));
     gc->Scale(conv[0], conv[1]);
-    gc->Translate(-proton_dose_origin(dose, 0), -proton_dose_origin(dose, 2));
+    gc->Translate(-view[0], -view[1]);
     gc->SetPen(*wxBLACK_PEN);
     gc->PushState();
     gc->ConcatTransform(gc->CreateMatrix(
@@ -66,28 +129,160 @@ void DoseWindow::paint_detector(wxPaintDC &dc)
 }
 
 
+void DoseWindow::paint_isodose(wxPaintDC &dc)
+/** Drawn in mm like the detector. The pens are narrowed by the view's scale
+ *  so the lines keep their width in pixels at any zoom */
+{
+    const IsodoseParams &iso = wxGetApp().isodose();
+    const isodose_lines *lines = isodose_at(wxGetApp().get_depth());
+    wxGraphicsContext *gc;
+    size_t i;
+
+    if (!lines) {
+        return;
+    }
+    gc = wxGraphicsContext::Create(dc);
+    gc->Clip(0.0, 0.0, static_cast<double>(proton_image_dimension(img, 0)),
+             static_cast<double>(proton_image_dimension(img, 1)));
+    gc->Scale(conv[0], conv[1]);
+    gc->Translate(-view[0], -view[1]);
+    for (i = 0; i < lines->paths.size(); i++) {
+        if (iso.enabled[i]) {
+            gc->SetPen(gc->CreatePen(wxGraphicsPenInfo(iso.colours[i]).Width(iso.width / conv[0])));
+            gc->StrokePath(lines->paths[i]);
+        }
+    }
+    delete gc;
+}
+
+
+void DoseWindow::paint_profile(wxPaintDC &dc)
+/** The segment, in mm like the detector, with a tick across its start so
+ *  the direction of the distance axis shows */
+{
+    constexpr double tick = 3.0;
+    const ProtonProfile &prof = wxGetApp().profile();
+    const double len = proton_profile_length(&prof);
+    wxGraphicsContext *gc;
+    wxGraphicsPath p;
+    double nx, nz;
+
+    if (!(len > 0.0)) {
+        return;
+    }
+    nx = -(prof.end[1] - prof.start[1]) / len * tick;
+    nz = (prof.end[0] - prof.start[0]) / len * tick;
+    gc = wxGraphicsContext::Create(dc);
+    gc->Clip(0.0, 0.0, static_cast<double>(proton_image_dimension(img, 0)),
+             static_cast<double>(proton_image_dimension(img, 1)));
+    gc->Scale(conv[0], conv[1]);
+    gc->Translate(-view[0], -view[1]);
+    gc->SetPen(gc->CreatePen(wxGraphicsPenInfo(*wxWHITE).Width(1.0 / conv[0])));
+    p = gc->CreatePath();
+    p.MoveToPoint(prof.start[0], prof.start[1]);
+    p.AddLineToPoint(prof.end[0], prof.end[1]);
+    p.MoveToPoint(prof.start[0] - nx, prof.start[1] - nz);
+    p.AddLineToPoint(prof.start[0] + nx, prof.start[1] + nz);
+    gc->StrokePath(p);
+    delete gc;
+}
+
+
 void DoseWindow::paint_bitmap(wxPaintDC &dc)
+/** While tiles are pending, the preview is stretched over the whole image
+ *  and the finished tiles are drawn over it */
 {
+    wxMemoryDC mdc;
     wxSize psz;
 
     psz = wxSize(proton_image_dimension(img, 0),
                  proton_image_dimension(img, 1));
     dc.SetClippingRegion(origin, psz);
     dc.SetDeviceOrigin(origin.x, origin.y);
-    dc.DrawBitmap(wxImage(psz, proton_image_raw(img), true), 0, 0);
+    if (cine_playing() && cinebmp.IsOk()) {
+        mdc.SelectObjectAsSource(cinebmp);
+        dc.StretchBlit(0, 0, psz.GetWidth(), psz.GetHeight(), &mdc, 0, 0,
+                       cinebmp.GetWidth(), cinebmp.GetHeight());
+        mdc.SelectObject(wxNullBitmap);
+    } else if (pending.empty()) {
+        dc.DrawBitmap(bmp, 0, 0);
+    } else {
+        mdc.SelectObjectAsSource(preview);
+        dc.StretchBlit(0, 0, psz.GetWidth(), psz.GetHeight(), &mdc, 0, 0,
+                       preview.GetWidth(), preview.GetHeight());
+        mdc.SelectObjectAsSource(bmp);
+        for (wxRegionIterator r(finished); r; ++r) {
+            dc.Blit(r.GetX(), r.GetY(), r.GetW(), r.GetH(), &mdc, r.GetX(), r.GetY());
+        }
+        mdc.SelectObject(wxNullBitmap);
+    }
+}
+
+
+void DoseWindow::paint_stats(wxPaintDC &dc)
+/** Drawn in window coordinates over everything else. The text is set in a
+ *  fixed pitch font so that the columns line up. The compute graph's
+ *  outputs follow the spans, with how often each ran and what it reads */
+{
+    ProtonTraceStat stats[STATS_MAX];
+    const size_t n = proton_trace_stats(stats, STATS_MAX);
+    std::vector<wxString> lines(n + 1);
+    const wxArrayString graph = wxSplit(wxGetApp().graph_stats().Trim(), wxT('\n'));
+    wxGraphicsContext *gc;
+    double w = 0.0, h = 0.0, lw, lh;
+    size_t i;
+
+    lines[0] = wxT("span                     calls   last ms   mean ms    max ms");
+    for (i = 0; i < n; i++) {
+        lines[i + 1].Printf(wxT("%-22s %7lu %9.2f %9.2f %9.2f"),
+                            wxString::FromUTF8(stats[i].name), stats[i].count,
+                            stats[i].last, stats[i].mean, stats[i].max);
+    }
+    lines.push_back(wxEmptyString);
+    lines.push_back(wxString::Format(wxT("%-24s %8s  %s"), wxT("graph output"), wxT("runs"), wxT("(inputs)")));
+    for (const wxString &line : graph) {
+        lines.push_back(line);
+    }
+    dc.DestroyClippingRegion();
+    dc.SetDeviceOrigin(0, 0);
+    gc = wxGraphicsContext::Create(dc);
+    gc->SetFont(wxFont(wxFontInfo(8).Family(wxFONTFAMILY_TELETYPE)), *wxWHITE);
+    for (const wxString &line : lines) {
+        gc->GetTextExtent(line, &lw, &lh);
+        w = std::max(w, lw);
+        h = std::max(h, lh);
+    }
+    gc->SetPen(*wxTRANSPARENT_PEN);
+    gc->SetBrush(wxBrush(wxColour(0, 0, 0, 170)));
+    gc->DrawRectangle(4.0, 4.0, w + 8.0, h * static_cast<double>(lines.size()) + 8.0);
+    for (i = 0; i < lines.size(); i++) {
+        gc->DrawText(lines[i], 8.0, 8.0 + h * static_cast<double>(i));
+    }
+    delete gc;
 }
 
 
 void DoseWindow::on_paint(wxPaintEvent &WXUNUSED(e))
 {
+    PROTON_TRACE_SCOPE("dose window paint");
     wxPaintDC dc(this);
 
     if (dose_loaded() && !proton_image_empty(img)) {
         paint_bitmap(dc);
+        /* Every cine frame is a new depth, which would only keep the tracer
+        busy with depths gone before their lines arrive. The lines come back
+        with the depth update when playback stops */
+        if (wxGetApp().isodose().show && !cine_playing()) {
+            paint_isodose(dc);
+        }
+        paint_profile(dc);
         if (wxGetApp().detector_enabled()) {
             paint_detector(dc);
         }
     }
+    if (showstats) {
+        paint_stats(dc);
+    }
 }
 
 
@@ -96,7 +291,6 @@ void DoseWindow::on_size(wxSizeEvent &e)
     if (dose_loaded()) {
         image_realloc_and_write(e.GetSize());
         affine_write();
-        conv_write();
     }
 }
 
@@ -109,14 +303,7 @@ void DoseWindow::on_lmb(wxMouseEvent &e)
     if (dose_loaded()) {
         p = e.GetPosition();
         if (point_in_dose(p)) {
-            /* const double conv[2] = {
-                static_cast<double>(proton_image_dimension(img, 0)) / proton_dose_width(dose, 0),
-                static_cast<double>(proton_image_dimension(img, 1)) / proton_dose_width(dose, 2)
-            }; */
-            p.x -= origin.x;
-            p.y -= origin.y;
-            x = static_cast<double>(p.x) / conv[0] + proton_dose_origin(dose, 0);
-            y = static_cast<double>(p.y) / conv[1] + proton_dose_origin(dose, 2);
+            point_to_dose(p, &x, &y);
             wxGetApp().set_translation(x, y);
         }
     }
@@ -125,6 +312,8 @@ void DoseWindow::on_lmb(wxMouseEvent &e)
 
 
 void DoseWindow::on_rmb(wxMouseEvent &e)
+/** With Shift held, the press anchors the profile segment and dragging
+ *  moves its end */
 {
     double x, y;
     wxPoint p;
@@ -132,15 +321,16 @@ void DoseWindow::on_rmb(wxMouseEvent &e)
     if (dose_loaded()) {
         p = e.GetPosition();
         if (point_in_dose(p)) {
-            /* const double conv[2] = {
-                static_cast<double>(proton_image_dimension(img, 0)) / proton_dose_width(dose, 0),
-                static_cast<double>(proton_image_dimension(img, 1)) / proton_dose_width(dose, 2)
-            }; */
-            p.x -= origin.x;
-            p.y -= origin.y;
-            x = static_cast<double>(p.x) / conv[0] + proton_dose_origin(dose, 0);
-            y = static_cast<double>(p.y) / conv[1] + proton_dose_origin(dose, 2);
-            wxGetApp().set_line_dose(x, y);
+            point_to_dose(p, &x, &y);
+            if (!e.ShiftDown()) {
+                wxGetApp().set_line_dose(x, y);
+            } else if (e.RightDown()) {
+                profanchor[0] = x;
+                profanchor[1] = y;
+            } else {
+                const double end[2] = { x, y };
+                wxGetApp().set_profile(profanchor, end);
+            }
         }
     }
     e.Skip();
@@ -153,16 +343,150 @@ void DoseWindow::on_motion(wxMouseEvent &e)
         on_lmb(e);
     } else if (e.RightIsDown()) {
         on_rmb(e);
+    } else if (e.MiddleIsDown() && dose_loaded()) {
+        const wxPoint p = e.GetPosition();
+        center[0] -= static_cast<double>(p.x - panfrom.x) / conv[0];
+        center[1] -= static_cast<double>(p.y - panfrom.y) / conv[1];
+        panfrom = p;
+        view_changed();
     } else {
         e.Skip();
     }
 }
 
 
-void DoseWindow::conv_write()
+void DoseWindow::on_mmb(wxMouseEvent &e)
+{
+    panfrom = e.GetPosition();
+    e.Skip();
+}
+
+
+void DoseWindow::on_mmb_dclick(wxMouseEvent &e)
+{
+    if (dose_loaded()) {
+        view_reset();
+        view_changed();
+    }
+    e.Skip();
+}
+
+
+void DoseWindow::on_wheel(wxMouseEvent &e)
+/** Zooms about the dose point under the cursor, which stays put unless the
+ *  view would leave the plane */
+{
+    const wxPoint p = e.GetPosition();
+    double x, y, z;
+
+    if (!dose_loaded() || proton_image_empty(img) || !e.GetWheelDelta()) {
+        e.Skip();
+        return;
+    }
+    z = zoom * std::pow(ZOOM_STEP, static_cast<double>(e.GetWheelRotation())
+                                 / static_cast<double>(e.GetWheelDelta()));
+    z = std::min(std::max(z, 1.0), ZOOM_MAX);
+    if (point_in_dose(p)) {
+        point_to_dose(p, &x, &y);
+        /* The cursor's offset from the centre scales with the view */
+        center[0] = x + (center[0] - x) * zoom / z;
+        center[1] = y + (center[1] - y) * zoom / z;
+    }
+    zoom = z;
+    view_changed();
+}
+
+
+void DoseWindow::on_stats_timer(wxTimerEvent &WXUNUSED(e))
+{
+    this->Refresh();
+}
+
+
+void DoseWindow::on_idle(wxIdleEvent &e)
+{
+    if (dose_loaded() && !pending.empty() && render_tiles()) {
+        e.RequestMore();
+    }
+    e.Skip();
+}
+
+
+void DoseWindow::on_cine_timer(wxTimerEvent &WXUNUSED(e))
+/** A frame still rendering at the tick holds the last one on screen */
+{
+    const double period = static_cast<double>(cinetimer.GetInterval());
+
+    if (!dose_loaded() || !cine.collect(cineframe)) {
+        return;
+    }
+    cine_present();
+    if (cineframe.ms > CINE_SLOW * period && cinescale < PREVIEW_SCALE) {
+        cinescale *= 2;
+    } else if (cineframe.ms < CINE_FAST * period && cinescale > 1) {
+        cinescale /= 2;
+    }
+    cinedepth += cinestep;
+    if (cinedepth > cinerange[1] || cinedepth < cinerange[0]) {
+        cinedepth = cinerange[0];
+    }
+    cine.submit(cine_job(cinedepth, cinescale));
+}
+
+
+void DoseWindow::on_cine_progress(wxThreadEvent &e)
 {
-    conv[0] = static_cast<double>(proton_image_dimension(img, 0)) / proton_dose_width(dose, 0);
-    conv[1] = static_cast<double>(proton_image_dimension(img, 1)) / proton_dose_width(dose, 2);
+    wxGetApp().cine_export_progress(e.GetInt(), e.GetExtraLong());
+}
+
+
+void DoseWindow::on_cine_finished(wxThreadEvent &e)
+{
+    exporter.finished();
+    wxGetApp().cine_export_finished(e.GetString());
+}
+
+
+void DoseWindow::view_reset()
+{
+    zoom = 1.0;
+    center[0] = proton_dose_origin(dose, 0)
+              + 0.5 * static_cast<double>(proton_dose_dimension(dose, 0) - 1) * proton_dose_spacing(dose, 0);
+    center[1] = proton_dose_origin(dose, 2)
+              + 0.5 * static_cast<double>(proton_dose_dimension(dose, 2) - 1) * proton_dose_spacing(dose, 2);
+}
+
+
+void DoseWindow::view_write()
+/** The fitted view puts the first and last pixels on the outermost voxel
+ *  centres, as the renderer always has. The centre is clamped so the view
+ *  never leaves the plane */
+{
+    const int dims[2] = { DOSE_LR, DOSE_SI };
+    const int npx[2] = { bmp.GetWidth(), bmp.GetHeight() };
+    double lo, span;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        lo = proton_dose_origin(dose, dims[i]);
+        span = static_cast<double>(proton_dose_dimension(dose, dims[i]) - 1)
+             * proton_dose_spacing(dose, dims[i]);
+        center[i] = std::min(std::max(center[i], lo + 0.5 * span / zoom),
+                             lo + span - 0.5 * span / zoom);
+        view[i] = center[i] - 0.5 * span / zoom;
+        view[i + 2] = center[i] + 0.5 * span / zoom;
+        conv[i] = (npx[i] > 1 && span > 0.0)
+            ? static_cast<double>(npx[i] - 1) * zoom / span
+            : 1.0;
+    }
+}
+
+
+void DoseWindow::view_changed()
+{
+    view_write();
+    image_write();
+    this->Refresh();
 }
 
 
@@ -173,11 +497,83 @@ void DoseWindow::affine_write()
 
 
 void DoseWindow::image_write()
+/** Renders the preview and queues every tile, nearest the centre first. The
+ *  pixel data must be reattached for every write, since the platform is free
+ *  to move the surface between accesses */
 {
+    PROTON_TRACE_SCOPE("dose window image");
+    const int w = bmp.GetWidth(), h = bmp.GetHeight();
+    const wxPoint c(w / 2, h / 2);
+    wxAlphaPixelData data(preview);
+    ProtonView pv;
+    int x, y;
+
+    proton_view_fit(&pxview, view, w, h);
+    if (cine_playing()) {
+        /* The next frame picks up the view and parameters */
+        pending.clear();
+        finished.Clear();
+        return;
+    }
+    if (data) {
+        wxAlphaPixelData::Iterator it(data);
+        proton_image_attach(&tile, reinterpret_cast<unsigned char *>(it.m_ptr),
+                            data.GetWidth(), data.GetHeight(),
+                            data.GetRowStride(), native_format());
+        proton_view_fit(&pv, view, data.GetWidth(), data.GetHeight());
+        proton_dose_get_plane_region(dose, &wxGetApp().visuals(), tile,
+                                     wxGetApp().get_depth(), &pv);
+    }
+    pending.clear();
+    finished.Clear();
+    for (y = 0; y < h; y += TILE_SIZE) {
+        for (x = 0; x < w; x += TILE_SIZE) {
+            pending.emplace_back(x, y, std::min(TILE_SIZE, w - x), std::min(TILE_SIZE, h - y));
+        }
+    }
+    /* Rendered from the back */
+    std::sort(pending.begin(), pending.end(), [c](const wxRect &a, const wxRect &b) {
+        const wxPoint da = a.GetPosition() + a.GetSize() / 2 - c;
+        const wxPoint db = b.GetPosition() + b.GetSize() / 2 - c;
+        return da.x * da.x + da.y * da.y > db.x * db.x + db.y * db.y;
+    });
+}
+
+
+bool DoseWindow::render_tiles()
+/** Renders queued tiles until the budget is spent, and returns true while
+ *  any remain. Each tile is the view with its origin moved to the tile, so
+ *  the seams are invisible */
+{
+    PROTON_TRACE_SCOPE("dose window tiles");
+    wxAlphaPixelData data(bmp);
+    wxStopWatch sw;
+    ProtonView tv;
     float depth;
-    
+    long stride;
+
+    if (!data) {
+        pending.clear();
+        return false;
+    }
+    wxAlphaPixelData::Iterator it(data);
+    stride = data.GetRowStride();
+    proton_image_attach(&img, reinterpret_cast<unsigned char *>(it.m_ptr),
+                        data.GetWidth(), data.GetHeight(), stride, native_format());
     depth = wxGetApp().get_depth();
-    proton_dose_get_plane(dose, &wxGetApp().visuals(), img, depth);
+    while (!pending.empty() && sw.Time() < TILE_BUDGET) {
+        const wxRect r = pending.back();
+        pending.pop_back();
+        proton_image_attach(&tile, proton_image_raw(img) + r.y * stride + r.x * proton_image_format_bpp(native_format()),
+                            r.width, r.height, stride, native_format());
+        tv = pxview;
+        tv.origin[0] += static_cast<double>(r.x) * pxview.step[0];
+        tv.origin[1] += static_cast<double>(r.y) * pxview.step[1];
+        proton_dose_get_plane_region(dose, &wxGetApp().visuals(), tile, depth, &tv);
+        finished.Union(r);
+        this->RefreshRect(wxRect(r.GetPosition() + origin, r.GetSize()), false);
+    }
+    return !pending.empty();
 }
 
 
@@ -199,17 +595,148 @@ void DoseWindow::image_realloc_and_write(const wxSize &csz)
         origin.x = (W - w) / 2;
         origin.y = 0;
     }
-    if (proton_image_realloc(&img, w, h)) {
+    if (!bmp.Create(std::max(w, 1), std::max(h, 1), 32)
+     || !preview.Create(std::max(w / PREVIEW_SCALE, 1), std::max(h / PREVIEW_SCALE, 1), 32)
+     || proton_image_attach(&img, nullptr, std::max(w, 1), std::max(h, 1), 0, native_format())) {
         unload_dose();
         wxMessageBox(wxT("Failed to reallocate image buffer\n"\
             "The dose has been unloaded"),
             wxT("Realloc failed"), wxICON_ERROR);
     } else {
+        bmp.UseAlpha();
+        preview.UseAlpha();
+        view_write();
         image_write();
     }
 }
 
 
+const DoseWindow::isodose_lines *DoseWindow::isodose_at(float depth)
+/** The levels are part of the key, as they follow the dose maximum. A miss
+ *  asks the tracer for the lines, once, and returns NULL until they arrive */
+{
+    const IsodoseParams &iso = wxGetApp().isodose();
+    std::vector<float> levels(iso.levels.size());
+    size_t i;
+
+    for (i = 0; i < levels.size(); i++) {
+        levels[i] = iso.levels[i] / 100.0f * proton_dose_max(dose);
+    }
+    auto it = std::find_if(isodoses.begin(), isodoses.end(), [&](const isodose_lines &x) {
+        return x.depth == depth && x.levels == levels;
+    });
+    if (it != isodoses.end()) {
+        std::rotate(isodoses.begin(), it, it + 1);
+        return &isodoses.front();
+    }
+    if (depth != isodepth || levels != isolevels) {
+        const double tol = ISODOSE_TOLERANCE * std::min(proton_dose_spacing(dose, DOSE_LR),
+                                                        proton_dose_spacing(dose, DOSE_SI));
+        isodepth = depth;
+        isolevels = levels;
+        tracer.submit({ dose, depth, std::move(levels), tol });
+    }
+    return nullptr;
+}
+
+
+void DoseWindow::on_isodose_done(wxThreadEvent &WXUNUSED(e))
+/** Only the paths are built here, which is linear in the points kept */
+{
+    wxGraphicsRenderer *renderer = wxGraphicsRenderer::GetDefaultRenderer();
+    ProtonContours *contours = tracer.collect();
+    const ProtonContourLine *line;
+    const double *p;
+    long l, n, i;
+
+    if (!contours) {
+        return;
+    }
+    isodose_lines entry{ contours->depth,
+                         std::vector<float>(contours->levels, contours->levels + contours->nlevels),
+                         { } };
+    for (l = 0; l < contours->nlevels; l++) {
+        wxGraphicsPath path = renderer->CreatePath();
+        for (line = proton_contours_level(contours, l, &n); n--; line++) {
+            p = proton_contours_points(contours) + 2 * line->start;
+            path.MoveToPoint(p[0], p[1]);
+            for (i = 1; i < line->count; i++) {
+                path.AddLineToPoint(p[2 * i], p[2 * i + 1]);
+            }
+            if (line->closed) {
+                path.CloseSubpath();
+            }
+        }
+        entry.paths.push_back(path);
+    }
+    proton_contours_destroy(contours);
+    isodoses.insert(isodoses.begin(), std::move(entry));
+    if (isodoses.size() > ISODOSE_CACHE) {
+        isodoses.pop_back();
+    }
+    this->Refresh();
+}
+
+
+CineJob DoseWindow::cine_job(float depth, int scale)
+    const
+{
+    CineJob job;
+
+    job.dose = dose;
+    job.params = wxGetApp().visuals();
+    job.depth = depth;
+    std::copy(view, view + 4, job.rect);
+    job.dim[0] = std::max(bmp.GetWidth() / scale, 1);
+    job.dim[1] = std::max(bmp.GetHeight() / scale, 1);
+    job.format = native_format();
+    return job;
+}
+
+
+void DoseWindow::cine_present()
+/** The frame is packed, the bitmap's rows may not be */
+{
+    const long w = cineframe.dim[0], h = cineframe.dim[1];
+    long y;
+
+    if (w < 1 || h < 1) {
+        return;
+    }
+    if (!cinebmp.IsOk() || cinebmp.GetWidth() != w || cinebmp.GetHeight() != h) {
+        if (!cinebmp.Create(static_cast<int>(w), static_cast<int>(h), 32)) {
+            return;
+        }
+        cinebmp.UseAlpha();
+    }
+    {
+        wxAlphaPixelData data(cinebmp);
+        if (!data) {
+            return;
+        }
+        wxAlphaPixelData::Iterator it(data);
+        unsigned char *dst = reinterpret_cast<unsigned char *>(it.m_ptr);
+        for (y = 0; y < h; y++) {
+            std::memcpy(dst + y * data.GetRowStride(), &cineframe.px[y * w * 4], w * 4);
+        }
+    }
+    wxGetApp().show_cine_depth(cineframe.depth);
+    this->Refresh(false);
+}
+
+
+void DoseWindow::cine_halt()
+/** Nothing may render from the dose once this returns */
+{
+    if (cine_playing()) {
+        cine_stop();
+        wxGetApp().cine_stopped();
+    }
+    cine.wait();
+    exporter.stop();
+}
+
+
 bool DoseWindow::point_in_dose(const wxPoint &p)
 {
     const wxRect clip(origin, wxSize(proton_image_dimension(img, 0),
@@ -219,6 +746,15 @@ bool DoseWindow::point_in_dose(const wxPoint &p)
 }
 
 
+void DoseWindow::point_to_dose(wxPoint p, double *x, double *y)
+    const
+{
+    p -= origin;
+    *x = static_cast<double>(p.x) / conv[0] + view[0];
+    *y = static_cast<double>(p.y) / conv[1] + view[1];
+}
+
+
 void DoseWindow::write_line_dose()
     noexcept
 {
@@ -226,6 +762,17 @@ void DoseWindow::write_line_dose()
 
     wxGetApp().get_line_dose(&x, &y);
     proton_dose_get_line(dose, x, y);
+    ldwritten = ldstamp;
+}
+
+
+const ProtonDose *DoseWindow::get_line_dose()
+    noexcept
+{
+    if (ldwritten != ldstamp) {
+        write_line_dose();
+    }
+    return dose;
 }
 
 
@@ -236,8 +783,26 @@ DoseWindow::DoseWindow(wxWindow *parent):
              wxDefaultSize,
              wxFULL_REPAINT_ON_RESIZE),
     dose(nullptr),
+    base(nullptr),
+    sgndose(false),
+    gstats(),
+    comparer(this),
     img(nullptr),
-    droptarget(new DoseDragNDrop)
+    tile(nullptr),
+    tracer(this),
+    isodepth(0.0f),
+    cinetimer(this, ID_CINE_TIMER),
+    cinerange{ 0.0f, 0.0f },
+    cinedepth(0.0f),
+    cinestep(1.0f),
+    cinescale(1),
+    droptarget(new DoseDragNDrop),
+    zoom(1.0),
+    profanchor{ 0.0, 0.0 },
+    statstimer(this, ID_STATS_TIMER),
+    showstats(false),
+    ldstamp(1),
+    ldwritten(0)
 {
     this->SetCursor(*wxCROSS_CURSOR);
 
@@ -246,6 +811,16 @@ DoseWindow::DoseWindow(wxWindow *parent):
     this->Bind(wxEVT_LEFT_DOWN, &DoseWindow::on_lmb, this);
     this->Bind(wxEVT_RIGHT_DOWN, &DoseWindow::on_rmb, this);
     this->Bind(wxEVT_MOTION, &DoseWindow::on_motion, this);
+    this->Bind(wxEVT_MIDDLE_DOWN, &DoseWindow::on_mmb, this);
+    this->Bind(wxEVT_MIDDLE_DCLICK, &DoseWindow::on_mmb_dclick, this);
+    this->Bind(wxEVT_MOUSEWHEEL, &DoseWindow::on_wheel, this);
+    this->Bind(wxEVT_TIMER, &DoseWindow::on_stats_timer, this, ID_STATS_TIMER);
+    this->Bind(wxEVT_TIMER, &DoseWindow::on_cine_timer, this, ID_CINE_TIMER);
+    this->Bind(EVT_CINE_PROGRESS, &DoseWindow::on_cine_progress, this);
+    this->Bind(EVT_CINE_FINISHED, &DoseWindow::on_cine_finished, this);
+    this->Bind(EVT_COMPARE_DONE, &DoseWindow::on_compare_done, this);
+    this->Bind(EVT_ISODOSE_DONE, &DoseWindow::on_isodose_done, this);
+    this->Bind(wxEVT_IDLE, &DoseWindow::on_idle, this);
 
 #if _WIN32
     this->SetDoubleBuffered(true);
@@ -257,23 +832,55 @@ DoseWindow::DoseWindow(wxWindow *parent):
 
 DoseWindow::~DoseWindow()
 {
+    comparer.wait();
+    tracer.wait();
+    cinetimer.Stop();
+    cine.wait();
+    exporter.stop();
+    proton_image_destroy(tile);
     proton_image_destroy(img);
     proton_dose_destroy(dose);
+    proton_dose_destroy(base);
 }
 
 
 void DoseWindow::load_file(const char *filename)
 {
+    PROTON_TRACE_SCOPE("dose load");
     char err[1024] = { 0 };
 
-    proton_dose_destroy(dose);
+    unload_dose();
     dose = proton_dose_create(filename, sizeof err, err);
+    dose_replaced(err);
+}
+
+
+void DoseWindow::load_files(const wxArrayString &paths)
+/** The old dose goes first, so that it is never held alongside the sum */
+{
+    PROTON_TRACE_SCOPE("dose sum load");
+    std::vector<const char *> names;
+    char err[1024] = { 0 };
+
+    for (const wxString &path : paths) {
+        names.push_back(path.c_str());
+    }
+    unload_dose();
+    dose = proton_dose_create_sum(names.data(), static_cast<long>(names.size()),
+                                  sizeof err, err);
+    dose_replaced(err);
+}
+
+
+void DoseWindow::dose_replaced(const char *err)
+{
+    wxGetApp().set_signed_dose(false);
     if (dose) {
         wxGetApp().set_depth_range();
+        view_reset();
         image_realloc_and_write(this->GetSize());
         affine_write();
-        conv_write();
-        write_line_dose();
+        ldstamp++;
     } else {
         wxMessageBox(wxString(err), wxT("Load failed"), wxICON_ERROR, this);
     }
@@ -281,34 +888,155 @@ void DoseWindow::load_file(const char *filename)
 }
 
 
-void DoseWindow::on_depth_changed(wxCommandEvent &WXUNUSED(e))
+void DoseWindow::redraw_plane()
 {
     image_write();
     this->Refresh();
 }
 
 
-void DoseWindow::on_plot_changed(wxCommandEvent &WXUNUSED(e))
+void DoseWindow::update_affine()
 {
+    affine_write();
     this->Refresh();
-    /** HI:
-     *  Consider whether or not we actually want to do this while this plot 
-     *  is not selected (none of the tested machines had any trouble with 
-     *  this) */
-    write_line_dose();
 }
 
 
-void DoseWindow::on_shift_changed(wxCommandEvent &WXUNUSED(e))
+void DoseWindow::release_views()
+/** Workers still reading the dose are waited for, as it may be about to go */
 {
-    affine_write();
-    this->Refresh();
+    cine_halt();
+    tracer.wait();
+    isodoses.clear();
+    isolevels.clear();
 }
 
 
 void DoseWindow::unload_dose()
-    noexcept
+/** A comparison still running reads the dose, so this waits for it */
 {
+    comparer.wait();
+    release_views();
     proton_dose_destroy(dose);
-    dose = nullptr;
+    proton_dose_destroy(base);
+    dose = base = nullptr;
+}
+
+
+void DoseWindow::drop_comparison()
+{
+    if (base) {
+        release_views();
+        proton_dose_destroy(dose);
+        dose = base;
+        base = nullptr;
+    }
+}
+
+
+void DoseWindow::dose_swapped()
+/** The grid is the same, so the view and image size hold */
+{
+    wxGetApp().set_signed_dose(base != nullptr && sgndose);
+    image_write();
+    ldstamp++;
+    this->Refresh();
+}
+
+
+bool DoseWindow::show_comparison(const char *filename, int mode)
+/** Any earlier comparison goes first, so that only one is ever held */
+{
+    if (!dose) {
+        return true;
+    }
+    if (base) {
+        drop_comparison();
+        dose_swapped();
+    }
+    comparer.submit({ dose, filename, mode, wxGetApp().gamma() });
+    return false;
+}
+
+
+void DoseWindow::on_compare_done(wxThreadEvent &WXUNUSED(e))
+{
+    CompareResult res;
+
+    if (!comparer.collect(res)) {
+        return;
+    }
+    if (!res.dose) {
+        wxMessageBox(wxString(res.err), wxT("Comparison failed"), wxICON_ERROR, this);
+        wxGetApp().comparison_finished(true, res.mode);
+        return;
+    }
+    release_views();
+    base = dose;
+    dose = res.dose;
+    sgndose = (res.mode != PROTON_COMPARE_GAMMA);
+    gstats = res.stats;
+    dose_swapped();
+    wxGetApp().comparison_finished(false, res.mode);
+}
+
+
+void DoseWindow::show_dose()
+{
+    comparer.cancel();
+    if (base) {
+        drop_comparison();
+        dose_swapped();
+    }
+}
+
+
+void DoseWindow::cine_start(double fps, double step)
+{
+    if (!dose_loaded()) {
+        return;
+    }
+    cinestep = static_cast<float>(step);
+    if (!cine_playing()) {
+        get_depth_range(cinerange);
+        cinedepth = std::min(std::max(wxGetApp().get_depth(), cinerange[0]), cinerange[1]);
+        cinescale = 1;
+        pending.clear();
+        finished.Clear();
+        cine.submit(cine_job(cinedepth, cinescale));
+    }
+    cinetimer.Start(std::max(static_cast<int>(std::lround(1000.0 / fps)), 1));
+}
+
+
+void DoseWindow::cine_stop()
+{
+    cinetimer.Stop();
+    cine.wait();
+    cinebmp = wxNullBitmap;
+}
+
+
+bool DoseWindow::cine_export(const wxString &dir, double step)
+{
+    float range[2];
+
+    if (!dose_loaded() || proton_image_empty(img) || step <= 0.0) {
+        return true;
+    }
+    get_depth_range(range);
+    return exporter.start(this, cine_job(range[0], 1), range[1],
+                          static_cast<float>(step), dir);
+}
+
+
+void DoseWindow::toggle_stats()
+{
+    showstats = !showstats;
+    if (showstats) {
+        statstimer.Start(STATS_PERIOD);
+    } else {
+        statstimer.Stop();
+    }
+    this->Refresh();
 }
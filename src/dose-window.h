@@ -5,15 +5,66 @@
 
 #include <wx/wx.h>
 #include <wx/dnd.h>
-#include "proton/proton-dose.h"
+#include <wx/graphics.h>
+#include <wx/timer.h>
+#include <vector>
+#include "cine-renderer.h"
+#include "compare-worker.h"
+#include "isodose-tracer.h"
+#include "proton/proton-gamma.h"
 
 
 class DoseWindow : public wxWindow {
     ProtonDose *dose;
+    /** The loaded dose, while a comparison with it is shown in its place */
+    ProtonDose *base;
+    /** Whether the comparison shown is signed, and the last gamma analysis */
+    bool sgndose;
+    ProtonGammaStats gstats;
+    CompareWorker comparer;
     ProtonImage *img;
+    wxBitmap bmp;
+
+    /** Progressive rendering. A low resolution preview of the whole plane is
+     *  rendered at once and drawn stretched, then the bitmap is filled in
+     *  tiles at idle time, each painted as it finishes. Repaints that only
+     *  change the overlays reuse the finished tiles */
+    wxBitmap preview;
+    ProtonImage *tile;
+    ProtonView pxview;
+    std::vector<wxRect> pending;
+    wxRegion finished;
 
     wxPoint origin;
 
+    /** Isodose lines of the last few depths shown, most recent first. Each
+     *  entry keeps one path per level, in mm, so toggling levels, restyling
+     *  and zooming only stroke them again. Lines not yet cached are traced
+     *  by the worker, and painted once they arrive */
+    struct isodose_lines {
+        float depth;
+        std::vector<float> levels;      /* Gy */
+        std::vector<wxGraphicsPath> paths;
+    };
+    std::vector<isodose_lines> isodoses;
+    IsodoseTracer tracer;
+    /* The depth and levels last sent to the tracer */
+    float isodepth;
+    std::vector<float> isolevels;
+
+    /** Cine playback. The worker draws frame N + 1 while frame N is shown,
+     *  each at the timer's tick, so the rate holds as long as one render
+     *  fits in a period. Frames that do not are drawn at a reduced size and
+     *  stretched, and grow back once there is time to spare */
+    CineRenderer cine;
+    CineFrame cineframe;
+    CineExporter exporter;
+    wxTimer cinetimer;
+    wxBitmap cinebmp;
+    float cinerange[2];
+    float cinedepth, cinestep;
+    int cinescale;
+
     class DoseDragNDrop : public wxFileDropTarget {
 
     public:
@@ -28,40 +79,131 @@ class DoseWindow : public wxWindow {
     double affine[6];
     double conv[2];
 
+    /** The plane shown, {x0, z0, x1, z1} in mm at the first and last pixel
+     *  centres. It is derived from the zoom, relative to the fitted plane,
+     *  and the centre of the view */
+    double view[4];
+    double zoom;
+    double center[2];
+    wxPoint panfrom;
+
+    /** Where a Shift + right drag of the profile segment started, in mm */
+    double profanchor[2];
+
+    /** Timing statistics overlay, repainted while visible */
+    wxTimer statstimer;
+    bool showstats;
+
+    /** The line dose is only interpolated when something reads it. The stamp
+     *  is bumped whenever the line dose point or the dose changes */
+    unsigned long ldstamp, ldwritten;
+
     void paint_detector(wxPaintDC &dc);
+    void paint_isodose(wxPaintDC &dc);
+    void paint_profile(wxPaintDC &dc);
     void paint_bitmap(wxPaintDC &dc);
+    void paint_stats(wxPaintDC &dc);
 
     void on_paint(wxPaintEvent &e);
     void on_size(wxSizeEvent &e);
     void on_lmb(wxMouseEvent &e);
     void on_rmb(wxMouseEvent &e);
     void on_motion(wxMouseEvent &e);
-
-    void conv_write();
+    void on_mmb(wxMouseEvent &e);
+    void on_mmb_dclick(wxMouseEvent &e);
+    void on_wheel(wxMouseEvent &e);
+    void on_stats_timer(wxTimerEvent &e);
+    void on_idle(wxIdleEvent &e);
+    void on_cine_timer(wxTimerEvent &e);
+    void on_cine_progress(wxThreadEvent &e);
+    void on_compare_done(wxThreadEvent &e);
+    void on_isodose_done(wxThreadEvent &e);
+    void on_cine_finished(wxThreadEvent &e);
+
+    void view_reset();
+    void view_write();
+    void view_changed();
     void affine_write();
 
     void image_write();
+    bool render_tiles();
     void image_realloc_and_write(const wxSize &csz);
 
+    const isodose_lines *isodose_at(float depth);
+
+    CineJob cine_job(float depth, int scale) const;
+    void cine_present();
+    void cine_halt();
+
     bool point_in_dose(const wxPoint &p);
+    void point_to_dose(wxPoint p, double *x, double *y) const;
     void write_line_dose() noexcept;
 
+    /** Shows the dose just loaded, or @p err if there is none */
+    void dose_replaced(const char *err);
+
+    /** Stops everything that reads from the shown dose, before it changes */
+    void release_views();
+
+    /** Puts the loaded dose back in place of the comparison */
+    void drop_comparison();
+
+    /** Redraws after the shown dose changed over the same grid */
+    void dose_swapped();
+
 public:
     DoseWindow(wxWindow *parent);
     ~DoseWindow();
 
     void load_file(const char *filename);
+
+    /** Loads the RTDose files as one dose, their sum */
+    void load_files(const wxArrayString &paths);
+
+    /** Starts comparing the loaded dose with the RTDose @p filename in the
+     *  background, @p mode one of PROTON_COMPARE_*. Gamma is analysed with
+     *  the criteria in MainApplication::gamma(). The dose is shown until the
+     *  comparison replaces it, and MainApplication::comparison_finished()
+     *  is told either way. Returns true if there is no dose to compare */
+    bool show_comparison(const char *filename, int mode);
+    const ProtonGammaStats &gamma_stats() const noexcept { return gstats; }
+    void show_dose();
+    constexpr bool comparing() const noexcept { return base != nullptr; }
     constexpr bool dose_loaded() const noexcept { return dose != nullptr; }
 
-    void on_depth_changed(wxCommandEvent &e);
-    void on_plot_changed(wxCommandEvent &e);
-    void on_shift_changed(wxCommandEvent &e);
+    /** Outputs of the compute graph, see MainApplication */
+    void redraw_plane();
+    void redraw_overlay() { this->Refresh(); }
+    void update_affine();
+    void invalidate_line_dose() noexcept { ldstamp++; }
 
+    /** Of the loaded dose, which a comparison's planes may not reach */
     void get_depth_range(float range[])
-        const noexcept { proton_dose_depth_range(dose, range); }
+        const noexcept { proton_dose_depth_range((base) ? base : dose, range); }
 
     constexpr const ProtonDose *get_dose() const noexcept { return dose; }
-    void unload_dose() noexcept;
+
+    /** Reinterpolates the line dose if it is stale, and returns the dose */
+    const ProtonDose *get_line_dose() noexcept;
+    void unload_dose();
+
+    /** Shows or hides the hot path timing overlay */
+    void toggle_stats();
+
+    /** Sweeps the depth range from the current depth at @p fps frames per
+     *  second, @p step mm per frame, looping at the end. Starting again
+     *  while playing only changes the rate */
+    void cine_start(double fps, double step);
+    void cine_stop();
+    bool cine_playing() const { return cinetimer.IsRunning(); }
+
+    /** The sweep continues from @p depth */
+    void cine_seek(float depth) noexcept { cinedepth = depth; }
+
+    /** Writes the sweep in @p step mm steps as PNG files in @p dir, at the
+     *  current view and size. Returns true if it could not be started */
+    bool cine_export(const wxString &dir, double step);
+    void cine_export_cancel() { exporter.stop(); }
 };
 
 
@@ -0,0 +1,101 @@
+#include "isodose-tracer.h"
+#include "proton/proton-trace.h"
+
+wxDEFINE_EVENT(EVT_ISODOSE_DONE, wxThreadEvent);
+
+
+void IsodoseTracer::run(IsodoseJob job)
+{
+    std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+    ProtonContours *out;
+
+    for (;;) {
+        {
+            PROTON_TRACE_SCOPE("isodose trace");
+            out = proton_contours_create(job.dose, job.depth, job.levels.data(),
+                                         static_cast<long>(job.levels.size()),
+                                         job.tolerance);
+        }
+        guard.lock();
+        if (stale || !out) {
+            proton_contours_destroy(out);
+        } else {
+            proton_contours_destroy(res);
+            res = out;
+            wxQueueEvent(sink, new wxThreadEvent(EVT_ISODOSE_DONE));
+        }
+        if (!queued) {
+            busy = false;
+            break;
+        }
+        job = std::move(waiting);
+        queued = stale = false;
+        guard.unlock();
+    }
+}
+
+
+IsodoseTracer::IsodoseTracer(wxEvtHandler *sink):
+    res(nullptr),
+    queued(false),
+    busy(false),
+    stale(false),
+    sink(sink)
+{
+}
+
+
+IsodoseTracer::~IsodoseTracer()
+{
+    wait();
+}
+
+
+void IsodoseTracer::submit(const IsodoseJob &job)
+/** A worker that has finished is joined here, which does not block */
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (busy) {
+        waiting = job;
+        queued = stale = true;
+        return;
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+    busy = true;
+    stale = false;
+    worker = std::thread(&IsodoseTracer::run, this, job);
+}
+
+
+void IsodoseTracer::cancel()
+    noexcept
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    queued = false;
+    stale = true;
+    proton_contours_destroy(res);
+    res = nullptr;
+}
+
+
+void IsodoseTracer::wait()
+{
+    cancel();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+
+ProtonContours *IsodoseTracer::collect()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ProtonContours *out = res;
+
+    res = nullptr;
+    return out;
+}
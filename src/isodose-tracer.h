@@ -0,0 +1,61 @@
+#pragma once
+
+#ifndef ISODOSE_TRACER_H
+#define ISODOSE_TRACER_H
+
+#include <wx/wx.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "proton/proton-contour.h"
+
+/** Posted by IsodoseTracer when a set of lines is ready, see collect() */
+wxDECLARE_EVENT(EVT_ISODOSE_DONE, wxThreadEvent);
+
+
+struct IsodoseJob {
+    const ProtonDose *dose;
+    float depth;
+    std::vector<float> levels;  /* Gy */
+    double tolerance;           /* mm */
+};
+
+
+/** Traces isodose lines on a worker thread, so that a repaint never waits
+ *  for marching squares over a full plane. One depth is traced at a time. A
+ *  request made while one runs waits for it, replacing any other request
+ *  still waiting, so a scrub only traces the depths it rests on. The lines
+ *  of a superseded or cancelled request are dropped rather than posted. The
+ *  dose must outlive the worker's use of it, see wait() */
+class IsodoseTracer {
+    std::thread worker;
+    std::mutex lock;
+    IsodoseJob waiting;
+    ProtonContours *res;
+    bool queued, busy, stale;
+
+    wxEvtHandler *sink;
+
+    void run(IsodoseJob job);
+
+public:
+    IsodoseTracer(wxEvtHandler *sink);
+    ~IsodoseTracer();
+
+    void submit(const IsodoseJob &job);
+
+    /** Drops the waiting request and the lines of the running and any
+     *  uncollected one, without waiting */
+    void cancel() noexcept;
+
+    /** Cancels, then blocks until the worker is idle. Call this before the
+     *  dose goes away */
+    void wait();
+
+    /** Returns the lines traced last, which the caller then owns, or NULL if
+     *  there are none */
+    ProtonContours *collect();
+};
+
+
+#endif /* ISODOSE_TRACER_H */
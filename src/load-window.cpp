@@ -3,6 +3,17 @@
 #define LOAD_FRAME  wxT("Load a DICOM")
 #define LOAD_TITLE  wxT("Load a Raystation DICOM")
 #define LOAD_FILTER wxT("DICOM files (*.dcm)|*.dcm")
+#define LOAD_SUMLBL wxT("Plan sum...")
+
+wxDEFINE_EVENT(EVT_LOAD_SUM, wxCommandEvent);
+
+
+void LoadWindow::on_sum(wxCommandEvent &WXUNUSED(e))
+{
+    wxCommandEvent evt(EVT_LOAD_SUM);
+
+    wxPostEvent(this, evt);
+}
 
 
 LoadWindow::LoadWindow(wxWindow *parent):
@@ -11,15 +22,19 @@ LoadWindow::LoadWindow(wxWindow *parent):
                                wxID_ANY,
                                wxEmptyString,
                                LOAD_TITLE,
-                               LOAD_FILTER))
+                               LOAD_FILTER)),
+    sbtn(new wxButton(this, wxID_ANY, LOAD_SUMLBL))
 {
     wxBoxSizer *hbox;
     
     hbox = new wxStaticBoxSizer(wxHORIZONTAL, this, LOAD_FRAME);
     hbox->AddStretchSpacer();
     hbox->Add(fctrl, 3, wxEXPAND | wxHORIZONTAL);
+    hbox->Add(sbtn, 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 4);
     hbox->AddStretchSpacer();
     this->SetSizer(hbox);
+
+    sbtn->Bind(wxEVT_BUTTON, &LoadWindow::on_sum, this);
 }
 
 wxString LoadWindow::get_directory() const
@@ -6,9 +6,15 @@
 #include <wx/wx.h>
 #include <wx/filepicker.h>
 
+/** "Plan sum..." was pressed */
+wxDECLARE_EVENT(EVT_LOAD_SUM, wxCommandEvent);
+
 
 class LoadWindow : public wxPanel {
     wxFilePickerCtrl *fctrl;
+    wxButton *sbtn;
+
+    void on_sum(wxCommandEvent &e);
 
 public:
     LoadWindow(wxWindow *parent);
@@ -1,12 +1,23 @@
 #include "main-window.h"
+#include "proton/proton-trace.h"
 
 #define MAIN_TITLE wxT("QA shift visualizer")
 
+enum {
+    ID_TRACE_OVERLAY = wxID_HIGHEST + 1,
+    ID_TRACE_EXPORT,
+    ID_DEPTH_UP_FINE,
+    ID_DEPTH_DOWN_FINE,
+    ID_DEPTH_UP,
+    ID_DEPTH_DOWN
+};
+
 wxIMPLEMENT_APP(MainApplication);
 
 
 void MainApplication::initialize_main_window()
 {
+    wxAcceleratorEntry accel[6];
     wxBoxSizer *hbox, *vbox;
 
     hbox = new wxBoxSizer(wxHORIZONTAL);
@@ -20,20 +31,30 @@ void MainApplication::initialize_main_window()
     ctrl_wnd() = new CtrlWindow(main_frame());
     load_wnd() = new LoadWindow(main_frame());
     plot_wnd() = new PlotWindow(main_frame());
+    slice_wnd() = new SliceWindow(main_frame());
 
     hbox->Add(canvas(), 1, wxEXPAND);
     hbox->Add(ctrl_wnd(), 0, wxEXPAND);
     vbox->Add(hbox, 1, wxEXPAND);
     vbox->Add(load_wnd(), 0, wxEXPAND);
     main_frame()->SetSizer(vbox);
+    initialize_compute_graph();
 
     load_wnd()->Bind(wxEVT_FILEPICKER_CHANGED,
                      &MainApplication::on_dicom_load,
                      this);
+    /** "Plan sum..." button pressed */
+    load_wnd()->Bind(EVT_LOAD_SUM,
+                     &MainApplication::on_sum_load,
+                     this);
     /** Depth was changed */
     ctrl_wnd()->Bind(EVT_DEPTH_CONTROL,
                      &MainApplication::on_depth_change,
                      this);
+    /** Cine play, rate or export */
+    ctrl_wnd()->Bind(EVT_CINE_CONTROL,
+                     &MainApplication::on_cine_change,
+                     this);
     /** Line dose marker, measurement file or measurement depth were changed */
     ctrl_wnd()->Bind(EVT_PLOT_CONTROL,
                      &MainApplication::on_plot_change,
@@ -46,17 +67,132 @@ void MainApplication::initialize_main_window()
     ctrl_wnd()->Bind(EVT_VISUAL_CONTROL,
                      &MainApplication::on_visual_change,
                      this);
+    /** Isodose lines shown, toggled or restyled */
+    ctrl_wnd()->Bind(EVT_ISODOSE_CONTROL,
+                     &MainApplication::on_isodose_change,
+                     this);
+    /** Profile segment drawn, spanned or its step changed */
+    ctrl_wnd()->Bind(EVT_PROFILE_CONTROL,
+                     &MainApplication::on_profile_change,
+                     this);
+    /** Second RTDose loaded, or the dose, difference or ratio picked */
+    ctrl_wnd()->Bind(EVT_COMPARE_CONTROL,
+                     &MainApplication::on_compare_change,
+                     this);
     /** "Open plot window" button pressed */
     ctrl_wnd()->Bind(EVT_PLOT_OPEN,
                      &MainApplication::on_plot_open,
                      this);
+    /** "Open slice window" button pressed */
+    ctrl_wnd()->Bind(EVT_SLICE_OPEN,
+                     &MainApplication::on_slice_open,
+                     this);
+    /** F12 shows the timing overlay, Ctrl+Shift+T saves the trace */
+    accel[0].Set(wxACCEL_NORMAL, WXK_F12, ID_TRACE_OVERLAY);
+    accel[1].Set(wxACCEL_CTRL | wxACCEL_SHIFT, 'T', ID_TRACE_EXPORT);
+    /** Ctrl+Up/Down step the depth by 0.1 mm, with Shift by 1 mm */
+    accel[2].Set(wxACCEL_CTRL, WXK_UP, ID_DEPTH_UP_FINE);
+    accel[3].Set(wxACCEL_CTRL, WXK_DOWN, ID_DEPTH_DOWN_FINE);
+    accel[4].Set(wxACCEL_CTRL | wxACCEL_SHIFT, WXK_UP, ID_DEPTH_UP);
+    accel[5].Set(wxACCEL_CTRL | wxACCEL_SHIFT, WXK_DOWN, ID_DEPTH_DOWN);
+    main_frame()->SetAcceleratorTable(wxAcceleratorTable(6, accel));
+    main_frame()->Bind(wxEVT_MENU,
+                       &MainApplication::on_trace_overlay,
+                       this, ID_TRACE_OVERLAY);
+    main_frame()->Bind(wxEVT_MENU,
+                       &MainApplication::on_trace_export,
+                       this, ID_TRACE_EXPORT);
+    main_frame()->Bind(wxEVT_MENU,
+                       &MainApplication::on_depth_nudge,
+                       this, ID_DEPTH_UP_FINE, ID_DEPTH_DOWN);
+}
+
+
+void MainApplication::initialize_compute_graph()
+/** Outputs are listed in dependency order. The DoseWindow renders the plane,
+ *  writes the affine and stamps the line dose itself when a file loads, since
+ *  it must also size its image then */
+{
+    graph.add_output(wxT("auto depth error"),
+        { ComputeGraph::IN_DEPTH },
+        [this]() {
+            if (ctrl_wnd()->on_depth_changed()) {
+                graph.invalidate(ComputeGraph::IN_VISUALS);
+            }
+        });
+    graph.add_output(wxT("plane image"),
+        { ComputeGraph::IN_DEPTH, ComputeGraph::IN_VISUALS },
+        [this]() { canvas()->redraw_plane(); });
+    graph.add_output(wxT("detector affine"),
+        { ComputeGraph::IN_SHIFT },
+        [this]() { canvas()->update_affine(); });
+    graph.add_output(wxT("dose overlay"),
+        { ComputeGraph::IN_LINE_POINT, ComputeGraph::IN_DETECTOR,
+          ComputeGraph::IN_ISODOSE, ComputeGraph::IN_PROFILE },
+        [this]() { canvas()->redraw_overlay(); });
+    graph.add_output(wxT("line dose"),
+        { ComputeGraph::IN_LINE_POINT },
+        [this]() { canvas()->invalidate_line_dose(); });
+    graph.add_output(wxT("plot axes"),
+        { ComputeGraph::IN_DOSE },
+        [this]() { plot_wnd()->on_dicom_changed(); });
+    graph.add_output(wxT("line dose trace"),
+        { ComputeGraph::IN_LINE_POINT },
+        [this]() { plot_wnd()->invalidate_line_dose_trace(); });
+    graph.add_output(wxT("line dose comparison"),
+        { ComputeGraph::IN_LINE_POINT, ComputeGraph::IN_SHIFT,
+          ComputeGraph::IN_MEASUREMENTS },
+        [this]() { plot_wnd()->invalidate_line_dose_plot(); });
+    graph.add_output(wxT("planar comparison"),
+        { ComputeGraph::IN_MEASUREMENTS },
+        [this]() { plot_wnd()->invalidate_planar_plot(); });
+    graph.add_output(wxT("profile axes"),
+        { ComputeGraph::IN_PROFILE },
+        [this]() { plot_wnd()->on_profile_changed(); });
+    graph.add_output(wxT("profile comparison"),
+        { ComputeGraph::IN_DOSE, ComputeGraph::IN_DEPTH, ComputeGraph::IN_LINE_POINT,
+          ComputeGraph::IN_SHIFT, ComputeGraph::IN_MEASUREMENTS },
+        [this]() { plot_wnd()->invalidate_profile_plot(); });
+    graph.add_output(wxT("depth traces"),
+        { ComputeGraph::IN_DEPTH },
+        [this]() { plot_wnd()->invalidate_depth_traces(); });
+    graph.add_output(wxT("plot markers"),
+        { ComputeGraph::IN_DEPTH },
+        [this]() { plot_wnd()->redraw_markers(); });
+    graph.add_output(wxT("slice axes"),
+        { ComputeGraph::IN_DOSE },
+        [this]() { slice_wnd()->on_dose_changed(); });
+    graph.add_output(wxT("slice image"),
+        { ComputeGraph::IN_VISUALS, ComputeGraph::IN_LINE_POINT },
+        [this]() { slice_wnd()->invalidate_plane(); });
+    graph.add_output(wxT("slice markers"),
+        { ComputeGraph::IN_DEPTH },
+        [this]() { slice_wnd()->redraw_markers(); });
+}
+
+
+void MainApplication::propagate(ComputeGraph::input in)
+{
+    graph.invalidate(in);
+    if (canvas()->dose_loaded()) {
+        graph.flush();
+    } else {
+        /* Loading a dose rebuilds everything anyway */
+        graph.discard();
+    }
 }
 
 
 void MainApplication::load_file(const wxString &path)
+/** A new grid starts with a crossline profile through the crosshair */
 {
     canvas()->load_file(path.c_str());
-    plot_wnd()->on_dicom_changed();
+    ctrl_wnd()->show_dose();
+    ctrl_wnd()->set_gamma_result(nullptr);
+    if (canvas()->dose_loaded()) {
+        ctrl_wnd()->span_profile(DOSE_LR);
+    }
+    propagate(ComputeGraph::IN_DOSE);
 }
 
 
@@ -69,39 +205,169 @@ void MainApplication::on_dicom_load(wxFileDirPickerEvent &e)
 }
 
 
-void MainApplication::on_depth_change(wxCommandEvent &e)
+void MainApplication::load_files(const wxArrayString &paths)
 {
+    canvas()->load_files(paths);
+    ctrl_wnd()->show_dose();
+    ctrl_wnd()->set_gamma_result(nullptr);
     if (canvas()->dose_loaded()) {
-        canvas()->on_depth_changed(e);
-        ctrl_wnd()->on_depth_changed(e);
-        plot_wnd()->on_depth_changed(e);
+        ctrl_wnd()->span_profile(DOSE_LR);
     }
+    propagate(ComputeGraph::IN_DOSE);
 }
 
 
-void MainApplication::on_plot_change(wxCommandEvent &e)
+void MainApplication::on_sum_load(wxCommandEvent &WXUNUSED(e))
+/** One file on its own loads as usual */
 {
-    if (canvas()->dose_loaded()) {
-        canvas()->on_plot_changed(e);
-        plot_wnd()->on_plot_changed(e);
+    wxFileDialog dlg(main_frame(), wxT("Load the beams of a plan"),
+                     get_RS_directory(), wxEmptyString,
+                     wxT("DICOM files (*.dcm)|*.dcm"),
+                     wxFD_OPEN | wxFD_FILE_MUST_EXIST | wxFD_MULTIPLE);
+    wxArrayString paths;
+
+    if (dlg.ShowModal() != wxID_OK) {
+        return;
+    }
+    dlg.GetPaths(paths);
+    if (paths.size() == 1) {
+        load_wnd()->set_file(paths[0]);
+        load_file(paths[0]);
+    } else if (!paths.empty()) {
+        load_files(paths);
     }
 }
 
 
+void MainApplication::on_depth_change(wxCommandEvent &WXUNUSED(e))
+{
+    if (canvas()->cine_playing()) {
+        canvas()->cine_seek(get_depth());
+    }
+    propagate(ComputeGraph::IN_DEPTH);
+}
+
+
+void MainApplication::on_depth_nudge(wxCommandEvent &e)
+{
+    switch (e.GetId()) {
+    case ID_DEPTH_UP_FINE:
+        ctrl_wnd()->nudge_depth(0.1);
+        break;
+    case ID_DEPTH_DOWN_FINE:
+        ctrl_wnd()->nudge_depth(-0.1);
+        break;
+    case ID_DEPTH_UP:
+        ctrl_wnd()->nudge_depth(1.0);
+        break;
+    case ID_DEPTH_DOWN:
+        ctrl_wnd()->nudge_depth(-1.0);
+        break;
+    }
+}
+
+
+void MainApplication::on_cine_change(wxCommandEvent &e)
+{
+    switch (e.GetInt()) {
+    case CINE_CHANGE_PLAY:
+        if (ctrl_wnd()->cine_playing() && dose_loaded()) {
+            canvas()->cine_start(ctrl_wnd()->get_cine_fps(), ctrl_wnd()->get_cine_step());
+        } else {
+            ctrl_wnd()->set_cine_playing(false);
+            canvas()->cine_stop();
+            /* Everything else catches up on the depth the sweep stopped at */
+            propagate(ComputeGraph::IN_DEPTH);
+        }
+        break;
+    case CINE_CHANGE_RATE:
+        if (canvas()->cine_playing()) {
+            canvas()->cine_start(ctrl_wnd()->get_cine_fps(), ctrl_wnd()->get_cine_step());
+        }
+        break;
+    case CINE_CHANGE_EXPORT:
+        if (ctrl_wnd()->cine_exporting()) {
+            canvas()->cine_export_cancel();
+        } else if (dose_loaded()) {
+            wxDirDialog dlg(main_frame(), wxT("Export frames to"));
+            if (dlg.ShowModal() != wxID_OK) {
+                break;
+            }
+            if (canvas()->cine_export(dlg.GetPath(), ctrl_wnd()->get_cine_step())) {
+                wxMessageBox(wxT("Could not start the export"),
+                             wxT("Export failed"), wxICON_ERROR);
+            } else {
+                ctrl_wnd()->set_cine_exporting(true);
+            }
+        }
+        break;
+    }
+}
+
+
+void MainApplication::on_plot_change(wxCommandEvent &e)
+{
+    propagate((e.GetInt() == PLOT_CHANGE_MEASUREMENT)
+        ? ComputeGraph::IN_MEASUREMENTS
+        : ComputeGraph::IN_LINE_POINT);
+}
+
+
 void MainApplication::on_shift_change(wxCommandEvent &e)
 {
-    if (canvas()->dose_loaded()) {
-        canvas()->on_shift_changed(e);
-        plot_wnd()->on_shift_changed(e);
+    propagate((e.GetInt() == SHIFT_CHANGE_DETECTOR)
+        ? ComputeGraph::IN_DETECTOR
+        : ComputeGraph::IN_SHIFT);
+}
+
+
+void MainApplication::on_visual_change(wxCommandEvent &WXUNUSED(e))
+{
+    propagate(ComputeGraph::IN_VISUALS);
+}
+
+
+void MainApplication::on_isodose_change(wxCommandEvent &WXUNUSED(e))
+{
+    propagate(ComputeGraph::IN_ISODOSE);
+}
+
+
+void MainApplication::on_profile_change(wxCommandEvent &WXUNUSED(e))
+{
+    propagate(ComputeGraph::IN_PROFILE);
+}
+
+
+void MainApplication::on_compare_change(wxCommandEvent &WXUNUSED(e))
+/** The comparison runs in the background, and the dose is shown meanwhile */
+{
+    const int mode = ctrl_wnd()->compare_mode();
+
+    if (!dose_loaded()) {
+        ctrl_wnd()->show_dose();
+        return;
     }
+    if (mode == COMPARE_SHOW_DOSE) {
+        canvas()->show_dose();
+    } else if (canvas()->show_comparison(ctrl_wnd()->compare_file().c_str(), mode)) {
+        ctrl_wnd()->show_dose();
+    }
+    propagate(ComputeGraph::IN_DOSE);
 }
 
 
-void MainApplication::on_visual_change(wxCommandEvent &e)
+void MainApplication::comparison_finished(bool failed, int mode)
+/** A comparison that fails leaves the dose shown */
 {
-    if (canvas()->dose_loaded()) {
-        canvas()->on_depth_changed(e);
+    if (failed) {
+        ctrl_wnd()->show_dose();
+        return;
+    }
+    if (mode == PROTON_COMPARE_GAMMA) {
+        ctrl_wnd()->set_gamma_result(&canvas()->gamma_stats());
     }
+    propagate(ComputeGraph::IN_DOSE);
 }
 
 
@@ -115,6 +381,52 @@ void MainApplication::on_plot_open(wxCommandEvent &WXUNUSED(e))
 }
 
 
+void MainApplication::on_slice_open(wxCommandEvent &WXUNUSED(e))
+{
+    if (!slice_wnd()->IsVisible()) {
+        slice_wnd()->Show();
+    } else {
+        slice_wnd()->Raise();
+    }
+}
+
+
+void MainApplication::on_trace_overlay(wxCommandEvent &WXUNUSED(e))
+{
+    canvas()->toggle_stats();
+}
+
+
+void MainApplication::on_trace_export(wxCommandEvent &WXUNUSED(e))
+/** Open the result in chrome://tracing or ui.perfetto.dev */
+{
+    wxFileDialog dlg(main_frame(), wxT("Save timing trace"), wxEmptyString,
+                     wxT("trace.json"), wxT("Chrome trace (*.json)|*.json"),
+                     wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
+    if (dlg.ShowModal() == wxID_OK
+     && proton_trace_export(dlg.GetPath().c_str())) {
+        wxMessageBox(wxT("Failed to write ") + dlg.GetPath(),
+                     wxT("Export failed"), wxICON_ERROR);
+    }
+}
+
+
+void MainApplication::cine_stopped()
+{
+    ctrl_wnd()->set_cine_playing(false);
+}
+
+
+void MainApplication::cine_export_finished(const wxString &err)
+{
+    ctrl_wnd()->set_cine_exporting(false);
+    if (!err.IsEmpty()) {
+        wxMessageBox(err, wxT("Export failed"), wxICON_ERROR);
+    }
+}
+
+
 void MainApplication::set_depth_range()
 {
     float range[2];
@@ -135,6 +447,18 @@ void MainApplication::dropped_file(const wxString &path)
 }
 
 
+void MainApplication::dropped_files(const wxArrayString &paths)
+{
+    load_files(paths);
+}
+
+
+void MainApplication::dropped_measurements(const wxArrayString &paths)
+{
+    ctrl_wnd()->add_measurements(paths);
+}
+
+
 bool MainApplication::OnInit()
 {
     bool res = false;
@@ -4,10 +4,12 @@
 #define MAIN_WINDOW_H
 
 #include <wx/wx.h>
+#include "compute-graph.h"
 #include "dose-window.h"
 #include "ctrl-window.h"
 #include "load-window.h"
 #include "plot-window.h"
+#include "slice-window.h"
 
 
 class MainApplication : public wxApp {
@@ -16,17 +18,34 @@ class MainApplication : public wxApp {
     CtrlWindow *m_cwnd;
     LoadWindow *m_lwnd;
     PlotWindow *m_pwnd;
+    SliceWindow *m_swnd;
+
+    ComputeGraph graph;
 
     void initialize_main_window();
+    void initialize_compute_graph();
+
+    /** Invalidates @p in and recomputes whatever depends on it */
+    void propagate(ComputeGraph::input in);
 
     void load_file(const wxString &path);
+    void load_files(const wxArrayString &paths);
 
     void on_dicom_load(wxFileDirPickerEvent &e);
+    void on_sum_load(wxCommandEvent &e);
     void on_depth_change(wxCommandEvent &e);
+    void on_depth_nudge(wxCommandEvent &e);
+    void on_cine_change(wxCommandEvent &e);
     void on_plot_change(wxCommandEvent &e);
     void on_shift_change(wxCommandEvent &e);
     void on_visual_change(wxCommandEvent &e);
+    void on_isodose_change(wxCommandEvent &e);
+    void on_profile_change(wxCommandEvent &e);
+    void on_compare_change(wxCommandEvent &e);
     void on_plot_open(wxCommandEvent &e);
+    void on_slice_open(wxCommandEvent &e);
+    void on_trace_overlay(wxCommandEvent &e);
+    void on_trace_export(wxCommandEvent &e);
 
 
     wxFrame *&main_frame() noexcept { return m_frame; }
@@ -34,12 +53,14 @@ class MainApplication : public wxApp {
     CtrlWindow *&ctrl_wnd() noexcept { return m_cwnd; }
     LoadWindow *&load_wnd() noexcept { return m_lwnd; }
     PlotWindow *&plot_wnd() noexcept { return m_pwnd; }
+    SliceWindow *&slice_wnd() noexcept { return m_swnd; }
 
     const wxFrame *main_frame() const noexcept { return m_frame; }
     const DoseWindow *canvas() const noexcept { return m_canv; }
     const CtrlWindow *ctrl_wnd() const noexcept { return m_cwnd; }
     const LoadWindow *load_wnd() const noexcept { return m_lwnd; }
     const PlotWindow *plot_wnd() const noexcept { return m_pwnd; }
+    const SliceWindow *slice_wnd() const noexcept { return m_swnd; }
 
 
 public:
@@ -56,6 +77,12 @@ public:
 
     void set_line_dose(double x, double y) { ctrl_wnd()->set_line_dose(x, y); }
 
+    const ProtonProfile &profile()
+        const noexcept { return ctrl_wnd()->profile(); }
+
+    void set_profile(const double start[], const double end[])
+        { ctrl_wnd()->set_profile(start, end); }
+
     void set_translation(double x, double y)
         { ctrl_wnd()->set_translation(x, y); }
 
@@ -63,13 +90,29 @@ public:
 
     const ProtonDose *get_dose() const noexcept { return canvas()->get_dose(); }
 
+    /** Use this instead of get_dose() to read the line dose */
+    const ProtonDose *get_line_dose_data() noexcept { return canvas()->get_line_dose(); }
+
     double get_max_slider_depth()
         const { return ctrl_wnd()->get_max_slider_depth(); }
 
     double get_max_dose()
         const noexcept { return (double)proton_dose_max(get_dose()); }
 
-    void unload_dose() noexcept { canvas()->unload_dose(); }
+    /** Recompute counts of the compute graph, for the timing overlay */
+    wxString graph_stats() const { return graph.stats(); }
+
+    void unload_dose() { canvas()->unload_dose(); }
+
+    /** Cine playback reports back through these */
+    void show_cine_depth(float depth) { ctrl_wnd()->show_depth(depth); }
+    void cine_stopped();
+    /** A comparison started by on_compare_change() in @p mode replaced the
+     *  dose, or failed and left it shown */
+    void comparison_finished(bool failed, int mode);
+    void cine_export_progress(long done, long total)
+        { ctrl_wnd()->set_cine_progress(done, total); }
+    void cine_export_finished(const wxString &err);
 
     void get_ld_measurements(std::vector<std::tuple<double, double>> &meas)
         const { ctrl_wnd()->get_ld_measurements(meas); }
@@ -80,6 +123,9 @@ public:
     void get_sp_measurements(std::vector<std::tuple<double, double>> &meas)
         const { ctrl_wnd()->get_sp_measurements(meas); }
 
+    void get_profile_measurements(std::vector<std::tuple<double, double>> &meas)
+        const { ctrl_wnd()->get_profile_measurements(meas); }
+
     wxString get_RS_directory() const { return load_wnd()->get_directory(); }
 
     void convert_coordinates(double *x, double *y)
@@ -88,8 +134,20 @@ public:
     const ProtonPlaneParams &visuals()
         const noexcept { return ctrl_wnd()->visuals(); }
 
+    const IsodoseParams &isodose()
+        const noexcept { return ctrl_wnd()->isodose(); }
+
+    void set_signed_dose(bool x) { ctrl_wnd()->set_signed_dose(x); }
+    const ProtonGammaParams &gamma() const noexcept { return ctrl_wnd()->gamma(); }
+
     void dropped_file(const wxString &path);
 
+    /** Several files dropped at once are summed, as the beams of a plan */
+    void dropped_files(const wxArrayString &paths);
+
+    /** MCC files dropped on the canvas are added as measurements */
+    void dropped_measurements(const wxArrayString &paths);
+
     virtual bool OnInit() override;
 };
 
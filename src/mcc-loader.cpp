@@ -0,0 +1,81 @@
+#include "mcc-loader.h"
+
+/* Files are mostly waiting on the disk, so this is not tied to the cores */
+#define MCC_LOADER_THREADS 16
+
+wxDEFINE_EVENT(EVT_MCC_LOADED, wxThreadEvent);
+
+
+void MCCLoader::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    std::pair<long, std::string> job;
+    MCCLoaded res;
+
+    for (;;) {
+        idle++;
+        cond.wait(guard, [this]() { return !jobs.empty() || quit; });
+        idle--;
+        if (quit) {
+            break;
+        }
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        guard.unlock();
+        res.id = job.first;
+        res.stat = MCC_ERROR_NONE;
+        res.data = mcc_data_create(job.second.c_str(), &res.stat);
+        guard.lock();
+        done.push_back(res);
+        wxQueueEvent(sink, new wxThreadEvent(EVT_MCC_LOADED));
+    }
+}
+
+
+MCCLoader::MCCLoader(wxEvtHandler *sink):
+    idle(0),
+    quit(false),
+    sink(sink)
+{
+}
+
+
+MCCLoader::~MCCLoader()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    cond.notify_all();
+    for (std::thread &t: workers) {
+        t.join();
+    }
+    for (const MCCLoaded &res: done) {
+        mcc_data_destroy(res.data);
+    }
+}
+
+
+void MCCLoader::submit(long id, const wxString &path)
+/** wxString is not safe to share between threads, so the worker gets the
+ *  path as fopen() will take it */
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.emplace_back(id, std::string(path.mb_str()));
+        if (jobs.size() > idle && workers.size() < MCC_LOADER_THREADS) {
+            workers.emplace_back(&MCCLoader::run, this);
+        }
+    }
+    cond.notify_one();
+}
+
+
+bool MCCLoader::collect(std::vector<MCCLoaded> &out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    out.clear();
+    std::swap(out, done);
+    return !out.empty();
+}
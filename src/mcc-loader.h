@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef MCC_LOADER_H
+#define MCC_LOADER_H
+
+#include <wx/wx.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "proton/mcc-data.h"
+
+/** Posted by MCCLoader whenever a file has been parsed, see collect() */
+wxDECLARE_EVENT(EVT_MCC_LOADED, wxThreadEvent);
+
+
+struct MCCLoaded {
+    long id;
+    MCCData *data;              /* NULL on failure, owned by the collector */
+    int stat;                   /* MCC_ERROR_* */
+};
+
+
+/** Parses MCC files on worker threads. Workers are started as files wait
+ *  for one, up to MCC_LOADER_THREADS, so a batch is parsed all at once and
+ *  takes about as long as its largest file */
+class MCCLoader {
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<std::pair<long, std::string>> jobs;
+    std::vector<MCCLoaded> done;
+    size_t idle;
+    bool quit;
+
+    wxEvtHandler *sink;
+
+    void run();
+
+public:
+    MCCLoader(wxEvtHandler *sink);
+    ~MCCLoader();
+
+    /** Queues @p path, which comes back under @p id */
+    void submit(long id, const wxString &path);
+
+    /** Moves every parsed file into @p out, returning false if there were
+     *  none */
+    bool collect(std::vector<MCCLoaded> &out);
+};
+
+
+#endif /* MCC_LOADER_H */
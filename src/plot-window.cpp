@@ -58,10 +58,14 @@ PlotWindow::PlotWindow(wxWindow *parent):
     wxFrame(parent, wxID_ANY, wxT("Plot window"), wxDefaultPosition, DEFWINDOWSZ),
     nb(new wxNotebook(this, wxID_ANY)),
     ldplot(new LineDosePlot(nb)),
-    pdplot(new PlanarDosePlot(nb))
+    pdplot(new PlanarDosePlot(nb)),
+    prplot(new LateralProfilePlot(nb)),
+    daplot(new DoseAreaPlot(nb))
 {
     nb->AddPage(ldplot, wxT("Line dose"));
     nb->AddPage(pdplot, wxT("Planar dose"));
+    nb->AddPage(prplot, wxT("Lateral profile"));
+    nb->AddPage(daplot, wxT("Dose-area histogram"));
 
     this->Bind(wxEVT_CLOSE_WINDOW, &PlotWindow::on_evt_close, this);
     this->Bind(wxEVT_CONTEXT_MENU, &PlotWindow::on_context_menu, this);
@@ -72,27 +76,74 @@ PlotWindow::PlotWindow(wxWindow *parent):
 
 void PlotWindow::on_dicom_changed(/* wxCommandEvent &WXUNUSED(e) */)
 {
+    daplot->on_dose_changed();
     if (wxGetApp().dose_loaded()) {
         ldplot->write_axes();
         pdplot->write_axes();
+        prplot->write_axes();
+        daplot->write_axes();
     }
+    ldplot->invalidate_trace_data();
+    pdplot->invalidate_trace_data();
+    prplot->invalidate_trace_data();
+    daplot->invalidate_trace_data();
+    ldplot->invalidate_measurements();
+    pdplot->invalidate_measurements();
+    prplot->invalidate_measurements();
     nb->GetCurrentPage()->Refresh();
 }
 
-void PlotWindow::on_depth_changed(wxCommandEvent &WXUNUSED(e))
+void PlotWindow::redraw_markers()
 {
-    /* Both plots' markers must be redrawn */
+    /* Only the marker layer is redrawn */
     nb->GetCurrentPage()->Refresh();
 }
 
-void PlotWindow::on_plot_changed(wxCommandEvent &WXUNUSED(e))
+void PlotWindow::invalidate_line_dose_trace()
 {
-    /* Line dose needs to be updated, and measurements reinterpolated */
-    nb->GetCurrentPage()->Refresh();
+    ldplot->invalidate_trace_data();
+    if (nb->GetCurrentPage() == ldplot) {
+        ldplot->Refresh();
+    }
 }
 
-void PlotWindow::on_shift_changed(wxCommandEvent &WXUNUSED(e))
+void PlotWindow::invalidate_line_dose_plot()
 {
-    /* Measurements need to be reinterpolated */
-    nb->GetCurrentPage()->Refresh();
+    ldplot->invalidate_measurements();
+    if (nb->GetCurrentPage() == ldplot) {
+        ldplot->Refresh();
+    }
+}
+
+void PlotWindow::invalidate_planar_plot()
+{
+    pdplot->invalidate_measurements();
+    if (nb->GetCurrentPage() == pdplot) {
+        pdplot->Refresh();
+    }
+}
+
+void PlotWindow::invalidate_profile_plot()
+{
+    prplot->invalidate_measurements();
+    if (nb->GetCurrentPage() == prplot) {
+        prplot->Refresh();
+    }
+}
+
+void PlotWindow::invalidate_depth_traces()
+{
+    prplot->invalidate_trace_data();
+    daplot->invalidate_trace_data();
+    if (nb->GetCurrentPage() == prplot || nb->GetCurrentPage() == daplot) {
+        nb->GetCurrentPage()->Refresh();
+    }
+}
+
+void PlotWindow::on_profile_changed()
+{
+    prplot->on_segment_changed();
+    if (nb->GetCurrentPage() == prplot) {
+        prplot->Refresh();
+    }
 }
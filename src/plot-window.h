@@ -6,6 +6,8 @@
 #include <wx/wx.h>
 #include <wx/notebook.h>
 #include <wx/graphics.h>
+#include "plots/dose-area.h"
+#include "plots/lateral-profile.h"
 #include "plots/line-dose.h"
 #include "plots/planar-dose.h"
 
@@ -28,6 +30,8 @@ class PlotWindow : public wxFrame {
     wxNotebook *nb;
     LineDosePlot *ldplot;
     PlanarDosePlot *pdplot;
+    LateralProfilePlot *prplot;
+    DoseAreaPlot *daplot;
 
     void on_evt_close(wxCloseEvent &e);
 
@@ -42,14 +46,26 @@ public:
     PlotWindow(wxWindow *parent);
     ~PlotWindow() = default;
 
-/** The only event that requires more than a redraw (currently) is the plot 
- *  changing, since the line dose will need to be reinterpolated. Depth/
- *  measurement markers are computed in the paint handler */
+/** The line dose plot trace reads the line dose point, the detector shift and
+ *  the measurements, the planar trace only the measurements. The profile
+ *  trace reads the depth as well, and its axis the length of the segment.
+ *  The dose-area trace reads only the dose and the depth.
+ *  Depth markers are drawn in the paint handler over the cached layers */
 
     void on_dicom_changed(/* wxCommandEvent &e */);
-    void on_depth_changed(wxCommandEvent &e);
-    void on_plot_changed(wxCommandEvent &e);
-    void on_shift_changed(wxCommandEvent &e);
+
+    /** Outputs of the compute graph. Only the current page is repainted, the
+     *  other keeps its invalidated cache until it is shown */
+    void redraw_markers();
+    /** The data under the traces changed, so their cached paths are dropped
+     *  too. The line dose follows the line dose point, the profile and the
+     *  dose-area histogram follow the depth */
+    void invalidate_line_dose_trace();
+    void invalidate_depth_traces();
+    void invalidate_line_dose_plot();
+    void invalidate_planar_plot();
+    void invalidate_profile_plot();
+    void on_profile_changed();
 };
 
 
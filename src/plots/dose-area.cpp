@@ -0,0 +1,215 @@
+#include <algorithm>
+#include "../main-window.h"
+#include <cmath>
+
+/* Bins across the dose axis, each half a percent of the maximum */
+#define DOSE_AREA_BINS 200
+
+#define DOSEPCT_AXLABEL wxT("Dose relative to maximum")
+#define AREA_AXLABEL    wxString::FromUTF8("Area at or above dose (cm²)")
+
+
+void DoseAreaPlot::draw_area(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    const ProtonDose *dose = wxGetApp().get_dose();
+    const unsigned long *counts;
+    double cm2, sum = 0.0;
+    long i;
+
+    if (!hist) {
+        hist = proton_histogram_create(dose, DOSE_AREA_BINS);
+        if (!hist) {
+            return;
+        }
+    }
+    if (binned != trace_version()) {
+        counts = proton_histogram_plane(hist, static_cast<float>(wxGetApp().get_depth()));
+        cm2 = proton_histogram_voxel_area(hist) / 100.0;
+        area.resize(proton_histogram_bins(hist));
+        for (i = static_cast<long>(area.size()) - 1; i >= 0; i--) {
+            sum += static_cast<double>(counts[i]);
+            area[i] = static_cast<float>(sum * cm2);
+        }
+        binned = trace_version();
+    }
+    draw_sampled_trace(gc, ctx, area.data(), static_cast<long>(area.size()),
+                       0.0, 100.0 / static_cast<double>(area.size()));
+}
+
+void DoseAreaPlot::draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    wxGraphicsPath p = gc->CreatePath();
+    unsigned i;
+    gc->SetPen(dashpen);
+    for (i = 1; i < xticks.size(); i++) {
+        const double tikx = std::fma(xticks[i].first, ctx->width.m_x, ctx->origin.m_x);
+        p.MoveToPoint(tikx, ctx->origin.m_y);
+        p.AddLineToPoint(tikx, ctx->tleft.m_y);
+    }
+    for (i = 1; i < yticks.size(); i++) {
+        const double tiky = std::fma(static_cast<double>(i), ctx->ytikscale, ctx->origin.m_y);
+        p.MoveToPoint(ctx->origin.m_x, tiky);
+        p.AddLineToPoint(ctx->bright.m_x, tiky);
+    }
+    gc->StrokePath(p);
+}
+
+void DoseAreaPlot::draw_xaxis(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    const wxString &axlbl = xlabel;
+    const double tikend = ctx->origin.m_y + ctx->tikwidth;
+    wxGraphicsPath p = gc->CreatePath();
+    double txw, txh;
+    unsigned i;
+    gc->SetFont(ctx->tikfont, *wxBLACK);
+    p.MoveToPoint(ctx->origin);
+    p.AddLineToPoint(ctx->bright);
+    for (i = 0; i < xticks.size(); i++) {
+        auto &pr = xticks[i];
+        const double tikx = std::fma(pr.first, ctx->width.m_x, ctx->origin.m_x);
+        p.MoveToPoint(tikx, ctx->origin.m_y);
+        p.AddLineToPoint(tikx, tikend);
+        gc->GetTextExtent(xticklabels[i], &txw, &txh);
+        gc->DrawText(xticklabels[i], std::fma(txw, -0.5, tikx), tikend);
+    }
+    gc->SetFont(ctx->axfont, *wxBLACK);
+    gc->GetTextExtent(axlbl, &txw, &txh);
+    gc->DrawText(axlbl,
+        std::fma(txw, -0.5, std::fma(ctx->width.m_x, 0.5, ctx->origin.m_x)),
+        ctx->origin.m_y + ctx->tikwidth + ctx->maxxheight);
+    gc->StrokePath(p);
+}
+
+void DoseAreaPlot::draw_yaxis(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    const wxString &axlbl = ylabel;
+    const double tikend = ctx->origin.m_x - ctx->tikwidth;
+    wxGraphicsPath p = gc->CreatePath();
+    double txw, txh;
+    unsigned i;
+    gc->SetFont(ctx->tikfont, *wxBLACK);
+    p.MoveToPoint(ctx->origin);
+    p.AddLineToPoint(ctx->tleft);
+    for (i = 0; i < yticks.size(); i++) {
+        const double tiky = std::fma(static_cast<double>(i), ctx->ytikscale, ctx->origin.m_y);
+        p.MoveToPoint(ctx->origin.m_x, tiky);
+        p.AddLineToPoint(tikend, tiky);
+        gc->GetTextExtent(yticklabels[i], &txw, &txh);
+        gc->DrawText(yticklabels[i], tikend - txw, std::fma(txh, -0.5, tiky));
+    }
+    gc->SetFont(ctx->axfont, *wxBLACK);
+    gc->GetTextExtent(axlbl, &txw, &txh);
+    gc->DrawText(axlbl,
+        ctx->origin.m_x - ctx->tikwidth - ctx->maxywidth - txh,
+        std::fma(txw, 0.5, std::fma(ctx->width.m_y, 0.5, ctx->origin.m_y)), M_PI_2);
+    gc->StrokePath(p);
+}
+
+void DoseAreaPlot::initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx)
+/** There is no % difference axis, so the right margin only has to fit half
+ *  of the last tick label */
+{
+    constexpr double tmargin = 0.05;
+    const double pmean = std::sqrt(ctx->width.m_x * ctx->width.m_y);
+    double txw, txh;
+
+    {
+        const double pscale = pmean / image_gmean;
+        ctx->tikfont = wxFont(std::floor(IMAGE_TIKFONT_SIZE * pscale),
+            wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+        ctx->axfont = wxFont(std::floor(IMAGE_AXFONT_SIZE * pscale),
+            wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+    }
+
+    ctx->tikwidth = std::min(ctx->width.m_x, ctx->width.m_y);
+    ctx->tikwidth *= 0.01;
+
+    ctx->maxxheight = ctx->maxywidth = ctx->maxpwidth = 0.0;
+    gc->SetFont(ctx->tikfont, *wxBLACK);
+    for (const wxString &xtl : xticklabels) {
+        gc->GetTextExtent(xtl, &txw, &txh);
+        ctx->maxxheight = std::max(ctx->maxxheight, txh);
+        ctx->maxpwidth = std::max(ctx->maxpwidth, txw);
+    }
+    for (const wxString &ytl : yticklabels) {
+        gc->GetTextExtent(ytl, &txw, &txh);
+        ctx->maxywidth = std::max(ctx->maxywidth, txw);
+    }
+
+    gc->SetFont(ctx->axfont, *wxBLACK);
+    gc->GetTextExtent(ylabel, &txw, &txh);
+    ctx->origin.m_x = txh + ctx->maxywidth + ctx->tikwidth;
+    gc->GetTextExtent(xlabel, &txw, &txh);
+    ctx->origin.m_y = ctx->width.m_y - (txh + ctx->maxxheight + ctx->tikwidth);
+    ctx->width.m_x -= std::fma(0.5, ctx->maxpwidth, ctx->origin.m_x);
+    ctx->width.m_y = std::fma(tmargin, ctx->width.m_y, -ctx->origin.m_y);
+
+    ctx->bright = ctx->tleft = ctx->origin;
+    ctx->bright.m_x += ctx->width.m_x;
+    ctx->tleft.m_y += ctx->width.m_y;
+    ctx->tright = ctx->tleft;
+    ctx->tright.m_x += ctx->width.m_x;
+
+    ctx->ytikscale = ctx->width.m_y / static_cast<double>(yticks.size() - 1);
+    ctx->boxwidth = pmean * 0.01;
+}
+
+void DoseAreaPlot::fetch_measurements()
+/** Nothing is measured as an area */
+{
+    measurements.clear();
+}
+
+void DoseAreaPlot::draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    draw_xaxis(gc, ctx);
+    draw_yaxis(gc, ctx);
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_dashes(gc, ctx);
+}
+
+void DoseAreaPlot::draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    gc->SetBrush(wxNullBrush);
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_area(gc, ctx);
+}
+
+void DoseAreaPlot::draw_marker(wxGraphicsContext *WXUNUSED(gc), const struct plot_context *WXUNUSED(ctx))
+/** The whole trace follows the depth, so there is nothing to mark */
+{
+}
+
+void DoseAreaPlot::write_xaxis()
+{
+    write_percent_axis();
+}
+
+void DoseAreaPlot::write_yaxis()
+/** Every voxel is at or above the lowest dose, so the curve starts at the
+ *  area of the whole plane */
+{
+    const ProtonDose *dose = wxGetApp().get_dose();
+    const double plane = static_cast<double>(dose->px_dimensions[0] * dose->px_dimensions[2])
+                       * dose->px_spacing[0] * dose->px_spacing[2];
+    write_dose_axis(PLANEMAX_MULT * plane / 100.0, wxT("%.1f"));
+}
+
+DoseAreaPlot::DoseAreaPlot(wxWindow *parent):
+    ProtonPlot(parent, DOSEPCT_AXLABEL, AREA_AXLABEL, wxEmptyString),
+    hist(nullptr),
+    binned(~0UL)
+{
+
+}
+
+DoseAreaPlot::~DoseAreaPlot()
+{
+    proton_histogram_destroy(hist);
+}
+
+void DoseAreaPlot::on_dose_changed()
+{
+    proton_histogram_destroy(hist);
+    hist = nullptr;
+}
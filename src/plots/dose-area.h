@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef DOSE_AREA_PLOT_H
+#define DOSE_AREA_PLOT_H
+
+#include <vector>
+#include "proton-plot.h"
+#include "../proton/proton-histogram.h"
+
+
+/** Area of the coronal plane at the slice depth receiving at least each dose.
+ *  The histogram keeps what it binned between depths, so scrubbing the depth
+ *  mostly reuses work already done */
+class DoseAreaPlot : public ProtonPlot {
+    ProtonHistogram *hist;      /* Created on the first draw after a dose change */
+    std::vector<float> area;    /* Cumulative, cm^2, one per bin */
+    unsigned long binned;       /* trace_version() when it was binned */
+
+    void draw_area(wxGraphicsContext *gc, const struct plot_context *ctx);
+    void draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx);
+
+    void draw_xaxis(wxGraphicsContext *gc, const struct plot_context *ctx);
+    void draw_yaxis(wxGraphicsContext *gc, const struct plot_context *ctx);
+
+    virtual void initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx) override;
+
+    virtual void fetch_measurements() override;
+
+    virtual void draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+
+    virtual void write_xaxis() override;
+    virtual void write_yaxis() override;
+
+public:
+    DoseAreaPlot(wxWindow *parent);
+    ~DoseAreaPlot();
+
+    /** Drops the histogram of the previous dose */
+    void on_dose_changed();
+};
+
+
+#endif /* DOSE_AREA_PLOT_H */
@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <array>
+#include "../main-window.h"
+#include <cmath>
+
+/* The crosshair is marked when it lies within this many mm of the segment */
+#define MARKER_TOL 1.0
+
+static const std::array<wxString, 4> plbls = {
+    wxT("-3"), wxT("-2"), wxT(" 2"), wxT(" 3") };
+
+
+double LateralProfilePlot::dose_at(double t)
+    const noexcept
+{
+    const double u = (prof.step > 0.0) ? t / prof.step : 0.0;
+    const long n = static_cast<long>(samples.size());
+    const long i = std::clamp(static_cast<long>(std::floor(u)), 0L, std::max(n - 2, 0L));
+    const double r = std::clamp(u - static_cast<double>(i), 0.0, 1.0);
+
+    if (n < 2) {
+        return (n) ? samples[0] : 0.0;
+    }
+    return std::fma(r, samples[i + 1] - samples[i], samples[i]);
+}
+
+void LateralProfilePlot::draw_legend(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    constexpr double toffset = 3.0;
+    static const wxString tlbl = wxT("TPS dose");
+    static const wxString mlbl = wxT("Measured dose");
+    static const wxString dlbl = wxT("% Difference");
+    const double textorg = std::fma(toffset, ctx->boxwidth, ctx->origin.m_x);
+    const double symorg = std::fma(toffset / 2.0, ctx->boxwidth, ctx->origin.m_x);
+    double lh, mh, dh, legendy, width;
+
+    gc->SetFont(ctx->axfont, *wxBLACK);
+
+    gc->GetTextExtent(tlbl, &width, &lh);
+    gc->GetTextExtent(mlbl, &width, &mh);
+    gc->GetTextExtent(dlbl, &width, &dh);
+
+    legendy = ctx->origin.m_y - dh;
+    width = 0.3 * dh;
+    gc->SetPen(diffpen);
+    gc->DrawEllipse(
+        std::fma(-0.5, width, symorg),
+        std::fma( 0.5, width, legendy),
+        width, width);
+    gc->DrawText(dlbl, textorg, legendy);
+
+    legendy -= mh;
+    width = 0.3 * mh;
+    gc->SetPen(measpen);
+    gc->DrawRectangle(
+        std::fma(-0.5, width, symorg),
+        std::fma( 0.5, width, legendy),
+        width, width);
+    gc->DrawText(mlbl, textorg, legendy);
+
+    legendy -= dh;
+    width = dh;
+    gc->SetPen(dosepen);
+    gc->StrokeLine(
+        std::fma(-0.5, width, symorg), std::fma(0.5, width, legendy),
+        std::fma( 0.5, width, symorg), std::fma(0.5, width, legendy));
+    gc->DrawText(tlbl, textorg, legendy);
+}
+
+void LateralProfilePlot::draw_measurements(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    const double dosescale = ctx->width.m_y / yticks.back();
+    const double xscale = ctx->width.m_x / static_cast<double>(xticks.back().second);
+    const double dcenter = std::fma(0.5, ctx->width.m_y, ctx->origin.m_y);
+    const double dscale = 5.0 * ctx->width.m_y;
+    std::vector<std::tuple<double, double>> diffs;
+    gc->SetPen(measpen);
+    diffs.reserve(measurements.size());
+    for (const auto &[t, dose] : measurements) {
+        const double x = std::fma(t, xscale, ctx->origin.m_x);
+        const double y = std::fma(dose, dosescale, ctx->origin.m_y);
+        const double pdose = dose_at(t);
+        gc->DrawRectangle(
+            std::fma(-0.5, ctx->boxwidth, x),
+            std::fma(-0.5, ctx->boxwidth, y),
+            ctx->boxwidth, ctx->boxwidth);
+        if (pdose > 0.0) {
+            diffs.push_back({x, (dose - pdose) / pdose});
+        }
+    }
+    gc->SetPen(diffpen);
+    for (const auto &[x, dose] : diffs) {
+        const double y = std::fma(dose, dscale, dcenter);
+        gc->DrawEllipse(
+            std::fma(-0.5, ctx->boxwidth, x),
+            std::fma(-0.5, ctx->boxwidth, y),
+            ctx->boxwidth, ctx->boxwidth);
+    }
+}
+
+void LateralProfilePlot::draw_profile(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    if (sampled != trace_version()) {
+        prof = wxGetApp().profile();
+        samples.resize(proton_profile_samples(&prof));
+        proton_dose_get_profile(wxGetApp().get_dose(), wxGetApp().get_depth(), &prof, samples.data());
+        sampled = trace_version();
+    }
+    draw_sampled_trace(gc, ctx, samples.data(), static_cast<long>(samples.size()), 0.0, prof.step);
+}
+
+void LateralProfilePlot::draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    wxGraphicsPath p = gc->CreatePath();
+    unsigned i;
+    /* gc->BeginLayer(GRID_OPACITY); */
+    gc->SetPen(dashpen);
+    for (i = 1; i < xticks.size(); i++) {
+        const double tikx = std::fma(xticks[i].first, ctx->width.m_x, ctx->origin.m_x);
+        p.MoveToPoint(tikx, ctx->origin.m_y);
+        p.AddLineToPoint(tikx, ctx->tleft.m_y);
+    }
+    for (i = 1; i < yticks.size(); i++) {
+        const double tiky = std::fma(static_cast<double>(i), ctx->ytikscale, ctx->origin.m_y);
+        p.MoveToPoint(ctx->origin.m_x, tiky);
+        p.AddLineToPoint(ctx->bright.m_x, tiky);
+    }
+    gc->StrokePath(p);
+    /* gc->EndLayer(); */
+}
+
+void LateralProfilePlot::draw_xaxis(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    const wxString &axlbl = xlabel;
+    const double tikend = ctx->origin.m_y + ctx->tikwidth;
+    wxGraphicsPath p = gc->CreatePath();
+    double txw, txh;
+    unsigned i;
+    gc->SetFont(ctx->tikfont, *wxBLACK);
+    p.MoveToPoint(ctx->origin);
+    p.AddLineToPoint(ctx->bright);
+    for (i = 0; i < (xticks.size() - 1); i++) {
+        auto &pr = xticks[i];
+        const double tikx = std::fma(pr.first, ctx->width.m_x, ctx->origin.m_x);
+        p.MoveToPoint(tikx, ctx->origin.m_y);
+        p.AddLineToPoint(tikx, tikend);
+        gc->GetTextExtent(xticklabels[i], &txw, &txh);
+        gc->DrawText(xticklabels[i], std::fma(txw, -0.5, tikx), tikend);
+    }
+    gc->SetFont(ctx->axfont, *wxBLACK);
+    gc->GetTextExtent(axlbl, &txw, &txh);
+    gc->DrawText(axlbl,
+        std::fma(txw, -0.5, std::fma(ctx->width.m_x, 0.5, ctx->origin.m_x)),
+        ctx->origin.m_y + ctx->tikwidth + ctx->maxxheight);
+    gc->StrokePath(p);
+}
+
+void LateralProfilePlot::draw_yaxis(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    const wxString &axlbl = ylabel;
+    const double tikend = ctx->origin.m_x - ctx->tikwidth;
+    wxGraphicsPath p = gc->CreatePath();
+    double txw, txh;
+    unsigned i;
+    gc->SetFont(ctx->tikfont, *wxBLACK);
+    p.MoveToPoint(ctx->origin);
+    p.AddLineToPoint(ctx->tleft);
+    for (i = 0; i < yticks.size(); i++) {
+        const double tiky = std::fma(static_cast<double>(i), ctx->ytikscale, ctx->origin.m_y);
+        p.MoveToPoint(ctx->origin.m_x, tiky);
+        p.AddLineToPoint(tikend, tiky);
+        gc->GetTextExtent(yticklabels[i], &txw, &txh);
+        gc->DrawText(yticklabels[i], tikend - txw, std::fma(txh, -0.5, tiky));
+    }
+    gc->SetFont(ctx->axfont, *wxBLACK);
+    gc->GetTextExtent(axlbl, &txw, &txh);
+    gc->DrawText(axlbl,
+        ctx->origin.m_x - ctx->tikwidth - ctx->maxywidth - txh,/* std::fma(ctx->tikwidth, -7.0, ctx->origin.m_x - txh), */
+        std::fma(txw, 0.5, std::fma(ctx->width.m_y, 0.5, ctx->origin.m_y)), M_PI_2);
+    gc->StrokePath(p);
+}
+
+void LateralProfilePlot::draw_paxis(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    const wxString &axlbl = plabel;
+    const double c = std::fma(0.5, ctx->width.m_y, ctx->origin.m_y);
+    const double t = std::fma(1.0, ctx->tikwidth, ctx->bright.m_x);
+    const double heights[] = {
+        std::fma(-0.15, ctx->width.m_y, c),
+        std::fma(-0.10, ctx->width.m_y, c),
+        std::fma( 0.10, ctx->width.m_y, c),
+        std::fma( 0.15, ctx->width.m_y, c)
+    };
+    wxGraphicsPath p = gc->CreatePath();
+    double txw, txh;
+    gc->PushState();
+
+    gc->SetPen(diffpen);
+    p.MoveToPoint(ctx->bright);
+    p.AddLineToPoint(ctx->tright);
+    p.MoveToPoint(ctx->origin.m_x, heights[1]);
+    p.AddLineToPoint(ctx->bright.m_x, heights[1]);
+    p.MoveToPoint(ctx->origin.m_x, heights[2]);
+    p.AddLineToPoint(ctx->bright.m_x, heights[2]);
+    gc->StrokePath(p);
+
+    gc->SetPen(diffpendashed);
+    p = gc->CreatePath();
+    p.MoveToPoint(ctx->origin.m_x, heights[0]);
+    p.AddLineToPoint(ctx->bright.m_x, heights[0]);
+    p.MoveToPoint(ctx->origin.m_x, heights[3]);
+    p.AddLineToPoint(ctx->bright.m_x, heights[3]);
+    gc->StrokePath(p);
+
+    gc->SetFont(ctx->tikfont, diffcolor);
+    gc->GetTextExtent(plbls[0], &txw, &txh);
+    gc->DrawText(plbls[0], t, std::fma(-0.5, txh, heights[0]));
+    gc->GetTextExtent(plbls[1], &txw, &txh);
+    gc->DrawText(plbls[1], t, std::fma(-0.5, txh, heights[1]));
+    gc->GetTextExtent(plbls[2], &txw, &txh);
+    gc->DrawText(plbls[2], t, std::fma(-0.5, txh, heights[2]));
+    gc->GetTextExtent(plbls[3], &txw, &txh);
+    gc->DrawText(plbls[3], t, std::fma(-0.5, txh, heights[3]));
+
+    gc->SetFont(ctx->axfont, diffcolor);
+    gc->GetTextExtent(axlbl, &txw, &txh);
+    gc->DrawText(axlbl,
+        ctx->bright.m_x + ctx->tikwidth + ctx->maxpwidth,/* std::fma(6.0, ctx->tikwidth, ctx->bright.m_x), */
+        std::fma(0.5, txw, c), M_PI_2);
+    gc->PopState();
+}
+
+void LateralProfilePlot::initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx)
+{
+    constexpr double tmargin = 0.05;
+    const double pmean = std::sqrt(ctx->width.m_x * ctx->width.m_y);
+    double txw, txh;
+
+    {
+        const double pscale = pmean / image_gmean;
+        ctx->tikfont = wxFont(std::floor(IMAGE_TIKFONT_SIZE * pscale),
+            wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+        ctx->axfont = wxFont(std::floor(IMAGE_AXFONT_SIZE * pscale),
+            wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+    }
+
+    ctx->tikwidth = std::min(ctx->width.m_x, ctx->width.m_y);
+    ctx->tikwidth *= 0.01;
+
+    ctx->maxxheight = ctx->maxywidth = ctx->maxpwidth = 0.0;
+    gc->SetFont(ctx->tikfont, *wxBLACK);
+    for (const wxString &xtl : xticklabels) {
+        gc->GetTextExtent(xtl, &txw, &txh);
+        ctx->maxxheight = std::max(ctx->maxxheight, txh);
+    }
+    for (const wxString &ytl : yticklabels) {
+        gc->GetTextExtent(ytl, &txw, &txh);
+        ctx->maxywidth = std::max(ctx->maxywidth, txw);
+    }
+    for (const wxString &ptl : plbls) {
+        gc->GetTextExtent(ptl, &txw, &txh);
+        ctx->maxpwidth = std::max(ctx->maxpwidth, txw);
+    }
+
+    gc->SetFont(ctx->axfont, *wxBLACK);
+    gc->GetTextExtent(ylabel, &txw, &txh);
+    ctx->origin.m_x = txh + ctx->maxywidth + ctx->tikwidth;
+    gc->GetTextExtent(xlabel, &txw, &txh);
+    ctx->origin.m_y = ctx->width.m_y - (txh + ctx->maxxheight + ctx->tikwidth);
+    gc->GetTextExtent(plabel, &txw, &txh);
+    ctx->width.m_x -= txh + ctx->maxpwidth + ctx->tikwidth + ctx->origin.m_x;
+    ctx->width.m_y = std::fma(tmargin, ctx->width.m_y, -ctx->origin.m_y);
+
+    ctx->bright = ctx->tleft = ctx->origin;
+    ctx->bright.m_x += ctx->width.m_x;
+    ctx->tleft.m_y += ctx->width.m_y;
+    ctx->tright = ctx->tleft;
+    ctx->tright.m_x += ctx->width.m_x;
+
+    ctx->ytikscale = ctx->width.m_y / static_cast<double>(yticks.size() - 1);
+    ctx->boxwidth = pmean * 0.01;
+}
+
+void LateralProfilePlot::fetch_measurements()
+{
+    wxGetApp().get_profile_measurements(measurements);
+}
+
+void LateralProfilePlot::draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    draw_xaxis(gc, ctx);
+    draw_yaxis(gc, ctx);
+    if (!measurements.empty()) {
+        draw_paxis(gc, ctx);
+    }
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_dashes(gc, ctx);
+}
+
+void LateralProfilePlot::draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    gc->SetBrush(wxNullBrush);
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_profile(gc, ctx);
+    if (!measurements.empty()) {
+        draw_measurements(gc, ctx);
+        draw_legend(gc, ctx);
+    }
+}
+
+void LateralProfilePlot::draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx)
+/** Where the segment passes the line dose crosshair, if it does */
+{
+    const double len = proton_profile_length(&prof);
+    double x, y, t, d;
+
+    if (!(len > 0.0) || samples.empty()) {
+        return;
+    }
+    wxGetApp().get_line_dose(&x, &y);
+    x -= prof.start[0];
+    y -= prof.start[1];
+    t = (x * (prof.end[0] - prof.start[0]) + y * (prof.end[1] - prof.start[1])) / len;
+    d = (y * (prof.end[0] - prof.start[0]) - x * (prof.end[1] - prof.start[1])) / len;
+    if (t >= 0.0 && t <= len && std::fabs(d) <= MARKER_TOL) {
+        const double dosescale = ctx->width.m_y / yticks.back();
+        const double xscale = ctx->width.m_x / static_cast<double>(xticks.back().second);
+        const double px = std::fma(t, xscale, ctx->origin.m_x);
+        const double py = std::fma(dose_at(t), dosescale, ctx->origin.m_y);
+        gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+        gc->SetPen(measpen);
+        gc->StrokeLine(px, ctx->origin.m_y, px, py);
+    }
+}
+
+long LateralProfilePlot::axis_length()
+    const
+/** No shorter than the fewest ticks allow, so a short segment leaves the
+ *  right of the plot empty */
+{
+    const double len = proton_profile_length(&wxGetApp().profile());
+    return std::max(static_cast<long>(std::ceil(len)), static_cast<long>(MIN_XTICKS + 1));
+}
+
+void LateralProfilePlot::write_xaxis()
+{
+    write_mm_axis(axis_length());
+}
+
+void LateralProfilePlot::write_yaxis()
+{
+    write_dose_axis(DOSEMAX_MULT * wxGetApp().get_max_dose(), wxT("%.2f"));
+}
+
+LateralProfilePlot::LateralProfilePlot(wxWindow *parent):
+    ProtonPlot(parent, PROFILE_AXLABEL, DOSE_AXLABEL, PDIFF_AXLABEL),
+    prof{ { 0.0, 0.0 }, { 0.0, 0.0 }, 1.0 },
+    sampled(~0UL)
+{
+
+}
+
+void LateralProfilePlot::on_segment_changed()
+{
+    if (xticks.empty() || xticks.back().second != axis_length()) {
+        write_axes();
+    }
+    invalidate_trace_data();
+    invalidate_measurements();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef LATERAL_PROFILE_PLOT_H
+#define LATERAL_PROFILE_PLOT_H
+
+#include <vector>
+#include "proton-plot.h"
+#include "../proton/proton-profile.h"
+
+
+/** Dose along the profile segment at the slice depth, against distance from
+ *  its start. The profile is sampled when the trace layer is drawn, so while
+ *  the segment is dragged only the page on show does any work */
+class LateralProfilePlot : public ProtonPlot {
+    ProtonProfile prof;         /* The segment the samples were taken along */
+    std::vector<float> samples;
+    unsigned long sampled;      /* trace_version() when they were taken */
+
+    /** Interpolates the samples at @p t mm along the segment */
+    double dose_at(double t) const noexcept;
+    /** Length of the distance axis for the current segment, in mm */
+    long axis_length() const;
+
+    void draw_legend(wxGraphicsContext *gc, const struct plot_context *ctx);
+    void draw_measurements(wxGraphicsContext *gc, const struct plot_context *ctx);
+    void draw_profile(wxGraphicsContext *gc, const struct plot_context *ctx);
+    void draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx);
+
+    void draw_xaxis(wxGraphicsContext *gc, const struct plot_context *ctx);
+    void draw_yaxis(wxGraphicsContext *gc, const struct plot_context *ctx);
+    void draw_paxis(wxGraphicsContext *gc, const struct plot_context *ctx);
+
+    virtual void initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx) override;
+
+    virtual void fetch_measurements() override;
+
+    virtual void draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+
+    virtual void write_xaxis() override;
+    virtual void write_yaxis() override;
+
+public:
+    LateralProfilePlot(wxWindow *parent);
+    ~LateralProfilePlot() = default;
+
+    /** The segment moved. The axes are only redrawn when the distance axis
+     *  changes length, which dragging mostly does not */
+    void on_segment_changed();
+};
+
+
+#endif /* LATERAL_PROFILE_PLOT_H */
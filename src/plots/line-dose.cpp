@@ -50,61 +50,40 @@ void LineDosePlot::draw_legend(wxGraphicsContext *gc, const struct plot_context
     gc->DrawText(tlbl, textorg, legendy);
 }
 
-void LineDosePlot::draw_measurements(wxGraphicsContext *gc, struct plot_context *ctx)
+void LineDosePlot::draw_measurements(wxGraphicsContext *gc, const struct plot_context *ctx)
 {
     const double dosescale = ctx->width.m_y / yticks.back();
     const double depthscale = ctx->width.m_x / static_cast<double>(xticks.back().second);
+    const double dcenter = std::fma(0.5, ctx->width.m_y, ctx->origin.m_y);
+    const double dscale = 5.0 * ctx->width.m_y;
+    std::vector<std::tuple<double, double>> diffs;
+    size_t i;
     gc->SetPen(measpen);
-    if (measurements.empty()) {
-        /* Draw a line at the currently drawn depth */
-        const double depth = wxGetApp().get_depth();
+    diffs.reserve(measurements.size());
+    for (i = 0; i < measurements.size(); i++) {
+        const auto &[depth, dose] = measurements[i];
         const double x = std::fma(depth, depthscale, ctx->origin.m_x);
-        const double y = std::fma(proton_line_get_dose(wxGetApp().get_dose(), depth), dosescale, ctx->origin.m_y);
-        gc->StrokeLine(x, ctx->origin.m_y, x, y);
-    } else {
-        const double dcenter = std::fma(0.5, ctx->width.m_y, ctx->origin.m_y);
-        const double dscale = 5.0 * ctx->width.m_y;
-        for (auto &[depth, dose] : measurements) {
-            const double x = std::fma(depth, depthscale, ctx->origin.m_x);
-            const double y = std::fma(dose, dosescale, ctx->origin.m_y);
-            const double mdose = proton_line_get_dose(wxGetApp().get_dose(), depth);
-            gc->DrawRectangle(
-                std::fma(-0.5, ctx->boxwidth, x),
-                std::fma(-0.5, ctx->boxwidth, y),
-                ctx->boxwidth, ctx->boxwidth);
-            dose = (dose - mdose) / mdose;
-            depth = x;
-        }
-        gc->SetPen(diffpen);
-        for (const auto &[x, dose] : measurements) {
-            const double y = std::fma(dose, dscale, dcenter);/* ctx->origin.m_y + 0.5 * ctx->width.m_y + 5 * ctx->width.m_y * meas.second; */
-            gc->DrawEllipse(
-                std::fma(-0.5, ctx->boxwidth, x),
-                std::fma(-0.5, ctx->boxwidth, y),
-                ctx->boxwidth, ctx->boxwidth);
-        }
+        const double y = std::fma(dose, dosescale, ctx->origin.m_y);
+        gc->DrawRectangle(
+            std::fma(-0.5, ctx->boxwidth, x),
+            std::fma(-0.5, ctx->boxwidth, y),
+            ctx->boxwidth, ctx->boxwidth);
+        diffs.push_back({x, differences[i]});
+    }
+    gc->SetPen(diffpen);
+    for (const auto &[x, dose] : diffs) {
+        const double y = std::fma(dose, dscale, dcenter);/* ctx->origin.m_y + 0.5 * ctx->width.m_y + 5 * ctx->width.m_y * meas.second; */
+        gc->DrawEllipse(
+            std::fma(-0.5, ctx->boxwidth, x),
+            std::fma(-0.5, ctx->boxwidth, y),
+            ctx->boxwidth, ctx->boxwidth);
     }
 }
 
 void LineDosePlot::draw_line_dose(wxGraphicsContext *gc, const struct plot_context *ctx)
 {
-    const double dosescale = ctx->width.m_y / yticks.back();
-    const double depthscale = ctx->width.m_x * proton_dose_spacing(wxGetApp().get_dose(), 1) / static_cast<double>(xticks.back().second);
-    const double depthorig = std::fma(depthscale, 0.5, ctx->origin.m_x);
-    const float *ld;
-    wxGraphicsPath p = gc->CreatePath();
-    long i;
-    ld = proton_line_raw(wxGetApp().get_dose());
-    gc->SetPen(dosepen);
-    p.MoveToPoint(depthorig, std::fma(static_cast<double>(*ld), dosescale, ctx->origin.m_y));
-    ld++;
-    for (i = 1; i < proton_line_length(wxGetApp().get_dose()); i++, ld++) {
-        const double dose = static_cast<double>(*ld);
-        p.AddLineToPoint(
-            std::fma(static_cast<double>(i), depthscale, depthorig),
-            std::fma(dose, dosescale, ctx->origin.m_y));
-    }
-    gc->StrokePath(p);
+    const ProtonDose *dose = wxGetApp().get_line_dose_data();
+    draw_dose_trace(gc, ctx, proton_line_raw(dose), proton_line_length(dose));
 }
 
 void LineDosePlot::draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx)
@@ -279,31 +258,53 @@ void LineDosePlot::initialize_plot_context(wxGraphicsContext *gc, struct plot_co
     ctx->boxwidth = pmean * 0.01;
 }
 
-void LineDosePlot::draw_plot(wxGraphicsContext *gc)
+void LineDosePlot::fetch_measurements()
 {
-    struct plot_context ctx;
-
-    /* Draw the background and compute the plot area subset */
-    gc->GetSize(&ctx.width.m_x, &ctx.width.m_y);
-    gc->SetBrush(*wxWHITE_BRUSH);
-    gc->DrawRectangle(0.0, 0.0, ctx.width.m_x, ctx.width.m_y);
-    initialize_plot_context(gc, &ctx);
+    const ProtonDose *ldose = wxGetApp().get_line_dose_data();
     wxGetApp().get_ld_measurements(measurements);
+    differences.clear();
+    differences.reserve(measurements.size());
+    for (const auto &[depth, dose] : measurements) {
+        const double mdose = proton_line_get_dose(ldose, depth);
+        differences.push_back((dose - mdose) / mdose);
+    }
+}
 
-    /* Prepare for drawing axes */
-    gc->SetBrush(wxNullBrush);
-    gc->SetPen(*wxBLACK_PEN);
-    draw_xaxis(gc, &ctx);
-    draw_yaxis(gc, &ctx);
+void LineDosePlot::draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    draw_xaxis(gc, ctx);
+    draw_yaxis(gc, ctx);
     if (!measurements.empty()) {
-        draw_paxis(gc, &ctx);
+        draw_paxis(gc, ctx);
     }
-    gc->Clip(ctx.origin.m_x, ctx.origin.m_y, ctx.width.m_x, ctx.width.m_y);
-    draw_dashes(gc, &ctx);
-    draw_line_dose(gc, &ctx);
-    draw_measurements(gc, &ctx);
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_dashes(gc, ctx);
+}
+
+void LineDosePlot::draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    gc->SetBrush(wxNullBrush);
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_line_dose(gc, ctx);
     if (!measurements.empty()) {
-        draw_legend(gc, &ctx);
+        draw_measurements(gc, ctx);
+        draw_legend(gc, ctx);
+    }
+}
+
+void LineDosePlot::draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx)
+/** Measurements replace the depth marker, so there is nothing to draw when
+ *  any are loaded */
+{
+    if (measurements.empty()) {
+        const double dosescale = ctx->width.m_y / yticks.back();
+        const double depthscale = ctx->width.m_x / static_cast<double>(xticks.back().second);
+        const double depth = wxGetApp().get_depth();
+        const double x = std::fma(depth, depthscale, ctx->origin.m_x);
+        const double y = std::fma(proton_line_get_dose(wxGetApp().get_line_dose_data(), depth), dosescale, ctx->origin.m_y);
+        gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+        gc->SetPen(measpen);
+        gc->StrokeLine(x, ctx->origin.m_y, x, y);
     }
 }
 
@@ -7,9 +7,10 @@
 
 
 class LineDosePlot : public ProtonPlot {
-    
+    std::vector<double> differences;    /* Relative, one per measurement */
+
     void draw_legend(wxGraphicsContext *gc, const struct plot_context *ctx);
-    void draw_measurements(wxGraphicsContext *gc, struct plot_context *ctx);
+    void draw_measurements(wxGraphicsContext *gc, const struct plot_context *ctx);
     void draw_line_dose(wxGraphicsContext *gc, const struct plot_context *ctx);
     void draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx);
 
@@ -17,7 +18,13 @@ class LineDosePlot : public ProtonPlot {
     void draw_yaxis(wxGraphicsContext *gc, const struct plot_context *ctx);
     void draw_paxis(wxGraphicsContext *gc, const struct plot_context *ctx);
 
-    void initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx);
+    virtual void initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx) override;
+
+    virtual void fetch_measurements() override;
+
+    virtual void draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx) override;
 
     virtual void write_xaxis() override;
     virtual void write_yaxis() override;
@@ -25,8 +32,6 @@ class LineDosePlot : public ProtonPlot {
 public:
     LineDosePlot(wxWindow *parent);
     ~LineDosePlot() = default;
-
-    virtual void draw_plot(wxGraphicsContext *gc) override;
 };
 
 
@@ -6,77 +6,44 @@ static const std::array<wxString, 4> plbls = {
     wxT("-10"), wxT("-5"), wxT(" 5"), wxT(" 10") };
 
 
-void PlanarDosePlot::draw_measurements(wxGraphicsContext *gc, struct plot_context *ctx)
+void PlanarDosePlot::draw_measurements(wxGraphicsContext *gc, const struct plot_context *ctx)
 {
     const double dosescale = ctx->width.m_y / yticks.back();
     const double depthscale = ctx->width.m_x / static_cast<double>(xticks.back().second);
+    const double dcenter = std::fma(0.5, ctx->width.m_y, ctx->origin.m_y);
+    const double dscale = 2.0 * ctx->width.m_y;
+    std::vector<std::tuple<double, double>> diffs;
+    size_t i;
     gc->SetPen(measpen);
-    if (measurements.empty()) {
-        /* Draw a line at the currently drawn depth */
-        const double depth = wxGetApp().get_depth();
+    diffs.reserve(measurements.size());
+    for (i = 0; i < measurements.size(); i++) {
+        const auto &[depth, dose] = measurements[i];
         const double x = std::fma(depth, depthscale, ctx->origin.m_x);
-#if PLOTTING_STOPPING_POWER
-        const double y = std::fma(proton_stppwr_get_dose(wxGetApp().get_dose(), depth), dosescale, ctx->origin.m_y);
-#else
-        const double y = std::fma(proton_planes_get_dose(wxGetApp().get_dose(), depth), dosescale, ctx->origin.m_y);
-#endif
-        gc->StrokeLine(x, ctx->origin.m_y, x, y);
-    } else {
-        const double dcenter = std::fma(0.5, ctx->width.m_y, ctx->origin.m_y);
-        const double dscale = 2.0 * ctx->width.m_y;
-        for (auto &[depth, dose] : measurements) {
-            const double x = std::fma(depth, depthscale, ctx->origin.m_x);
-            const double y = std::fma(dose, dosescale, ctx->origin.m_y);
-#if PLOTTING_STOPPING_POWER
-            const double mdose = proton_stppwr_get_dose(wxGetApp().get_dose(), depth);
-#else
-            const double mdose = proton_planes_get_dose(wxGetApp().get_dose(), depth);
-#endif
-            std::cout << " TPS dose:      " << mdose
-                    << "\n Measured dose: " << dose
-                    << '\n';
-            gc->DrawRectangle(
-                std::fma(-0.5, ctx->boxwidth, x),
-                std::fma(-0.5, ctx->boxwidth, y),
-                ctx->boxwidth, ctx->boxwidth);
-            dose = (dose - mdose) / mdose;
-            std::cout << " %difference:   " << dose * 100.0 << "%\n";
-            depth = x;
-        }
-        gc->SetPen(diffpen);
-        for (auto &&[x, dose] : measurements) {
-            const double y = std::fma(dose, dscale, dcenter);/* ctx->origin.m_y + 0.5 * ctx->width.m_y + 5 * ctx->width.m_y * meas.second; */
-            gc->DrawEllipse(
-                std::fma(-0.5, ctx->boxwidth, x),
-                std::fma(-0.5, ctx->boxwidth, y),
-                ctx->boxwidth, ctx->boxwidth);
-        }
+        const double y = std::fma(dose, dosescale, ctx->origin.m_y);
+        gc->DrawRectangle(
+            std::fma(-0.5, ctx->boxwidth, x),
+            std::fma(-0.5, ctx->boxwidth, y),
+            ctx->boxwidth, ctx->boxwidth);
+        diffs.push_back({x, differences[i]});
+    }
+    gc->SetPen(diffpen);
+    for (const auto &[x, dose] : diffs) {
+        const double y = std::fma(dose, dscale, dcenter);/* ctx->origin.m_y + 0.5 * ctx->width.m_y + 5 * ctx->width.m_y * meas.second; */
+        gc->DrawEllipse(
+            std::fma(-0.5, ctx->boxwidth, x),
+            std::fma(-0.5, ctx->boxwidth, y),
+            ctx->boxwidth, ctx->boxwidth);
     }
 }
 
 void PlanarDosePlot::draw_line_dose(wxGraphicsContext *gc, const struct plot_context *ctx)
 {
-    const double dosescale = ctx->width.m_y / yticks.back();
-    const double depthscale = ctx->width.m_x * proton_dose_spacing(wxGetApp().get_dose(), 1) / static_cast<double>(xticks.back().second);
-    const double depthorig = std::fma(depthscale, 0.5, ctx->origin.m_x);
-    const float *ld;
-    wxGraphicsPath p = gc->CreatePath();
-    long i;
+    const ProtonDose *dose = wxGetApp().get_dose();
 #if PLOTTING_STOPPING_POWER
-    ld = proton_stppwr_raw(wxGetApp().get_dose());
+    draw_dose_trace(gc, ctx, proton_stppwr_raw(dose), proton_line_length(dose));
 #else
-    ld = proton_planes_raw(wxGetApp().get_dose());
+    draw_dose_trace(gc, ctx, proton_planes_raw(dose), proton_line_length(dose));
 #endif
-    gc->SetPen(dosepen);
-    p.MoveToPoint(depthorig, std::fma(static_cast<double>(*ld), dosescale, ctx->origin.m_y));
-    ld++;
-    for (i = 1; i < proton_line_length(wxGetApp().get_dose()); i++, ld++) {
-        const double dose = static_cast<double>(*ld);
-        p.AddLineToPoint(
-            std::fma(static_cast<double>(i), depthscale, depthorig),
-            std::fma(dose, dosescale, ctx->origin.m_y));
-    }
-    gc->StrokePath(p);
 }
 
 void PlanarDosePlot::draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx)
@@ -251,32 +218,64 @@ void PlanarDosePlot::initialize_plot_context(wxGraphicsContext *gc, struct plot_
     ctx->boxwidth = pmean * 0.01;
 }
 
-void PlanarDosePlot::draw_plot(wxGraphicsContext *gc)
+void PlanarDosePlot::fetch_measurements()
 {
-    struct plot_context ctx;
-
-    gc->GetSize(&ctx.width.m_x, &ctx.width.m_y);
-    gc->SetBrush(*wxWHITE_BRUSH);
-    gc->DrawRectangle(0.0, 0.0, ctx.width.m_x, ctx.width.m_y);
+    const ProtonDose *pdose = wxGetApp().get_dose();
 #if PLOTTING_STOPPING_POWER
     wxGetApp().get_sp_measurements(measurements);
 #else
     wxGetApp().get_pd_measurements(measurements);
 #endif
-    initialize_plot_context(gc, &ctx);
+    differences.clear();
+    differences.reserve(measurements.size());
+    for (const auto &[depth, dose] : measurements) {
+#if PLOTTING_STOPPING_POWER
+        const double mdose = proton_stppwr_get_dose(pdose, depth);
+#else
+        const double mdose = proton_planes_get_dose(pdose, depth);
+#endif
+        differences.push_back((dose - mdose) / mdose);
+    }
+}
 
+void PlanarDosePlot::draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    draw_xaxis(gc, ctx);
+    draw_yaxis(gc, ctx);
+    if (!measurements.empty()) {
+        draw_paxis(gc, ctx);
+    }
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_dashes(gc, ctx);
+}
+
+void PlanarDosePlot::draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
     gc->SetBrush(wxNullBrush);
-    gc->SetPen(*wxBLACK_PEN);
-    draw_xaxis(gc, &ctx);
-    draw_yaxis(gc, &ctx);
+    gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+    draw_line_dose(gc, ctx);
     if (!measurements.empty()) {
-        draw_paxis(gc, &ctx);
+        draw_measurements(gc, ctx);
     }
+}
 
-    gc->Clip(ctx.origin.m_x, ctx.origin.m_y, ctx.width.m_x, ctx.width.m_y);
-    draw_dashes(gc, &ctx);
-    draw_line_dose(gc, &ctx);
-    draw_measurements(gc, &ctx);
+void PlanarDosePlot::draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx)
+{
+    if (measurements.empty()) {
+        /* Draw a line at the currently drawn depth */
+        const double dosescale = ctx->width.m_y / yticks.back();
+        const double depthscale = ctx->width.m_x / static_cast<double>(xticks.back().second);
+        const double depth = wxGetApp().get_depth();
+        const double x = std::fma(depth, depthscale, ctx->origin.m_x);
+#if PLOTTING_STOPPING_POWER
+        const double y = std::fma(proton_stppwr_get_dose(wxGetApp().get_dose(), depth), dosescale, ctx->origin.m_y);
+#else
+        const double y = std::fma(proton_planes_get_dose(wxGetApp().get_dose(), depth), dosescale, ctx->origin.m_y);
+#endif
+        gc->Clip(ctx->origin.m_x, ctx->origin.m_y, ctx->width.m_x, ctx->width.m_y);
+        gc->SetPen(measpen);
+        gc->StrokeLine(x, ctx->origin.m_y, x, y);
+    }
 }
 
 void PlanarDosePlot::write_xaxis()
@@ -7,8 +7,9 @@
 
 
 class PlanarDosePlot : public ProtonPlot {
+    std::vector<double> differences;    /* Relative, one per measurement */
 
-    void draw_measurements(wxGraphicsContext *gc, struct plot_context *ctx);
+    void draw_measurements(wxGraphicsContext *gc, const struct plot_context *ctx);
     void draw_line_dose(wxGraphicsContext *gc, const struct plot_context *ctx);
     void draw_dashes(wxGraphicsContext *gc, const struct plot_context *ctx);
 
@@ -16,7 +17,13 @@ class PlanarDosePlot : public ProtonPlot {
     void draw_yaxis(wxGraphicsContext *gc, const struct plot_context *ctx);
     void draw_paxis(wxGraphicsContext *gc, const struct plot_context *ctx);
 
-    void initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx);
+    virtual void initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx) override;
+
+    virtual void fetch_measurements() override;
+
+    virtual void draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx) override;
+    virtual void draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx) override;
 
     virtual void write_xaxis() override;
     virtual void write_yaxis() override;
@@ -24,8 +31,6 @@ class PlanarDosePlot : public ProtonPlot {
 public:
     PlanarDosePlot(wxWindow *parent);
     ~PlanarDosePlot() = default;
-
-    virtual void draw_plot(wxGraphicsContext *gc) override;
 };
 
 
@@ -1,32 +1,172 @@
 #include "../main-window.h"
+#include <wx/graphics.h>
+#include <algorithm>
+#include <cmath>
+#include "../proton/proton-trace.h"
 
 
 void ProtonPlot::on_evt_paint(wxPaintEvent &WXUNUSED(e))
 {
+    PROTON_TRACE_SCOPE("plot paint");
     wxPaintDC dc(this);
-    if (wxGetApp().dose_loaded()) {
-        wxGraphicsContext *gc = wxGraphicsContext::Create(dc);
-        this->draw_plot(gc);
+    const wxSize sz = this->GetClientSize();
+    if (wxGetApp().dose_loaded() && sz.GetWidth() > 0 && sz.GetHeight() > 0) {
+        wxGraphicsContext *gc;
+        update_measurements();
+        if (!axvalid || axmeasured == measurements.empty() || axlayer.GetSize() != sz) {
+            render_axes_layer(sz);
+        }
+        if (!trvalid) {
+            render_trace_layer();
+        }
+        dc.DrawBitmap(trlayer, 0, 0);
+        gc = wxGraphicsContext::Create(dc);
+        draw_marker(gc, &layerctx);
         delete gc;
     }
 }
 
+void ProtonPlot::update_measurements()
+{
+    if (!measvalid) {
+        PROTON_TRACE_SCOPE("plot measurements");
+        fetch_measurements();
+        measvalid = true;
+    }
+}
+
+void ProtonPlot::begin_plot(wxGraphicsContext *gc, struct plot_context *ctx)
+{
+    gc->GetSize(&ctx->width.m_x, &ctx->width.m_y);
+    gc->SetBrush(*wxWHITE_BRUSH);
+    gc->DrawRectangle(0.0, 0.0, ctx->width.m_x, ctx->width.m_y);
+    initialize_plot_context(gc, ctx);
+    gc->SetBrush(wxNullBrush);
+    gc->SetPen(*wxBLACK_PEN);
+}
+
+void ProtonPlot::render_axes_layer(const wxSize &sz)
+{
+    PROTON_TRACE_SCOPE("plot axes layer");
+    wxGraphicsContext *gc;
+    wxMemoryDC dc;
+    axlayer.Create(sz, 24);
+    dc.SelectObject(axlayer);
+    gc = wxGraphicsContext::Create(dc);
+    begin_plot(gc, &layerctx);
+    draw_axes(gc, &layerctx);
+    delete gc;
+    dc.SelectObject(wxNullBitmap);
+    axmeasured = !measurements.empty();
+    axvalid = true;
+    trvalid = false;
+}
+
+void ProtonPlot::render_trace_layer()
+{
+    PROTON_TRACE_SCOPE("plot trace layer");
+    wxGraphicsContext *gc;
+    wxMemoryDC dc;
+    trlayer = axlayer.GetSubBitmap(wxRect(axlayer.GetSize()));
+    dc.SelectObject(trlayer);
+    gc = wxGraphicsContext::Create(dc);
+    draw_trace(gc, &layerctx);
+    delete gc;
+    dc.SelectObject(wxNullBitmap);
+    trvalid = true;
+}
+
+/** Pushes the M4 reduction of @p data: per device pixel column, the first,
+ *  lowest, highest and last sample, in their original order. Stroking this
+ *  is indistinguishable from stroking every sample at that resolution */
+static void decimate_trace(std::vector<wxPoint2DDouble> &pts, const float *data,
+                           const long n, const double x0, const double dx,
+                           const double y0, const double dy)
+{
+    long i = 0;
+    pts.clear();
+    while (i < n) {
+        const double col = std::floor(std::fma(static_cast<double>(i), dx, x0));
+        const long first = i;
+        long lo = i, hi = i, last = i;
+        while (++i < n && std::floor(std::fma(static_cast<double>(i), dx, x0)) == col) {
+            lo = (data[i] < data[lo]) ? i : lo;
+            hi = (data[i] > data[hi]) ? i : hi;
+            last = i;
+        }
+        for (const long j : { first, std::min(lo, hi), std::max(lo, hi), last }) {
+            const wxPoint2DDouble pt(std::fma(static_cast<double>(j), dx, x0),
+                                     std::fma(static_cast<double>(data[j]), dy, y0));
+            if (pts.empty() || pts.back() != pt) {
+                pts.push_back(pt);
+            }
+        }
+    }
+}
+
+void ProtonPlot::draw_dose_trace(wxGraphicsContext *gc, const struct plot_context *ctx,
+                                 const float *data, long n)
+{
+    const double spacing = proton_dose_spacing(wxGetApp().get_dose(), 1);
+    draw_sampled_trace(gc, ctx, data, n, 0.5 * spacing, spacing);
+}
+
+void ProtonPlot::draw_sampled_trace(wxGraphicsContext *gc, const struct plot_context *ctx,
+                                    const float *data, long n, double first, double step)
+{
+    const double dosescale = ctx->width.m_y / yticks.back();
+    const double xscale = ctx->width.m_x / static_cast<double>(xticks.back().second);
+    const double xorig = std::fma(first, xscale, ctx->origin.m_x);
+    const double dx = step * xscale;
+    const struct trace_key key = {
+        data, n, traceserial, xorig, dx, ctx->origin.m_y, dosescale
+    };
+    if (!tracecached || !(key == tracekey)) {
+        decimate_trace(tracepts, data, n, xorig, dx, ctx->origin.m_y, dosescale);
+        tracepath = gc->CreatePath();
+        if (!tracepts.empty()) {
+            tracepath.MoveToPoint(tracepts.front());
+            for (auto it = tracepts.cbegin() + 1; it != tracepts.cend(); ++it) {
+                tracepath.AddLineToPoint(*it);
+            }
+        }
+        tracekey = key;
+        tracecached = true;
+    }
+    gc->SetPen(dosepen);
+    gc->StrokePath(tracepath);
+}
+
 void ProtonPlot::write_depth_axis()
+{
+    write_mm_axis(static_cast<long>(wxGetApp().get_max_slider_depth()));
+}
+
+void ProtonPlot::write_mm_axis(long maxmm)
+{
+    write_integer_axis(maxmm, wxT("%li"));
+}
+
+void ProtonPlot::write_percent_axis()
+{
+    write_integer_axis(100, wxT("%li%%"));
+}
+
+void ProtonPlot::write_integer_axis(long maxval, const wxString &fmt)
 {
     constexpr std::array<long, 7> tikdivs = { 100, 50, 20, 10, 5, 2, 1 };
-    const long maxdepth = static_cast<long>(wxGetApp().get_max_slider_depth());
     long div = 0, i;
     double tikinc;
     std::ldiv_t res;
     for (const long tdiv : tikdivs) {
-        res = std::ldiv(maxdepth, tdiv);
+        res = std::ldiv(maxval, tdiv);
         if (res.quot > MIN_XTICKS) {
             div = tdiv;
             break;
         }
     }
     if (div) {
-        const double xtra = static_cast<double>(res.rem) / static_cast<double>(maxdepth);
+        const double xtra = static_cast<double>(res.rem) / static_cast<double>(maxval);
         tikinc = (1.0 - xtra) / static_cast<double>(res.quot);
     } else [[unlikely]] {
         /* Is this even possible? */
@@ -37,10 +177,10 @@ void ProtonPlot::write_depth_axis()
     xticklabels.resize(res.quot + 1);
     for (i = 0; i <= res.quot; i++) {
         xticks[i] = { static_cast<double>(i) * tikinc, i * div };
-        xticklabels[i].Printf(wxT("%li"), xticks[i].second);
+        xticklabels[i].Printf(fmt, xticks[i].second);
     }
     if (res.rem) {
-        xticks.push_back({1.0, maxdepth});
+        xticks.push_back({1.0, maxval});
     }
 }
 
@@ -59,6 +199,8 @@ void ProtonPlot::write_dose_axis(const double limit, const wxString &fmt)
 
 ProtonPlot::ProtonPlot(wxWindow *parent, const wxString &xlabel, const wxString &ylabel, const wxString &plabel):
     wxWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE),
+    axvalid(false), trvalid(false), measvalid(false), axmeasured(false),
+    tracecached(false), traceserial(0),
     dosecolor(60, 160, 100),
     meascolor(60, 60, 190),
     diffcolor(200, 50, 20),
@@ -76,8 +218,22 @@ ProtonPlot::ProtonPlot(wxWindow *parent, const wxString &xlabel, const wxString
 #endif
 }
 
+void ProtonPlot::draw_plot(wxGraphicsContext *gc)
+{
+    struct plot_context ctx;
+
+    update_measurements();
+    begin_plot(gc, &ctx);
+    draw_axes(gc, &ctx);
+    gc->ResetClip();
+    draw_trace(gc, &ctx);
+    gc->ResetClip();
+    draw_marker(gc, &ctx);
+}
+
 void ProtonPlot::write_axes()
 {
     write_xaxis();
     write_yaxis();
+    axvalid = false;
 }
@@ -4,6 +4,8 @@
 #define PROTON_PLOT_H
 
 #include <wx/wx.h>
+#include <wx/graphics.h>
+#include <tuple>
 #include <vector>
 
 /** Controls the vertical axis limit of the line dose plot. Determines what 
@@ -24,6 +26,7 @@
 #define IMAGE_TIKFONT_SIZE 14   /* Axis tick labels */
 
 #define DEPTH_AXLABEL   wxT("Depth (mm)")
+#define PROFILE_AXLABEL wxT("Distance along profile (mm)")
 #define DOSE_AXLABEL    wxT("Dose (Gy)")
 #define PLANE_AXLABEL   wxT("Average planar dose (Gy)")
 #define PDIFF_AXLABEL   wxT("% Dose difference")
@@ -34,11 +37,6 @@ constexpr double M_PI_2 = 1.57079632679489661923;
 
 
 class ProtonPlot : public wxWindow {
-    void on_evt_paint(wxPaintEvent &e);
-
-    virtual void write_xaxis() = 0;
-    virtual void write_yaxis() = 0;
-
 protected:
     struct plot_context {
         wxFont tikfont, axfont;
@@ -49,6 +47,51 @@ protected:
         double maxxheight, maxywidth, maxpwidth;
     };
 
+private:
+    /** Cached layers. The axes layer holds the background, axes and grid, and
+     *  the trace layer is a copy of it with the dose trace and measurements
+     *  drawn on top. Only the depth marker is drawn on every paint */
+    wxBitmap axlayer, trlayer;
+    struct plot_context layerctx;
+    bool axvalid, trvalid;
+    /** The measurements are compared with the dose when they are fetched, and
+     *  kept until one of their inputs changes, so redrawing the trace layer
+     *  for any other reason does no measurement work */
+    bool measvalid;
+    bool axmeasured;    /* Whether the axes layer was drawn with a % axis */
+
+    /** The decimated dose trace is kept between paints, and rebuilt only when
+     *  the data or the plot geometry changes. The serial counts changes to the
+     *  data, since a plot may refill the same buffer */
+    struct trace_key {
+        const float *data;
+        long n;
+        unsigned long serial;
+        double x0, dx, y0, dy;
+
+        bool operator==(const trace_key &k) const noexcept
+            { return data == k.data && n == k.n && serial == k.serial
+                && x0 == k.x0 && dx == k.dx && y0 == k.y0 && dy == k.dy; }
+    } tracekey;
+    std::vector<wxPoint2DDouble> tracepts;
+    wxGraphicsPath tracepath;
+    bool tracecached;
+    unsigned long traceserial;  /* Bumped by invalidate_trace_data() only */
+
+    void on_evt_paint(wxPaintEvent &e);
+
+    void update_measurements();
+    void begin_plot(wxGraphicsContext *gc, struct plot_context *ctx);
+    void render_axes_layer(const wxSize &sz);
+    void render_trace_layer();
+
+    /** Whole-number ticks from zero to @p maxval, labelled with @p fmt */
+    void write_integer_axis(long maxval, const wxString &fmt);
+
+    virtual void write_xaxis() = 0;
+    virtual void write_yaxis() = 0;
+
+protected:
     const wxColour dosecolor, meascolor, diffcolor;
     const wxPen dashpen, dosepen, measpen, diffpen, diffpendashed;
 
@@ -60,15 +103,51 @@ protected:
 
     std::vector<std::tuple<double, double>> measurements;
 
+    /** Plots that sample their trace themselves resample when this changes */
+    unsigned long trace_version() const noexcept { return traceserial; }
+
     void write_depth_axis();
+    /** Ticks in whole mm from zero to @p maxmm, which must be at least
+     *  MIN_XTICKS + 1 */
+    void write_mm_axis(long maxmm);
+    /** Ticks every 10% from zero to 100% */
+    void write_percent_axis();
     void write_dose_axis(const double limit, const wxString &fmt);
 
+    /** Strokes @p n samples of @p data, one per dose plane, reduced to the
+     *  first, lowest, highest and last sample in each pixel column */
+    void draw_dose_trace(wxGraphicsContext *gc, const struct plot_context *ctx,
+                         const float *data, long n);
+    /** The same for samples @p step apart from @p first, in x axis units */
+    void draw_sampled_trace(wxGraphicsContext *gc, const struct plot_context *ctx,
+                            const float *data, long n, double first, double step);
+
+    /** Fetches the measurements, and anything compared from them that
+     *  does not depend on the plot geometry */
+    virtual void fetch_measurements() = 0;
+    virtual void initialize_plot_context(wxGraphicsContext *gc, struct plot_context *ctx) = 0;
+
+    /** Static layer: axes, tick labels and grid */
+    virtual void draw_axes(wxGraphicsContext *gc, const struct plot_context *ctx) = 0;
+    /** Changes with the dose, the line dose or the measurements */
+    virtual void draw_trace(wxGraphicsContext *gc, const struct plot_context *ctx) = 0;
+    /** Changes with the depth only, so this must stay cheap */
+    virtual void draw_marker(wxGraphicsContext *gc, const struct plot_context *ctx) = 0;
+
 public:
     ProtonPlot(wxWindow *parent, const wxString &xlabel, 
                const wxString &ylabel, const wxString &plabel);
 
-    virtual void draw_plot(wxGraphicsContext *gc) = 0;
+    /** Draws every layer directly onto @p gc, without touching the cache */
+    void draw_plot(wxGraphicsContext *gc);
     void write_axes();
+
+    /** The trace layer must be redrawn, over the same data */
+    void invalidate_trace() noexcept { trvalid = false; }
+    /** The data under the dose trace changed */
+    void invalidate_trace_data() noexcept { traceserial++; invalidate_trace(); }
+    /** The measurements, or the dose they are compared with, changed */
+    void invalidate_measurements() noexcept { measvalid = false; invalidate_trace(); }
 };
 
 
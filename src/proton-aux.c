@@ -31,7 +31,7 @@ static float cmap_clamp(float x, const float lbound, const float ubound)
 
 static unsigned char cmap_red(float x)
 {   
-    x = cmap_clamp(fmaf(4.0f, x, -1.0f), 0.0f, 1.0f);
+    x = cmap_clamp(4.0f * x - 1.0f, 0.0f, 1.0f);
     return STATIC_CAST(unsigned char, UCHAR_MAXF * x);
 }
 
@@ -42,14 +42,14 @@ static unsigned char cmap_green(float x)
     } else if (x < 0.75f) {
         x = 1.5f - x;
     } else {
-        x = fmaf(-3.0f, x, 3.0f);
+        x = 3.0f - 3.0f * x;
     }
     return STATIC_CAST(unsigned char, UCHAR_MAXF * x);
 }
 
 static unsigned char cmap_blue(float x)
 {
-    x = cmap_clamp(fmaf(-4.0f, x, 1.0f), 0.0f, 1.0f);
+    x = cmap_clamp(1.0f - 4.0f * x, 0.0f, 1.0f);
     return STATIC_CAST(unsigned char, UCHAR_MAXF * x);
 }
 
@@ -325,6 +325,10 @@ void proton_cmap_viridis(float x, unsigned char px[])
 {
     static const float vsize = STATIC_CAST(float, sizeof viridis / 3);
     size_t idx = STATIC_CAST(size_t, x * vsize);
+    if (idx >= sizeof viridis / 3) {
+        /* x == 1 at the dose maximum */
+        idx = sizeof viridis / 3 - 1;
+    }
     memcpy(px, viridis + idx * 3, sizeof *px * 3);
 }
 
@@ -593,6 +597,10 @@ void proton_cmap_turbo(float x, unsigned char px[])
 {
     static const float vsize = STATIC_CAST(float, sizeof turbo / 3);
     size_t idx = STATIC_CAST(size_t, x * vsize);
+    if (idx >= sizeof turbo / 3) {
+        /* x == 1 at the dose maximum */
+        idx = sizeof turbo / 3 - 1;
+    }
     memcpy(px, turbo + idx * 3, sizeof *px * 3);
 }
 
@@ -602,7 +610,7 @@ void proton_cmap_gradient(float x, unsigned char px[])
     x = fabsf(x);
     if (x < 1.0f) {
         px[0] = (unsigned char)(x * (float)0xFF);
-        px[1] = (unsigned char)((1.0f - fabsf(fmaf(2.0f, x, -1.0f))) * (float)0xFF);
+        px[1] = (unsigned char)((1.0f - fabsf(2.0f * x - 1.0f)) * (float)0xFF);
         px[2] = (unsigned char)((1.0f - x) * (float)0xFF);
     } else {
         px[0] = 0xFF;
@@ -612,6 +620,23 @@ void proton_cmap_gradient(float x, unsigned char px[])
 }
 
 
+void proton_cmap_diverging(float x, unsigned char px[])
+{
+    const float t = (x < -1.0f) ? 1.0f : (x > 1.0f) ? 1.0f : fabsf(x);
+    const unsigned char fade = (unsigned char)((1.0f - t) * (float)0xFF);
+
+    if (x < 0.0f) {
+        px[0] = fade;
+        px[1] = fade;
+        px[2] = 0xFF;
+    } else {
+        px[0] = 0xFF;
+        px[1] = fade;
+        px[2] = fade;
+    }
+}
+
+
 double proton_buildup(double theor)
 {
     return (theor - 8) / 1.02;
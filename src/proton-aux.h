@@ -20,6 +20,11 @@ void proton_cmap_turbo(float x, unsigned char px[]);
 void proton_cmap_gradient(float x, unsigned char px[]);
 
 
+/** For comparisons, which can be negative: blue at -1 through white at zero
+ *  to red at 1 */
+void proton_cmap_diverging(float x, unsigned char px[]);
+
+
 /** @brief Compute the physical solid water buildup required to create an
  *      apparent depth of @p theor to the proton beam
  *  @param theor
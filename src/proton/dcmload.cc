@@ -1,6 +1,10 @@
 #include "dcmload.h"
+#include "proton-kernels.h"
 #include <cmath>
+#include <memory>
+#include <string>
 #include <dcmtk/dcmrt/drmdose.h>
+#include <dcmtk/dcmdata/dctk.h>
 
 
 struct _dicom_rtdose {
@@ -32,6 +36,48 @@ void rtdose_destroy(RTDose *dcm)
 }
 
 
+bool rtdose_read_geometry(const char *filename, long dim[], double imgpos[],
+                          double spacing[], size_t ebufsz, char errbuf[])
+/** Parsing stops at the pixel data, so only the header is held */
+{
+    DcmFileFormat file;
+    DcmDataset *ds;
+    OFCondition stat;
+    Uint16 cols, rows;
+    Sint32 frames;
+    Float64 x;
+    unsigned long i;
+
+    stat = file.loadFileUntilTag(filename, EXS_Unknown, EGL_noChange,
+                                 DCM_MaxReadLength, ERM_autoDetect, DCM_PixelData);
+    if (stat.bad()) {
+        snprintf(errbuf, ebufsz, "%s", stat.text());
+        return true;
+    }
+    ds = file.getDataset();
+    if (ds->findAndGetUint16(DCM_Columns, cols).bad()
+     || ds->findAndGetUint16(DCM_Rows, rows).bad()
+     || ds->findAndGetSint32(DCM_NumberOfFrames, frames).bad()
+     || ds->findAndGetFloat64(DCM_PixelSpacing, spacing[0], 0).bad()
+     || ds->findAndGetFloat64(DCM_PixelSpacing, spacing[1], 1).bad()
+     || ds->findAndGetFloat64(DCM_SliceThickness, spacing[2]).bad()) {
+        snprintf(errbuf, ebufsz, "Missing the dose grid geometry");
+        return true;
+    }
+    for (i = 0; i < 3; i++) {
+        if (ds->findAndGetFloat64(DCM_ImagePositionPatient, x, i).bad()) {
+            snprintf(errbuf, ebufsz, "Missing the dose grid geometry");
+            return true;
+        }
+        imgpos[i] = static_cast<double>(x);
+    }
+    dim[0] = static_cast<long>(cols);
+    dim[1] = static_cast<long>(rows);
+    dim[2] = static_cast<long>(frames);
+    return false;
+}
+
+
 bool rtdose_get_img_pos_pt(const RTDose *dcm, double imgpos[])
 {
     OFCondition stat;
@@ -98,29 +144,229 @@ bool rtdose_get_dimensions(const RTDose *dcm, long dim[])
 }
 
 
-bool rtdose_get_dose_data(RTDose *dcm, const long dim[], float *dptr, float *dmax)
+bool rtdose_get_dose_frame(RTDose *dcm, const long dim[], long k, float *dptr,
+                           float *dmax)
 {
     const long ax_N = dim[0] * dim[1];
-    OFVector<Float64>::iterator it;
     OFVector<Float64> plane;
     OFCondition stat;
-    long k, N;
+
+    stat = dcm->dcm.getDoseImage(plane, k);
+    if (stat.bad() || plane.size() < static_cast<size_t>(ax_N)) {
+        return true;
+    }
+    proton_kernels()->narrow(dptr, &plane[0], ax_N, dmax);
+    return false;
+}
+
+
+bool rtdose_get_dose_data(RTDose *dcm, const long dim[], float *dptr, float *dmax)
+{
+    const long ax_N = dim[0] * dim[1];
+    long k;
 
     *dmax = -HUGE_VAL;
     for (k = 0; k < dim[2]; k++) {
-        N = ax_N;
-        stat = dcm->dcm.getDoseImage(plane, k);
-        if (stat.bad()) {
+        if (rtdose_get_dose_frame(dcm, dim, k, dptr, dmax)) {
             return true;
         }
-        it = plane.begin();
-        do {
-            *dptr = static_cast<float>(*it);
-            *dmax = (std::max)(*dmax, *dptr);
-            dptr++;
-            ++it;
-            N--;
-        } while (N);
+        dptr += ax_N;
+    }
+    return false;
+}
+
+
+/** Formats one DS value. %.8g never exceeds the 16 characters DS allows */
+static OFString rtdose_ds(double x)
+{
+    char buf[24];
+
+    snprintf(buf, sizeof buf, "%.8g", x);
+    return OFString(buf);
+}
+
+
+static OFString rtdose_ds_list(const double *x, long n)
+{
+    OFString res;
+    long i;
+
+    for (i = 0; i < n; i++) {
+        if (i) {
+            res += "\\";
+        }
+        res += rtdose_ds(x[i]);
+    }
+    return res;
+}
+
+
+static OFCondition rtdose_write_header(DcmDataset *ds, const RTDoseDesc *desc,
+                                       double scaling)
+{
+    const double imgorient[6] = { 1.0, 0.0, 0.0, 0.0, 1.0, 0.0 };
+    /* The loader reads PixelSpacing's two values into dim 0 and dim 1 in that
+    order, so they are written back the same way */
+    const double pxspacing[2] = { desc->spacing[0], desc->spacing[1] };
+    char study[100], series[100], instance[100], frame[100];
+    OFCondition stat;
+    OFString offsets;
+    long k;
+
+    dcmGenerateUniqueIdentifier(study, SITE_STUDY_UID_ROOT);
+    dcmGenerateUniqueIdentifier(series, SITE_SERIES_UID_ROOT);
+    dcmGenerateUniqueIdentifier(instance, SITE_INSTANCE_UID_ROOT);
+    dcmGenerateUniqueIdentifier(frame, SITE_INSTANCE_UID_ROOT);
+    for (k = 0; k < desc->dim[2]; k++) {
+        if (k) {
+            offsets += "\\";
+        }
+        offsets += rtdose_ds(static_cast<double>(k) * desc->spacing[2]);
+    }
+
+    const struct {
+        DcmTagKey tag;
+        OFString value;
+    } strs[] = {
+        { DCM_SOPClassUID,                UID_RTDoseStorage },
+        { DCM_SOPInstanceUID,             instance },
+        { DCM_StudyInstanceUID,           study },
+        { DCM_SeriesInstanceUID,          series },
+        { DCM_FrameOfReferenceUID,        frame },
+        { DCM_Modality,                   "RTDOSE" },
+        { DCM_PatientName,                "Synthetic^Phantom" },
+        { DCM_PatientID,                  "SYNTHETIC" },
+        { DCM_SeriesDescription,          "Synthetic SOBP" },
+        { DCM_PhotometricInterpretation,  "MONOCHROME2" },
+        { DCM_NumberOfFrames,             std::to_string(desc->dim[2]).c_str() },
+        { DCM_ImagePositionPatient,       rtdose_ds_list(desc->imgpos, 3) },
+        { DCM_ImageOrientationPatient,    rtdose_ds_list(imgorient, 6) },
+        { DCM_PixelSpacing,               rtdose_ds_list(pxspacing, 2) },
+        { DCM_SliceThickness,             rtdose_ds(desc->spacing[2]) },
+        { DCM_GridFrameOffsetVector,      offsets },
+        { DCM_DoseUnits,                  "GY" },
+        { DCM_DoseType,                   "PHYSICAL" },
+        { DCM_DoseSummationType,          "PLAN" },
+        { DCM_DoseGridScaling,            rtdose_ds(scaling) }
+    };
+    const struct {
+        DcmTagKey tag;
+        Uint16 value;
+    } ushorts[] = {
+        { DCM_SamplesPerPixel,      1 },
+        { DCM_Rows,                 static_cast<Uint16>(desc->dim[1]) },
+        { DCM_Columns,              static_cast<Uint16>(desc->dim[0]) },
+        { DCM_BitsAllocated,        static_cast<Uint16>(desc->bits) },
+        { DCM_BitsStored,           static_cast<Uint16>(desc->bits) },
+        { DCM_HighBit,              static_cast<Uint16>(desc->bits - 1) },
+        { DCM_PixelRepresentation,  0 }
+    };
+
+    for (const auto &s : strs) {
+        stat = ds->putAndInsertOFStringArray(s.tag, s.value);
+        if (stat.bad()) {
+            return stat;
+        }
+    }
+    for (const auto &u : ushorts) {
+        stat = ds->putAndInsertUint16(u.tag, u.value);
+        if (stat.bad()) {
+            return stat;
+        }
+    }
+    return ds->putAndInsertTagKey(DCM_FrameIncrementPointer, DCM_GridFrameOffsetVector);
+}
+
+
+/** Quantizes and packs the frames into @p px, which holds bits / 16 words
+ *  per voxel. OW data is kept in host word order by DCMTK, so a 32-bit value
+ *  is stored as its low word followed by its high word */
+static bool rtdose_write_pixels(Uint16 *px, const RTDoseDesc *desc, double scaling,
+                                rtdose_frame_fn frame, void *arg)
+{
+    const long npx = desc->dim[0] * desc->dim[1];
+    const double maxval = (desc->bits == 32) ? 4294967295.0 : 65535.0;
+    std::unique_ptr<float[]> plane(new (std::nothrow) float[npx]);
+    long i, k;
+
+    if (!plane) {
+        return true;
+    }
+    for (k = 0; k < desc->dim[2]; k++) {
+        frame(arg, k, plane.get());
+        for (i = 0; i < npx; i++) {
+            const double v = std::round(static_cast<double>(plane[i]) / scaling);
+            const Uint32 q = static_cast<Uint32>((std::min)((std::max)(v, 0.0), maxval));
+            if (desc->bits == 32) {
+                *px++ = static_cast<Uint16>(q & 0xFFFF);
+                *px++ = static_cast<Uint16>(q >> 16);
+            } else {
+                *px++ = static_cast<Uint16>(q);
+            }
+        }
+    }
+    return false;
+}
+
+
+bool rtdose_write(const char *filename, const RTDoseDesc *desc,
+                  rtdose_frame_fn frame, void *arg, size_t ebufsz, char err[])
+{
+    const double maxval = (desc->bits == 32) ? 4294967295.0 : 65535.0;
+    const double scaling = (desc->dmax > 0.0f) ? desc->dmax / maxval : 1.0;
+    const double words = static_cast<double>(desc->dim[0]) * desc->dim[1]
+                       * desc->dim[2] * (desc->bits / 16);
+    DcmFileFormat file;
+    DcmDataset *ds = file.getDataset();
+    DcmPixelData *pixel;
+    OFCondition stat;
+    Uint16 *px;
+
+    if (desc->bits != 16 && desc->bits != 32) {
+        snprintf(err, ebufsz, "Bits allocated must be 16 or 32");
+        return true;
+    }
+    if (desc->dim[0] < 1 || desc->dim[1] < 1 || desc->dim[2] < 1
+     || desc->dim[0] > 0xFFFF || desc->dim[1] > 0xFFFF) {
+        snprintf(err, ebufsz, "Rows and columns must be in 1..65535");
+        return true;
+    }
+    /* Pixel data is a single element with a 32-bit length */
+    if (2.0 * words >= 4294967294.0) {
+        snprintf(err, ebufsz, "Pixel data exceeds the 4 GiB element limit");
+        return true;
+    }
+    stat = rtdose_write_header(ds, desc, scaling);
+    if (stat.bad()) {
+        snprintf(err, ebufsz, "%s", stat.text());
+        return true;
+    }
+    pixel = new (std::nothrow) DcmPixelData(DCM_PixelData);
+    if (!pixel) {
+        snprintf(err, ebufsz, "Out of memory");
+        return true;
+    }
+    pixel->setVR(EVR_OW);
+    stat = pixel->createUint16Array(static_cast<Uint32>(words), px);
+    if (stat.bad()) {
+        delete pixel;
+        snprintf(err, ebufsz, "%s", stat.text());
+        return true;
+    }
+    stat = ds->insert(pixel, true);
+    if (stat.bad()) {
+        delete pixel;
+        snprintf(err, ebufsz, "%s", stat.text());
+        return true;
+    }
+    if (rtdose_write_pixels(px, desc, scaling, frame, arg)) {
+        snprintf(err, ebufsz, "Out of memory");
+        return true;
+    }
+    stat = file.saveFile(filename, EXS_LittleEndianExplicit);
+    if (stat.bad()) {
+        snprintf(err, ebufsz, "%s", stat.text());
+        return true;
     }
     return false;
 }
@@ -18,6 +18,12 @@ typedef struct _dicom_rtdose RTDose;
 RTDose *rtdose_create(const char *filename, size_t ebufsz, char err[]);
 void rtdose_destroy(RTDose *dcm);
 
+/** Reads the grid of an RTDose without loading its pixel data: columns,
+ *  rows and frames to @p dim, the position and spacing as the getters below
+ *  give them. Returns true on failure */
+bool rtdose_read_geometry(const char *filename, long dim[], double imgpos[],
+                          double spacing[], size_t ebufsz, char err[]);
+
 /* None of these do any NULL checking */
 bool rtdose_get_img_pos_pt(const RTDose *dcm, double imgpos[]);
 bool rtdose_get_px_spacing(const RTDose *dcm, double spacing[]);
@@ -26,6 +32,31 @@ bool rtdose_get_dimensions(const RTDose *dcm, long dim[]);
 /* Buffer must be preallocated */
 bool rtdose_get_dose_data(RTDose *dcm, const long dim[], float *dptr, float *dmax);
 
+/** Decodes only frame @p k into @p dptr, which holds dim[0] x dim[1] floats,
+ *  raising @p dmax to its maximum. The RTDose is not safe to share between
+ *  threads while this runs */
+bool rtdose_get_dose_frame(RTDose *dcm, const long dim[], long k, float *dptr,
+                           float *dmax);
+
+
+/** Geometry of an RTDose to be written. The axes follow the loader: dim and
+ *  spacing are columns, rows, frames */
+typedef struct _rtdose_desc {
+    double imgpos[3];
+    double spacing[3];
+    long dim[3];
+    float dmax;     /* Upper bound of the dose, sets DoseGridScaling */
+    int bits;       /* 16 or 32 */
+} RTDoseDesc;
+
+/** Writes the dim[0] x dim[1] frame @p k to @p plane */
+typedef void (*rtdose_frame_fn)(void *arg, long k, float *plane);
+
+/** Writes an RTDose file, requesting the voxels one frame at a time so that
+ *  only the encoded pixel data is ever held in full. Returns true on failure */
+bool rtdose_write(const char *filename, const RTDoseDesc *desc,
+                  rtdose_frame_fn frame, void *arg, size_t ebufsz, char err[]);
+
 
 #if __cplusplus
 }
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "mcc-data.h"
+#include "proton-trace.h"
 
 #if _MSC_VER
 #   define _q(qualifiers)
@@ -104,7 +105,7 @@ static void mcc_data_push_scan(MCCData **data, double y, jmp_buf env)
 
     if ((*data)->sz == (*data)->_cap) {
         newcap = (*data)->_cap * 2;
-        newptr = realloc(*data, sizeof **data + sizeof *(*data)->scans);
+        newptr = realloc(*data, sizeof **data + sizeof *(*data)->scans * newcap);
         if (newptr) {
             *data = newptr;
             (*data)->_cap = newcap;
@@ -152,9 +153,10 @@ enum mcc_scope {
 struct mcc_parse_context {
     enum mcc_scope scope;
     struct mcc_stmt stmt;
-    double offaxis, crosscal;
+    double offaxis, crosscal, depth;
     bool offaxis_fnd:   1;
     bool crosscal_fnd:  1;
+    bool depth_fnd:     1;
 };
 
 static const char *delims[] = {
@@ -380,6 +382,7 @@ static void mcc_data_keyval_check(struct mcc_parse_context *ctx, jmp_buf env)
 {
     static const char *const offax_key = "SCAN_OFFAXIS_INPLANE";
     static const char *const crosscal_key = "CROSS_CALIBRATION";
+    static const char *const depth_key = "SCAN_DEPTH";
     const char *const key = ctx->stmt.u.keyval.key;
 
     if (ctx->scope == SCOPE_SCAN) {
@@ -389,6 +392,10 @@ static void mcc_data_keyval_check(struct mcc_parse_context *ctx, jmp_buf env)
         } else if (!strcmp(key, crosscal_key)) {
             ctx->crosscal = mcc_data_doubleconv(ctx->stmt.u.keyval.val, env);
             ctx->crosscal_fnd = 1;
+        } else if (!strcmp(key, depth_key) && !ctx->depth_fnd) {
+            /* Every scan of a planar measurement is at the same depth */
+            ctx->depth = mcc_data_doubleconv(ctx->stmt.u.keyval.val, env);
+            ctx->depth_fnd = 1;
         }
     }
 }
@@ -408,7 +415,8 @@ static void mcc_data_load_nodes(FILE *mcc, MCCData **data, jmp_buf env)
     struct mcc_parse_context ctx = {
         .scope = SCOPE_OUT_OF_FILE,
         .offaxis_fnd = 0,
-        .crosscal_fnd = 0
+        .crosscal_fnd = 0,
+        .depth_fnd = 0
     };
     char linebuf[LINEBUFSZ];
 
@@ -429,6 +437,7 @@ static void mcc_data_load_nodes(FILE *mcc, MCCData **data, jmp_buf env)
             longjmp(env, MCC_ERROR_UNCLASSIFIABLE_STATEMENT);
         }
     }
+    (*data)->depth = (ctx.depth_fnd) ? ctx.depth : -1.0;
 }
 
 
@@ -556,6 +565,7 @@ static MCCData *mcc_data_alloc(FILE *mcc, int *stat)
 
 MCCData *mcc_data_create(const char *filename, int *stat)
 {
+    const uint64_t t0 = proton_trace_begin();
     MCCData *data = NULL;
     FILE *mfile;
 
@@ -564,8 +574,10 @@ MCCData *mcc_data_create(const char *filename, int *stat)
         data = mcc_data_alloc(mfile, stat);
     } else {
         *stat = MCC_ERROR_FOPEN_FAILED;
+        return NULL;
     }
     fclose(mfile);
+    proton_trace_end("mcc parse", t0);
     return data;
 }
 
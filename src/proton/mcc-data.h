@@ -32,6 +32,7 @@ typedef struct _mcc_data {
     unsigned int sz, _cap;
     long nsupp;
     double sum;
+    double depth;       /* SCAN_DEPTH of the first scan in mm, or -1 if none */
 
 #if !defined(__cplusplus) || !__cplusplus
     struct mcc_scan {
@@ -50,6 +51,7 @@ void mcc_data_destroy(MCCData *mcc);
 double mcc_data_get_point_dose(const MCCData *mcc, double x, double y);
 inline double mcc_data_get_sum(const MCCData *mcc) { return mcc->sum; }
 inline long mcc_data_get_supp(const MCCData *mcc) { return mcc->nsupp; }
+inline double mcc_data_get_depth(const MCCData *mcc) { return mcc->depth; }
 
 
 #if __cplusplus
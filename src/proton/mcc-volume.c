@@ -0,0 +1,366 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcc-volume.h"
+#include "proton-trace.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+/* Detector positions closer than this (mm) are the same lattice line */
+#define LATTICE_TOL 1e-6
+
+
+/** Every plane is sampled at every lattice node. Within a cell each plane
+ *  is bilinear, since the lattice holds every scan ordinate and detector
+ *  position of every plane, so a cell lies between two scans and between
+ *  two detectors of each. Cells a plane does not cover read zero, as
+ *  mcc_data_get_point_dose() does off the detectors */
+struct _mcc_volume {
+    long n, nx, ny;
+    double *x, *y;              /* Lattice lines, ascending */
+    double *depth;              /* Per plane, ascending */
+    double *node;               /* n planes of ny rows of nx */
+    unsigned char *valid;       /* n planes of ny - 1 rows of nx - 1 cells */
+};
+
+struct volume_order {
+    double depth;
+    long idx;
+};
+
+
+static int volume_dblcmp(const void *a, const void *b)
+{
+    const double *x = a, *y = b;
+
+    return (*x > *y) - (*x < *y);
+}
+
+
+/** By depth, then in the order given, so that equal depths keep it */
+static int volume_ordercmp(const void *a, const void *b)
+{
+    const struct volume_order *x = a, *y = b;
+
+    if (x->depth != y->depth) {
+        return (x->depth > y->depth) - (x->depth < y->depth);
+    }
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+
+/** Sorts @p v and drops repeats, returning how many are left */
+static long lattice_unique(double *v, long n)
+{
+    long i, m = 0;
+
+    qsort(v, n, sizeof *v, volume_dblcmp);
+    for (i = 0; i < n; i++) {
+        if (!m || v[i] - v[m - 1] > LATTICE_TOL) {
+            v[m++] = v[i];
+        }
+    }
+    return m;
+}
+
+
+/** Index of the lattice line at or below @p u with a line above it, or -1 */
+static long lattice_find(const double *v, long n, double u)
+{
+    long l = 0, r = n - 1, m;
+
+    if (n < 2 || u < v[0] || u >= v[n - 1]) {
+        return -1;
+    }
+    while (r - l > 1) {
+        m = (l + r) / 2;
+        if (v[m] <= u) {
+            l = m;
+        } else {
+            r = m;
+        }
+    }
+    return l;
+}
+
+
+static bool volume_lattice(MCCVolume *vol, const MCCData *const planes[], long n)
+{
+    long k, nx = 0, ny = 0;
+    unsigned j, i;
+
+    for (k = 0; k < n; k++) {
+        ny += planes[k]->sz;
+        for (j = 0; j < planes[k]->sz; j++) {
+            nx += planes[k]->scans[j]->sz;
+        }
+    }
+    vol->x = malloc(sizeof *vol->x * (nx + 1));
+    vol->y = malloc(sizeof *vol->y * (ny + 1));
+    if (!vol->x || !vol->y) {
+        return true;
+    }
+    nx = ny = 0;
+    for (k = 0; k < n; k++) {
+        for (j = 0; j < planes[k]->sz; j++) {
+            vol->y[ny++] = planes[k]->scans[j]->y;
+            for (i = 0; i < planes[k]->scans[j]->sz; i++) {
+                vol->x[nx++] = planes[k]->scans[j]->data[i].x;
+            }
+        }
+    }
+    vol->nx = lattice_unique(vol->x, nx);
+    vol->ny = lattice_unique(vol->y, ny);
+    return false;
+}
+
+
+static bool scan_covers(const struct mcc_scan *scan, double lo, double hi)
+{
+    return scan->sz > 1 && scan->data[0].x <= lo && scan->data[scan->sz - 1].x >= hi;
+}
+
+
+/** Dose of @p scan at @p x, which it covers, end detectors included */
+static double scan_dose(const struct mcc_scan *scan, double x)
+{
+    unsigned l = 0, r = scan->sz - 1, m;
+    double t;
+
+    while (r - l > 1) {
+        m = (l + r) / 2;
+        if (scan->data[m].x <= x) {
+            l = m;
+        } else {
+            r = m;
+        }
+    }
+    t = (x - scan->data[l].x) / (scan->data[r].x - scan->data[l].x);
+    return fma(scan->data[r].dose - scan->data[l].dose, t, scan->data[l].dose);
+}
+
+
+/** Samples @p mcc at the nodes, and marks the cells between two of its
+ *  scans that both cover the cell's detectors */
+static void volume_fill(const MCCVolume *vol, const MCCData *mcc, double *node,
+                        unsigned char *valid)
+{
+    const struct mcc_scan *s0, *s1;
+    const long nx = vol->nx;
+    unsigned l = 0;
+    double Y;
+    long i, j;
+
+    for (j = 0; j < vol->ny; j++) {
+        double *row = node + j * nx;
+        unsigned char *cells = valid + j * (nx - 1);
+        const bool last = (j == vol->ny - 1);
+
+        memset(row, 0, sizeof *row * nx);
+        if (!last) {
+            memset(cells, 0, sizeof *cells * (nx - 1));
+        }
+        if (!mcc->sz || vol->y[j] < mcc->scans[0]->y
+         || vol->y[j] > mcc->scans[mcc->sz - 1]->y) {
+            continue;
+        }
+        while (l + 1 < mcc->sz && mcc->scans[l + 1]->y <= vol->y[j]) {
+            l++;
+        }
+        s0 = mcc->scans[l];
+        s1 = (l + 1 < mcc->sz) ? mcc->scans[l + 1] : s0;
+        Y = (s1 == s0) ? 0.0 : (vol->y[j] - s0->y) / (s1->y - s0->y);
+        for (i = 0; i < nx; i++) {
+            const double x = vol->x[i];
+
+            if (Y == 0.0 && scan_covers(s0, x, x)) {
+                row[i] = scan_dose(s0, x);
+            } else if (scan_covers(s0, x, x) && scan_covers(s1, x, x)) {
+                const double d0 = scan_dose(s0, x);
+                row[i] = fma(scan_dose(s1, x) - d0, Y, d0);
+            }
+        }
+        if (last || s1 == s0) {
+            continue;
+        }
+        for (i = 0; i < nx - 1; i++) {
+            cells[i] = scan_covers(s0, vol->x[i], vol->x[i + 1])
+                    && scan_covers(s1, vol->x[i], vol->x[i + 1]);
+        }
+    }
+}
+
+
+MCCVolume *mcc_volume_create(const MCCData *const planes[], const double depths[],
+                             long n)
+{
+    const uint64_t t0 = proton_trace_begin();
+    struct volume_order *order;
+    const MCCData **sorted;
+    MCCVolume *vol;
+    long k, nnodes, ncells;
+
+    vol = calloc(1, sizeof *vol);
+    order = malloc(sizeof *order * (n + 1));
+    sorted = malloc(sizeof *sorted * (n + 1));
+    if (!vol || !order || !sorted) {
+        goto fail;
+    }
+    for (k = 0; k < n; k++) {
+        order[k].depth = depths[k];
+        order[k].idx = k;
+    }
+    qsort(order, n, sizeof *order, volume_ordercmp);
+    for (k = 0; k < n; k++) {
+        sorted[k] = planes[order[k].idx];
+    }
+    if (volume_lattice(vol, sorted, n)) {
+        goto fail;
+    }
+    vol->n = n;
+    nnodes = vol->nx * vol->ny;
+    ncells = (vol->nx > 1 && vol->ny > 1) ? (vol->nx - 1) * (vol->ny - 1) : 0;
+    vol->depth = malloc(sizeof *vol->depth * (n + 1));
+    vol->node = malloc(sizeof *vol->node * (n * nnodes + 1));
+    vol->valid = malloc(sizeof *vol->valid * (n * ncells + 1));
+    if (!vol->depth || !vol->node || !vol->valid) {
+        goto fail;
+    }
+    for (k = 0; k < n; k++) {
+        vol->depth[k] = order[k].depth;
+        if (ncells) {
+            volume_fill(vol, sorted[k], vol->node + k * nnodes, vol->valid + k * ncells);
+        }
+    }
+    free(order);
+    free(sorted);
+    proton_trace_end("mcc volume", t0);
+    return vol;
+
+fail:
+    free(order);
+    free(sorted);
+    mcc_volume_destroy(vol);
+    return NULL;
+}
+
+
+void mcc_volume_destroy(MCCVolume *vol)
+{
+    if (vol) {
+        free(vol->x);
+        free(vol->y);
+        free(vol->depth);
+        free(vol->node);
+        free(vol->valid);
+        free(vol);
+    }
+}
+
+
+long mcc_volume_planes(const MCCVolume *vol)
+{
+    return vol->n;
+}
+
+
+double mcc_volume_depth(const MCCVolume *vol, long k)
+{
+    return vol->depth[k];
+}
+
+
+/** Locates (x, y) on the lattice. Returns false off it */
+static bool volume_cell(const MCCVolume *vol, double x, double y, long *node,
+                        long *cell, double w[2])
+{
+    const long i = lattice_find(vol->x, vol->nx, x);
+    const long j = lattice_find(vol->y, vol->ny, y);
+
+    if (i < 0 || j < 0) {
+        return false;
+    }
+    *node = j * vol->nx + i;
+    *cell = j * (vol->nx - 1) + i;
+    w[0] = (x - vol->x[i]) / (vol->x[i + 1] - vol->x[i]);
+    w[1] = (y - vol->y[j]) / (vol->y[j + 1] - vol->y[j]);
+    return true;
+}
+
+
+static double volume_sample(const double *node, long nx, const double w[2])
+{
+    const double a = fma(node[1] - node[0], w[0], node[0]);
+    const double b = fma(node[nx + 1] - node[nx], w[0], node[nx]);
+
+    return fma(b - a, w[1], a);
+}
+
+
+void mcc_volume_depth_dose(const MCCVolume *vol, double x, double y, double dose[])
+/** The cell is found once, and each plane is the same offset further on */
+{
+    const long nnodes = vol->nx * vol->ny;
+    const long ncells = (vol->nx - 1) * (vol->ny - 1);
+    long node, cell, k;
+    double w[2];
+
+    if (!volume_cell(vol, x, y, &node, &cell, w)) {
+        memset(dose, 0, sizeof *dose * vol->n);
+        return;
+    }
+    for (k = 0; k < vol->n; k++) {
+        dose[k] = (vol->valid[k * ncells + cell])
+                ? volume_sample(vol->node + k * nnodes + node, vol->nx, w)
+                : 0.0;
+    }
+}
+
+
+double mcc_volume_plane_dose(const MCCVolume *vol, long k, double x, double y)
+{
+    const long nnodes = vol->nx * vol->ny;
+    const long ncells = (vol->nx - 1) * (vol->ny - 1);
+    long node, cell;
+    double w[2];
+
+    if (!volume_cell(vol, x, y, &node, &cell, w) || !vol->valid[k * ncells + cell]) {
+        return 0.0;
+    }
+    return volume_sample(vol->node + k * nnodes + node, vol->nx, w);
+}
+
+
+/** Mean dose of the planes at the depth of plane @p k, from @p k upwards */
+static double volume_group_dose(const MCCVolume *vol, long k, double x, double y)
+{
+    const double depth = vol->depth[k];
+    double sum = 0.0;
+    long m;
+
+    for (m = k; m < vol->n && vol->depth[m] == depth; m++) {
+        sum += mcc_volume_plane_dose(vol, m, x, y);
+    }
+    return sum / STATIC_CAST(double, m - k);
+}
+
+
+double mcc_volume_point_dose(const MCCVolume *vol, double x, double y, double depth)
+{
+    long lo, hi;
+    double d0, t;
+
+    if (!vol->n || depth < vol->depth[0] || depth > vol->depth[vol->n - 1]) {
+        return 0.0;
+    }
+    /* First plane of the group at or below the depth, and of the next one */
+    for (hi = 0; hi < vol->n && vol->depth[hi] <= depth; hi++);
+    for (lo = hi - 1; lo > 0 && vol->depth[lo - 1] == vol->depth[hi - 1]; lo--);
+    d0 = volume_group_dose(vol, lo, x, y);
+    if (hi == vol->n || vol->depth[lo] == depth) {
+        return d0;
+    }
+    t = (depth - vol->depth[lo]) / (vol->depth[hi] - vol->depth[lo]);
+    return fma(volume_group_dose(vol, hi, x, y) - d0, t, d0);
+}
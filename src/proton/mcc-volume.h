@@ -0,0 +1,45 @@
+#pragma once
+/** MCC planes measured at several depths, stacked in depth order on one
+ *  detector lattice shared by all of them. A query finds its lattice cell
+ *  once and reads it from every plane, instead of searching each file */
+#ifndef MCC_VOLUME_H
+#define MCC_VOLUME_H
+
+#include "mcc-data.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct _mcc_volume MCCVolume;
+
+
+/** Stacks the @p n planes, measured at @p depths in mm, onto the union of
+ *  their detector positions. Returns NULL on failure */
+MCCVolume *mcc_volume_create(const MCCData *const planes[], const double depths[],
+                             long n);
+void mcc_volume_destroy(MCCVolume *vol);
+
+long mcc_volume_planes(const MCCVolume *vol);
+
+/** Depth of plane @p k, in ascending order */
+double mcc_volume_depth(const MCCVolume *vol, long k);
+
+/** Writes the dose of every plane at (x, y) to @p dose, in depth order.
+ *  Each is what mcc_data_get_point_dose() gives for that plane */
+void mcc_volume_depth_dose(const MCCVolume *vol, double x, double y, double dose[]);
+
+/** Dose of plane @p k at (x, y) */
+double mcc_volume_plane_dose(const MCCVolume *vol, long k, double x, double y);
+
+/** Dose at (x, y, depth), linear in depth between the nearest planes. Planes
+ *  at the same depth are averaged, and the dose is zero outside the stack */
+double mcc_volume_point_dose(const MCCVolume *vol, double x, double y, double depth);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* MCC_VOLUME_H */
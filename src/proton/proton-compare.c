@@ -0,0 +1,188 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "proton-compare.h"
+#include "proton-kernels.h"
+#include "proton-trace.h"
+
+/** compare_volume() mode that keeps the source as it is */
+#define COMPARE_RESAMPLE -1
+
+
+static void compare_grid(const ProtonDose *dose, ProtonGrid *grid)
+{
+    int d;
+
+    for (d = 0; d < 3; d++) {
+        grid->dim[d] = dose->px_dimensions[d];
+        grid->top_left[d] = dose->top_left[d];
+        grid->spacing[d] = dose->px_spacing[d];
+    }
+}
+
+
+/** Sources may only be read by one thread at a time */
+static bool compare_read(void *arg, long k, float *frame)
+{
+    const ProtonSumSource *src = arg;
+    bool fail;
+
+#if defined _OPENMP
+#   pragma omp critical (proton_compare_read)
+#endif
+    fail = src->frame(src->arg, k, frame);
+    return fail;
+}
+
+
+static void compare_ratio(float *dst, const float *ref, const float *other,
+                          float lo, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = (ref[i] > lo) ? other[i] / ref[i] - 1.0f : 0.0f;
+    }
+}
+
+
+/** Largest magnitude in @p frame */
+static float compare_extent(const float *frame, long n)
+{
+    float res = 0.0f;
+    long i;
+
+    for (i = 0; i < n; i++) {
+        res = fmaxf(res, fabsf(frame[i]));
+    }
+    return res;
+}
+
+
+/** Writes frame @p k of the comparison, raising @p extent */
+static bool compare_frame(ProtonDose *cmp, const ProtonDose *ref,
+                          const ProtonSumSource *other, ProtonResampler *rs,
+                          int mode, long k, float *frame, float *extent)
+{
+    const long framesz = ref->px_dimensions[0] * ref->px_dimensions[1];
+    const float *a = ref->data + k * framesz;
+    float *dst = cmp->data + k * framesz;
+
+    if (mode == COMPARE_RESAMPLE) {
+        frame = dst;
+    }
+    if (proton_resampler_frame(rs, compare_read, (void *)other, k, frame)) {
+        return true;
+    }
+    if (mode == COMPARE_RESAMPLE) {
+        /* The frame is the result */
+    } else if (mode == PROTON_COMPARE_RATIO) {
+        compare_ratio(dst, a, frame, PROTON_COMPARE_RATIO_FLOOR * ref->dmax, framesz);
+    } else {
+        proton_kernels()->diff(dst, a, frame, 1.0f, framesz);
+    }
+    *extent = compare_extent(dst, framesz);
+    return false;
+}
+
+
+/** Each thread takes a run of frames, so that its resampler reads every
+ *  source frame in the run once. Frame maxima are kept apart and reduced in
+ *  order afterwards. Nothing is derived */
+static ProtonDose *compare_volume(const ProtonDose *ref, const ProtonSumSource *other,
+                                  int mode)
+{
+    const long nz = ref->px_dimensions[2];
+    ProtonDose *cmp;
+    ProtonGrid grid;
+    float *extent;
+    uint64_t t0;
+    bool fail = false;
+    long k;
+
+    compare_grid(ref, &grid);
+    cmp = proton_dose_alloc(grid.dim, grid.top_left, grid.spacing);
+    extent = calloc(nz, sizeof *extent);
+    if (!cmp || !extent) {
+        proton_dose_destroy(cmp);
+        free(extent);
+        return NULL;
+    }
+    t0 = proton_trace_begin();
+#if defined _OPENMP
+#   pragma omp parallel reduction(||:fail)
+#endif
+    {
+        ProtonResampler *rs = proton_resampler_create(&other->grid, &grid);
+        float *frame = malloc(sizeof *frame * grid.dim[0] * grid.dim[1]);
+        fail = !rs || !frame;
+#if defined _OPENMP
+#   pragma omp for schedule(static)
+#endif
+        for (k = 0; k < nz; k++) {
+            if (!fail) {
+                fail = compare_frame(cmp, ref, other, rs, mode, k, frame, extent + k);
+            }
+        }
+        free(frame);
+        proton_resampler_destroy(rs);
+    }
+    proton_trace_end("compare frames", t0);
+    if (fail) {
+        proton_dose_destroy(cmp);
+        free(extent);
+        return NULL;
+    }
+    /* An exact match still needs a scale to be drawn against */
+    for (k = 0; k < nz; k++) {
+        cmp->dmax = fmaxf(cmp->dmax, extent[k]);
+    }
+    cmp->dmax = (cmp->dmax > 0.0f) ? cmp->dmax : 1.0f;
+    free(extent);
+    return cmp;
+}
+
+
+ProtonDose *proton_dose_compare(const ProtonDose *ref, const ProtonSumSource *other,
+                                int mode)
+{
+    ProtonDose *cmp;
+
+    cmp = compare_volume(ref, other, mode);
+    if (cmp && proton_dose_derive(cmp)) {
+        proton_dose_destroy(cmp);
+        return NULL;
+    }
+    return cmp;
+}
+
+
+ProtonDose *proton_dose_resample(const ProtonDose *ref, const ProtonSumSource *other)
+{
+    return compare_volume(ref, other, COMPARE_RESAMPLE);
+}
+
+
+ProtonDose *proton_dose_create_compare(const ProtonDose *ref, const char *filename,
+                                       int mode, size_t ebufsz, char err[])
+{
+    ProtonSumSource other;
+    ProtonDose *cmp;
+    uint64_t t0;
+    bool fail;
+
+    t0 = proton_trace_begin();
+    fail = proton_source_open(&other, filename, ebufsz, err);
+    proton_trace_end("compare read geometry", t0);
+    if (fail) {
+        return NULL;
+    }
+    cmp = proton_dose_compare(ref, &other, mode);
+    if (!cmp) {
+        snprintf(err, ebufsz, "%s", (proton_source_error(&other))
+                 ? proton_source_error(&other) : "Failed to compare the doses");
+    }
+    proton_source_close(&other);
+    return cmp;
+}
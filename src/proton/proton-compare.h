@@ -0,0 +1,49 @@
+#pragma once
+/** Voxel-wise comparisons of a dose against a second one, for checking a
+ *  plan against an independent calculation. The result is a dose on the
+ *  first one's grid, so every view shows it as it would the dose */
+#ifndef PROTON_COMPARE_H
+#define PROTON_COMPARE_H
+
+#include "proton-sum.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+enum {
+    PROTON_COMPARE_DIFF = 0,    /* other - ref, in Gy */
+    PROTON_COMPARE_RATIO,       /* other / ref - 1, so both centre on zero */
+    PROTON_COMPARE_GAMMA        /* See proton-gamma.h */
+};
+
+/** A ratio is only taken where the reference is above this fraction of its
+ *  maximum, and is zero elsewhere */
+#define PROTON_COMPARE_RATIO_FLOOR 0.1f
+
+
+/** Compares @p other with @p ref, reading its frames in order and resampling
+ *  them onto the grid of @p ref if the two differ. The frames are shared
+ *  between threads, which take turns to read them. The result can be
+ *  negative, and its maximum is the largest magnitude in it. Returns NULL on
+ *  failure */
+ProtonDose *proton_dose_compare(const ProtonDose *ref, const ProtonSumSource *other,
+                                int mode);
+
+/** Resamples @p other onto the grid of @p ref, as above, for analyses that
+ *  need all of it at once. Only the maximum is set, nothing is derived */
+ProtonDose *proton_dose_resample(const ProtonDose *ref, const ProtonSumSource *other);
+
+/** Compares the RTDose file @p filename with @p ref, as above */
+ProtonDose *proton_dose_create_compare(const ProtonDose *ref, const char *filename,
+                                       int mode, size_t ebufsz, char err[]);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_COMPARE_H */
@@ -0,0 +1,408 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "proton-contour.h"
+#include "proton-trace.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+
+/* Crossings are found on the edges of the grid. Edge ids number the
+horizontal edges (i, k)-(i + 1, k) as k * nx + i, and the vertical edges
+(i, k)-(i, k + 1) after them as nx * nz + k * nx + i. Each cell's corners are
+taken counterclockwise from (i, k), and edge n joins corner n to corner
+n + 1. A segment runs from the edge where that walk leaves the dose above the
+level to the edge where it comes back, so the neighbouring cell, which walks
+the shared edge the other way, continues the line from where this one ended */
+
+
+/** Number of segments for each corner case. The saddles have two */
+static const unsigned char contour_nseg[16] = {
+    0, 1, 1, 1, 1, 2, 1, 1, 1, 1, 2, 1, 1, 1, 1, 0
+};
+
+
+struct contour_buf {
+    long n, cap;
+    size_t size;
+    void *data;
+};
+
+/** Makes room for @p n more elements. Returns true on allocation failure */
+static bool contour_buf_reserve(struct contour_buf *buf, long n)
+{
+    long cap;
+    void *data;
+
+    if (buf->n + n <= buf->cap) {
+        return false;
+    }
+    cap = (buf->cap) ? buf->cap : 256;
+    while (cap < buf->n + n) {
+        cap *= 2;
+    }
+    data = realloc(buf->data, buf->size * cap);
+    if (!data) {
+        return true;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return false;
+}
+
+
+/** Case of cell (i, k) at level @p t, corner n in bit n */
+static unsigned contour_case(const float *slab, long nx, long i, long k, float t)
+{
+    const float *v = slab + k * nx + i;
+
+    return (v[0] >= t) | (v[1] >= t) << 1 | (v[nx + 1] >= t) << 2 | (v[nx] >= t) << 3;
+}
+
+
+/** Whether the counterclockwise walk round case @p c leaves the region at
+ *  edge @p e, or enters it */
+static bool contour_leaves(unsigned c, long e)
+{
+    return (c >> (e & 3) & 1) && !(c >> ((e + 1) & 3) & 1);
+}
+
+static bool contour_enters(unsigned c, long e)
+{
+    return !(c >> (e & 3) & 1) && (c >> ((e + 1) & 3) & 1);
+}
+
+
+/** Writes the segments of cell (i, k) as edge id pairs to @p seg, and returns
+ *  their number */
+static long contour_cell(const float *slab, long nx, long nz, long i, long k,
+                         unsigned c, float t, long *seg)
+{
+    const long nh = nx * nz;
+    const long edge[4] = {
+        k * nx + i, nh + k * nx + i + 1, (k + 1) * nx + i, nh + k * nx + i
+    };
+    const float *v;
+    float centre;
+    long n, m, ns = 0;
+
+    for (n = 0; n < 4; n++) {
+        if (contour_leaves(c, n)) {
+            if (contour_nseg[c] == 1) {
+                for (m = n + 1; !contour_enters(c, m); m++);
+                m &= 3;
+            } else {
+                /* A saddle joins the diagonal whose corners the mean is on
+                the side of */
+                v = slab + k * nx + i;
+                centre = 0.25f * (v[0] + v[1] + v[nx] + v[nx + 1]);
+                m = (centre >= t) ? (n + 1) & 3 : (n + 3) & 3;
+            }
+            seg[ns++] = edge[n];
+            seg[ns++] = edge[m];
+        }
+    }
+    return ns / 2;
+}
+
+
+/** Position of the level crossing on edge @p e */
+static void contour_point(const float *slab, long nx, long nz, long e, float t,
+                          const double origin[], const double step[], double p[])
+{
+    const long nh = nx * nz;
+    const long d = (e < nh) ? 1 : nx;
+    long i, k;
+    float v0, v1;
+    double f;
+
+    e -= (e < nh) ? 0 : nh;
+    i = e % nx;
+    k = e / nx;
+    v0 = slab[e];
+    v1 = slab[e + d];
+    f = STATIC_CAST(double, (t - v0) / (v1 - v0));
+    p[0] = origin[0] + (STATIC_CAST(double, i) + ((d == 1) ? f : 0.0)) * step[0];
+    p[1] = origin[1] + (STATIC_CAST(double, k) + ((d == 1) ? 0.0 : f)) * step[1];
+}
+
+
+/** Ramer-Douglas-Peucker over the @p n points at @p p, marking those kept in
+ *  @p keep. @p stack holds 2 * n longs */
+static void contour_simplify(const double *p, long n, double tol, unsigned char *keep,
+                             long *stack)
+{
+    long a, b, i, far, top = 0;
+    double dx, dy, len, d, dmax;
+
+    memset(keep, 0, n);
+    keep[0] = keep[n - 1] = 1;
+    stack[top++] = 0;
+    stack[top++] = n - 1;
+    while (top) {
+        b = stack[--top];
+        a = stack[--top];
+        dx = p[2 * b] - p[2 * a];
+        dy = p[2 * b + 1] - p[2 * a + 1];
+        len = sqrt(dx * dx + dy * dy);
+        dmax = 0.0;
+        far = a;
+        for (i = a + 1; i < b; i++) {
+            const double ex = p[2 * i] - p[2 * a], ey = p[2 * i + 1] - p[2 * a + 1];
+            /* A closed line's ends coincide, so the distance is to the point */
+            d = (len > 0.0) ? fabs(dx * ey - dy * ex) / len : sqrt(ex * ex + ey * ey);
+            if (d > dmax) {
+                dmax = d;
+                far = i;
+            }
+        }
+        if (dmax > tol) {
+            keep[far] = 1;
+            stack[top++] = a;
+            stack[top++] = far;
+            stack[top++] = far;
+            stack[top++] = b;
+        }
+    }
+}
+
+
+struct contour_level {
+    const float *slab;
+    long nx, nz;
+    float t;
+    double origin[2], step[2], tol;
+    long nseg;
+    long *seg;              /* Edge id pairs */
+    long *from, *to;        /* Segment leaving and entering each edge, or -1.
+                            Left all -1 between levels */
+    unsigned char *cases;
+    long *rows;             /* Segments before each cell row */
+    unsigned char *visited;
+};
+
+
+/** Finds every segment of one level. Each row is counted, then written at
+ *  its offset, so the segments come out in the same order however the rows
+ *  are shared between threads. Returns true on allocation failure */
+static bool contour_march(struct contour_level *lv)
+{
+    const long nx = lv->nx, nz = lv->nz;
+    long i, k, n;
+
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static) private(i, n)
+#endif
+    for (k = 0; k < nz - 1; k++) {
+        unsigned char *c = lv->cases + k * (nx - 1);
+        for (i = 0, n = 0; i < nx - 1; i++) {
+            c[i] = STATIC_CAST(unsigned char, contour_case(lv->slab, nx, i, k, lv->t));
+            n += contour_nseg[c[i]];
+        }
+        lv->rows[k + 1] = n;
+    }
+    lv->rows[0] = 0;
+    for (k = 0; k < nz - 1; k++) {
+        lv->rows[k + 1] += lv->rows[k];
+    }
+    lv->nseg = lv->rows[nz - 1];
+    lv->seg = malloc(sizeof *lv->seg * 2 * (lv->nseg + 1));
+    if (!lv->seg) {
+        return true;
+    }
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static) private(i, n)
+#endif
+    for (k = 0; k < nz - 1; k++) {
+        const unsigned char *c = lv->cases + k * (nx - 1);
+        long *seg = lv->seg + 2 * lv->rows[k];
+        for (i = 0; i < nx - 1; i++) {
+            if (contour_nseg[c[i]]) {
+                n = contour_cell(lv->slab, nx, nz, i, k, c[i], lv->t, seg);
+                seg += 2 * n;
+            }
+        }
+    }
+    return false;
+}
+
+
+/** Links the segments of one level into lines and appends them, simplified,
+ *  to @p lines and @p points. @p scratch holds nseg + 1 points, and @p stack
+ *  and @p keep twice and once that many entries. Returns true on allocation
+ *  failure */
+static bool contour_link(struct contour_level *lv, struct contour_buf *lines,
+                         struct contour_buf *points, double *scratch, long *stack,
+                         unsigned char *keep)
+{
+    ProtonContourLine *line;
+    long s, s0, i, n;
+    double *dst;
+    bool closed;
+
+    memset(lv->visited, 0, lv->nseg);
+    for (s = 0; s < lv->nseg; s++) {
+        lv->from[lv->seg[2 * s]] = s;
+        lv->to[lv->seg[2 * s + 1]] = s;
+    }
+    for (s0 = 0; s0 < lv->nseg; s0++) {
+        if (lv->visited[s0]) {
+            continue;
+        }
+        /* Back up to the start of an open line, or once round a closed one */
+        for (s = s0; lv->to[lv->seg[2 * s]] >= 0 && lv->to[lv->seg[2 * s]] != s0; ) {
+            s = lv->to[lv->seg[2 * s]];
+        }
+        closed = lv->to[lv->seg[2 * s]] == s0;
+        s = (closed) ? s0 : s;
+        contour_point(lv->slab, lv->nx, lv->nz, lv->seg[2 * s], lv->t,
+                      lv->origin, lv->step, scratch);
+        for (n = 1; s >= 0 && !lv->visited[s]; n++) {
+            lv->visited[s] = 1;
+            contour_point(lv->slab, lv->nx, lv->nz, lv->seg[2 * s + 1], lv->t,
+                          lv->origin, lv->step, scratch + 2 * n);
+            s = lv->from[lv->seg[2 * s + 1]];
+        }
+        contour_simplify(scratch, n, lv->tol, keep, stack);
+        if (contour_buf_reserve(lines, 1) || contour_buf_reserve(points, n)) {
+            return true;
+        }
+        line = STATIC_CAST(ProtonContourLine *, lines->data) + lines->n++;
+        line->start = points->n;
+        line->closed = closed;
+        dst = STATIC_CAST(double *, points->data) + 2 * points->n;
+        for (i = 0; i < n; i++) {
+            if (keep[i]) {
+                *dst++ = scratch[2 * i];
+                *dst++ = scratch[2 * i + 1];
+                points->n++;
+            }
+        }
+        line->count = points->n - line->start;
+    }
+    /* Only the edges crossed were set, so only they are reset */
+    for (s = 0; s < lv->nseg; s++) {
+        lv->from[lv->seg[2 * s]] = -1;
+        lv->to[lv->seg[2 * s + 1]] = -1;
+    }
+    return false;
+}
+
+
+static void contour_level_free(struct contour_level *lv)
+{
+    free(lv->seg);
+    free(lv->from);
+    free(lv->to);
+    free(lv->cases);
+    free(lv->rows);
+    free(lv->visited);
+}
+
+
+ProtonContours *proton_contours_create(const ProtonDose *dose, float depth,
+                                       const float levels[], long nlevels,
+                                       double tolerance)
+{
+    const uint64_t t0 = proton_trace_begin();
+    const long nx = dose->px_dimensions[0], nz = dose->px_dimensions[2];
+    struct contour_buf lines = { 0, 0, sizeof (ProtonContourLine), NULL };
+    struct contour_buf points = { 0, 0, 2 * sizeof (double), NULL };
+    struct contour_level lv = { 0 };
+    ProtonContours *res;
+    unsigned char *keep = NULL;
+    double *scratch = NULL;
+    long *stack = NULL;
+    bool ok = false;
+    float *slab;
+    long j;
+
+    res = calloc(1, sizeof *res);
+    slab = malloc(sizeof *slab * nx * nz);
+    if (!res || !slab) {
+        goto fail;
+    }
+    res->depth = depth;
+    res->nlevels = nlevels;
+    res->levels = malloc(sizeof *res->levels * (nlevels + 1));
+    res->first = malloc(sizeof *res->first * (nlevels + 1));
+    lv.from = malloc(sizeof *lv.from * 2 * nx * nz);
+    lv.to = malloc(sizeof *lv.to * 2 * nx * nz);
+    lv.cases = malloc((nx - 1) * (nz - 1) + 1);
+    lv.rows = malloc(sizeof *lv.rows * (nz + 1));
+    if (!res->levels || !res->first || !lv.from || !lv.to || !lv.cases || !lv.rows) {
+        goto fail;
+    }
+    memset(lv.from, 0xFF, sizeof *lv.from * 2 * nx * nz);
+    memset(lv.to, 0xFF, sizeof *lv.to * 2 * nx * nz);
+    proton_dose_get_slab(dose, depth, slab);
+    lv.slab = slab;
+    lv.nx = nx;
+    lv.nz = nz;
+    lv.origin[0] = dose->top_left[0];
+    lv.origin[1] = dose->top_left[2];
+    lv.step[0] = dose->px_spacing[0];
+    lv.step[1] = dose->px_spacing[2];
+    lv.tol = tolerance;
+    for (j = 0; j < nlevels; j++) {
+        res->levels[j] = levels[j];
+        res->first[j] = lines.n;
+        lv.t = levels[j];
+        if (nx < 2 || nz < 2) {
+            continue;
+        }
+        free(lv.seg);
+        lv.seg = NULL;
+        if (contour_march(&lv)) {
+            goto fail;
+        }
+        /* One more point than segments on each line */
+        free(lv.visited);
+        free(scratch);
+        free(stack);
+        free(keep);
+        lv.visited = malloc(lv.nseg + 1);
+        scratch = malloc(sizeof *scratch * 2 * (lv.nseg + 1));
+        stack = malloc(sizeof *stack * 2 * (lv.nseg + 1));
+        keep = malloc(lv.nseg + 1);
+        if (!lv.visited || !scratch || !stack || !keep) {
+            goto fail;
+        }
+        if (contour_link(&lv, &lines, &points, scratch, stack, keep)) {
+            goto fail;
+        }
+    }
+    res->first[nlevels] = lines.n;
+    res->nlines = lines.n;
+    res->npoints = points.n;
+    res->lines = lines.data;
+    res->points = points.data;
+    lines.data = points.data = NULL;
+    ok = true;
+fail:
+    if (!ok) {
+        proton_contours_destroy(res);
+        res = NULL;
+    }
+    free(lines.data);
+    free(points.data);
+    contour_level_free(&lv);
+    free(scratch);
+    free(stack);
+    free(keep);
+    free(slab);
+    proton_trace_end("isodose contours", t0);
+    return res;
+}
+
+
+void proton_contours_destroy(ProtonContours *contours)
+{
+    if (contours) {
+        free(contours->levels);
+        free(contours->first);
+        free(contours->lines);
+        free(contours->points);
+        free(contours);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+/** Isodose lines on the coronal plane. Marching squares runs over the full
+ *  resolution grid at one depth, in parallel over cell rows, and the lines
+ *  are then linked and simplified. Every line keeps the higher dose on the
+ *  same side, so closed lines around a peak all turn the same way */
+#ifndef PROTON_CONTOUR_H
+#define PROTON_CONTOUR_H
+
+#include "proton-dose.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+typedef struct _proton_contour_line {
+    long start;             /* First point, an index into points */
+    long count;             /* Points, a closed line repeats its first */
+    bool closed;            /* Open lines end on the edge of the grid */
+} ProtonContourLine;
+
+
+typedef struct _proton_contours {
+    float depth;
+    long nlevels;
+    float *levels;          /* Gy */
+    long *first;            /* Level i owns lines [first[i], first[i + 1]) */
+    long nlines, npoints;
+    ProtonContourLine *lines;
+    double *points;         /* (x, z) pairs in mm */
+} ProtonContours;
+
+
+/** Traces @p nlevels isodose lines, in Gy, at @p depth. Points are dropped
+ *  while the line stays within @p tolerance mm of the full trace. Returns
+ *  NULL on allocation failure */
+ProtonContours *proton_contours_create(const ProtonDose *dose, float depth,
+                                       const float levels[], long nlevels,
+                                       double tolerance);
+void proton_contours_destroy(ProtonContours *contours);
+
+/** The lines of level @p level, writing their number to @p n */
+inline const ProtonContourLine *proton_contours_level(const ProtonContours *c,
+                                                      long level, long *n)
+{
+    *n = c->first[level + 1] - c->first[level];
+    return c->lines + c->first[level];
+}
+
+inline const double *proton_contours_points(const ProtonContours *c) { return c->points; }
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_CONTOUR_H */
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <string.h>
+#include "proton-kernels.h"
+
+#if defined _MSC_VER
+#   include <intrin.h>
+#endif
+#if defined PROTON_DISPATCH_X86
+#   if defined _MSC_VER
+#       include <immintrin.h>
+#   else
+#       include <cpuid.h>
+#   endif
+#endif
+
+
+extern const ProtonKernels proton_kernels_base;
+#if defined PROTON_DISPATCH_X86
+extern const ProtonKernels proton_kernels_avx2;
+extern const ProtonKernels proton_kernels_avx512;
+#endif
+
+static const ProtonKernels *const tables[PROTON_ISA_COUNT] = {
+    &proton_kernels_base,
+#if defined PROTON_DISPATCH_X86
+    &proton_kernels_avx2,
+    &proton_kernels_avx512
+#endif
+};
+
+/* The first call may come from inside a parallel region, so the table is
+published atomically. Detection gives every caller the same answer, so the
+threads that lose the exchange drop theirs */
+static const ProtonKernels *selected;
+
+#if defined _MSC_VER
+/* Volatile accesses are acquire and release on x86 (/volatile:ms) */
+#   define SELECTED_LOAD() (*(const ProtonKernels *volatile *)&selected)
+#   define SELECTED_STORE(t) (*(const ProtonKernels *volatile *)&selected = (t))
+#   define SELECTED_PUBLISH(t) \
+    _InterlockedCompareExchangePointer((void *volatile *)&selected, (void *)(t), NULL)
+#else
+#   define SELECTED_LOAD() __atomic_load_n(&selected, __ATOMIC_ACQUIRE)
+#   define SELECTED_STORE(t) __atomic_store_n(&selected, (t), __ATOMIC_RELEASE)
+#   define SELECTED_PUBLISH(t) do { \
+        const ProtonKernels *expect = NULL; \
+        __atomic_compare_exchange_n(&selected, &expect, (t), false, \
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); \
+    } while (0)
+#endif
+
+
+#if defined PROTON_DISPATCH_X86
+
+static void cpu_cpuid(unsigned leaf, unsigned sub, unsigned r[])
+{
+#if defined _MSC_VER
+    int x[4];
+    __cpuidex(x, (int)leaf, (int)sub);
+    memcpy(r, x, sizeof x);
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+/** The state components the OS saves on a context switch */
+static unsigned long long cpu_xcr0(void)
+{
+#if defined _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+/** The widest instruction set both the CPU and the OS support */
+static int cpu_detect(void)
+{
+    const unsigned avx2_ebx = 1u << 3 | 1u << 5 | 1u << 8;     /* BMI1, AVX2, BMI2 */
+    const unsigned avx512_ebx = 1u << 16 | 1u << 17 | 1u << 30 | 1u << 31;
+    unsigned r1[4], r7[4];
+    unsigned long long xcr0;
+
+    cpu_cpuid(0, 0, r1);
+    if (r1[0] < 7) {
+        return PROTON_ISA_BASE;
+    }
+    cpu_cpuid(1, 0, r1);
+    cpu_cpuid(7, 0, r7);
+    /* OSXSAVE, AVX and FMA, then YMM state enabled */
+    if ((r1[2] & (1u << 27 | 1u << 28 | 1u << 12)) != (1u << 27 | 1u << 28 | 1u << 12)) {
+        return PROTON_ISA_BASE;
+    }
+    xcr0 = cpu_xcr0();
+    if ((xcr0 & 0x6) != 0x6 || (r7[1] & avx2_ebx) != avx2_ebx) {
+        return PROTON_ISA_BASE;
+    }
+    /* Opmask and both halves of ZMM state */
+    if ((xcr0 & 0xE0) != 0xE0 || (r7[1] & avx512_ebx) != avx512_ebx) {
+        return PROTON_ISA_AVX2;
+    }
+    return PROTON_ISA_AVX512;
+}
+
+#else
+
+static int cpu_detect(void)
+{
+    return PROTON_ISA_BASE;
+}
+
+#endif
+
+
+/** Not cached, so that it is safe from any thread. It is only reached when
+ *  the table is chosen or by proton_cpu_supports() */
+static int cpu_supported(void)
+{
+    return cpu_detect();
+}
+
+
+static int cpu_env_cap(void)
+{
+    const char *env = getenv("PROTON_ISA");
+    int isa;
+
+    if (env) {
+        for (isa = 0; isa < PROTON_ISA_COUNT; isa++) {
+            if (!strcmp(env, proton_isa_name(isa))) {
+                return isa;
+            }
+        }
+    }
+    return PROTON_ISA_COUNT - 1;
+}
+
+
+const ProtonKernels *proton_kernels(void)
+{
+    const ProtonKernels *sel = SELECTED_LOAD();
+    int isa;
+
+    if (!sel) {
+        isa = cpu_supported();
+        isa = (cpu_env_cap() < isa) ? cpu_env_cap() : isa;
+        SELECTED_PUBLISH(tables[isa]);
+        sel = SELECTED_LOAD();
+    }
+    return sel;
+}
+
+
+int proton_cpu_isa(void)
+{
+    const ProtonKernels *sel = proton_kernels();
+    int isa;
+
+    for (isa = PROTON_ISA_COUNT - 1; isa > 0 && tables[isa] != sel; isa--);
+    return isa;
+}
+
+
+const char *proton_isa_name(int isa)
+{
+    static const char *names[PROTON_ISA_COUNT] = {
+#if defined PROTON_DISPATCH_X86
+        "sse2",
+#else
+        "generic",
+#endif
+        "avx2",
+        "avx512"
+    };
+    return (isa >= 0 && isa < PROTON_ISA_COUNT) ? names[isa] : "unknown";
+}
+
+
+bool proton_cpu_supports(int isa)
+{
+    return isa >= 0 && isa <= cpu_supported() && tables[isa];
+}
+
+
+bool proton_cpu_select(int isa)
+{
+    if (!proton_cpu_supports(isa)) {
+        return true;
+    }
+    SELECTED_STORE(tables[isa]);
+    return false;
+}
@@ -1,10 +1,13 @@
 #include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "proton-dose.h"
 #include "dcmload.h"
+#include "proton-kernels.h"
+#include "proton-trace.h"
 
 #if defined _MSC_VER
 #   define _q(qualifiers)
@@ -14,8 +17,6 @@
 
 #define STATIC_CAST(type, expr) (type)(expr)
 
-#define IDIVCEIL(num, denom) (((num) + (denom) - 1) / (denom))
-
 /* The threshold dose used to determine whether a plane is empty or not
 If all dose values are less than this, it is empty */
 #define NULL_THRESH 0.0001
@@ -40,56 +41,124 @@ static float proton_planes_lebesgue_dose(const ProtonDose *dose)
 }
 
 
-static void proton_planes_integrate(ProtonDose *dose)
+/** Sum of row[i] * i, the x moment of a row */
+static double proton_row_moment(const float *row, long n)
+{
+    double res = 0.0;
+    long i;
+
+    for (i = 0; i < n; i++) {
+        res += STATIC_CAST(double, row[i]) * STATIC_CAST(double, i);
+    }
+    return res;
+}
+
+
+/** Index of the largest element of @p row */
+static long proton_row_argmax(const float *row, long n)
+{
+    long i, res = 0;
+
+    for (i = 1; i < n; i++) {
+        res = (row[i] > row[res]) ? i : res;
+    }
+    return res;
+}
+
+
+/** Dose-weighted, or the middle of the grid where there is no dose */
+static void proton_planes_centroid(ProtonDose *dose, const double mom[], long j)
+{
+    const double *tl = dose->top_left, *sp = dose->px_spacing;
+    const double w = mom[3 * j + 2];
+    double x, z;
+
+    if (w > 0.0) {
+        x = mom[3 * j] / w;
+        z = mom[3 * j + 1] / w;
+    } else {
+        x = 0.5 * STATIC_CAST(double, dose->px_dimensions[0] - 1);
+        z = 0.5 * STATIC_CAST(double, dose->px_dimensions[2] - 1);
+    }
+    dose->stats.centroid[2 * j] = STATIC_CAST(float, fma(x, sp[0], tl[0]));
+    dose->stats.centroid[2 * j + 1] = STATIC_CAST(float, fma(z, sp[2], tl[2]));
+}
+
+
+static bool proton_planes_integrate(ProtonDose *dose)
+/** The statistics are gathered on the same pass over the rows. Returns true
+ *  on failure */
 {
-    const float *f1 = dose->data, *f2 = dose->data + dose->px_dimensions[0];
-    /* Not checking those pointers there chief... You better hope 64-bit Windows
-    never fails allocating memory */
-    float *pmax = calloc(dose->px_dimensions[1], sizeof *pmax);
+    const ProtonKernels *kern = proton_kernels();
+    const long nx = dose->px_dimensions[0];
+    const float *f1 = dose->data, *best = dose->data;
+    ProtonDoseStats *st = &dose->stats;
     long *nsupp = calloc(dose->px_dimensions[1], sizeof *nsupp);
+    /* x moment, z moment and sum of each row, in voxels. The x moment is
+    taken from the rows summed over z, which axpy builds at full speed */
+    double *mom = calloc(3 * dose->px_dimensions[1], sizeof *mom);
+    float *cols = calloc(nx * dose->px_dimensions[1], sizeof *cols);
+    float bmax = 0.0f, rsum;
     long j, k;
 
+    if (!nsupp || !mom || !cols) {
+        free(nsupp);
+        free(mom);
+        free(cols);
+        return true;
+    }
     /* Raw sum and compute planar maxima */
+    st->dmax_voxel[0] = st->dmax_voxel[1] = st->dmax_voxel[2] = 0;
     for (k = 0; k < dose->px_dimensions[2]; k++) {
-        for (j = 0; j < dose->px_dimensions[1]; j++) {
-            do {
-                dose->planes[j] += *f1;
-                pmax[j] = maxf(pmax[j], *f1);
-            } while (++f1 < f2);
-            f2 += dose->px_dimensions[0];
+        for (j = 0; j < dose->px_dimensions[1]; j++, f1 += nx) {
+            rsum = 0.0f;
+            kern->sum_max(f1, nx, &rsum, st->plane_max + j);
+            dose->planes[j] += rsum;
+            kern->axpy(cols + j * nx, f1, 1.0f, nx);
+            mom[3 * j + 1] += STATIC_CAST(double, rsum) * STATIC_CAST(double, k);
+            mom[3 * j + 2] += rsum;
+            /* Only rises when this row holds a new maximum */
+            if (st->plane_max[j] > bmax) {
+                bmax = st->plane_max[j];
+                best = f1;
+                st->dmax_voxel[1] = j;
+                st->dmax_voxel[2] = k;
+            }
         }
     }
-    /* Compute threshold from planar maxima */
+    st->dmax_voxel[0] = proton_row_argmax(best, nx);
     for (j = 0; j < dose->px_dimensions[1]; j++) {
-        pmax[j] *= 0.1f;
+        mom[3 * j] = proton_row_moment(cols + j * nx, nx);
     }
-    /* Compute measure of supported regions */
+    /* Compute measure of supported regions, above a tenth of the maximum */
     f1 = dose->data;
-    f2 = f1 + dose->px_dimensions[0];
     for (k = 0; k < dose->px_dimensions[2]; k++) {
-        for (j = 0; j < dose->px_dimensions[1]; j++) {
-            do {
-                nsupp[j] += *f1 > pmax[j];
-            } while (++f1 < f2);
-            f2 += dose->px_dimensions[0];
+        for (j = 0; j < dose->px_dimensions[1]; j++, f1 += nx) {
+            nsupp[j] += kern->count_above(f1, nx, st->plane_max[j] * 0.1f);
         }
     }
     for (j = 0; j < dose->px_dimensions[1]; j++) {
         dose->stppwr[j] = dose->planes[j] * proton_planes_lebesgue_dose(dose);
         dose->planes[j] = (nsupp[j]) ? dose->planes[j] / (float)nsupp[j] : 0.0f;
+        st->support[j] = STATIC_CAST(float, STATIC_CAST(double, nsupp[j])
+                       * dose->px_spacing[0] * dose->px_spacing[2]);
+        proton_planes_centroid(dose, mom, j);
     }
     free(nsupp);
-    free(pmax);
+    free(mom);
+    free(cols);
+    return false;
 }
 
 static void proton_planes_constrict(ProtonDose *dose)
+/** By magnitude, since a comparison's planes can be negative */
 {
     const float threshold = STATIC_CAST(double, NULL_THRESH * dose->dmax);
     void *testptr;
     long i, end;
 
     for (i = end = 0; i < dose->px_dimensions[1]; i++) {
-        end = (dose->planes[i] > threshold) ? i : end;
+        end = (fabsf(dose->planes[i]) > threshold) ? i : end;
     }
     testptr = realloc(dose->planes, sizeof *dose->planes * (++end + 1));
     if (testptr) {
@@ -103,14 +172,53 @@ static void proton_planes_constrict(ProtonDose *dose)
     }
 }
 
-static void proton_planes_create(ProtonDose *dose)
+static void proton_stats_destroy(ProtonDoseStats *st)
+{
+    free(st->plane_max);
+    free(st->support);
+    free(st->centroid);
+    st->plane_max = st->support = st->centroid = NULL;
+}
+
+static bool proton_stats_alloc(ProtonDoseStats *st, long ny)
 {
+    proton_stats_destroy(st);
+    st->plane_max = calloc(ny, sizeof *st->plane_max);
+    st->support = calloc(ny, sizeof *st->support);
+    st->centroid = calloc(2 * ny, sizeof *st->centroid);
+    return !st->plane_max || !st->support || !st->centroid;
+}
+
+static float array_maxf(long n, float arr[_q(static n)])
+{
+    float res = 0.0f;
+    do {
+        res = maxf(res, *arr++);
+    } while (--n);
+    return res;
+}
+
+bool proton_planes_create(ProtonDose *dose)
+{
+    const bool fail = proton_stats_alloc(&dose->stats, dose->px_dimensions[1]);
+
+    free(dose->planes);
+    free(dose->stppwr);
     dose->planes = calloc(dose->px_dimensions[1], sizeof *dose->planes);
     dose->stppwr = calloc(dose->px_dimensions[1], sizeof *dose->stppwr);
-    if (dose->planes && dose->stppwr) {
-        proton_planes_integrate(dose);
-        proton_planes_constrict(dose);
+    if (fail || !dose->planes || !dose->stppwr) {
+        return true;
+    }
+    if (proton_planes_integrate(dose)) {
+        return true;
     }
+    proton_planes_constrict(dose);
+    if (!dose->planes) {
+        return true;
+    }
+    dose->stats.planes_max = array_maxf(dose->nplanes, dose->planes);
+    dose->stats.stppwr_max = array_maxf(dose->nplanes, dose->stppwr);
+    return false;
 }
 
 
@@ -178,92 +286,280 @@ static bool proton_dose_square_out_of_bounds(const ProtonDose *dose,
     return xbnd || ybnd;
 }
 
-static float proton_dose_interp_eval(const float interp[_q(static 4)],
-                                     const float x[_q(static 2)])
-{
-    return fmaf(x[1],
-        fmaf(x[0], interp[3], interp[2]),
-        fmaf(x[0], interp[1], interp[0]));
-}
-
-static float proton_dose_interpolate_square(const float *dptr, const long axskip,
-                                            const float r[_q(static 2)])
-{
-    float interp[4] = { dptr[0], dptr[1], dptr[axskip], dptr[axskip + 1] };
-    interp[1] -= interp[0];
-    interp[3] -= interp[1] + interp[2];
-    interp[2] -= interp[0];
-    return proton_dose_interp_eval(interp, r);
-}
-
 void proton_dose_get_line(ProtonDose *dose, double x, double y)
 {
+    const uint64_t t0 = proton_trace_begin();
     long a[2];
     float r[2];
     proton_dose_find_square(dose, a, x, y, r);
     if (proton_dose_square_out_of_bounds(dose, a)) {
         memset(dose->linedose, 0, sizeof *dose->linedose * dose->nplanes);
     } else {
-        const unsigned long axskip = dose->px_dimensions[0] * dose->px_dimensions[1];
-        float *lptr, *const lend = dose->linedose + dose->nplanes;
+        const long axskip = dose->px_dimensions[0] * dose->px_dimensions[1];
         const float *dptr = dose->data + a[1] * axskip + a[0];
-        for (lptr = dose->linedose; lptr < lend; lptr++) {
-            *lptr = proton_dose_interpolate_square(dptr, axskip, r);
-            dptr += dose->px_dimensions[0];
-        }
+        proton_kernels()->line(dose->linedose, dptr, dose->px_dimensions[0],
+                               axskip, dose->nplanes, r);
     }
+    proton_trace_end("line dose", t0);
 }
 
-static float array_maxf(long n, float arr[_q(static n)])
+float proton_planes_max(const ProtonDose *dose)
 {
-    float res = 0.0f;
-    do {
-        res = maxf(res, *arr++);
-    } while (--n);
-    return res;
+    return dose->stats.planes_max;
 }
 
-float proton_planes_max(const ProtonDose *dose)
+float proton_stppwr_max(const ProtonDose *dose)
 {
-    return array_maxf(dose->nplanes, dose->planes);
+    return dose->stats.stppwr_max;
 }
 
-float proton_stppwr_max(const ProtonDose *dose)
+const ProtonDoseStats *proton_dose_stats(const ProtonDose *dose)
+{
+    return &dose->stats;
+}
+
+void proton_dose_dmax_position(const ProtonDose *dose, double pos[])
 {
-    return array_maxf(dose->nplanes, dose->stppwr);
+    const long *v = dose->stats.dmax_voxel;
+
+    pos[0] = fma(STATIC_CAST(double, v[0]), dose->px_spacing[0], dose->top_left[0]);
+    pos[1] = fma(STATIC_CAST(double, v[1]), dose->px_spacing[1], proton_dose_min_depth(dose));
+    pos[2] = fma(STATIC_CAST(double, v[2]), dose->px_spacing[2], dose->top_left[2]);
 }
 
 
-static void proton_gradient_compute(ProtonDose *dose)
+/** Forward differences in depth over an nx x ny x nz grid. The last row of
+ *  each frame is left as it was (zero from calloc) */
+static void proton_gradient_compute(float *grad, const float *data, long nx,
+                                    long ny, long nz, float s)
 {
-    const size_t axskip = (size_t)dose->px_dimensions[0] * dose->px_dimensions[1];
-    const long jend = dose->px_dimensions[1] - 1;
-    const float *dptr, s = dose->px_spacing[1];
+    const ProtonKernels *kern = proton_kernels();
+    const size_t axskip = (size_t)nx * ny;
+    const float *dptr;
     float *gptr;
-    long i, j, k;
+    long j, k;
 
-    for (k = 0; k < dose->px_dimensions[2]; k++) {
-        gptr = dose->grad + k * axskip;
-        dptr = dose->data + k * axskip;
-        for (j = 0; j < jend; j++) {
-            for (i = 0; i < dose->px_dimensions[0]; i++) {
-                *gptr = (dptr[dose->px_dimensions[0]] - dptr[0]) / s;
-                gptr++;
-                dptr++;
-            }
+    for (k = 0; k < nz; k++) {
+        gptr = grad + k * axskip;
+        dptr = data + k * axskip;
+        for (j = 0; j < ny - 1; j++, gptr += nx, dptr += nx) {
+            kern->diff(gptr, dptr, dptr + nx, s, nx);
         }
     }
 }
 
 
-static void proton_gradient_create(ProtonDose *dose)
+bool proton_gradient_create(ProtonDose *dose)
 {
     const size_t len = dose->px_dimensions[0] * dose->px_dimensions[1] * dose->px_dimensions[2];
 
+    free(dose->grad);
     dose->grad = calloc(len, sizeof *dose->grad);
     if (dose->grad) {
-        proton_gradient_compute(dose);
+        proton_gradient_compute(dose->grad, dose->data, dose->px_dimensions[0],
+                                dose->px_dimensions[1], dose->px_dimensions[2],
+                                STATIC_CAST(float, dose->px_spacing[1]));
     }
+    return !dose->grad;
+}
+
+
+/* ---------------------------------------------------------------------- */
+/*                                Pyramid                                 */
+/* ---------------------------------------------------------------------- */
+
+
+/** Source taps of one reduced node. A tent spanning two source nodes either
+ *  side touches at most five of them */
+struct mip_taps {
+    long lo, n;
+    float w[5];
+};
+
+/** Nodes kept along an axis of @p n nodes. The reduced lattice spans the same
+ *  extent, so the renderer's corner-aligned mapping needs no correction */
+static long proton_mip_length(long n)
+{
+    return (n > 2) ? n / 2 + 1 : n;
+}
+
+/** Tent filter weights resampling @p n nodes onto @p m spanning the same
+ *  extent. Node c lands on c * h of the source lattice, h = (n - 1) / (m - 1),
+ *  which is 2 for odd n (the usual [1 2 1] / 4) and a bit less for even n.
+ *  Tents truncated at the edges are renormalized */
+static struct mip_taps *proton_mip_taps(long n, long m)
+{
+    struct mip_taps *taps = malloc(sizeof *taps * m);
+    const double h = (m > 1) ? STATIC_CAST(double, n - 1) / STATIC_CAST(double, m - 1) : 1.0;
+    double p, wsum, w[5];
+    long c, i, hi;
+
+    if (!taps) {
+        return NULL;
+    }
+    for (c = 0; c < m; c++) {
+        p = STATIC_CAST(double, c) * h;
+        taps[c].lo = STATIC_CAST(long, ceil(p - h));
+        taps[c].lo = (taps[c].lo < 0) ? 0 : taps[c].lo;
+        hi = STATIC_CAST(long, floor(p + h));
+        hi = (hi > n - 1) ? n - 1 : hi;
+        taps[c].n = hi - taps[c].lo + 1;
+        wsum = 0.0;
+        for (i = 0; i < taps[c].n; i++) {
+            w[i] = 1.0 - fabs(STATIC_CAST(double, taps[c].lo + i) - p) / h;
+            w[i] = (w[i] > 0.0) ? w[i] : 0.0;
+            wsum += w[i];
+        }
+        for (i = 0; i < taps[c].n; i++) {
+            taps[c].w[i] = STATIC_CAST(float, w[i] / wsum);
+        }
+    }
+    return taps;
+}
+
+/** Reduces the nx x ny x nz grid @p src into the mx x ny x mz grid @p dst,
+ *  first combining whole frames in z into @p tmp (nx x ny x mz), then
+ *  filtering what is left row by row in x */
+static void proton_mip_reduce(float *dst, const float *src, float *tmp,
+                              const long dim[_q(static 3)], long mx, long mz,
+                              const struct mip_taps *xtaps,
+                              const struct mip_taps *ztaps)
+{
+    const ProtonKernels *kern = proton_kernels();
+    const long frame = dim[0] * dim[1];
+    const long nrows = dim[1] * mz;
+    const float *row;
+    float *out, acc;
+    long r, c, t;
+
+    for (c = 0, out = tmp; c < mz; c++, out += frame) {
+        memset(out, 0, sizeof *out * frame);
+        for (t = 0; t < ztaps[c].n; t++) {
+            kern->axpy(out, src + (ztaps[c].lo + t) * frame, ztaps[c].w[t], frame);
+        }
+    }
+    for (r = 0; r < nrows; r++) {
+        row = tmp + r * dim[0];
+        out = dst + r * mx;
+        for (c = 0; c < mx; c++) {
+            acc = 0.0f;
+            for (t = 0; t < xtaps[c].n; t++) {
+                acc = PROTON_FMAF(xtaps[c].w[t], row[xtaps[c].lo + t], acc);
+            }
+            out[c] = acc;
+        }
+    }
+}
+
+static void proton_pyramid_destroy(ProtonDose *dose)
+{
+    long l;
+
+    for (l = 0; l < dose->nmips; l++) {
+        free(dose->mips[l].data);
+        free(dose->mips[l].grad);
+    }
+    dose->nmips = 0;
+}
+
+/** Builds the next level from @p src, the nx x ny x nz level above it */
+static bool proton_pyramid_level(ProtonDose *dose, const float *src,
+                                 const long dim[_q(static 3)])
+{
+    ProtonDoseMip *mip = dose->mips + dose->nmips;
+    const long mx = proton_mip_length(dim[0]), mz = proton_mip_length(dim[2]);
+    const size_t len = (size_t)mx * dim[1] * mz;
+    struct mip_taps *xtaps = proton_mip_taps(dim[0], mx);
+    struct mip_taps *ztaps = proton_mip_taps(dim[2], mz);
+    float *tmp = malloc(sizeof *tmp * dim[0] * dim[1] * mz);
+    bool fail;
+
+    mip->dim[0] = mx;
+    mip->dim[1] = mz;
+    mip->data = malloc(sizeof *mip->data * len);
+    mip->grad = calloc(len, sizeof *mip->grad);
+    fail = !xtaps || !ztaps || !tmp || !mip->data || !mip->grad;
+    if (!fail) {
+        proton_mip_reduce(mip->data, src, tmp, dim, mx, mz, xtaps, ztaps);
+        /* Differencing in depth commutes with filtering across it, so the
+        coarse gradient comes from the coarse dose */
+        proton_gradient_compute(mip->grad, mip->data, mx, dim[1], mz,
+                                STATIC_CAST(float, dose->px_spacing[1]));
+        dose->nmips++;
+    } else {
+        free(mip->data);
+        free(mip->grad);
+    }
+    free(tmp);
+    free(ztaps);
+    free(xtaps);
+    return fail;
+}
+
+bool proton_pyramid_create(ProtonDose *dose)
+{
+    long dim[3];
+    const float *src = dose->data;
+
+    proton_pyramid_destroy(dose);
+    memcpy(dim, dose->px_dimensions, sizeof dim);
+    while (dose->nmips < PROTON_DOSE_MIPS
+        && (proton_mip_length(dim[0]) < dim[0] || proton_mip_length(dim[2]) < dim[2])) {
+        if (proton_pyramid_level(dose, src, dim)) {
+            proton_pyramid_destroy(dose);
+            return true;
+        }
+        src = dose->mips[dose->nmips - 1].data;
+        dim[0] = dose->mips[dose->nmips - 1].dim[0];
+        dim[2] = dose->mips[dose->nmips - 1].dim[1];
+    }
+    return false;
+}
+
+/** Node spacing of level @p level, in nodes of the full grid */
+static void proton_dose_level_step(const ProtonDose *dose, long level, double step[_q(static 2)])
+{
+    const long n[2] = { dose->px_dimensions[0], dose->px_dimensions[2] };
+    long d;
+
+    for (d = 0; d < 2; d++) {
+        step[d] = (level > 0 && dose->mips[level - 1].dim[d] > 1)
+            ? STATIC_CAST(double, n[d] - 1) / STATIC_CAST(double, dose->mips[level - 1].dim[d] - 1)
+            : 1.0;
+    }
+}
+
+/** The coarsest level whose nodes are no further apart than pixels @p du
+ *  full grid nodes apart */
+static long proton_dose_step_level(const ProtonDose *dose, const double du[_q(static 2)])
+{
+    double step[2];
+    long l;
+
+    for (l = dose->nmips; l > 0; l--) {
+        proton_dose_level_step(dose, l, step);
+        if (fabs(du[0]) >= step[0] && fabs(du[1]) >= step[1]) {
+            break;
+        }
+    }
+    return l;
+}
+
+/** Pixel spacing, in full grid nodes, of the whole plane fitted to an image
+ *  @p width x @p height */
+static void proton_dose_fit_step(const ProtonDose *dose, long width, long height,
+                                 double du[_q(static 2)])
+{
+    du[0] = (width > 1) ? STATIC_CAST(double, dose->px_dimensions[0] - 1) / STATIC_CAST(double, width - 1) : 0.0;
+    du[1] = (height > 1) ? STATIC_CAST(double, dose->px_dimensions[2] - 1) / STATIC_CAST(double, height - 1) : 0.0;
+}
+
+long proton_dose_pick_level(const ProtonDose *dose, long width, long height)
+{
+    double du[2];
+
+    proton_dose_fit_step(dose, width, height, du);
+    return proton_dose_step_level(dose, du);
 }
 
 
@@ -275,9 +571,71 @@ static void proton_gradient_create(ProtonDose *dose)
 static ProtonDose *proton_dose_flexible_alloc(const long N)
 {
     ProtonDose *dose = malloc(sizeof *dose + sizeof *dose->data * N);
+    if (dose) {
+        dose->planes = NULL;
+        dose->stppwr = NULL;
+        dose->linedose = NULL;
+        dose->grad = NULL;
+        dose->nplanes = 0;
+        memset(&dose->stats, 0, sizeof dose->stats);
+        dose->nmips = 0;
+    }
+    return dose;
+}
+
+ProtonDose *proton_dose_alloc(const long dim[], const double top_left[],
+                              const double spacing[])
+{
+    ProtonDose *dose = proton_dose_flexible_alloc(dim[0] * dim[1] * dim[2]);
+    if (dose) {
+        memcpy(dose->px_dimensions, dim, sizeof dose->px_dimensions);
+        memcpy(dose->top_left, top_left, sizeof dose->top_left);
+        memcpy(dose->px_spacing, spacing, sizeof dose->px_spacing);
+        dose->dmax = 0.0f;
+    }
     return dose;
 }
 
+float *proton_dose_data(ProtonDose *dose)
+{
+    return dose->data;
+}
+
+bool proton_dose_derive(ProtonDose *dose)
+{
+    uint64_t t0;
+    bool fail;
+
+    t0 = proton_trace_begin();
+    fail = proton_planes_create(dose);
+    proton_trace_end("dose planes", t0);
+    if (fail) {
+        return true;
+    }
+    t0 = proton_trace_begin();
+    fail = proton_gradient_create(dose);
+    proton_trace_end("dose gradient", t0);
+    if (fail) {
+        return true;
+    }
+    t0 = proton_trace_begin();
+    fail = proton_pyramid_create(dose);
+    proton_trace_end("dose pyramid", t0);
+    if (fail) {
+        return true;
+    }
+    /** Allocate one extra point, set it to zero, and don't touch it. This
+     *  avoids the need for special fencepost code in the interpolator
+     *  (the planes are allocated with an additional 0.0 as well) */
+    free(dose->linedose);
+    dose->linedose = malloc(sizeof *dose->linedose * (dose->nplanes + 1));
+    if (!dose->linedose) {
+        return true;
+    }
+    dose->linedose[dose->nplanes] = 0.0f;
+    return false;
+}
+
 /** Allocates the structure and initializes all components derived directly
  *  from the DICOM */
 static ProtonDose *proton_dose_init(RTDose *dcm)
@@ -310,6 +668,7 @@ static ProtonDose *proton_dose_init(RTDose *dcm)
 ProtonDose *proton_dose_create(const char *filename, size_t ebufsz, char err[])
 {
     ProtonDose *dose;
+    uint64_t t0;
     RTDose *dcm;
 
     /* If you see this then you probably have an allocation failure. I wasn't
@@ -317,32 +676,23 @@ ProtonDose *proton_dose_create(const char *filename, size_t ebufsz, char err[])
     now to go through and isolate these functions. Still better than it was,
     since the most frequent failure state is DCMTK failing to load the RTDose */
     snprintf(err, ebufsz, "Failed to load dose");
+    t0 = proton_trace_begin();
     dcm = rtdose_create(filename, ebufsz, err);
+    proton_trace_end("dose read DICOM", t0);
     if (!dcm) {
         return NULL;
     }
+    t0 = proton_trace_begin();
     dose = proton_dose_init(dcm);
     rtdose_destroy(dcm);
+    proton_trace_end("dose decode voxels", t0);
     if (!dose) {
         return NULL;
     }
-    dose->linedose = NULL;
-    dose->grad = NULL;
-    proton_planes_create(dose);
-    proton_gradient_create(dose);
-    if (!dose->planes || !dose->grad) {
+    if (proton_dose_derive(dose)) {
         proton_dose_destroy(dose);
         return NULL;
     }
-    /** Allocate one extra point, set it to zero, and don't touch it. This
-     *  avoids the need for special fencepost code in the interpolator
-     *  (the planes are allocated with an additional 0.0 as well) */
-    dose->linedose = malloc(sizeof *dose->linedose * (dose->nplanes + 1));
-    if (!dose->linedose) {
-        proton_dose_destroy(dose);
-        return NULL;
-    }
-    dose->linedose[dose->nplanes] = 0.0f;
     return dose;
 }
 
@@ -352,6 +702,9 @@ void proton_dose_destroy(ProtonDose *dose)
         free(dose->planes);
         free(dose->linedose);
         free(dose->stppwr);
+        free(dose->grad);
+        proton_stats_destroy(&dose->stats);
+        proton_pyramid_destroy(dose);
         free(dose);
     }
 }
@@ -390,9 +743,15 @@ static ProtonImage *proton_image_flexible_alloc(long N)
     return img;
 }
 
-bool proton_image_realloc(ProtonImage **img, long width, long height)
+long proton_image_format_bpp(int format)
+{
+    return (format == PROTON_PX_RGB24) ? 3 : 4;
+}
+
+bool proton_image_realloc(ProtonImage **img, long width, long height, int format)
 {
-    const long N = 3UL * width * height;
+    const long stride = proton_image_format_bpp(format) * width;
+    const long N = stride * height;
     const long N_old = (*img) ? (*img)->bufwidth : 0;
     if (N > N_old) {
         free(*img);
@@ -403,6 +762,26 @@ bool proton_image_realloc(ProtonImage **img, long width, long height)
     }
     (*img)->dim[0] = width;
     (*img)->dim[1] = height;
+    (*img)->stride = stride;
+    (*img)->format = format;
+    (*img)->px = (*img)->buf;
+    return false;
+}
+
+bool proton_image_attach(ProtonImage **img, unsigned char *px, long width,
+                         long height, long stride, int format)
+{
+    if (!*img) {
+        *img = proton_image_flexible_alloc(0);
+        if (!*img) {
+            return true;
+        }
+    }
+    (*img)->dim[0] = width;
+    (*img)->dim[1] = height;
+    (*img)->stride = stride;
+    (*img)->format = format;
+    (*img)->px = px;
     return false;
 }
 
@@ -413,110 +792,117 @@ void proton_image_destroy(ProtonImage *img)
 
 unsigned char *proton_image_raw(ProtonImage *img)
 {
-    return img->buf;
+    return img->px;
 }
 
-static void proton_dose_load_interpolant(float interp[_q(static 4)],
-                                         const float *dline,
-                                         const long yskip,
-                                         const long zskip,
-                                         const float z,
-                                         const float dmax)
+long proton_dose_find_scan(const ProtonDose *dose, float *z)
+/** Given a slice depth in @p z, find the the scan with the greatest z 
+ *  coordinate not greater than @p z, leaving the fraction of the way to the
+ *  next in @p z */
 {
-    interp[0] = dline[0];
-    interp[1] = dline[1];
-    interp[2] = dline[zskip];
-    interp[3] = dline[zskip + 1];
-
-    dline += yskip;
-    interp[0] = fmaf(dline[0] - interp[0], z, interp[0]);
-    interp[1] = fmaf(dline[1] - interp[1], z, interp[1]);
-    interp[2] = fmaf(dline[zskip] - interp[2], z, interp[2]);
-    interp[3] = fmaf(dline[zskip + 1] - interp[3], z, interp[3]);
-
-    interp[1] -= interp[0];
-    interp[3] -= interp[2] + interp[1];
-    interp[2] -= interp[0];
-
-    interp[0] /= dmax;
-    interp[1] /= dmax;
-    interp[2] /= dmax;
-    interp[3] /= dmax;
+    float flz;
+    long idx;
+    *z -= STATIC_CAST(float, proton_dose_min_depth(dose));
+    *z /= STATIC_CAST(float, dose->px_spacing[1]);
+    flz = floorf(*z);
+    idx = STATIC_CAST(long, flz);
+    *z -= flz;
+    if (idx < 0) {
+        *z = 0.0f;
+        return 0;
+    }
+    return (idx < dose->px_dimensions[1]) ? idx : dose->px_dimensions[1] - 1;
 }
 
-static void proton_dose_sublattice_clamp(long b[_q(restrict static 2)],
-                                         const long blim[_q(static 2)],
-                                         const long a[_q(static 2)],
-                                         const long alim[_q(static 2)])
+/** Lerps a @p w x @p h window between the coronal planes starting at @p a
+ *  and @p b, whose rows are @p stride apart, into @p slab at fraction @p z,
+ *  scaled by 1 / @p norm */
+static void proton_dose_slab(float *slab, const float *a, const float *b, long stride,
+                             float z, float norm, long w, long h)
 {
-    b[0] = IDIVCEIL(blim[0] * a[0], alim[0]);
-    b[1] = IDIVCEIL(blim[1] * a[1], alim[1]);
-}
+    const ProtonKernels *kern = proton_kernels();
+    long k;
 
-static void proton_dose_fma(float a[_q(restrict static 2)],
-                            const float b[_q(static 2)],
-                            const float c[_q(static 2)])
-{
-    a[0] = fmaf(a[0], b[0], c[0]);
-    a[1] = fmaf(a[1], b[1], c[1]);
+    for (k = 0; k < h; k++, a += stride, b += stride, slab += w) {
+        kern->lerp(slab, a, b, z, 1.0f / norm, w);
+    }
 }
 
-static void proton_dose_fcast(float dst[_q(restrict static 2)],
-                              const long src[_q(static 2)])
+void proton_dose_get_slab(const ProtonDose *dose, float depth, float *slab)
 {
-    dst[0] = STATIC_CAST(float, src[0]);
-    dst[1] = STATIC_CAST(float, src[1]);
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    const long row = proton_dose_find_scan(dose, &depth);
+    const float *a = dose->data + row * nx;
+
+    proton_dose_slab(slab, a, (row + 1 < ny) ? a + nx : a, nx * ny, depth, 1.0f,
+                     nx, dose->px_dimensions[2]);
 }
 
-static void proton_dose_interpolate_cell(const float interp[_q(static 4)],
-                                         const long a[_q(static 2)],
-                                         const long alim[_q(static 2)],
-                                         const long blim[_q(static 2)],
-                                         unsigned char *buf,
-                                         void (*cmap)(float, unsigned char *))
+/** Renders @p u, the first pixel's position and the pixel steps in node
+ *  coordinates of the full grid, from level @p level. Only the cells under
+ *  the image are interpolated, so a zoomed in render or a tile costs about
+ *  the same per pixel as the whole plane */
+static void proton_dose_render(const ProtonDose        *dose,
+                               const ProtonPlaneParams *params,
+                               ProtonImage             *img,
+                               float                    depth,
+                               long                     level,
+                               const double             u[_q(static 4)])
 {
-    const float tfm[2] = {
-        STATIC_CAST(float, alim[0]) / STATIC_CAST(float, blim[0]),
-        STATIC_CAST(float, alim[1]) / STATIC_CAST(float, blim[1]) };
-    const float tlt[2] = {
-        -STATIC_CAST(float, a[0]), -STATIC_CAST(float, a[1]) };
-    const long bskip = blim[0] + 1;
-    long b[2], b0;
-    float x[2];
-    unsigned char *px;
-    proton_dose_sublattice_clamp(b, blim, a, alim);
-    b0 = b[0];
-    px = buf + 3 * (b[1] * bskip + b[0]);
-    while (1) {
-        proton_dose_fcast(x, b);
-        proton_dose_fma(x, tfm, tlt);
-        if (x[1] > 1.0f) {
-            break;
-        } else if (x[0] > 1.0f) {
-            b[0] = b0;
-            b[1]++;
-            px = buf + 3 * (b[1] * bskip + b[0]);
-        } else {
-            cmap(proton_dose_interp_eval(interp, x), px);
-            b[0]++;
-            px += 3;
+    const ProtonDoseMip *mip = (level > 0 && level <= dose->nmips) ? dose->mips + level - 1 : NULL;
+    const long nx = (mip) ? mip->dim[0] : dose->px_dimensions[0];
+    const long nz = (mip) ? mip->dim[1] : dose->px_dimensions[2];
+    const float norm = (params->type == PROTON_IMG_DOSE) ? dose->dmax : (params->pct_diff * dose->dmax) / params->depth_err;
+    const uint64_t t0 = proton_trace_begin();
+    const float *a, *b, *base;
+    double step[2], v[4], sview[4];
+    long lo[2], hi[2], d, row;
+    float *slab;
+
+    if (params->type == PROTON_IMG_DOSE) {
+        base = (mip) ? mip->data : dose->data;
+    } else {
+        base = (mip) ? mip->grad : dose->grad;
+    }
+    if (!proton_image_empty(img) && nx > 1 && nz > 1) {
+        proton_dose_level_step(dose, (mip) ? level : 0, step);
+        for (d = 0; d < 2; d++) {
+            const long n = (d) ? nz : nx;
+            /* First and last pixel, in level nodes */
+            v[d] = u[d] / step[d];
+            v[d + 2] = (u[d] + u[d + 2] * STATIC_CAST(double, img->dim[d] - 1)) / step[d];
+            lo[d] = STATIC_CAST(long, floor(fmin(v[d], v[d + 2])));
+            lo[d] = (lo[d] < 0) ? 0 : (lo[d] > n - 2) ? n - 2 : lo[d];
+            hi[d] = STATIC_CAST(long, ceil(fmax(v[d], v[d + 2])));
+            hi[d] = (hi[d] <= lo[d]) ? lo[d] + 1 : (hi[d] > n - 1) ? n - 1 : hi[d];
+            sview[d] = v[d] - STATIC_CAST(double, lo[d]);
+            sview[d + 2] = u[d + 2] / step[d];
+        }
+        row = proton_dose_find_scan(dose, &depth);
+        a = base + row * nx + lo[1] * nx * dose->px_dimensions[1] + lo[0];
+        b = (row + 1 < dose->px_dimensions[1]) ? a + nx : a;
+        slab = malloc(sizeof *slab * (hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1));
+        if (slab) {
+            proton_dose_slab(slab, a, b, nx * dose->px_dimensions[1], depth, norm,
+                             hi[0] - lo[0] + 1, hi[1] - lo[1] + 1);
+            proton_kernels()->render(slab, hi[0] - lo[0] + 1, hi[1] - lo[1] + 1,
+                                     sview, img, params->colormap);
+            free(slab);
         }
     }
+    proton_trace_end("render plane", t0);
 }
 
-/** Given a slice depth in @p z, find the the scan with the greatest z 
- *  coordinate not greater than @p z */
-static void proton_dose_find_scan(const ProtonDose *dose, float *z,
-                                  const float *base, const float **dline)
+void proton_dose_get_plane_level(const ProtonDose        *dose,
+                                 const ProtonPlaneParams *params,
+                                 ProtonImage             *img,
+                                 float                    depth,
+                                 long                     level)
 {
-    float flz;
-    long idx;
-    *z -= STATIC_CAST(float, proton_dose_min_depth(dose));
-    *z /= STATIC_CAST(float, dose->px_spacing[1]);
-    flz = floorf(*z);
-    idx = STATIC_CAST(long, flz);
-    *dline = base + idx * dose->px_dimensions[0];
-    *z -= flz;
+    double u[4] = { 0.0, 0.0 };
+
+    proton_dose_fit_step(dose, img->dim[0], img->dim[1], u + 2);
+    proton_dose_render(dose, params, img, depth, level, u);
 }
 
 void proton_dose_get_plane(const ProtonDose        *dose,
@@ -524,25 +910,41 @@ void proton_dose_get_plane(const ProtonDose        *dose,
                            ProtonImage             *img,
                            float                    depth)
 {
-    const long axskip = dose->px_dimensions[0] * dose->px_dimensions[1];
-    const long alim[2] = { dose->px_dimensions[0] - 1, dose->px_dimensions[2] - 1 };
-    const long blim[2] = { proton_image_dimension(img, 0) - 1, proton_image_dimension(img, 1) - 1 };
-    unsigned char *buf = proton_image_raw(img);
-    const float *dptr, *base = (params->type == PROTON_IMG_DOSE) ? dose->data : dose->grad;
-    const float norm = (params->type == PROTON_IMG_DOSE) ? dose->dmax : (params->pct_diff * dose->dmax) / params->depth_err;
-    float interp[4];
-    long a[2];
+    proton_dose_get_plane_level(dose, params, img, depth,
+        proton_dose_pick_level(dose, img->dim[0], img->dim[1]));
+}
 
-    if (!proton_image_empty(img)) {
-        proton_dose_find_scan(dose, &depth, base, &dptr);
-        for (a[1] = 0; a[1] < alim[1]; a[1]++) {
-            const float *const dline = dptr;
-            for (a[0] = 0; a[0] < alim[0]; a[0]++, dptr++) {
-                proton_dose_load_interpolant(interp, dptr, dose->px_dimensions[0],
-                                             axskip, depth, norm);
-                proton_dose_interpolate_cell(interp, a, alim, blim, buf, params->colormap);
-            }
-            dptr = dline + axskip;
-        }
-    }
+void proton_view_fit(ProtonView *view, const double rect[], long width, long height)
+{
+    view->origin[0] = rect[0];
+    view->origin[1] = rect[1];
+    view->step[0] = (width > 1) ? (rect[2] - rect[0]) / STATIC_CAST(double, width - 1) : 0.0;
+    view->step[1] = (height > 1) ? (rect[3] - rect[1]) / STATIC_CAST(double, height - 1) : 0.0;
+}
+
+void proton_dose_get_plane_region(const ProtonDose        *dose,
+                                  const ProtonPlaneParams *params,
+                                  ProtonImage             *img,
+                                  float                    depth,
+                                  const ProtonView        *view)
+{
+    const double u[4] = {
+        (view->origin[0] - dose->top_left[0]) / dose->px_spacing[0],
+        (view->origin[1] - dose->top_left[2]) / dose->px_spacing[2],
+        view->step[0] / dose->px_spacing[0],
+        view->step[1] / dose->px_spacing[2] };
+
+    proton_dose_render(dose, params, img, depth, proton_dose_step_level(dose, u + 2), u);
+}
+
+void proton_dose_get_plane_view(const ProtonDose        *dose,
+                                const ProtonPlaneParams *params,
+                                ProtonImage             *img,
+                                float                    depth,
+                                const double             rect[])
+{
+    ProtonView view;
+
+    proton_view_fit(&view, rect, img->dim[0], img->dim[1]);
+    proton_dose_get_plane_region(dose, params, img, depth, &view);
 }
@@ -19,6 +19,30 @@ enum {
 };
 
 
+/** Coronal pyramid levels kept beyond the full grid, at 2x and 4x */
+#define PROTON_DOSE_MIPS 2
+
+/** One reduced copy of the grid. Only x and z are reduced, every level keeps
+ *  all the depth rows so planes interpolate between them exactly as before */
+typedef struct _proton_dose_mip {
+    long dim[2];            /* Nodes in x and z */
+    float *data, *grad;
+} ProtonDoseMip;
+
+
+/** Statistics of the voxels, computed along with the planes so that plot
+ *  axes and normalisation read them instead of scanning the grid */
+typedef struct _proton_dose_stats {
+    float planes_max, stppwr_max;   /* Over the planes that hold dose */
+    long dmax_voxel[3];             /* (x, depth, z) index of the largest voxel */
+
+    /* One per depth row, px_dimensions[1] of each */
+    float *plane_max;
+    float *support;                 /* Area above 10% of the row maximum (mm^2) */
+    float *centroid;                /* Dose-weighted (x, z) in mm, two per row */
+} ProtonDoseStats;
+
+
 typedef struct _proton_dose {
     /* Everything in this section must be extracted from the DICOM */
     double top_left[3];
@@ -29,9 +53,15 @@ typedef struct _proton_dose {
     long nplanes;
     float *planes, *stppwr, *linedose;
     float dmax;
+    ProtonDoseStats stats;
 
     /* Gradient field in y */
     float *grad;
+
+    /* Coarser levels of data and grad, fewer than PROTON_DOSE_MIPS when the
+    grid is too small to reduce */
+    long nmips;
+    ProtonDoseMip mips[PROTON_DOSE_MIPS];
 #if !defined(__cplusplus) || !__cplusplus
     float data[];
 #endif /* C ONLY */
@@ -41,6 +71,22 @@ typedef struct _proton_dose {
 ProtonDose *proton_dose_create(const char *filename, size_t ebufsz, char err[]);
 void proton_dose_destroy(ProtonDose *dose);
 
+/** For callers that produce the voxels themselves (generators, benchmarks):
+ *  allocate, fill proton_dose_data() and dmax, then derive the rest. The
+ *  voxel layout is x fastest, then depth (y), then z */
+ProtonDose *proton_dose_alloc(const long dim[], const double top_left[],
+                              const double spacing[]);
+float *proton_dose_data(ProtonDose *dose);
+
+/** Computes everything derived from the voxels. Returns true on allocation
+ *  failure */
+bool proton_dose_derive(ProtonDose *dose);
+
+/** The stages of proton_dose_derive(), each replacing its previous result */
+bool proton_planes_create(ProtonDose *dose);
+bool proton_gradient_create(ProtonDose *dose);
+bool proton_pyramid_create(ProtonDose *dose);
+
 inline double proton_dose_origin(const ProtonDose *dose, int dim) { return dose->top_left[dim]; }
 inline double proton_dose_spacing(const ProtonDose *dose, int dim) { return dose->px_spacing[dim]; }
 inline long proton_dose_dimension(const ProtonDose *dose, int dim) { return dose->px_dimensions[dim]; }
@@ -67,21 +113,38 @@ inline const float *proton_line_raw(const ProtonDose *dose) { return dose->lined
 inline const float *proton_planes_raw(const ProtonDose *dose) { return dose->planes; }
 inline const float *proton_stppwr_raw(const ProtonDose *dose) { return dose->stppwr; }
 
-/** @warning This value is NOT stored in the dose struct, so this function
- *      COMPUTES the result!
- */
+/** Read from the statistics, these do not scan the planes */
 float proton_planes_max(const ProtonDose *dose);
 float proton_stppwr_max(const ProtonDose *dose);
 
+const ProtonDoseStats *proton_dose_stats(const ProtonDose *dose);
+
+/** Writes the position of the largest voxel to @p pos: x, depth and z in mm,
+ *  depth measured as proton_line_get_dose() takes it */
+void proton_dose_dmax_position(const ProtonDose *dose, double pos[]);
+
 double proton_planes_get_dose(const ProtonDose *dose, double depth);
 double proton_stppwr_get_dose(const ProtonDose *dose, double depth);
 
 inline long proton_line_length(const ProtonDose *dose) { return dose->nplanes; }
 
 
+/** Pixel layouts understood by the plane renderer. The 32-bit layouts are
+ *  written one whole word per pixel with an opaque alpha byte, so they can
+ *  be handed to the platform without conversion */
+enum {
+    PROTON_PX_RGB24 = 0,
+    PROTON_PX_RGBA32,
+    PROTON_PX_BGRA32
+};
+
+
 typedef struct _proton_image {
     long dim[2];
     long bufwidth;
+    long stride;            /* Bytes between rows, may be negative */
+    int format;
+    unsigned char *px;      /* First pixel, owned buffer or foreign surface */
     
 #if !defined(__cplusplus) || !__cplusplus
     unsigned char buf[];
@@ -89,10 +152,17 @@ typedef struct _proton_image {
 } ProtonImage;
 
 
-bool proton_image_realloc(ProtonImage **img, long width, long height);
+bool proton_image_realloc(ProtonImage **img, long width, long height, int format);
+
+/** Points @p img at a surface it does not own, e.g. the raw data of a
+ *  native bitmap. Any buffer previously owned by @p img is kept for reuse */
+bool proton_image_attach(ProtonImage **img, unsigned char *px, long width,
+                         long height, long stride, int format);
 void proton_image_destroy(ProtonImage *img);
 
 inline long proton_image_dimension(const ProtonImage *img, int dim) { return img->dim[dim]; }
+/** Bytes per pixel of @p format */
+long proton_image_format_bpp(int format);
 unsigned char *proton_image_raw(ProtonImage *img);
 
 inline bool proton_image_empty(const ProtonImage *img) { return img->dim[0] == 0 || img->dim[1] == 0; }
@@ -110,12 +180,67 @@ typedef struct _proton_plane_params {
     float depth_err;
 } ProtonPlaneParams;
 
-/** Interpolates the dose grid onto the 2D buffer at @p img */
+/** Interpolates the full resolution coronal plane at @p depth into @p slab,
+ *  which holds dim[0] x dim[2] values in Gy, x fastest */
+void proton_dose_get_slab(const ProtonDose *dose, float depth, float *slab);
+
+/** The depth row at or above @p depth, replacing @p depth with the fraction
+ *  of the way to the next. This is the pair of rows every coronal plane is
+ *  interpolated between. The last row is paired with itself */
+long proton_dose_find_scan(const ProtonDose *dose, float *depth);
+
+/** Interpolates the dose grid onto the 2D buffer at @p img, from the
+ *  coarsest pyramid level that still has a node for every pixel */
 void proton_dose_get_plane(const ProtonDose        *dose,
                            const ProtonPlaneParams *params,
                            ProtonImage             *img,
                            float                    depth);
 
+/** Same as above, from pyramid level @p level (0 is the full grid). Coarse
+ *  levels make cheap previews */
+void proton_dose_get_plane_level(const ProtonDose        *dose,
+                                 const ProtonPlaneParams *params,
+                                 ProtonImage             *img,
+                                 float                    depth,
+                                 long                     level);
+
+/** Renders only the part of the plane in @p rect, {x0, z0, x1, z1} in mm.
+ *  The first pixel is centred on (x0, z0) and the last on (x1, z1), and the
+ *  level is picked for the nodes actually in view. Pixels beyond the grid
+ *  repeat its edge */
+void proton_dose_get_plane_view(const ProtonDose        *dose,
+                                const ProtonPlaneParams *params,
+                                ProtonImage             *img,
+                                float                    depth,
+                                const double             rect[]);
+
+
+/** Places pixels on the coronal plane: pixel (i, j) is centred on
+ *  origin + (i, j) * step, in mm in x and z */
+typedef struct _proton_view {
+    double origin[2];
+    double step[2];
+} ProtonView;
+
+/** The view putting the first pixel of a @p width x @p height image on
+ *  (rect[0], rect[1]) and the last on (rect[2], rect[3]) */
+void proton_view_fit(ProtonView *view, const double rect[], long width, long height);
+
+/** Renders @p img through @p view. For tiles, attach @p img to part of a
+ *  larger image and move the origin to the tile's first pixel: the tile
+ *  comes out as those pixels of the whole would */
+void proton_dose_get_plane_region(const ProtonDose        *dose,
+                                  const ProtonPlaneParams *params,
+                                  ProtonImage             *img,
+                                  float                    depth,
+                                  const ProtonView        *view);
+
+/** Level count, including the full grid */
+inline long proton_dose_levels(const ProtonDose *dose) { return dose->nmips + 1; }
+
+/** The coarsest level with at least @p width x @p height coronal nodes */
+long proton_dose_pick_level(const ProtonDose *dose, long width, long height);
+
 
 #if __cplusplus
 }
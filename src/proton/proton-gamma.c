@@ -0,0 +1,279 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "proton-gamma.h"
+#include "proton-parallel.h"
+#include "proton-trace.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+
+/** A point of the search around a reference voxel, interpolated between the
+ *  eight evaluated voxels from lo to up */
+struct gamma_offset {
+    long step;          /* Index of the lo corner, from the reference voxel */
+    long lo[3], up[3];  /* Voxel offsets of the corners, for bounds */
+    long hi[3];         /* Index strides to the up corner, zero where aligned */
+    float w[3];         /* Weight of the up corner */
+    float dist;         /* Squared distance over the squared DTA */
+};
+
+/** Each row's share of the statistics, reduced once every row is done */
+struct gamma_rowstats {
+    long evaluated, passed;
+    double sum;
+    float max;
+};
+
+struct gamma_search {
+    struct gamma_offset *offs;
+    long noffs;
+    const float *ref, *eval;
+    long dim[3];
+    float thresh;       /* Gy */
+    float crit;         /* Fraction of the dose taken as the dose criterion */
+    float global;       /* Gy, or zero for local */
+    float *dst;
+    struct gamma_rowstats *rows;
+};
+
+
+static int gamma_offset_cmp(const void *a, const void *b)
+{
+    const struct gamma_offset *x = a, *y = b;
+
+    return (x->dist > y->dist) - (x->dist < y->dist);
+}
+
+
+/** Floor division, as C truncates toward zero */
+static long gamma_floordiv(long a, long b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+
+/** Every search point within PROTON_GAMMA_SEARCH DTAs, spaced by a voxel
+ *  over the interpolation factor, nearest first */
+static bool gamma_offsets(struct gamma_search *gs, const ProtonDose *ref,
+                          const ProtonGammaParams *params)
+{
+    const long f = (params->interp > 1) ? params->interp : 1;
+    const long stride[3] = { 1, gs->dim[0], gs->dim[0] * gs->dim[1] };
+    const float r = PROTON_GAMMA_SEARCH * params->dta;
+    long n[3], a[3], d, cnt;
+    float step[3], dist;
+
+    cnt = 1;
+    for (d = 0; d < 3; d++) {
+        step[d] = STATIC_CAST(float, ref->px_spacing[d]) / STATIC_CAST(float, f);
+        n[d] = STATIC_CAST(long, r / step[d]);
+        cnt *= 2 * n[d] + 1;
+    }
+    gs->offs = malloc(sizeof *gs->offs * cnt);
+    if (!gs->offs) {
+        return true;
+    }
+    gs->noffs = 0;
+    for (a[2] = -n[2]; a[2] <= n[2]; a[2]++) {
+        for (a[1] = -n[1]; a[1] <= n[1]; a[1]++) {
+            for (a[0] = -n[0]; a[0] <= n[0]; a[0]++) {
+                struct gamma_offset *o = gs->offs + gs->noffs;
+
+                dist = 0.0f;
+                for (d = 0; d < 3; d++) {
+                    const float x = STATIC_CAST(float, a[d]) * step[d];
+
+                    dist += x * x;
+                }
+                if (dist > r * r) {
+                    continue;
+                }
+                o->step = 0;
+                for (d = 0; d < 3; d++) {
+                    o->lo[d] = gamma_floordiv(a[d], f);
+                    o->w[d] = STATIC_CAST(float, a[d] - o->lo[d] * f) / STATIC_CAST(float, f);
+                    o->up[d] = o->lo[d] + (o->w[d] > 0.0f);
+                    o->hi[d] = (o->w[d] > 0.0f) ? stride[d] : 0;
+                    o->step += o->lo[d] * stride[d];
+                }
+                o->dist = dist / (params->dta * params->dta);
+                gs->noffs++;
+            }
+        }
+    }
+    qsort(gs->offs, gs->noffs, sizeof *gs->offs, gamma_offset_cmp);
+    return false;
+}
+
+
+static float gamma_sample(const float *p, const struct gamma_offset *o)
+{
+    const long x = o->hi[0], y = o->hi[1], z = o->hi[2];
+    float c0, c1, c2, c3;
+
+    c0 = p[0] + o->w[0] * (p[x] - p[0]);
+    c1 = p[y] + o->w[0] * (p[y + x] - p[y]);
+    c2 = p[z] + o->w[0] * (p[z + x] - p[z]);
+    c3 = p[z + y] + o->w[0] * (p[z + y + x] - p[z + y]);
+    c0 += o->w[1] * (c1 - c0);
+    c2 += o->w[1] * (c3 - c2);
+    return c0 + o->w[2] * (c2 - c0);
+}
+
+
+static bool gamma_inside(const struct gamma_search *gs, const struct gamma_offset *o,
+                         const long pos[])
+{
+    int d;
+
+    for (d = 0; d < 3; d++) {
+        if (pos[d] + o->lo[d] < 0 || pos[d] + o->up[d] >= gs->dim[d]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/** Squared gamma at @p pos. Offsets come nearest first, so the search stops
+ *  as soon as distance alone can do no better. The voxel itself is always
+ *  inside, bounding the result by the dose difference there */
+static float gamma_point(const struct gamma_search *gs, const long pos[], long idx,
+                         float inv_dd2)
+{
+    const struct gamma_offset *o, *end = gs->offs + gs->noffs;
+    const float dr = gs->ref[idx];
+    float best = INFINITY, diff, g;
+
+    for (o = gs->offs; o < end && o->dist < best; o++) {
+        if (gamma_inside(gs, o, pos)) {
+            diff = gamma_sample(gs->eval + idx + o->step, o) - dr;
+            g = o->dist + diff * diff * inv_dd2;
+            best = (g < best) ? g : best;
+        }
+    }
+    return best;
+}
+
+
+/** Row @p row of the volume, counting rows of every frame in turn */
+static void gamma_row(void *arg, long row)
+{
+    const struct gamma_search *gs = arg;
+    struct gamma_rowstats *st = gs->rows + row;
+    const long base = row * gs->dim[0];
+    long pos[3] = { 0, row % gs->dim[1], row / gs->dim[1] };
+    float dd, g;
+
+    for (pos[0] = 0; pos[0] < gs->dim[0]; pos[0]++) {
+        const long idx = base + pos[0];
+
+        if (gs->ref[idx] <= gs->thresh) {
+            gs->dst[idx] = 0.0f;
+            continue;
+        }
+        dd = (gs->global > 0.0f) ? gs->global : gs->crit * gs->ref[idx];
+        g = sqrtf(gamma_point(gs, pos, idx, 1.0f / (dd * dd)));
+        gs->dst[idx] = g;
+        st->max = (g > st->max) ? g : st->max;
+        st->evaluated++;
+        st->passed += (g <= 1.0f);
+        st->sum += g;
+    }
+}
+
+
+ProtonDose *proton_dose_gamma(const ProtonDose *ref, const ProtonDose *eval,
+                              const ProtonGammaParams *params, ProtonGammaStats *stats)
+/** Rows go to threads one at a time as they finish, since the cost of a row
+ *  depends on how much of it is above the threshold and how well it agrees.
+ *  This uses proton_parallel_for() rather than OpenMP, so a build without
+ *  OpenMP still searches on every core. Row statistics are kept apart and
+ *  reduced afterwards, in order */
+{
+    struct gamma_search gs;
+    ProtonDose *res;
+    long nrows, row;
+    double sum = 0.0;
+    uint64_t t0;
+    int d;
+
+    for (d = 0; d < 3; d++) {
+        gs.dim[d] = ref->px_dimensions[d];
+    }
+    gs.ref = ref->data;
+    gs.eval = eval->data;
+    gs.thresh = params->threshold / 100.0f * ref->dmax;
+    gs.crit = params->dose / 100.0f;
+    gs.global = (params->local) ? 0.0f : gs.crit * ref->dmax;
+    if (params->dose <= 0.0f || params->dta <= 0.0f || gs.thresh < 0.0f) {
+        return NULL;
+    }
+    nrows = gs.dim[1] * gs.dim[2];
+    res = proton_dose_alloc(gs.dim, ref->top_left, ref->px_spacing);
+    gs.rows = calloc(nrows, sizeof *gs.rows);
+    if (!res || !gs.rows || gamma_offsets(&gs, ref, params)) {
+        proton_dose_destroy(res);
+        free(gs.rows);
+        return NULL;
+    }
+    gs.dst = res->data;
+    t0 = proton_trace_begin();
+    proton_parallel_for(nrows, gamma_row, &gs);
+    proton_trace_end("gamma search", t0);
+    free(gs.offs);
+    stats->evaluated = 0;
+    stats->passed = 0;
+    stats->max = 0.0f;
+    for (row = 0; row < nrows; row++) {
+        stats->evaluated += gs.rows[row].evaluated;
+        stats->passed += gs.rows[row].passed;
+        stats->max = fmaxf(stats->max, gs.rows[row].max);
+        sum += gs.rows[row].sum;
+    }
+    stats->mean = (stats->evaluated)
+                ? STATIC_CAST(float, sum / STATIC_CAST(double, stats->evaluated)) : 0.0f;
+    free(gs.rows);
+    /* A perfect match is still drawn against a gamma of one */
+    res->dmax = fmaxf(stats->max, 1.0f);
+    if (proton_dose_derive(res)) {
+        proton_dose_destroy(res);
+        return NULL;
+    }
+    return res;
+}
+
+
+ProtonDose *proton_dose_create_gamma(const ProtonDose *ref, const char *filename,
+                                     const ProtonGammaParams *params,
+                                     ProtonGammaStats *stats,
+                                     size_t ebufsz, char err[])
+{
+    ProtonSumSource other;
+    ProtonDose *eval, *res;
+    uint64_t t0;
+
+    t0 = proton_trace_begin();
+    if (proton_source_open(&other, filename, ebufsz, err)) {
+        proton_trace_end("gamma read DICOM", t0);
+        return NULL;
+    }
+    eval = proton_dose_resample(ref, &other);
+    if (!eval) {
+        snprintf(err, ebufsz, "%s", (proton_source_error(&other))
+                 ? proton_source_error(&other) : "Failed to resample the second dose");
+    }
+    proton_source_close(&other);
+    proton_trace_end("gamma read DICOM", t0);
+    if (!eval) {
+        return NULL;
+    }
+    res = proton_dose_gamma(ref, eval, params, stats);
+    proton_dose_destroy(eval);
+    if (!res) {
+        snprintf(err, ebufsz, "Failed to compute gamma");
+    }
+    return res;
+}
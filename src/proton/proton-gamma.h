@@ -0,0 +1,55 @@
+#pragma once
+/** 3D gamma analysis of a second dose against the loaded one. Every point of
+ *  the reference above the low-dose threshold searches the evaluated dose
+ *  around it, nearest first, for the smallest combined dose and distance
+ *  disagreement */
+#ifndef PROTON_GAMMA_H
+#define PROTON_GAMMA_H
+
+#include "proton-compare.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+/** The search radius, in units of the DTA. Gamma above this is a lower
+ *  bound on the true value */
+#define PROTON_GAMMA_SEARCH 3.0f
+
+typedef struct _proton_gamma_params {
+    float dose;         /* Dose criterion, percent */
+    float dta;          /* Distance to agreement, mm */
+    float threshold;    /* Low-dose cutoff, percent of the reference maximum */
+    bool local;         /* Dose criterion of each point's own dose, else the maximum's */
+    int interp;         /* Search steps per voxel along each axis */
+} ProtonGammaParams;
+
+typedef struct _proton_gamma_stats {
+    long evaluated;     /* Points above the threshold */
+    long passed;        /* Of those, with gamma at most 1 */
+    float max, mean;
+} ProtonGammaStats;
+
+
+/** Writes the gamma of @p eval, on the same grid as @p ref, at every point of
+ *  @p ref to a new dose. Points below the threshold are zero. Returns NULL
+ *  on failure */
+ProtonDose *proton_dose_gamma(const ProtonDose *ref, const ProtonDose *eval,
+                              const ProtonGammaParams *params, ProtonGammaStats *stats);
+
+/** Resamples the RTDose file @p filename onto the grid of @p ref and
+ *  analyses it as above */
+ProtonDose *proton_dose_create_gamma(const ProtonDose *ref, const char *filename,
+                                     const ProtonGammaParams *params,
+                                     ProtonGammaStats *stats,
+                                     size_t ebufsz, char err[]);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_GAMMA_H */
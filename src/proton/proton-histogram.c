@@ -0,0 +1,198 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "proton-histogram.h"
+#include "proton-kernels.h"
+#include "proton-trace.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+/* The frames are split into this many bands, each binned into counts of its
+own and added afterwards. A fixed count keeps the bands independent of the
+thread count */
+#define HISTOGRAM_BANDS 32
+
+
+struct _proton_histogram {
+    const ProtonDose *dose;
+    long nbins;
+    float scale;                /* Bins per Gy */
+    unsigned long *rows;        /* nbins per depth row, once binned */
+    bool *binned;
+    long row;                   /* Depth row of planes[0], or -1 */
+    float *planes[2];           /* nx x nz each, x fastest */
+    unsigned *bands;            /* Two copies of the counts per band */
+    unsigned long *out;
+};
+
+
+ProtonHistogram *proton_histogram_create(const ProtonDose *dose, long nbins)
+{
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    const long nz = dose->px_dimensions[2];
+    ProtonHistogram *hist;
+
+    hist = calloc(1, sizeof *hist);
+    if (!hist) {
+        return NULL;
+    }
+    hist->dose = dose;
+    hist->nbins = nbins;
+    hist->scale = (dose->dmax > 0.0f) ? STATIC_CAST(float, nbins) / dose->dmax : 0.0f;
+    hist->row = -1;
+    hist->rows = malloc(sizeof *hist->rows * nbins * ny);
+    hist->binned = calloc(ny, sizeof *hist->binned);
+    hist->planes[0] = malloc(sizeof *hist->planes[0] * nx * nz);
+    hist->planes[1] = malloc(sizeof *hist->planes[1] * nx * nz);
+    hist->bands = malloc(sizeof *hist->bands * 2 * nbins * HISTOGRAM_BANDS);
+    hist->out = malloc(sizeof *hist->out * nbins);
+    if (!hist->rows || !hist->binned || !hist->planes[0] || !hist->planes[1]
+     || !hist->bands || !hist->out) {
+        proton_histogram_destroy(hist);
+        return NULL;
+    }
+    return hist;
+}
+
+
+void proton_histogram_destroy(ProtonHistogram *hist)
+{
+    if (hist) {
+        free(hist->rows);
+        free(hist->binned);
+        free(hist->planes[0]);
+        free(hist->planes[1]);
+        free(hist->bands);
+        free(hist->out);
+        free(hist);
+    }
+}
+
+
+long proton_histogram_bins(const ProtonHistogram *hist)
+{
+    return hist->nbins;
+}
+
+
+float proton_histogram_bin_width(const ProtonHistogram *hist)
+{
+    return hist->dose->dmax / STATIC_CAST(float, hist->nbins);
+}
+
+
+double proton_histogram_voxel_area(const ProtonHistogram *hist)
+{
+    return hist->dose->px_spacing[0] * hist->dose->px_spacing[2];
+}
+
+
+/** Bins the rows lerped by @p t between @p a and @p b, one per frame and
+ *  @p stride apart, into @p out */
+static void histogram_count(ProtonHistogram *hist, const float *a, const float *b,
+                            long stride, float t, unsigned long *out)
+{
+    const ProtonKernels *kern = proton_kernels();
+    const long nx = hist->dose->px_dimensions[0], nz = hist->dose->px_dimensions[2];
+    const long nb = hist->nbins;
+    const unsigned *counts;
+    long c, i;
+
+    memset(hist->bands, 0, sizeof *hist->bands * 2 * nb * HISTOGRAM_BANDS);
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static)
+#endif
+    for (c = 0; c < HISTOGRAM_BANDS; c++) {
+        const long k1 = (c + 1) * nz / HISTOGRAM_BANDS;
+        long k;
+
+        for (k = c * nz / HISTOGRAM_BANDS; k < k1; k++) {
+            kern->histogram(hist->bands + 2 * nb * c, a + k * stride, b + k * stride,
+                            t, hist->scale, nb, nx);
+        }
+    }
+    memset(out, 0, sizeof *out * nb);
+    for (c = 0; c < 2 * HISTOGRAM_BANDS; c++) {
+        counts = hist->bands + nb * c;
+        for (i = 0; i < nb; i++) {
+            out[i] += counts[i];
+        }
+    }
+}
+
+
+/** Copies depth row @p row of every frame into @p plane */
+static void histogram_gather(const ProtonDose *dose, float *plane, long row)
+{
+    const long nx = dose->px_dimensions[0], nz = dose->px_dimensions[2];
+    const long axskip = nx * dose->px_dimensions[1];
+    const float *src = dose->data + row * nx;
+    long k;
+
+    for (k = 0; k < nz; k++, src += axskip, plane += nx) {
+        memcpy(plane, src, sizeof *plane * nx);
+    }
+}
+
+
+/** Brings rows @p row and @p row + 1 into the planes. A step of one row on
+ *  or back keeps the plane both share */
+static void histogram_bracket(ProtonHistogram *hist, long row)
+{
+    float *tmp;
+
+    if (hist->row == row) {
+        return;
+    }
+    if (hist->row >= 0 && hist->row + 1 == row) {
+        tmp = hist->planes[0];
+        hist->planes[0] = hist->planes[1];
+        hist->planes[1] = tmp;
+        histogram_gather(hist->dose, hist->planes[1], row + 1);
+    } else if (hist->row >= 0 && hist->row - 1 == row) {
+        tmp = hist->planes[1];
+        hist->planes[1] = hist->planes[0];
+        hist->planes[0] = tmp;
+        histogram_gather(hist->dose, hist->planes[0], row);
+    } else {
+        histogram_gather(hist->dose, hist->planes[0], row);
+        histogram_gather(hist->dose, hist->planes[1], row + 1);
+    }
+    hist->row = row;
+}
+
+
+const unsigned long *proton_histogram_plane(ProtonHistogram *hist, float depth)
+/** On a row the counts are exact, and are kept. The row comes from the
+ *  planes when they hold it, and from across the volume otherwise */
+{
+    const uint64_t t0 = proton_trace_begin();
+    const ProtonDose *dose = hist->dose;
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    unsigned long *res;
+    const float *a;
+    float t = depth;
+    long row;
+
+    row = proton_dose_find_scan(dose, &t);
+    if (t == 0.0f || row + 1 >= ny) {
+        res = hist->rows + row * hist->nbins;
+        if (!hist->binned[row]) {
+            if (hist->row >= 0 && (hist->row == row || hist->row + 1 == row)) {
+                a = hist->planes[row - hist->row];
+                histogram_count(hist, a, a, nx, 0.0f, res);
+            } else {
+                a = dose->data + row * nx;
+                histogram_count(hist, a, a, nx * ny, 0.0f, res);
+            }
+            hist->binned[row] = true;
+        }
+    } else {
+        histogram_bracket(hist, row);
+        res = hist->out;
+        histogram_count(hist, hist->planes[0], hist->planes[1], nx, t, res);
+    }
+    proton_trace_end("dose-area histogram", t0);
+    return res;
+}
@@ -0,0 +1,46 @@
+#pragma once
+/** Dose-area histograms of the coronal plane at any depth. Depth rows are
+ *  binned once and kept, so a depth on a row costs nothing the second time.
+ *  Between rows, the two rows either side are gathered into contiguous
+ *  planes, and a depth between the same two rows only redoes the lerp and
+ *  the binning */
+#ifndef PROTON_HISTOGRAM_H
+#define PROTON_HISTOGRAM_H
+
+#include "proton-dose.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+typedef struct _proton_histogram ProtonHistogram;
+
+
+/** Bins the dose from zero to the maximum of @p dose in @p nbins bins. Doses
+ *  below zero fall in the first bin. The dose must outlive the histogram.
+ *  Returns NULL on failure */
+ProtonHistogram *proton_histogram_create(const ProtonDose *dose, long nbins);
+void proton_histogram_destroy(ProtonHistogram *hist);
+
+/** Voxel counts of the plane at @p depth, interpolated between depth rows as
+ *  proton_dose_get_slab() does, one per bin. They belong to @p hist and last
+ *  until the next call */
+const unsigned long *proton_histogram_plane(ProtonHistogram *hist, float depth);
+
+long proton_histogram_bins(const ProtonHistogram *hist);
+
+/** Dose covered by each bin (Gy) */
+float proton_histogram_bin_width(const ProtonHistogram *hist);
+
+/** Area of one voxel of the plane (mm^2) */
+double proton_histogram_voxel_area(const ProtonHistogram *hist);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_HISTOGRAM_H */
@@ -0,0 +1,358 @@
+/** Compiled once per instruction set, with PROTON_ISA_SUFFIX naming the
+ *  table. The loops are written with explicit accumulator lanes, because a
+ *  compiler may not reorder floating point reductions by itself */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "proton-kernels.h"
+
+#if defined _MSC_VER
+#   define _q(qualifiers)
+#else
+#   define _q(qualifiers) qualifiers
+#endif
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+#ifndef PROTON_ISA_SUFFIX
+#   define PROTON_ISA_SUFFIX base
+#endif
+
+#define KERNEL_CAT2(a, b) a##_##b
+#define KERNEL_CAT(a, b) KERNEL_CAT2(a, b)
+
+/* Two vectors of accumulators, so consecutive adds don't wait on each other */
+#if defined __AVX512F__
+#   define LANES 32
+#elif defined __AVX__
+#   define LANES 16
+#else
+#   define LANES 8
+#endif
+
+/* Profile points whose cells are found before their corners are gathered */
+#define KERNEL_PROFILE_BLOCK 64
+
+/* Histogram values whose bins are found before any count is raised */
+#define KERNEL_HISTOGRAM_BLOCK 256
+
+
+static void kernel_lerp(float dst[_q(restrict)], const float a[_q(restrict)],
+                        const float b[_q(restrict)], float t, float scale, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = PROTON_FMAF(b[i] - a[i], t, a[i]) * scale;
+    }
+}
+
+
+static void kernel_sum_max(const float *row, long n, float *sum, float *max)
+{
+    float s[LANES], m[LANES], stot = 0.0f, mtot = *max;
+    long i = 0, l;
+
+    for (l = 0; l < LANES; l++) {
+        s[l] = 0.0f;
+        m[l] = *max;
+    }
+    for (; i + LANES <= n; i += LANES) {
+        for (l = 0; l < LANES; l++) {
+            s[l] += row[i + l];
+            m[l] = (row[i + l] > m[l]) ? row[i + l] : m[l];
+        }
+    }
+    for (; i < n; i++) {
+        s[0] += row[i];
+        m[0] = (row[i] > m[0]) ? row[i] : m[0];
+    }
+    for (l = 0; l < LANES; l++) {
+        stot += s[l];
+        mtot = (m[l] > mtot) ? m[l] : mtot;
+    }
+    *sum += stot;
+    *max = mtot;
+}
+
+
+static long kernel_count_above(const float *row, long n, float thresh)
+{
+    int32_t c[LANES];
+    long i = 0, l, res = 0;
+
+    for (l = 0; l < LANES; l++) {
+        c[l] = 0;
+    }
+    /* Blocks short enough that the 32-bit lanes can't overflow */
+    while (i + LANES <= n) {
+        const long end = (n - i > (1L << 24)) ? i + (1L << 24) : n;
+        for (; i + LANES <= end; i += LANES) {
+            for (l = 0; l < LANES; l++) {
+                c[l] += row[i + l] > thresh;
+            }
+        }
+        for (l = 0; l < LANES; l++) {
+            res += c[l];
+            c[l] = 0;
+        }
+    }
+    for (; i < n; i++) {
+        res += row[i] > thresh;
+    }
+    return res;
+}
+
+
+static void kernel_axpy(float dst[_q(restrict)], const float src[_q(restrict)],
+                        float w, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = PROTON_FMAF(src[i], w, dst[i]);
+    }
+}
+
+
+static void kernel_diff(float dst[_q(restrict)], const float a[_q(restrict)],
+                        const float b[_q(restrict)], float s, long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = (b[i] - a[i]) / s;
+    }
+}
+
+
+static void kernel_narrow(float dst[_q(restrict)], const double src[_q(restrict)],
+                          long n, float *max)
+{
+    float m[LANES], mtot = *max;
+    long i = 0, l;
+
+    for (l = 0; l < LANES; l++) {
+        m[l] = *max;
+    }
+    for (; i + LANES <= n; i += LANES) {
+        for (l = 0; l < LANES; l++) {
+            dst[i + l] = STATIC_CAST(float, src[i + l]);
+            m[l] = (dst[i + l] > m[l]) ? dst[i + l] : m[l];
+        }
+    }
+    for (; i < n; i++) {
+        dst[i] = STATIC_CAST(float, src[i]);
+        mtot = (dst[i] > mtot) ? dst[i] : mtot;
+    }
+    for (l = 0; l < LANES; l++) {
+        mtot = (m[l] > mtot) ? m[l] : mtot;
+    }
+    *max = mtot;
+}
+
+
+static void kernel_line(float dst[_q(restrict)], const float *src, long yskip,
+                        long zskip, long n, const float r[])
+{
+    const float r0 = r[0], r1 = r[1];
+    long j;
+
+    for (j = 0; j < n; j++, src += yskip) {
+        const float i0 = src[0];
+        const float i1 = src[1] - i0;
+        const float i2 = src[zskip];
+        const float i3 = src[zskip + 1] - i2 - i1;
+        dst[j] = PROTON_FMAF(r1, PROTON_FMAF(r0, i3, i2 - i0), PROTON_FMAF(r0, i1, i0));
+    }
+}
+
+
+/* ---------------------------------------------------------------------- */
+/*                                 Render                                 */
+/* ---------------------------------------------------------------------- */
+
+
+static long kernel_bpp(int format)
+{
+    return (format == PROTON_PX_RGB24) ? 3 : 4;
+}
+
+/** Writes one colormapped value at @p px. The 32-bit words are assembled in
+ *  a register and stored whole, and the shifts assume a little-endian host */
+static void kernel_store(const ProtonImage *img, unsigned char *px, float x,
+                         void (*cmap)(float, unsigned char *))
+{
+    unsigned char rgb[3];
+    uint32_t word;
+
+    switch (img->format) {
+    case PROTON_PX_RGBA32:
+        cmap(x, rgb);
+        word = 0xFF000000u | (uint32_t)rgb[2] << 16 | (uint32_t)rgb[1] << 8 | rgb[0];
+        memcpy(px, &word, sizeof word);
+        break;
+    case PROTON_PX_BGRA32:
+        cmap(x, rgb);
+        word = 0xFF000000u | (uint32_t)rgb[0] << 16 | (uint32_t)rgb[1] << 8 | rgb[2];
+        memcpy(px, &word, sizeof word);
+        break;
+    default:
+        cmap(x, px);
+        break;
+    }
+}
+
+/** Cell and offset of lattice coordinate @p x on an axis of @p n nodes.
+ *  Coordinates off the lattice repeat its edge */
+static long kernel_cell(double x, long n, float *r)
+{
+    const double flx = floor(x);
+    long a = STATIC_CAST(long, flx);
+
+    if (a < 0) {
+        *r = 0.0f;
+        return 0;
+    } else if (a > n - 2) {
+        *r = 1.0f;
+        return n - 2;
+    }
+    *r = STATIC_CAST(float, x - flx);
+    return a;
+}
+
+/** Pixel (b0, b1) samples the lattice at view[0..1] + b * view[2..3].
+ *  Positions are found in double once per row and column, so a tile of an
+ *  image lands on exactly the same cells and offsets as the whole. Each
+ *  pixel is then two lerps from its row pair and a store */
+static void kernel_render(const float *slab, long nx, long nz, const double view[],
+                          const ProtonImage *img, void (*cmap)(float, unsigned char *))
+{
+    const long bpp = kernel_bpp(img->format);
+    const long w = img->dim[0], h = img->dim[1];
+    const float *s0, *s1;
+    unsigned char *px;
+    float *rx, rz, v0, v1;
+    long *ax, b0, b1;
+
+    if (nx < 2 || nz < 2) {
+        return;
+    }
+    ax = malloc(sizeof *ax * w);
+    rx = malloc(sizeof *rx * w);
+    if (ax && rx) {
+        for (b0 = 0; b0 < w; b0++) {
+            ax[b0] = kernel_cell(view[0] + STATIC_CAST(double, b0) * view[2], nx, rx + b0);
+        }
+        for (b1 = 0; b1 < h; b1++) {
+            s0 = slab + nx * kernel_cell(view[1] + STATIC_CAST(double, b1) * view[3], nz, &rz);
+            s1 = s0 + nx;
+            px = img->px + b1 * img->stride;
+            for (b0 = 0; b0 < w; b0++, px += bpp) {
+                v0 = PROTON_FMAF(rx[b0], s0[ax[b0] + 1] - s0[ax[b0]], s0[ax[b0]]);
+                v1 = PROTON_FMAF(rx[b0], s1[ax[b0] + 1] - s1[ax[b0]], s1[ax[b0]]);
+                kernel_store(img, px, PROTON_FMAF(rz, v1 - v0, v0), cmap);
+            }
+        }
+    }
+    free(rx);
+    free(ax);
+}
+
+
+/* ---------------------------------------------------------------------- */
+/*                                Profile                                 */
+/* ---------------------------------------------------------------------- */
+
+
+/** Cell and offset of lattice coordinate @p x, as kernel_cell() finds them
+ *  but without branches, so a loop calling it still vectorizes */
+static int kernel_cell_clamped(double x, int n, float *r)
+{
+    const double hi = STATIC_CAST(double, n - 1);
+    const double xc = (x < 0.0) ? 0.0 : (x > hi) ? hi : x;
+    const int a = STATIC_CAST(int, xc);
+    const int c = (a > n - 2) ? n - 2 : a;
+
+    *r = STATIC_CAST(float, xc - STATIC_CAST(double, c));
+    return c;
+}
+
+/** A block of points finds its cells first, in double as the renderer does,
+ *  and then gathers the eight corners of each, two rows of four. Keeping the
+ *  two loops apart lets the gather vectorize, which it does not next to the
+ *  double arithmetic. The offsets are ints, so the grid must have fewer than
+ *  2^31 voxels */
+static void kernel_profile(float dst[_q(restrict)], const float *a, const float *b,
+                           float t, long nx, long nz, long zskip, const double uv[],
+                           long n)
+{
+    const int zs = STATIC_CAST(int, zskip);
+    float rx[KERNEL_PROFILE_BLOCK], rz[KERNEL_PROFILE_BLOCK];
+    int off[KERNEL_PROFILE_BLOCK];
+    long i0, i, m;
+
+    for (i0 = 0; i0 < n; i0 += m) {
+        m = (n - i0 < KERNEL_PROFILE_BLOCK) ? n - i0 : KERNEL_PROFILE_BLOCK;
+        for (i = 0; i < m; i++) {
+            const double x = uv[0] + STATIC_CAST(double, i0 + i) * uv[2];
+            const double z = uv[1] + STATIC_CAST(double, i0 + i) * uv[3];
+            off[i] = kernel_cell_clamped(z, STATIC_CAST(int, nz), rz + i) * zs
+                   + kernel_cell_clamped(x, STATIC_CAST(int, nx), rx + i);
+        }
+        for (i = 0; i < m; i++) {
+            const int o = off[i];
+            const float c00 = PROTON_FMAF(t, b[o] - a[o], a[o]);
+            const float c01 = PROTON_FMAF(t, b[o + 1] - a[o + 1], a[o + 1]);
+            const float c10 = PROTON_FMAF(t, b[o + zs] - a[o + zs], a[o + zs]);
+            const float c11 = PROTON_FMAF(t, b[o + zs + 1] - a[o + zs + 1], a[o + zs + 1]);
+            const float v0 = PROTON_FMAF(rx[i], c01 - c00, c00);
+            const float v1 = PROTON_FMAF(rx[i], c11 - c10, c10);
+            dst[i0 + i] = PROTON_FMAF(rz[i], v1 - v0, v0);
+        }
+    }
+}
+
+
+/** Bins a block of values first, which vectorizes, and then raises the
+ *  counts, alternating between the two copies */
+static void kernel_histogram(unsigned counts[_q(restrict)], const float *a,
+                             const float *b, float t, float scale, long nbins, long n)
+{
+    const float top = STATIC_CAST(float, nbins - 1);
+    unsigned *const twin = counts + nbins;
+    int bin[KERNEL_HISTOGRAM_BLOCK];
+    long i0, i, m;
+
+    for (i0 = 0; i0 < n; i0 += m) {
+        m = (n - i0 < KERNEL_HISTOGRAM_BLOCK) ? n - i0 : KERNEL_HISTOGRAM_BLOCK;
+        for (i = 0; i < m; i++) {
+            float v = PROTON_FMAF(b[i0 + i] - a[i0 + i], t, a[i0 + i]) * scale;
+            v = (v > 0.0f) ? v : 0.0f;
+            v = (v < top) ? v : top;
+            bin[i] = STATIC_CAST(int, v);
+        }
+        for (i = 0; i + 1 < m; i += 2) {
+            counts[bin[i]]++;
+            twin[bin[i + 1]]++;
+        }
+        if (i < m) {
+            counts[bin[i]]++;
+        }
+    }
+}
+
+
+const ProtonKernels KERNEL_CAT(proton_kernels, PROTON_ISA_SUFFIX) = {
+    kernel_lerp,
+    kernel_sum_max,
+    kernel_count_above,
+    kernel_diff,
+    kernel_axpy,
+    kernel_narrow,
+    kernel_line,
+    kernel_render,
+    kernel_profile,
+    kernel_histogram
+};
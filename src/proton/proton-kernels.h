@@ -0,0 +1,104 @@
+#pragma once
+/** Inner loops of the proton library. proton-kernels.c is compiled once per
+ *  instruction set and the best table the CPU supports is chosen on first
+ *  use, so a single binary runs on SSE2-only machines and still uses AVX2
+ *  and AVX-512 where they exist */
+#ifndef PROTON_KERNELS_H
+#define PROTON_KERNELS_H
+
+#include "proton-dose.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+/* fmaf() is a single instruction only when the target has FMA. Everywhere
+else it is a library call, and a separate multiply and add is much faster.
+MSVC never defines __FMA__, but /arch:AVX2 implies it and defines __AVX2__ */
+#if defined __FMA__ || defined __AVX2__
+#   define PROTON_FMAF(a, b, c) fmaf(a, b, c)
+#else
+#   define PROTON_FMAF(a, b, c) ((a) * (b) + (c))
+#endif
+
+
+enum {
+    PROTON_ISA_BASE = 0,    /* SSE2 on x86-64, the compiler default elsewhere */
+    PROTON_ISA_AVX2,        /* AVX2, FMA, BMI1 and BMI2 */
+    PROTON_ISA_AVX512,      /* AVX-512 F, BW, DQ and VL */
+    PROTON_ISA_COUNT
+};
+
+
+typedef struct _proton_kernels {
+    /** dst[i] = (a[i] + (b[i] - a[i]) * t) * scale */
+    void (*lerp)(float *dst, const float *a, const float *b, float t,
+                 float scale, long n);
+
+    /** Adds the sum of @p row to @p sum and raises @p max to its maximum */
+    void (*sum_max)(const float *row, long n, float *sum, float *max);
+
+    /** Number of elements of @p row strictly greater than @p thresh */
+    long (*count_above)(const float *row, long n, float thresh);
+
+    /** dst[i] = (b[i] - a[i]) / s */
+    void (*diff)(float *dst, const float *a, const float *b, float s, long n);
+
+    /** dst[i] += src[i] * w */
+    void (*axpy)(float *dst, const float *src, float w, long n);
+
+    /** Narrows @p src to floats, raising @p max to their maximum */
+    void (*narrow)(float *dst, const double *src, long n, float *max);
+
+    /** Bilinearly interpolates @p n planes @p yskip apart at offsets @p r
+     *  into the cell whose first voxel is @p src and whose far row is
+     *  @p zskip further on */
+    void (*line)(float *dst, const float *src, long yskip, long zskip,
+                 long n, const float r[]);
+
+    /** Interpolates the nx x nz lattice @p slab of normalized values onto
+     *  @p img. Pixel (i, j) lands on lattice coordinates
+     *  (view[0] + i * view[2], view[1] + j * view[3]) */
+    void (*render)(const float *slab, long nx, long nz, const double view[],
+                   const ProtonImage *img, void (*cmap)(float, unsigned char *));
+
+    /** Interpolates @p n points of the plane lerped by @p t between the
+     *  depth rows @p a and @p b, whose frames are @p zskip apart. Point i
+     *  lies at (uv[0] + i * uv[2], uv[1] + i * uv[3]) on the nx x nz nodes,
+     *  and points off them repeat the edge */
+    void (*profile)(float *dst, const float *a, const float *b, float t,
+                    long nx, long nz, long zskip, const double uv[], long n);
+
+    /** Bins the @p n values lerped by @p t from @p a to @p b at
+     *  floor(value * scale), clamped to [0, nbins), raising their counts.
+     *  @p counts holds two copies of the @p nbins counts for the caller to
+     *  add, so that a run of values in one bin does not wait on itself */
+    void (*histogram)(unsigned *counts, const float *a, const float *b,
+                      float t, float scale, long nbins, long n);
+} ProtonKernels;
+
+
+/** The table for the selected instruction set */
+const ProtonKernels *proton_kernels(void);
+
+/** The selected instruction set. The PROTON_ISA environment variable (sse2,
+ *  avx2, avx512) caps the choice, e.g. to reproduce a slower machine */
+int proton_cpu_isa(void);
+
+const char *proton_isa_name(int isa);
+
+bool proton_cpu_supports(int isa);
+
+/** Selects @p isa if the CPU supports it. Returns true if it does not. Not
+ *  for use while kernels are running on other threads */
+bool proton_cpu_select(int isa);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_KERNELS_H */
@@ -0,0 +1,32 @@
+#include "proton-parallel.h"
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+
+void proton_parallel_for(long n, void (*fn)(void *arg, long i), void *arg)
+{
+    const long hw = static_cast<long>(std::thread::hardware_concurrency());
+    const long nworkers = ((hw < n) ? hw : n) - 1;
+    std::vector<std::thread> workers;
+    std::atomic<long> next(0);
+    auto work = [&]() {
+        for (long i = next++; i < n; i = next++) {
+            fn(arg, i);
+        }
+    };
+
+    try {
+        workers.reserve(nworkers > 0 ? nworkers : 0);
+        for (long t = 0; t < nworkers; t++) {
+            workers.emplace_back(work);
+        }
+    } catch (const std::exception &) {
+        /* Whoever did start, and this thread, share the rest */
+    }
+    work();
+    for (std::thread &w: workers) {
+        w.join();
+    }
+}
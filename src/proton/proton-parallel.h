@@ -0,0 +1,24 @@
+#pragma once
+/** A parallel loop that does not depend on OpenMP. Indices are handed to
+ *  worker threads one at a time as they finish the last, so uneven work
+ *  balances itself */
+#ifndef PROTON_PARALLEL_H
+#define PROTON_PARALLEL_H
+
+#if __cplusplus
+extern "C" {
+#endif
+
+
+/** Calls @p fn(@p arg, i) once for every i in [0, @p n), from the calling
+ *  thread and up to one worker per further hardware thread. Returns when
+ *  every call has. Threads that fail to start leave their share to the
+ *  others */
+void proton_parallel_for(long n, void (*fn)(void *arg, long i), void *arg);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_PARALLEL_H */
@@ -0,0 +1,155 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "proton-profile.h"
+#include "proton-kernels.h"
+#include "proton-trace.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+
+double proton_profile_length(const ProtonProfile *prof)
+{
+    return hypot(prof->end[0] - prof->start[0], prof->end[1] - prof->start[1]);
+}
+
+
+long proton_profile_samples(const ProtonProfile *prof)
+/** A sample within a millionth of a step of the end counts as on it, so a
+ *  segment a whole number of steps long ends on a sample */
+{
+    const double len = proton_profile_length(prof);
+
+    if (!(prof->step > 0.0) || !(len > 0.0)) {
+        return 1;
+    }
+    return STATIC_CAST(long, floor(len / prof->step + 1e-6)) + 1;
+}
+
+
+/** The step along the segment in x and z, in mm */
+static void profile_direction(const ProtonProfile *prof, double d[])
+{
+    const double len = proton_profile_length(prof);
+
+    if (len > 0.0) {
+        d[0] = (prof->end[0] - prof->start[0]) * prof->step / len;
+        d[1] = (prof->end[1] - prof->start[1]) * prof->step / len;
+    } else {
+        d[0] = d[1] = 0.0;
+    }
+}
+
+
+void proton_profile_point(const ProtonProfile *prof, long i, double xz[])
+{
+    double d[2];
+
+    profile_direction(prof, d);
+    xz[0] = prof->start[0] + STATIC_CAST(double, i) * d[0];
+    xz[1] = prof->start[1] + STATIC_CAST(double, i) * d[1];
+}
+
+
+/** Samples one line starting at @p start, in mm, into @p dst. The depth rows
+ *  and their fraction are found once by the caller */
+static void profile_line(const ProtonDose *dose, const float *a, const float *b,
+                         float t, const double start[], const double d[],
+                         long n, float *dst)
+{
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    double uv[4];
+
+    uv[0] = (start[0] - dose->top_left[0]) / dose->px_spacing[0];
+    uv[1] = (start[1] - dose->top_left[2]) / dose->px_spacing[2];
+    uv[2] = d[0] / dose->px_spacing[0];
+    uv[3] = d[1] / dose->px_spacing[2];
+    proton_kernels()->profile(dst, a, b, t, nx, dose->px_dimensions[2], nx * ny, uv, n);
+}
+
+
+/** The depth rows either side of @p depth and the fraction of the way from
+ *  the first to the second, which is the first again at the last row */
+static float profile_rows(const ProtonDose *dose, float depth, const float **a,
+                          const float **b)
+{
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    const double u = (STATIC_CAST(double, depth) - dose->px_spacing[1] / 2.0) / dose->px_spacing[1];
+    const double fl = floor(u);
+    long row = STATIC_CAST(long, fl);
+    float t = STATIC_CAST(float, u - fl);
+
+    if (row < 0) {
+        row = 0;
+        t = 0.0f;
+    } else if (row > ny - 1) {
+        row = ny - 1;
+    }
+    *a = dose->data + row * nx;
+    *b = (row + 1 < ny) ? *a + nx : *a;
+    return t;
+}
+
+
+/** A grid one voxel wide or tall has no cell to interpolate in, and its
+ *  profiles are left at zero */
+static bool profile_degenerate(const ProtonDose *dose, long nlines, long n,
+                               float *dst)
+{
+    long i;
+
+    if (dose->px_dimensions[0] > 1 && dose->px_dimensions[2] > 1) {
+        return false;
+    }
+    for (i = 0; i < nlines * n; i++) {
+        dst[i] = 0.0f;
+    }
+    return true;
+}
+
+
+void proton_dose_get_profile(const ProtonDose *dose, float depth,
+                             const ProtonProfile *prof, float *profile)
+{
+    const uint64_t t0 = proton_trace_begin();
+    const long n = proton_profile_samples(prof);
+    const float *a, *b;
+    double d[2];
+    float t;
+
+    if (!profile_degenerate(dose, 1, n, profile)) {
+        t = profile_rows(dose, depth, &a, &b);
+        profile_direction(prof, d);
+        profile_line(dose, a, b, t, prof->start, d, n, profile);
+    }
+    proton_trace_end("profile", t0);
+}
+
+
+void proton_dose_get_profiles(const ProtonDose *dose, float depth,
+                              const ProtonProfile *prof, const double shift[],
+                              long nlines, float *profiles)
+{
+    const uint64_t t0 = proton_trace_begin();
+    const long n = proton_profile_samples(prof);
+    const float *a, *b;
+    double d[2];
+    float t;
+    long l;
+
+    if (!profile_degenerate(dose, nlines, n, profiles)) {
+        t = profile_rows(dose, depth, &a, &b);
+        profile_direction(prof, d);
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static)
+#endif
+        for (l = 0; l < nlines; l++) {
+            const double start[2] = {
+                prof->start[0] + STATIC_CAST(double, l) * shift[0],
+                prof->start[1] + STATIC_CAST(double, l) * shift[1]
+            };
+            profile_line(dose, a, b, t, start, d, n, profiles + l * n);
+        }
+    }
+    proton_trace_end("profiles", t0);
+}
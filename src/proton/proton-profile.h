@@ -0,0 +1,51 @@
+#pragma once
+/** Lateral profiles: the coronal plane at one depth sampled along a segment,
+ *  to set beside the rows of an MCC scan. A crossline runs along x, an
+ *  inline along z, and any other segment works the same way */
+#ifndef PROTON_PROFILE_H
+#define PROTON_PROFILE_H
+
+#include "proton-dose.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+typedef struct _proton_profile {
+    double start[2];        /* (x, z) in mm, as the line dose point */
+    double end[2];
+    double step;            /* mm between samples */
+} ProtonProfile;
+
+
+/** Length of the segment in mm */
+double proton_profile_length(const ProtonProfile *prof);
+
+/** Samples along the segment: one at the start and one every step after
+ *  it, as far as the end. Always at least one */
+long proton_profile_samples(const ProtonProfile *prof);
+
+/** Writes the position of sample @p i, (x, z) in mm, to @p xz */
+void proton_profile_point(const ProtonProfile *prof, long i, double xz[]);
+
+/** Interpolates the plane at @p depth onto every sample of @p prof, in Gy.
+ *  Samples off the grid repeat its edge, as the rendered plane does */
+void proton_dose_get_profile(const ProtonDose *dose, float depth,
+                             const ProtonProfile *prof, float *profile);
+
+/** @p nlines profiles parallel to @p prof, line l moved by l * shift mm in
+ *  x and z, written one after another into @p profiles, each
+ *  proton_profile_samples() long. The lines are shared between threads */
+void proton_dose_get_profiles(const ProtonDose *dose, float depth,
+                              const ProtonProfile *prof, const double shift[],
+                              long nlines, float *profiles);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_PROFILE_H */
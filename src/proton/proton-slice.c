@@ -0,0 +1,370 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "proton-slice.h"
+#include "proton-kernels.h"
+#include "proton-trace.h"
+
+#if defined _MSC_VER
+#   define _q(qualifiers)
+#else
+#   define _q(qualifiers) qualifiers
+#endif
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+/* Image rows per band handed to one thread, and the block edge of the axial
+transpose, which keeps both sides of a block in L1 */
+#define SLICE_BAND 32
+#define SLICE_BLOCK 32
+
+#define DEG2RAD (3.14159265358979323846 / 180.0)
+
+
+/** Where the lattice's lateral samples lie, in mm along the lateral axis.
+ *  Sagittal and axial planes sample at the voxel nodes. An oblique plane's
+ *  nodes are not on the lateral axis, so it samples at the image rows, and
+ *  every pixel is then one trilinear sample of the grid */
+struct slice_lattice {
+    long n;
+    double origin, step;
+};
+
+
+/** Cell and offset of lattice coordinate @p x on an axis of @p n nodes, as
+ *  the render kernel finds them */
+static long slice_cell(double x, long n, float *r)
+{
+    const double flx = floor(x);
+    long a = STATIC_CAST(long, flx);
+
+    if (a < 0) {
+        *r = 0.0f;
+        return 0;
+    } else if (a > n - 2) {
+        *r = 1.0f;
+        return n - 2;
+    }
+    *r = STATIC_CAST(float, x - flx);
+    return a;
+}
+
+
+static void slice_direction(const ProtonSlice *slice, double d[_q(static 2)])
+{
+    d[0] = sin(slice->angle * DEG2RAD);
+    d[1] = cos(slice->angle * DEG2RAD);
+}
+
+
+void proton_slice_lateral(const ProtonSlice *slice, double t, double xz[])
+{
+    double d[2];
+
+    switch (slice->orient) {
+    case PROTON_SLICE_SAGITTAL:
+        xz[0] = slice->pos;
+        xz[1] = t;
+        break;
+    case PROTON_SLICE_AXIAL:
+        xz[0] = t;
+        xz[1] = slice->pos;
+        break;
+    default:
+        slice_direction(slice, d);
+        xz[0] = slice->centre[0] + t * d[0];
+        xz[1] = slice->centre[1] + t * d[1];
+        break;
+    }
+}
+
+
+/** Clips the lateral line to the nodes of the coronal grid */
+static bool slice_clip(const ProtonDose *dose, const ProtonSlice *slice, double t[_q(static 2)])
+{
+    const int dims[2] = { DOSE_LR, DOSE_SI };
+    double d[2], lo, hi, a, b;
+    int i;
+
+    slice_direction(slice, d);
+    t[0] = -HUGE_VAL;
+    t[1] = HUGE_VAL;
+    for (i = 0; i < 2; i++) {
+        lo = dose->top_left[dims[i]];
+        hi = lo + STATIC_CAST(double, dose->px_dimensions[dims[i]] - 1) * dose->px_spacing[dims[i]];
+        if (fabs(d[i]) < 1e-12) {
+            if (slice->centre[i] < lo || slice->centre[i] > hi) {
+                return true;
+            }
+            continue;
+        }
+        a = (lo - slice->centre[i]) / d[i];
+        b = (hi - slice->centre[i]) / d[i];
+        t[0] = fmax(t[0], fmin(a, b));
+        t[1] = fmin(t[1], fmax(a, b));
+    }
+    return t[0] > t[1];
+}
+
+
+bool proton_slice_bounds(const ProtonDose *dose, const ProtonSlice *slice, double rect[])
+{
+    const int fixed = (slice->orient == PROTON_SLICE_SAGITTAL) ? DOSE_LR : DOSE_SI;
+    const int lateral = (slice->orient == PROTON_SLICE_SAGITTAL) ? DOSE_SI : DOSE_LR;
+    double t[2], lo;
+
+    rect[0] = dose->px_spacing[1] / 2.0;
+    rect[2] = rect[0] + STATIC_CAST(double, dose->px_dimensions[1] - 1) * dose->px_spacing[1];
+    if (slice->orient == PROTON_SLICE_OBLIQUE) {
+        if (slice_clip(dose, slice, t)) {
+            rect[1] = rect[3] = 0.0;
+            return true;
+        }
+        rect[1] = t[0];
+        rect[3] = t[1];
+        return false;
+    }
+    rect[1] = dose->top_left[lateral];
+    rect[3] = rect[1] + STATIC_CAST(double, dose->px_dimensions[lateral] - 1) * dose->px_spacing[lateral];
+    lo = dose->top_left[fixed];
+    return slice->pos < lo
+        || slice->pos > lo + STATIC_CAST(double, dose->px_dimensions[fixed] - 1) * dose->px_spacing[fixed];
+}
+
+
+/** The lateral samples of @p slice for an image of @p height rows through
+ *  @p view */
+static void slice_lattice(const ProtonDose *dose, const ProtonSlice *slice,
+                          const ProtonView *view, long height, struct slice_lattice *lat)
+{
+    switch (slice->orient) {
+    case PROTON_SLICE_SAGITTAL:
+        lat->n = dose->px_dimensions[2];
+        lat->origin = dose->top_left[2];
+        lat->step = dose->px_spacing[2];
+        break;
+    case PROTON_SLICE_AXIAL:
+        lat->n = dose->px_dimensions[0];
+        lat->origin = dose->top_left[0];
+        lat->step = dose->px_spacing[0];
+        break;
+    default:
+        /* One spare sample past the last row, so the lattice has a cell */
+        lat->n = height + 1;
+        lat->origin = view->origin[1];
+        lat->step = (view->step[1] != 0.0) ? view->step[1] : fmin(dose->px_spacing[0], dose->px_spacing[2]);
+        break;
+    }
+}
+
+
+static void slice_scale(float *row, long n, float s)
+{
+    long i;
+
+    for (i = 0; i < n; i++) {
+        row[i] *= s;
+    }
+}
+
+
+/* Each gather fills the w x h window of the lattice whose first node is
+(lo[0], lo[1]), depth fastest, scaled by s. The voxels are x fastest, then
+depth, then z, so only the axial plane reads whole cache lines. The other two
+walk the depth rows one cell at a time, with every lateral sample on its own
+thread, which is as few lines as their orientation allows */
+
+
+static void slice_gather_sagittal(const ProtonDose *dose, const float *base,
+                                  const ProtonSlice *slice, const long lo[_q(static 2)],
+                                  long w, long h, float s, float *slab)
+{
+    const ProtonKernels *kern = proton_kernels();
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    float r[2] = { 0.0f, 0.0f };
+    const long i = slice_cell((slice->pos - dose->top_left[0]) / dose->px_spacing[0], nx, r);
+    long m;
+
+    /* No far row, so the bilinear kernel is a lerp along x */
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static)
+#endif
+    for (m = 0; m < h; m++) {
+        kern->line(slab + m * w, base + (lo[1] + m) * nx * ny + lo[0] * nx + i,
+                   nx, 0, w, r);
+        slice_scale(slab + m * w, w, s);
+    }
+}
+
+
+/** Lerps whole x rows between the two z planes, which are contiguous, and
+ *  transposes them in blocks */
+static bool slice_gather_axial(const ProtonDose *dose, const float *base,
+                               const ProtonSlice *slice, const long lo[_q(static 2)],
+                               long w, long h, float s, float *slab)
+{
+    const ProtonKernels *kern = proton_kernels();
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    float r;
+    const long k = slice_cell((slice->pos - dose->top_left[2]) / dose->px_spacing[2],
+                              dose->px_dimensions[2], &r);
+    const float *a = base + k * nx * ny + lo[0] * nx + lo[1];
+    float *rows = malloc(sizeof *rows * w * h);
+    long j, m, jb, mb;
+
+    if (!rows) {
+        return true;
+    }
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static)
+#endif
+    for (j = 0; j < w; j++) {
+        kern->lerp(rows + j * h, a + j * nx, a + j * nx + nx * ny, r, s, h);
+    }
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static) private(j, m, jb)
+#endif
+    for (mb = 0; mb < h; mb += SLICE_BLOCK) {
+        for (jb = 0; jb < w; jb += SLICE_BLOCK) {
+            for (m = mb; m < h && m < mb + SLICE_BLOCK; m++) {
+                for (j = jb; j < w && j < jb + SLICE_BLOCK; j++) {
+                    slab[m * w + j] = rows[j * h + m];
+                }
+            }
+        }
+    }
+    free(rows);
+    return false;
+}
+
+
+/** Each sample interpolates bilinearly in x and z on every depth row */
+static void slice_gather_oblique(const ProtonDose *dose, const float *base,
+                                 const ProtonSlice *slice, const struct slice_lattice *lat,
+                                 const long lo[_q(static 2)], long w, long h, float s,
+                                 float *slab)
+{
+    const ProtonKernels *kern = proton_kernels();
+    const long nx = dose->px_dimensions[0], ny = dose->px_dimensions[1];
+    long m;
+
+#if defined _OPENMP
+#   pragma omp parallel for schedule(static)
+#endif
+    for (m = 0; m < h; m++) {
+        double xz[2];
+        float r[2];
+        long i, k;
+
+        proton_slice_lateral(slice, lat->origin + STATIC_CAST(double, lo[1] + m) * lat->step, xz);
+        i = slice_cell((xz[0] - dose->top_left[0]) / dose->px_spacing[0], nx, r);
+        k = slice_cell((xz[1] - dose->top_left[2]) / dose->px_spacing[2],
+                       dose->px_dimensions[2], r + 1);
+        kern->line(slab + m * w, base + k * nx * ny + lo[0] * nx + i, nx, nx * ny, w, r);
+        slice_scale(slab + m * w, w, s);
+    }
+}
+
+
+/** Draws the lattice in bands of image rows, one thread each. A band is the
+ *  image with its first row and view origin moved, like a tile */
+static void slice_draw(const float *slab, long w, long h, const double view[_q(static 4)],
+                       const ProtonImage *img, void (*cmap)(float, unsigned char *))
+{
+    const ProtonKernels *kern = proton_kernels();
+    const long nband = (img->dim[1] + SLICE_BAND - 1) / SLICE_BAND;
+    long b;
+
+#if defined _OPENMP
+#   pragma omp parallel for schedule(dynamic)
+#endif
+    for (b = 0; b < nband; b++) {
+        const long y = b * SLICE_BAND;
+        double v[4];
+        ProtonImage band = *img;
+
+        v[0] = view[0];
+        v[1] = view[1] + STATIC_CAST(double, y) * view[3];
+        v[2] = view[2];
+        v[3] = view[3];
+        band.dim[1] = (img->dim[1] - y < SLICE_BAND) ? img->dim[1] - y : SLICE_BAND;
+        band.px = img->px + y * img->stride;
+        kern->render(slab, w, h, v, &band, cmap);
+    }
+}
+
+
+void proton_dose_get_slice_region(const ProtonDose        *dose,
+                                  const ProtonPlaneParams *params,
+                                  ProtonImage             *img,
+                                  const ProtonSlice       *slice,
+                                  const ProtonView        *view)
+{
+    const float norm = (params->type == PROTON_IMG_DOSE) ? dose->dmax : (params->pct_diff * dose->dmax) / params->depth_err;
+    const float *base = (params->type == PROTON_IMG_DOSE) ? dose->data : dose->grad;
+    const uint64_t t0 = proton_trace_begin();
+    struct slice_lattice lat;
+    double u[4], sview[4], a, b;
+    long lo[2], hi[2], n[2], d;
+    bool fail = false;
+    float *slab;
+
+    slice_lattice(dose, slice, view, img->dim[1], &lat);
+    n[0] = dose->px_dimensions[1];
+    n[1] = lat.n;
+    if (img->dim[0] < 1 || img->dim[1] < 1 || n[0] < 2 || dose->px_dimensions[0] < 2
+     || dose->px_dimensions[2] < 2) {
+        proton_trace_end("render slice", t0);
+        return;
+    }
+    /* Pixel positions in lattice nodes */
+    u[0] = (view->origin[0] - dose->px_spacing[1] / 2.0) / dose->px_spacing[1];
+    u[1] = (view->origin[1] - lat.origin) / lat.step;
+    u[2] = view->step[0] / dose->px_spacing[1];
+    u[3] = view->step[1] / lat.step;
+    for (d = 0; d < 2; d++) {
+        a = u[d];
+        b = u[d] + u[d + 2] * STATIC_CAST(double, img->dim[d] - 1);
+        lo[d] = STATIC_CAST(long, floor(fmin(a, b)));
+        lo[d] = (lo[d] < 0) ? 0 : (lo[d] > n[d] - 2) ? n[d] - 2 : lo[d];
+        hi[d] = STATIC_CAST(long, ceil(fmax(a, b)));
+        hi[d] = (hi[d] <= lo[d]) ? lo[d] + 1 : (hi[d] > n[d] - 1) ? n[d] - 1 : hi[d];
+        sview[d] = a - STATIC_CAST(double, lo[d]);
+        sview[d + 2] = u[d + 2];
+    }
+    n[0] = hi[0] - lo[0] + 1;
+    n[1] = hi[1] - lo[1] + 1;
+    slab = malloc(sizeof *slab * n[0] * n[1]);
+    if (slab) {
+        switch (slice->orient) {
+        case PROTON_SLICE_SAGITTAL:
+            slice_gather_sagittal(dose, base, slice, lo, n[0], n[1], 1.0f / norm, slab);
+            break;
+        case PROTON_SLICE_AXIAL:
+            fail = slice_gather_axial(dose, base, slice, lo, n[0], n[1], 1.0f / norm, slab);
+            break;
+        default:
+            slice_gather_oblique(dose, base, slice, &lat, lo, n[0], n[1], 1.0f / norm, slab);
+            break;
+        }
+        if (!fail) {
+            slice_draw(slab, n[0], n[1], sview, img, params->colormap);
+        }
+        free(slab);
+    }
+    proton_trace_end("render slice", t0);
+}
+
+
+void proton_dose_get_slice(const ProtonDose        *dose,
+                           const ProtonPlaneParams *params,
+                           ProtonImage             *img,
+                           const ProtonSlice       *slice)
+{
+    ProtonView view;
+    double rect[4];
+
+    proton_slice_bounds(dose, slice, rect);
+    proton_view_fit(&view, rect, img->dim[0], img->dim[1]);
+    proton_dose_get_slice_region(dose, params, img, slice, &view);
+}
@@ -0,0 +1,66 @@
+#pragma once
+/** Planes through the depth axis, for looking at the penumbra along the
+ *  beam. Every orientation is first resampled onto a lattice of lateral
+ *  samples by depth rows, gathered in whatever order suits the voxel layout,
+ *  and then drawn by the same kernel and colormaps as the coronal plane.
+ *  Images put depth along their first axis, as the depth dose plots do */
+#ifndef PROTON_SLICE_H
+#define PROTON_SLICE_H
+
+#include "proton-dose.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+enum {
+    PROTON_SLICE_SAGITTAL = 0,  /* Fixed x, lateral axis is z */
+    PROTON_SLICE_AXIAL,         /* Fixed z, lateral axis is x */
+    PROTON_SLICE_OBLIQUE        /* Rotated about the depth axis */
+};
+
+
+typedef struct _proton_slice {
+    int orient;
+    double pos;             /* mm, x of a sagittal plane or z of an axial one */
+
+    /** Oblique planes pass through (centre[0], centre[1]) in x and z. The
+     *  lateral axis turns from z (sagittal) at 0 degrees to x (axial) at 90,
+     *  like the gantry about the beam axis, and its origin is the centre */
+    double centre[2];
+    double angle;
+} ProtonSlice;
+
+
+/** Writes the extent of the plane, {d0, t0, d1, t1} in mm of depth and of
+ *  the lateral axis at the outermost nodes, to @p rect. Returns true if the
+ *  plane misses the grid */
+bool proton_slice_bounds(const ProtonDose *dose, const ProtonSlice *slice, double rect[]);
+
+/** The (x, z) position in mm of lateral coordinate @p t */
+void proton_slice_lateral(const ProtonSlice *slice, double t, double xz[]);
+
+/** Renders @p img through @p view, whose first axis is depth and second the
+ *  lateral axis, both in mm. Tiles work as they do for
+ *  proton_dose_get_plane_region(). Pixels beyond the grid repeat its edge */
+void proton_dose_get_slice_region(const ProtonDose        *dose,
+                                  const ProtonPlaneParams *params,
+                                  ProtonImage             *img,
+                                  const ProtonSlice       *slice,
+                                  const ProtonView        *view);
+
+/** Renders the whole plane onto @p img */
+void proton_dose_get_slice(const ProtonDose        *dose,
+                           const ProtonPlaneParams *params,
+                           ProtonImage             *img,
+                           const ProtonSlice       *slice);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_SLICE_H */
@@ -0,0 +1,470 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "proton-sum.h"
+#include "dcmload.h"
+#include "proton-kernels.h"
+#include "proton-trace.h"
+
+#define STATIC_CAST(type, expr) (type)(expr)
+
+/** Fraction of a voxel that positions may disagree by and still match */
+#define GRID_TOL 1e-3
+
+
+bool proton_grid_equal(const ProtonGrid *a, const ProtonGrid *b)
+{
+    int d;
+
+    for (d = 0; d < 3; d++) {
+        const double tol = GRID_TOL * a->spacing[d];
+        if (a->dim[d] != b->dim[d]
+         || fabs(a->top_left[d] - b->top_left[d]) > tol
+         || fabs(a->spacing[d] - b->spacing[d]) * STATIC_CAST(double, a->dim[d]) > tol) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void proton_grid_union(const ProtonSumSource src[], long n, ProtonGrid *grid)
+{
+    double hi[3];
+    long s;
+    int d;
+
+    *grid = src[0].grid;
+    for (s = 1; s < n && proton_grid_equal(grid, &src[s].grid); s++) ;
+    if (s == n) {
+        return;
+    }
+    for (d = 0; d < 3; d++) {
+        hi[d] = -HUGE_VAL;
+        for (s = 0; s < n; s++) {
+            const ProtonGrid *g = &src[s].grid;
+            const double end = g->top_left[d] + STATIC_CAST(double, g->dim[d] - 1) * g->spacing[d];
+            grid->top_left[d] = fmin(grid->top_left[d], g->top_left[d]);
+            grid->spacing[d] = fmin(grid->spacing[d], g->spacing[d]);
+            hi[d] = fmax(hi[d], end);
+        }
+        grid->dim[d] = STATIC_CAST(long, ceil((hi[d] - grid->top_left[d]) / grid->spacing[d] - GRID_TOL)) + 1;
+    }
+}
+
+
+/* ---------------------------------------------------------------------- */
+/*                               Resampling                               */
+/* ---------------------------------------------------------------------- */
+
+
+/** Each destination node along an axis lies between source nodes lo and hi,
+ *  w of the way to hi. lo is -1 off the source */
+struct resample_axis {
+    long *lo, *hi;
+    float *w;
+};
+
+struct _proton_resampler {
+    ProtonGrid src, dst;
+    bool aligned;               /* Frames are copied straight through */
+    struct resample_axis ax[3];
+    float *frame;               /* One source frame */
+    float *slot[2];             /* Source frames resampled in plane */
+    long slotk[2];              /* Source frame in each slot, or -1 */
+};
+
+
+static bool resample_axis_init(struct resample_axis *ax, const ProtonResampler *rs,
+                               int d)
+{
+    const long ns = rs->src.dim[d], nd = rs->dst.dim[d];
+    long i;
+
+    ax->lo = malloc(sizeof *ax->lo * nd);
+    ax->hi = malloc(sizeof *ax->hi * nd);
+    ax->w = malloc(sizeof *ax->w * nd);
+    if (!ax->lo || !ax->hi || !ax->w) {
+        return true;
+    }
+    for (i = 0; i < nd; i++) {
+        const double pos = rs->dst.top_left[d] + STATIC_CAST(double, i) * rs->dst.spacing[d];
+        double u = (pos - rs->src.top_left[d]) / rs->src.spacing[d];
+        if (u < -GRID_TOL || u > STATIC_CAST(double, ns - 1) + GRID_TOL) {
+            ax->lo[i] = ax->hi[i] = -1;
+            ax->w[i] = 0.0f;
+            continue;
+        }
+        u = fmin(fmax(u, 0.0), STATIC_CAST(double, ns - 1));
+        ax->lo[i] = STATIC_CAST(long, floor(u));
+        if (ax->lo[i] >= ns - 1) {
+            ax->lo[i] = ax->hi[i] = ns - 1;
+            ax->w[i] = 0.0f;
+        } else {
+            ax->hi[i] = ax->lo[i] + 1;
+            ax->w[i] = STATIC_CAST(float, u - STATIC_CAST(double, ax->lo[i]));
+        }
+    }
+    return false;
+}
+
+
+ProtonResampler *proton_resampler_create(const ProtonGrid *src, const ProtonGrid *dst)
+{
+    const long srcsz = src->dim[0] * src->dim[1], dstsz = dst->dim[0] * dst->dim[1];
+    ProtonResampler *rs;
+    int d;
+
+    rs = calloc(1, sizeof *rs);
+    if (!rs) {
+        return NULL;
+    }
+    rs->src = *src;
+    rs->dst = *dst;
+    rs->aligned = proton_grid_equal(src, dst);
+    rs->slotk[0] = rs->slotk[1] = -1;
+    for (d = 0; d < 3; d++) {
+        if (resample_axis_init(rs->ax + d, rs, d)) {
+            proton_resampler_destroy(rs);
+            return NULL;
+        }
+    }
+    if (!rs->aligned) {
+        rs->frame = malloc(sizeof *rs->frame * srcsz);
+        rs->slot[0] = malloc(sizeof *rs->slot[0] * dstsz);
+        rs->slot[1] = malloc(sizeof *rs->slot[1] * dstsz);
+        if (!rs->frame || !rs->slot[0] || !rs->slot[1]) {
+            proton_resampler_destroy(rs);
+            return NULL;
+        }
+    }
+    return rs;
+}
+
+
+void proton_resampler_destroy(ProtonResampler *rs)
+{
+    int d;
+
+    if (rs) {
+        for (d = 0; d < 3; d++) {
+            free(rs->ax[d].lo);
+            free(rs->ax[d].hi);
+            free(rs->ax[d].w);
+        }
+        free(rs->frame);
+        free(rs->slot[0]);
+        free(rs->slot[1]);
+        free(rs);
+    }
+}
+
+
+bool proton_resampler_covers(const ProtonResampler *rs, long k)
+{
+    return rs->ax[2].lo[k] >= 0;
+}
+
+
+/** Bilinearly resamples the source frame onto the destination's frame */
+static void resample_plane(const ProtonResampler *rs, float *dst)
+{
+    const struct resample_axis *x = rs->ax, *y = rs->ax + 1;
+    const long snx = rs->src.dim[0], dnx = rs->dst.dim[0];
+    long i, j;
+
+    for (j = 0; j < rs->dst.dim[1]; j++, dst += dnx) {
+        const float wy = y->w[j];
+        const float *r0, *r1;
+        if (y->lo[j] < 0) {
+            memset(dst, 0, sizeof *dst * dnx);
+            continue;
+        }
+        r0 = rs->frame + y->lo[j] * snx;
+        r1 = rs->frame + y->hi[j] * snx;
+        for (i = 0; i < dnx; i++) {
+            const long lo = x->lo[i], hi = x->hi[i];
+            float a, b;
+            if (lo < 0) {
+                dst[i] = 0.0f;
+                continue;
+            }
+            a = r0[lo] + (r0[hi] - r0[lo]) * x->w[i];
+            b = r1[lo] + (r1[hi] - r1[lo]) * x->w[i];
+            dst[i] = a + (b - a) * wy;
+        }
+    }
+}
+
+
+/** Source frame @p k resampled in plane, reading it unless a slot holds it.
+ *  The slot holding @p keep is not overwritten */
+static const float *resample_slot(ProtonResampler *rs, proton_frame_fn frame,
+                                  void *arg, long k, long keep)
+{
+    int s;
+
+    for (s = 0; s < 2; s++) {
+        if (rs->slotk[s] == k) {
+            return rs->slot[s];
+        }
+    }
+    s = (rs->slotk[0] == keep) ? 1 : 0;
+    rs->slotk[s] = -1;
+    if (frame(arg, k, rs->frame)) {
+        return NULL;
+    }
+    resample_plane(rs, rs->slot[s]);
+    rs->slotk[s] = k;
+    return rs->slot[s];
+}
+
+
+bool proton_resampler_frame(ProtonResampler *rs, proton_frame_fn frame,
+                            void *arg, long k, float *dst)
+{
+    const struct resample_axis *z = rs->ax + 2;
+    const long dstsz = rs->dst.dim[0] * rs->dst.dim[1];
+    const float *a, *b;
+
+    if (rs->aligned) {
+        return frame(arg, k, dst);
+    }
+    if (z->lo[k] < 0) {
+        memset(dst, 0, sizeof *dst * dstsz);
+        return false;
+    }
+    a = resample_slot(rs, frame, arg, z->lo[k], z->hi[k]);
+    b = (a) ? resample_slot(rs, frame, arg, z->hi[k], z->lo[k]) : NULL;
+    if (!b) {
+        return true;
+    }
+    proton_kernels()->lerp(dst, a, b, z->w[k], 1.0f, dstsz);
+    return false;
+}
+
+
+/* ---------------------------------------------------------------------- */
+/*                                  Sums                                  */
+/* ---------------------------------------------------------------------- */
+
+
+/** Adds one source to @p dose a frame at a time. Only the add itself is
+ *  serialized, so that the reading and resampling overlap between sources.
+ *  Sources are added to a frame in whichever order they get there, which
+ *  can change the sum by a rounding error between runs */
+static bool sum_source(ProtonDose *dose, const ProtonGrid *grid,
+                       const ProtonSumSource *src)
+{
+    const ProtonKernels *kern = proton_kernels();
+    const long framesz = grid->dim[0] * grid->dim[1];
+    ProtonResampler *rs;
+    float *frame;
+    bool fail;
+    long k;
+
+    rs = proton_resampler_create(&src->grid, grid);
+    frame = malloc(sizeof *frame * framesz);
+    fail = !rs || !frame;
+    for (k = 0; !fail && k < grid->dim[2]; k++) {
+        if (!proton_resampler_covers(rs, k)) {
+            continue;
+        }
+        fail = proton_resampler_frame(rs, src->frame, src->arg, k, frame);
+        if (!fail) {
+#if defined _OPENMP
+#   pragma omp critical (proton_sum)
+#endif
+            kern->axpy(dose->data + k * framesz, frame, 1.0f, framesz);
+        }
+    }
+    free(frame);
+    proton_resampler_destroy(rs);
+    if (src->release) {
+        src->release(src->arg);
+    }
+    return fail;
+}
+
+
+ProtonDose *proton_dose_sum(const ProtonSumSource src[], long n)
+{
+    const ProtonKernels *kern = proton_kernels();
+    uint64_t t0;
+    ProtonDose *dose;
+    ProtonGrid grid;
+    float total = 0.0f;
+    bool fail = false;
+    long s, k, framesz;
+
+    if (n < 1) {
+        return NULL;
+    }
+    proton_grid_union(src, n, &grid);
+    dose = proton_dose_alloc(grid.dim, grid.top_left, grid.spacing);
+    if (!dose) {
+        return NULL;
+    }
+    framesz = grid.dim[0] * grid.dim[1];
+    memset(dose->data, 0, sizeof *dose->data * framesz * grid.dim[2]);
+    t0 = proton_trace_begin();
+#if defined _OPENMP
+#   pragma omp parallel for schedule(dynamic, 1) reduction(||:fail)
+#endif
+    for (s = 0; s < n; s++) {
+        fail = sum_source(dose, &grid, src + s) || fail;
+    }
+    proton_trace_end("sum accumulate", t0);
+    if (fail) {
+        proton_dose_destroy(dose);
+        return NULL;
+    }
+    dose->dmax = 0.0f;
+    for (k = 0; k < grid.dim[2]; k++) {
+        kern->sum_max(dose->data + k * framesz, framesz, &total, &dose->dmax);
+    }
+    if (proton_dose_derive(dose)) {
+        proton_dose_destroy(dose);
+        return NULL;
+    }
+    return dose;
+}
+
+
+/** The DICOM is loaded by the first frame read, so a sum holds one per
+ *  thread adding, not one per file */
+struct sum_file {
+    RTDose *dcm;
+    long dim[3];
+    char *path;
+    char err[256];          /* Why the load failed, if it did */
+};
+
+
+static bool sum_file_frame(void *arg, long k, float *frame)
+{
+    struct sum_file *f = arg;
+    float dmax = 0.0f;
+
+    if (!f->dcm) {
+        f->dcm = rtdose_create(f->path, sizeof f->err, f->err);
+        if (!f->dcm) {
+            return true;
+        }
+    }
+    return rtdose_get_dose_frame(f->dcm, f->dim, k, frame, &dmax);
+}
+
+
+static void sum_file_release(void *arg)
+{
+    struct sum_file *f = arg;
+
+    rtdose_destroy(f->dcm);
+    f->dcm = NULL;
+}
+
+
+bool proton_source_open(ProtonSumSource *src, const char *filename,
+                        size_t ebufsz, char err[])
+{
+    const size_t len = strlen(filename) + 1;
+    struct sum_file *f;
+
+    src->arg = NULL;
+    f = calloc(1, sizeof *f);
+    if (f) {
+        f->path = malloc(len);
+    }
+    if (!f || !f->path) {
+        free(f);
+        snprintf(err, ebufsz, "Out of memory");
+        return true;
+    }
+    memcpy(f->path, filename, len);
+    if (rtdose_read_geometry(filename, f->dim, src->grid.top_left,
+                             src->grid.spacing, ebufsz, err)) {
+        free(f->path);
+        free(f);
+        return true;
+    }
+    memcpy(src->grid.dim, f->dim, sizeof f->dim);
+    src->frame = sum_file_frame;
+    src->release = sum_file_release;
+    src->arg = f;
+    return false;
+}
+
+
+void proton_source_close(ProtonSumSource *src)
+{
+    struct sum_file *f = src->arg;
+
+    if (f) {
+        sum_file_release(f);
+        free(f->path);
+        free(f);
+        src->arg = NULL;
+    }
+}
+
+
+const char *proton_source_error(const ProtonSumSource *src)
+{
+    const struct sum_file *f = src->arg;
+
+    return (f && f->err[0]) ? f->err : NULL;
+}
+
+
+ProtonDose *proton_dose_create_sum(const char *const filenames[], long n,
+                                   size_t ebufsz, char err[])
+{
+    ProtonSumSource *src;
+    ProtonDose *dose = NULL;
+    uint64_t t0;
+    long s, bad = n;
+
+    snprintf(err, ebufsz, "Failed to load dose");
+    src = calloc(n, sizeof *src);
+    if (n < 1 || !src) {
+        free(src);
+        return NULL;
+    }
+    t0 = proton_trace_begin();
+#if defined _OPENMP
+#   pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (s = 0; s < n; s++) {
+        char ferr[256] = { 0 };
+        if (proton_source_open(src + s, filenames[s], sizeof ferr, ferr)) {
+#if defined _OPENMP
+#   pragma omp critical (proton_sum_err)
+#endif
+            if (s < bad) {
+                bad = s;
+                snprintf(err, ebufsz, "%s: %s", filenames[s], ferr);
+            }
+        }
+    }
+    proton_trace_end("sum read geometry", t0);
+    if (bad == n) {
+        dose = proton_dose_sum(src, n);
+        if (!dose) {
+            snprintf(err, ebufsz, "Failed to sum %ld doses", n);
+            for (s = 0; s < n; s++) {
+                if (proton_source_error(src + s)) {
+                    snprintf(err, ebufsz, "%s: %s", filenames[s], proton_source_error(src + s));
+                    break;
+                }
+            }
+        }
+    }
+    for (s = 0; s < n; s++) {
+        proton_source_close(src + s);
+    }
+    free(src);
+    return dose;
+}
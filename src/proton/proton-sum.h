@@ -0,0 +1,91 @@
+#pragma once
+/** Plan sums: per-beam doses added onto one grid. Sources are read a frame
+ *  at a time and resampled where their geometry differs from the grid's, so
+ *  no beam is ever held in full as floats */
+#ifndef PROTON_SUM_H
+#define PROTON_SUM_H
+
+#include "proton-dose.h"
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+typedef struct _proton_grid {
+    long dim[3];
+    double top_left[3];     /* Centre of voxel 0, in mm */
+    double spacing[3];
+} ProtonGrid;
+
+/** Writes frame @p k of a source, dim[0] x dim[1] floats, to @p frame.
+ *  Returns true on failure */
+typedef bool (*proton_frame_fn)(void *arg, long k, float *frame);
+
+typedef struct _proton_sum_source {
+    ProtonGrid grid;
+    proton_frame_fn frame;
+    void (*release)(void *arg);     /* Once the source is added, may be NULL */
+    void *arg;
+} ProtonSumSource;
+
+
+/** Opens an RTDose file as a source, reading its geometry but none of its
+ *  frames. The file is loaded by the first frame read and dropped when the
+ *  source is released. Returns true on failure */
+bool proton_source_open(ProtonSumSource *src, const char *filename,
+                        size_t ebufsz, char err[]);
+
+/** Closes a source opened above, whether or not it has been released */
+void proton_source_close(ProtonSumSource *src);
+
+/** Why the file of a source opened above failed to load, or NULL */
+const char *proton_source_error(const ProtonSumSource *src);
+
+
+/** True if the grids agree to within a thousandth of a voxel */
+bool proton_grid_equal(const ProtonGrid *a, const ProtonGrid *b);
+
+/** The grid the sources are summed on. Sources that share one geometry keep
+ *  it, otherwise the grid covers all of them at the finest spacing found
+ *  along each axis */
+void proton_grid_union(const ProtonSumSource src[], long n, ProtonGrid *grid);
+
+
+/** Interpolates the frames of one grid onto another */
+typedef struct _proton_resampler ProtonResampler;
+
+ProtonResampler *proton_resampler_create(const ProtonGrid *src, const ProtonGrid *dst);
+void proton_resampler_destroy(ProtonResampler *rs);
+
+/** True if frame @p k of the destination meets the source at all */
+bool proton_resampler_covers(const ProtonResampler *rs, long k);
+
+/** Writes frame @p k of the destination to @p dst, trilinearly from the
+ *  source frames read through @p frame, and zero off the source's nodes.
+ *  The two source frames last read are kept, so walking k upwards reads
+ *  each one once. Returns true on failure */
+bool proton_resampler_frame(ProtonResampler *rs, proton_frame_fn frame,
+                            void *arg, long k, float *dst);
+
+
+/** Adds the @p n sources on the grid of proton_grid_union(). The sources
+ *  are shared between threads, each adding its frames as it reads them, so
+ *  a source's frame callback is only ever called from one thread at a time.
+ *  The derived quantities are computed once, at the end */
+ProtonDose *proton_dose_sum(const ProtonSumSource src[], long n);
+
+/** Reads the geometry of @p n RTDose files in parallel and sums them, as
+ *  above. Each file is loaded when a thread starts adding it and released
+ *  once it has been added, so no more are held than there are threads */
+ProtonDose *proton_dose_create_sum(const char *const filenames[], long n,
+                                   size_t ebufsz, char err[]);
+
+
+#if __cplusplus
+}
+#endif
+
+#endif /* PROTON_SUM_H */
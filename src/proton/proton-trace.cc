@@ -0,0 +1,202 @@
+#include "proton-trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+
+
+namespace {
+
+/** Names past the table's capacity are pooled under the last slot */
+constexpr size_t MAX_NAMES = 64;
+constexpr size_t RING_SIZE = 1 << 16;
+
+struct trace_name {
+    std::string name;
+    unsigned long count;
+    uint64_t total, last, max;
+};
+
+struct trace_event {
+    uint64_t start, dur;
+    uint32_t name, tid;
+};
+
+std::mutex lock;
+std::atomic<bool> enabled(true);
+std::atomic<uint32_t> nthreads(0);
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+trace_name names[MAX_NAMES];
+size_t nnames;
+
+trace_event *ring;
+size_t head, nevents;
+
+
+uint64_t trace_now()
+{
+    const auto dt = std::chrono::steady_clock::now() - epoch;
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count());
+}
+
+
+uint32_t trace_tid()
+{
+    thread_local const uint32_t tid = nthreads++;
+    return tid;
+}
+
+
+/** Requires the lock. Spans are milliseconds long, so a linear search of a
+ *  few dozen names is noise */
+uint32_t trace_intern(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < nnames; i++) {
+        if (names[i].name == name) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+    if (nnames == MAX_NAMES - 1) {
+        names[nnames].name = "(other)";
+        nnames++;
+    }
+    if (nnames == MAX_NAMES) {
+        return MAX_NAMES - 1;
+    }
+    names[nnames] = { name, 0, 0, 0, 0 };
+    return static_cast<uint32_t>(nnames++);
+}
+
+
+/** Writes a JSON string body, escaping what a span name could contain */
+void trace_escape(FILE *f, const std::string &s)
+{
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', f);
+            fputc(c, f);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+}
+
+}
+
+
+uint64_t proton_trace_begin(void)
+{
+    /* Never 0, which marks a span opened while disabled */
+    return enabled.load(std::memory_order_relaxed) ? trace_now() + 1 : 0;
+}
+
+
+void proton_trace_end(const char *name, uint64_t start)
+{
+    uint64_t dur;
+    uint32_t id, tid;
+
+    if (!start) {
+        return;
+    }
+    dur = trace_now() + 1 - start;
+    tid = trace_tid();
+    std::lock_guard<std::mutex> guard(lock);
+    if (!ring) {
+        ring = new (std::nothrow) trace_event[RING_SIZE];
+    }
+    id = trace_intern(name);
+    names[id].count++;
+    names[id].total += dur;
+    names[id].last = dur;
+    names[id].max = (dur > names[id].max) ? dur : names[id].max;
+    if (ring) {
+        ring[head] = { start - 1, dur, id, tid };
+        head = (head + 1) % RING_SIZE;
+        nevents += (nevents < RING_SIZE);
+    }
+}
+
+
+void proton_trace_enable(bool enable)
+{
+    enabled = enable;
+}
+
+
+bool proton_trace_enabled(void)
+{
+    return enabled;
+}
+
+
+size_t proton_trace_stats(ProtonTraceStat stats[], size_t n)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t i;
+
+    for (i = 0; i < n && i < nnames; i++) {
+        const trace_name &tn = names[i];
+        stats[i].name = tn.name.c_str();
+        stats[i].count = tn.count;
+        stats[i].last = 1e-6 * static_cast<double>(tn.last);
+        stats[i].mean = (tn.count)
+            ? 1e-6 * static_cast<double>(tn.total) / static_cast<double>(tn.count)
+            : 0.0;
+        stats[i].max = 1e-6 * static_cast<double>(tn.max);
+    }
+    return i;
+}
+
+
+void proton_trace_reset(void)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t i;
+
+    for (i = 0; i < nnames; i++) {
+        names[i] = trace_name();
+    }
+    nnames = 0;
+    head = 0;
+    nevents = 0;
+}
+
+
+bool proton_trace_export(const char *filename)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t i, idx;
+    FILE *f;
+
+    f = std::fopen(filename, "w");
+    if (!f) {
+        return true;
+    }
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    for (i = 0; i < nevents; i++) {
+        /* Oldest first */
+        idx = (head + RING_SIZE - nevents + i) % RING_SIZE;
+        const trace_event &ev = ring[idx];
+        std::fputs("{\"name\":\"", f);
+        trace_escape(f, names[ev.name].name);
+        std::fprintf(f, "\",\"cat\":\"proton\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                        "\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                     static_cast<unsigned>(ev.tid),
+                     1e-3 * static_cast<double>(ev.start),
+                     1e-3 * static_cast<double>(ev.dur),
+                     (i + 1 < nevents) ? "," : "");
+    }
+    std::fputs("]}\n", f);
+    return std::fclose(f) != 0;
+}
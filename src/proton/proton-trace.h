@@ -0,0 +1,73 @@
+#pragma once
+/** Scoped timers for the hot paths, kept as per-name statistics and a ring
+ *  of recent spans that can be exported as a Chrome/Perfetto trace. A span
+ *  costs two clock reads and a short critical section, so tracing stays on
+ *  in release builds */
+#ifndef PROTON_TRACE_H
+#define PROTON_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#else
+#   include <stdbool.h>
+#endif
+
+
+typedef struct _proton_trace_stat {
+    const char *name;
+    unsigned long count;
+    double last, mean, max;     /* Milliseconds */
+} ProtonTraceStat;
+
+
+/** Returns the start of a span, or 0 if tracing is disabled */
+uint64_t proton_trace_begin(void);
+
+/** Closes the span opened at @p start. The name is copied on first use, so
+ *  it need not outlive the call */
+void proton_trace_end(const char *name, uint64_t start);
+
+void proton_trace_enable(bool enable);
+bool proton_trace_enabled(void);
+
+/** Copies up to @p n statistics, in order of first appearance, and returns
+ *  the number written. The names remain valid until proton_trace_reset() */
+size_t proton_trace_stats(ProtonTraceStat stats[], size_t n);
+
+/** Forgets every span and statistic */
+void proton_trace_reset(void);
+
+/** Writes the recorded spans in the Chrome trace event format. Returns true
+ *  on failure */
+bool proton_trace_export(const char *filename);
+
+
+#if __cplusplus
+}
+
+
+/** Times the enclosing scope */
+class ProtonTraceScope {
+    const char *name;
+    uint64_t start;
+
+public:
+    explicit ProtonTraceScope(const char *name) noexcept:
+        name(name), start(proton_trace_begin()) { }
+    ~ProtonTraceScope() { proton_trace_end(name, start); }
+
+    ProtonTraceScope(const ProtonTraceScope &) = delete;
+    ProtonTraceScope &operator=(const ProtonTraceScope &) = delete;
+};
+
+#define PROTON_TRACE_CAT2(a, b) a##b
+#define PROTON_TRACE_CAT(a, b) PROTON_TRACE_CAT2(a, b)
+#define PROTON_TRACE_SCOPE(name) \
+    ProtonTraceScope PROTON_TRACE_CAT(trace_scope_, __LINE__)(name)
+
+#endif
+
+#endif /* PROTON_TRACE_H */
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "main-window.h"
+#include <wx/rawbmp.h>
+#include "proton/proton-trace.h"
+
+#define DEFWINDOWSZ wxSize(640, 480)
+
+#define SLICE_TITLE     wxT("Slice window")
+#define SLICE_FOLLOW    wxT("Through crosshair")
+#define SLICE_POSLBL    wxT("Position (mm)")
+#define SLICE_ANGLELBL  wxT("Angle (degrees)")
+
+
+/** The renderer writes straight into the bitmap's native 32-bit layout */
+static constexpr int native_format()
+{
+    return (wxAlphaPixelFormat::RED == 2 && wxAlphaPixelFormat::BLUE == 0)
+        ? PROTON_PX_BGRA32
+        : PROTON_PX_RGBA32;
+}
+
+
+/** In the order of PROTON_SLICE_* */
+static const wxArrayString &orientations()
+{
+    static const std::array<wxString, 3> names = {
+        wxString(wxT("Sagittal")),
+        wxString(wxT("Axial")),
+        wxString(wxT("Oblique"))
+    };
+    static const wxArrayString res(names.size(), names.data());
+
+    return res;
+}
+
+
+void SliceWindow::on_evt_close(wxCloseEvent &WXUNUSED(e))
+{
+    this->Show(false);
+}
+
+
+void SliceWindow::on_orient(wxCommandEvent &WXUNUSED(e))
+{
+    update_controls();
+    invalidate_plane();
+}
+
+
+void SliceWindow::on_follow(wxCommandEvent &WXUNUSED(e))
+{
+    update_controls();
+    invalidate_plane();
+}
+
+
+void SliceWindow::on_spin(wxSpinDoubleEvent &WXUNUSED(e))
+{
+    invalidate_plane();
+}
+
+
+void SliceWindow::on_paint(wxPaintEvent &WXUNUSED(e))
+{
+    wxPaintDC dc(canvas);
+
+    dc.SetBackground(*wxBLACK_BRUSH);
+    dc.Clear();
+    if (!wxGetApp().dose_loaded()) {
+        return;
+    }
+    if (stale) {
+        image_write();
+    }
+    if (bmp.IsOk()) {
+        dc.DrawBitmap(bmp, origin);
+        paint_markers(dc);
+    }
+}
+
+
+void SliceWindow::on_size(wxSizeEvent &e)
+{
+    stale = true;
+    canvas->Refresh();
+    e.Skip();
+}
+
+
+ProtonSlice SliceWindow::get_slice()
+    const
+/** Away from the crosshair, an oblique plane passes through the centre of
+ *  the grid, moved by the position along its normal */
+{
+    const ProtonDose *dose = wxGetApp().get_dose();
+    const double theta = angle->GetValue() * M_PI / 180.0;
+    ProtonSlice slice;
+    double x, y;
+
+    slice.orient = orient->GetSelection();
+    slice.pos = pos->GetValue();
+    slice.angle = angle->GetValue();
+    if (follow->GetValue()) {
+        wxGetApp().get_line_dose(&x, &y);
+        slice.pos = (slice.orient == PROTON_SLICE_SAGITTAL) ? x : y;
+        slice.centre[0] = x;
+        slice.centre[1] = y;
+    } else {
+        slice.centre[0] = proton_dose_origin(dose, DOSE_LR)
+            + 0.5 * static_cast<double>(proton_dose_dimension(dose, DOSE_LR) - 1) * proton_dose_spacing(dose, DOSE_LR)
+            + slice.pos * std::cos(theta);
+        slice.centre[1] = proton_dose_origin(dose, DOSE_SI)
+            + 0.5 * static_cast<double>(proton_dose_dimension(dose, DOSE_SI) - 1) * proton_dose_spacing(dose, DOSE_SI)
+            - slice.pos * std::sin(theta);
+    }
+    return slice;
+}
+
+
+void SliceWindow::update_controls()
+/** The position spans the grid along the plane's normal */
+{
+    const int o = orient->GetSelection();
+    const ProtonDose *dose;
+    double lo, hi;
+
+    pos->Enable(!follow->GetValue());
+    angle->Enable(o == PROTON_SLICE_OBLIQUE);
+    if (!wxGetApp().dose_loaded()) {
+        return;
+    }
+    dose = wxGetApp().get_dose();
+    if (o == PROTON_SLICE_OBLIQUE) {
+        hi = 0.5 * std::hypot(proton_dose_width(dose, DOSE_LR), proton_dose_width(dose, DOSE_SI));
+        lo = -hi;
+    } else {
+        const int dim = (o == PROTON_SLICE_SAGITTAL) ? DOSE_LR : DOSE_SI;
+        lo = proton_dose_origin(dose, dim);
+        hi = lo + static_cast<double>(proton_dose_dimension(dose, dim) - 1) * proton_dose_spacing(dose, dim);
+    }
+    pos->SetRange(lo, hi);
+}
+
+
+void SliceWindow::image_write()
+/** The bitmap keeps the plane's aspect in mm. The pixel data is reattached
+ *  for every write, as in the dose window */
+{
+    PROTON_TRACE_SCOPE("slice window image");
+    const wxSize csz = canvas->GetClientSize();
+    const ProtonSlice slice = get_slice();
+    ProtonView view;
+    double aspect;
+    int w, h;
+
+    stale = false;
+    if (proton_slice_bounds(wxGetApp().get_dose(), &slice, rect)
+     || csz.GetWidth() < 1 || csz.GetHeight() < 1) {
+        bmp = wxNullBitmap;
+        return;
+    }
+    aspect = (rect[2] - rect[0]) / std::max(rect[3] - rect[1], 1e-6);
+    if (static_cast<double>(csz.GetWidth()) / static_cast<double>(csz.GetHeight()) < aspect) {
+        w = csz.GetWidth();
+        h = std::max(static_cast<int>(static_cast<double>(w) / aspect), 1);
+    } else {
+        h = csz.GetHeight();
+        w = std::max(static_cast<int>(static_cast<double>(h) * aspect), 1);
+    }
+    origin = wxPoint((csz.GetWidth() - w) / 2, (csz.GetHeight() - h) / 2);
+    if (!bmp.IsOk() || bmp.GetWidth() != w || bmp.GetHeight() != h) {
+        if (!bmp.Create(w, h, 32)) {
+            bmp = wxNullBitmap;
+            return;
+        }
+        bmp.UseAlpha();
+    }
+    wxAlphaPixelData data(bmp);
+    if (!data) {
+        bmp = wxNullBitmap;
+        return;
+    }
+    wxAlphaPixelData::Iterator it(data);
+    proton_image_attach(&img, reinterpret_cast<unsigned char *>(it.m_ptr),
+                        data.GetWidth(), data.GetHeight(), data.GetRowStride(),
+                        native_format());
+    proton_view_fit(&view, rect, w, h);
+    proton_dose_get_slice_region(wxGetApp().get_dose(), &wxGetApp().visuals(),
+                                 img, &slice, &view);
+}
+
+
+void SliceWindow::paint_markers(wxPaintDC &dc)
+/** The coronal slice depth, and the crosshair's lateral position when the
+ *  plane passes through it */
+{
+    const double sx = (bmp.GetWidth() > 1) ? static_cast<double>(bmp.GetWidth() - 1) / (rect[2] - rect[0]) : 0.0;
+    const double sy = (bmp.GetHeight() > 1) ? static_cast<double>(bmp.GetHeight() - 1) / (rect[3] - rect[1]) : 0.0;
+    const int x = origin.x + static_cast<int>(std::lround((wxGetApp().get_depth() - rect[0]) * sx));
+    double ldx, ldy, t;
+    int y;
+
+    dc.SetClippingRegion(origin, bmp.GetSize());
+    dc.SetPen(wxPen(*wxWHITE, 1, wxPENSTYLE_SHORT_DASH));
+    dc.DrawLine(x, origin.y, x, origin.y + bmp.GetHeight());
+    if (follow->GetValue()) {
+        wxGetApp().get_line_dose(&ldx, &ldy);
+        switch (orient->GetSelection()) {
+        case PROTON_SLICE_SAGITTAL:
+            t = ldy;
+            break;
+        case PROTON_SLICE_AXIAL:
+            t = ldx;
+            break;
+        default:
+            t = 0.0;
+            break;
+        }
+        y = origin.y + static_cast<int>(std::lround((t - rect[1]) * sy));
+        dc.DrawLine(origin.x, y, origin.x + bmp.GetWidth(), y);
+    }
+    dc.DestroyClippingRegion();
+}
+
+
+SliceWindow::SliceWindow(wxWindow *parent):
+    wxFrame(parent, wxID_ANY, SLICE_TITLE, wxDefaultPosition, DEFWINDOWSZ),
+    img(nullptr),
+    rect{ 0.0, 0.0, 1.0, 1.0 },
+    stale(true)
+{
+    wxPanel *bar = new wxPanel(this);
+    wxBoxSizer *hbox = new wxBoxSizer(wxHORIZONTAL);
+    wxBoxSizer *vbox = new wxBoxSizer(wxVERTICAL);
+
+    orient = new wxChoice(bar, wxID_ANY, wxDefaultPosition, wxDefaultSize, orientations());
+    follow = new wxCheckBox(bar, wxID_ANY, SLICE_FOLLOW);
+    pos = new wxSpinCtrlDouble(bar, wxID_ANY, wxEmptyString, wxDefaultPosition,
+                               wxDefaultSize, wxSP_ARROW_KEYS, -500.0, 500.0, 0.0, 0.5);
+    angle = new wxSpinCtrlDouble(bar, wxID_ANY, wxEmptyString, wxDefaultPosition,
+                                 wxDefaultSize, wxSP_ARROW_KEYS | wxSP_WRAP, -180.0, 180.0, 45.0, 5.0);
+    canvas = new wxWindow(this, wxID_ANY, wxDefaultPosition, wxDefaultSize,
+                          wxFULL_REPAINT_ON_RESIZE);
+    orient->SetSelection(PROTON_SLICE_SAGITTAL);
+    follow->SetValue(true);
+    pos->SetDigits(1);
+    angle->SetDigits(1);
+
+    hbox->Add(orient, 0, wxALIGN_CENTER_VERTICAL | wxALL, 4);
+    hbox->Add(follow, 0, wxALIGN_CENTER_VERTICAL | wxALL, 4);
+    hbox->Add(new wxStaticText(bar, wxID_ANY, SLICE_POSLBL), 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 8);
+    hbox->Add(pos, 0, wxALIGN_CENTER_VERTICAL | wxALL, 4);
+    hbox->Add(new wxStaticText(bar, wxID_ANY, SLICE_ANGLELBL), 0, wxALIGN_CENTER_VERTICAL | wxLEFT, 8);
+    hbox->Add(angle, 0, wxALIGN_CENTER_VERTICAL | wxALL, 4);
+    bar->SetSizer(hbox);
+    vbox->Add(bar, 0, wxEXPAND);
+    vbox->Add(canvas, 1, wxEXPAND);
+    this->SetSizer(vbox);
+    update_controls();
+
+    canvas->SetBackgroundStyle(wxBG_STYLE_PAINT);
+    canvas->Bind(wxEVT_PAINT, &SliceWindow::on_paint, this);
+    canvas->Bind(wxEVT_SIZE, &SliceWindow::on_size, this);
+    orient->Bind(wxEVT_CHOICE, &SliceWindow::on_orient, this);
+    follow->Bind(wxEVT_CHECKBOX, &SliceWindow::on_follow, this);
+    pos->Bind(wxEVT_SPINCTRLDOUBLE, &SliceWindow::on_spin, this);
+    angle->Bind(wxEVT_SPINCTRLDOUBLE, &SliceWindow::on_spin, this);
+    this->Bind(wxEVT_CLOSE_WINDOW, &SliceWindow::on_evt_close, this);
+}
+
+
+SliceWindow::~SliceWindow()
+{
+    proton_image_destroy(img);
+}
+
+
+void SliceWindow::on_dose_changed()
+{
+    update_controls();
+    invalidate_plane();
+}
+
+
+void SliceWindow::invalidate_plane()
+{
+    stale = true;
+    if (this->IsShown()) {
+        canvas->Refresh();
+    }
+}
+
+
+void SliceWindow::redraw_markers()
+{
+    if (this->IsShown()) {
+        canvas->Refresh();
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#ifndef SLICE_WINDOW_H
+#define SLICE_WINDOW_H
+
+#include <wx/wx.h>
+#include <wx/spinctrl.h>
+#include "proton/proton-slice.h"
+
+
+/** Planes through the depth axis, for the lateral penumbra. Depth runs
+ *  across the window as in the line dose plot, with the coronal slice depth
+ *  marked on it. By default the plane passes through the line dose
+ *  crosshair, so moving the crosshair on the coronal view moves the plane */
+class SliceWindow : public wxFrame {
+    wxChoice *orient;
+    wxCheckBox *follow;
+    wxSpinCtrlDouble *pos, *angle;
+    wxWindow *canvas;
+
+    ProtonImage *img;
+    wxBitmap bmp;
+    wxPoint origin;
+    double rect[4];         /* Extent shown, as proton_slice_bounds() */
+    bool stale;
+
+    void on_evt_close(wxCloseEvent &e);
+    void on_orient(wxCommandEvent &e);
+    void on_follow(wxCommandEvent &e);
+    void on_spin(wxSpinDoubleEvent &e);
+    void on_paint(wxPaintEvent &e);
+    void on_size(wxSizeEvent &e);
+
+    /** The plane selected by the controls */
+    ProtonSlice get_slice() const;
+    void update_controls();
+
+    void image_write();
+    void paint_markers(wxPaintDC &dc);
+
+public:
+    SliceWindow(wxWindow *parent);
+    ~SliceWindow();
+
+    /** Outputs of the compute graph. The image is only rendered while the
+     *  window is shown */
+    void on_dose_changed();
+    void invalidate_plane();
+    void redraw_markers();
+};
+
+
+#endif /* SLICE_WINDOW_H */